@@ -7,13 +7,19 @@ module;
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <cstdlib>
+#include <unistd.h>
 
 export module compiler;
 
 import token;
 import lexer;
+import outputwriter;
+import flatast;
+import ir;
 import ast;
 import parser;
+import parsertrace;
 
 export class Compiler {
     private:
@@ -30,19 +36,17 @@ export class Compiler {
             return code;
         }
 
-        void printTokens(const std::vector<Token>& tokens) const {
-            std::cout << lexer.getPrintString(tokens) << std::endl;
+        void printTokens(const std::vector<Token>& tokens, OutputWriter& out) const {
+            lexer.writePrintString(tokens, out);
+            out.put('\n');
+            // Shown before any errors on stderr
+            out.flush();
         }
 
         void writeTokensToFile(const std::vector<Token>& tokens, const std::string_view filenamesv) const {
-            const std::string filename(filenamesv);
-            std::ofstream file(filename);
-            if (!file.is_open()) {
-                throw std::runtime_error("Failed to open file: " + filename);
-            }
-            for (const auto& token : tokens) {
-                file << token;
-            }
+            OutputWriter file{std::string(filenamesv)};
+            lexer.writeTokenFile(tokens, file);
+            file.flush();
         }
 
     public:
@@ -56,24 +60,36 @@ export class Compiler {
                 return 1;
             }
             const auto& tokens = std::get<std::vector<Token>>(result);
-            printTokens(tokens);
+            OutputWriter out(STDOUT_FILENO);
+            printTokens(tokens, out);
             writeTokensToFile(tokens, tokenFile);
 
-            const auto parseResult = parser.parse(tokens);
-            if (std::holds_alternative<ParserError>(parseResult)) {
-                std::cerr << std::get<ParserError>(parseResult) << std::endl;
+            // Set PARSER_TRACE to "table" or "json" to print parser statistics
+            const char* traceFormat = std::getenv("PARSER_TRACE");
+            ParserTrace trace;
+            const auto parseResult = parser.parseWithRecovery(tokens, traceFormat != nullptr ? &trace : nullptr);
+            if (traceFormat != nullptr) {
+                std::cerr << (std::string_view(traceFormat) == "json" ? trace.toJson() : trace.toTable()) << std::endl;
+            }
+            if (!parseResult.errors.empty()) {
+                for (const auto& error : parseResult.errors) {
+                    std::cerr << error << std::endl;
+                }
                 return 1;
             }
-            const auto& ast = std::get<std::unique_ptr<AstNode>>(parseResult);
+            // The passes run over the flat AST
+            const auto flatAst = parseResult.ast->toFlatAst();
 
-            const auto typeCheckResult = ast->startTypeCheck();
+            const auto typeCheckResult = FlatAstTypeChecker(flatAst).startTypeCheck();
             if (std::holds_alternative<TypeCheckError>(typeCheckResult)) {
                 const auto typeCheckError = std::get<TypeCheckError>(typeCheckResult);
                 std::cerr << typeCheckError.message + " (at position " + typeCheckError.where + ")" << std::endl;
                 return 1;
             }
 
-            std::cout << ast->toQuadrupleString() << std::endl;
+            IrPrinter(FlatAstQuadrupleGenerator(flatAst).toIr()).write(out);
+            out.put('\n');
+            out.flush();
 
             return 0;
         }
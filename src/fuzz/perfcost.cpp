@@ -0,0 +1,102 @@
+module;
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <set>
+#include <variant>
+#include <optional>
+#include <memory>
+#include <chrono>
+
+export module perfcost;
+
+import token;
+import lexer;
+import flatast;
+import ast;
+import parser;
+import parsertrace;
+
+// Limits on the work done per input token. Parsing and type checking are meant to be linear,
+// so an input over budget points to backtracking or re-checking that grows with the input.
+// Deeply nested parentheses, the most expensive linear case, take about 21 parse visits per token.
+export struct PerfBudget {
+    double parseVisitsPerToken = 32.0;
+    double typeCheckVisitsPerToken = 2.0;
+};
+
+// The work done to parse and type check one input
+export struct PerfCost {
+    size_t tokenCount = 0;
+    // Tokens visited by the parsers, counting each revisit after backtracking
+    long parseVisits = 0;
+    // AST nodes visited by the type checker
+    long typeCheckVisits = 0;
+    bool parsed = false;
+    bool typeChecked = false;
+    std::chrono::steady_clock::duration time{};
+    // The non-terminals and parser states reached, and whether any of their alternatives failed
+    std::set<std::string> coverage;
+
+    double getParseVisitsPerToken() const {
+        return tokenCount == 0 ? 0.0 : static_cast<double>(parseVisits) / tokenCount;
+    }
+
+    double getTypeCheckVisitsPerToken() const {
+        return tokenCount == 0 ? 0.0 : static_cast<double>(typeCheckVisits) / tokenCount;
+    }
+
+    double getMicrosecondsPerToken() const {
+        const auto microseconds = std::chrono::duration<double, std::micro>(time).count();
+        return tokenCount == 0 ? 0.0 : microseconds / tokenCount;
+    }
+
+    bool exceeds(const PerfBudget& budget) const {
+        return getParseVisitsPerToken() > budget.parseVisitsPerToken || getTypeCheckVisitsPerToken() > budget.typeCheckVisitsPerToken;
+    }
+};
+
+// Measures with Parser::parse, so the parser measured is the static one that production parsing runs
+export class PerfMeter {
+    private:
+        Lexer lexer;
+        Parser parser;
+
+    public:
+        PerfMeter(): lexer(), parser() {}
+
+        // Empty if the code cannot be lexed; parse and type errors are part of the measurement
+        std::optional<PerfCost> measure(const std::string_view code) const {
+            const auto lexResult = lexer.acceptCode(code);
+            if (std::holds_alternative<LexerError>(lexResult)) {
+                return std::nullopt;
+            }
+            const auto& tokens = std::get<std::vector<Token>>(lexResult);
+
+            PerfCost cost;
+            cost.tokenCount = tokens.size();
+            ParserTrace trace;
+            const auto startTime = std::chrono::steady_clock::now();
+            const auto parseResult = parser.parse(tokens, &trace);
+            if (std::holds_alternative<std::unique_ptr<AstNode>>(parseResult)) {
+                cost.parsed = true;
+                const auto flatAst = std::get<std::unique_ptr<AstNode>>(parseResult)->toFlatAst();
+                FlatAstTypeChecker typeChecker(flatAst);
+                const auto typeCheckResult = typeChecker.startTypeCheck();
+                cost.typeChecked = std::holds_alternative<TypeCheckSuccess>(typeCheckResult);
+                cost.typeCheckVisits = typeChecker.getVisits();
+            }
+            cost.time = std::chrono::steady_clock::now() - startTime;
+            cost.parseVisits = trace.getTokenVisits();
+
+            for (const auto& [name, entry] : trace.getEntries()) {
+                cost.coverage.insert(name);
+                if (entry.failedAlternatives > 0) {
+                    cost.coverage.insert(name + " failed");
+                }
+            }
+            cost.coverage.insert(cost.parsed ? (cost.typeChecked ? "type check accepted" : "type check rejected") : "parse rejected");
+            return cost;
+        }
+};
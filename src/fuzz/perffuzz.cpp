@@ -0,0 +1,418 @@
+module;
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <set>
+#include <variant>
+#include <optional>
+#include <random>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cctype>
+
+export module perffuzz;
+
+import token;
+import lexer;
+import perfcost;
+
+// Programs to start from when no corpus is given; all are valid under doc/language-spec.md
+const std::vector<std::string> seedPrograms{
+    "int a, b[4], c = 1;\n"
+    "int main() { a = 2; b[a] = c + a * 3; return b[a]; }\n",
+
+    "float scale(float x, int n) { return x * n; }\n"
+    "int main() { float f = 1.5; if (f > 1.0 && f < 2.0) { f = scale(f, 2); } else { f = -f; } return 0; }\n",
+
+    "int sum(int n) { int s = 0; int i; for (i = 0; i < n; i = i + 1) { s = s + i % 3; } return s; }\n"
+    "int main() { int k = 10; while (k > 0) { k = k - sum(k); } return !k; }\n",
+
+    "str greet(str name) { return \"hi \" + name; }\n"
+    "int main() { str s; s = greet(\"x\"); if (s == \"hi x\") { return 1; } return 0; }\n",
+};
+
+// Searches for inputs that make parsing or type checking do much more work per token than usual.
+// Mutated programs that reach new non-terminals or parser states, or that cost more than the
+// program they came from, are kept for further mutation. Inputs over the budget are written to
+// the output directory, which test-perf checks on every run.
+export class PerfFuzzer {
+    private:
+        struct CorpusEntry {
+            std::vector<std::string> tokens;
+            double score;
+        };
+
+        Lexer lexer;
+        PerfMeter meter;
+        const PerfBudget budget;
+        const std::filesystem::path outputDirectory;
+        const size_t maxTokens;
+        std::mt19937 random;
+
+        std::vector<CorpusEntry> corpus;
+        std::set<std::string> coverage;
+        std::set<size_t> savedHashes;
+        PerfCost worstParse;
+        PerfCost worstTypeCheck;
+
+        size_t randomIndex(size_t size) {
+            return std::uniform_int_distribution<size_t>(0, size - 1)(random);
+        }
+
+        static std::string toCode(const std::vector<std::string>& tokens) {
+            std::ostringstream oss;
+            for (size_t i = 0; i < tokens.size(); i++) {
+                if (i > 0) {
+                    oss << (tokens[i - 1] == ";" || tokens[i - 1] == "{" || tokens[i - 1] == "}" ? "\n" : " ");
+                }
+                oss << tokens[i];
+            }
+            oss << "\n";
+            return oss.str();
+        }
+
+        std::optional<std::vector<std::string>> toTokens(const std::string_view code) const {
+            const auto result = lexer.acceptCode(code);
+            if (std::holds_alternative<LexerError>(result)) {
+                return std::nullopt;
+            }
+            std::vector<std::string> tokens;
+            for (const auto& token : std::get<std::vector<Token>>(result)) {
+                tokens.push_back(token.getValue());
+            }
+            return tokens;
+        }
+
+        // Higher for inputs that do more work per token; time breaks ties between equal counts
+        static double getScore(const PerfCost& cost) {
+            return cost.getParseVisitsPerToken() + cost.getTypeCheckVisitsPerToken() + cost.getMicrosecondsPerToken() / 100.0;
+        }
+
+        // Index of the bracket closing the one at the given index, if any
+        static std::optional<size_t> findClosing(const std::vector<std::string>& tokens, size_t openIndex) {
+            const auto& open = tokens[openIndex];
+            const std::string close = open == "(" ? ")" : open == "{" ? "}" : "]";
+            int depth = 0;
+            for (size_t i = openIndex; i < tokens.size(); i++) {
+                if (tokens[i] == open) {
+                    depth++;
+                } else if (tokens[i] == close && --depth == 0) {
+                    return i;
+                }
+            }
+            return std::nullopt;
+        }
+
+        std::optional<size_t> findRandomToken(const std::vector<std::string>& tokens, const std::function<bool(size_t)>& predicate) {
+            std::vector<size_t> indices;
+            for (size_t i = 0; i < tokens.size(); i++) {
+                if (predicate(i)) {
+                    indices.push_back(i);
+                }
+            }
+            if (indices.empty()) {
+                return std::nullopt;
+            }
+            return indices[randomIndex(indices.size())];
+        }
+
+        static void insertTokens(std::vector<std::string>& tokens, size_t index, const std::vector<std::string>& inserted) {
+            tokens.insert(tokens.begin() + index, inserted.begin(), inserted.end());
+        }
+
+        // Wraps the contents of a pair of brackets in another level of nesting
+        bool nest(std::vector<std::string>& tokens) {
+            const auto openIndex = findRandomToken(tokens, [&](size_t i) { return tokens[i] == "(" || tokens[i] == "{"; });
+            if (!openIndex.has_value()) {
+                return false;
+            }
+            const auto closeIndex = findClosing(tokens, *openIndex);
+            if (!closeIndex.has_value()) {
+                return false;
+            }
+            static const std::set<std::string> keywords{"if", "while", "for", "return"};
+            const bool isCall = tokens[*openIndex] == "(" && *openIndex > 0 && !keywords.contains(tokens[*openIndex - 1])
+                && std::isalpha(static_cast<unsigned char>(tokens[*openIndex - 1][0]));
+            if (tokens[*openIndex] == "{") {
+                const bool withElse = std::bernoulli_distribution(0.5)(random);
+                insertTokens(tokens, *closeIndex, withElse ? std::vector<std::string>{"}", "else", "{", "}"} : std::vector<std::string>{"}"});
+                insertTokens(tokens, *openIndex + 1, {"if", "(", "1", ")", "{"});
+            } else if (isCall) {
+                insertTokens(tokens, *closeIndex, {")"});
+                insertTokens(tokens, *openIndex + 1, {tokens[*openIndex - 1], "("});
+            } else {
+                insertTokens(tokens, *closeIndex, {")"});
+                insertTokens(tokens, *openIndex + 1, {"("});
+            }
+            return true;
+        }
+
+        // Repeats a statement or declaration after itself
+        bool duplicateStatement(std::vector<std::string>& tokens) {
+            const auto endIndex = findRandomToken(tokens, [&](size_t i) { return tokens[i] == ";" || tokens[i] == "}"; });
+            if (!endIndex.has_value()) {
+                return false;
+            }
+            // Walk back to the end of the previous statement, skipping over bracketed parts
+            size_t startIndex = *endIndex;
+            int depth = tokens[*endIndex] == "}" ? 1 : 0;
+            while (startIndex > 0) {
+                const auto& previous = tokens[startIndex - 1];
+                if (depth == 0 && (previous == ";" || previous == "{" || previous == "}")) {
+                    break;
+                }
+                if (previous == "}" || previous == ")") {
+                    depth++;
+                } else if (previous == "{" || previous == "(") {
+                    if (depth == 0) {
+                        break;
+                    }
+                    depth--;
+                }
+                startIndex--;
+            }
+            const std::vector<std::string> statement(tokens.begin() + startIndex, tokens.begin() + *endIndex + 1);
+            insertTokens(tokens, *endIndex + 1, statement);
+            return true;
+        }
+
+        // Prefixes an operand with a unary operator
+        bool addUnary(std::vector<std::string>& tokens) {
+            static const std::vector<std::string> unaryOps{"-", "+", "!"};
+            const auto index = findRandomToken(tokens, [&](size_t i) { return i > 0 && (tokens[i - 1] == "=" || tokens[i - 1] == "(" || tokens[i - 1] == "return"); });
+            if (!index.has_value()) {
+                return false;
+            }
+            insertTokens(tokens, *index, {unaryOps[randomIndex(unaryOps.size())]});
+            return true;
+        }
+
+        // Inserts a run of tokens from another corpus entry
+        bool splice(std::vector<std::string>& tokens) {
+            const auto& other = corpus[randomIndex(corpus.size())].tokens;
+            const size_t start = randomIndex(other.size());
+            const size_t length = 1 + randomIndex(std::min<size_t>(16, other.size() - start));
+            const std::vector<std::string> inserted(other.begin() + start, other.begin() + start + length);
+            insertTokens(tokens, randomIndex(tokens.size() + 1), inserted);
+            return true;
+        }
+
+        // Replaces a token by another one; usually makes the program invalid, which tests error paths
+        bool replaceToken(std::vector<std::string>& tokens) {
+            static const std::vector<std::string> dictionary{
+                "int", "float", "str", "if", "else", "while", "for", "return",
+                "=", "==", "<", "+", "*", "&&", "||", "!",
+                "{", "}", "(", ")", "[", "]", ",", ";",
+                "a", "main", "1", "2.5", "\"s\"",
+            };
+            if (tokens.empty()) {
+                return false;
+            }
+            tokens[randomIndex(tokens.size())] = dictionary[randomIndex(dictionary.size())];
+            return true;
+        }
+
+        bool deleteTokens(std::vector<std::string>& tokens) {
+            if (tokens.size() < 2) {
+                return false;
+            }
+            const size_t start = randomIndex(tokens.size());
+            const size_t length = 1 + randomIndex(std::min<size_t>(4, tokens.size() - start));
+            tokens.erase(tokens.begin() + start, tokens.begin() + start + length);
+            return true;
+        }
+
+        std::vector<std::string> mutate(const std::vector<std::string>& tokens) {
+            // Structural mutations keep programs valid and are chosen most often
+            static const std::vector<std::pair<int, bool (PerfFuzzer::*)(std::vector<std::string>&)>> mutations{
+                {6, &PerfFuzzer::nest},
+                {4, &PerfFuzzer::duplicateStatement},
+                {2, &PerfFuzzer::addUnary},
+                {2, &PerfFuzzer::splice},
+                {1, &PerfFuzzer::replaceToken},
+                {1, &PerfFuzzer::deleteTokens},
+            };
+            std::vector<int> weights;
+            for (const auto& [weight, mutation] : mutations) {
+                weights.push_back(weight);
+            }
+            std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+
+            auto mutated = tokens;
+            const size_t count = 1 + randomIndex(4);
+            for (size_t i = 0; i < count; i++) {
+                (this->*mutations[pick(random)].second)(mutated);
+            }
+            return mutated;
+        }
+
+        void save(const std::string& code, const PerfCost& cost) {
+            const size_t hash = std::hash<std::string>{}(code);
+            if (!savedHashes.insert(hash).second) {
+                return;
+            }
+            std::filesystem::create_directories(outputDirectory);
+            std::ostringstream name;
+            name << "perf-" << std::hex << std::setw(16) << std::setfill('0') << hash << ".txt";
+            const auto path = outputDirectory / name.str();
+            std::ofstream file(path);
+            if (!file.is_open()) {
+                throw std::runtime_error("Failed to open file: " + path.string());
+            }
+            file << code;
+            std::cout << "over budget: " << path.string() << " (" << describe(cost) << ")" << std::endl;
+        }
+
+        static std::string describe(const PerfCost& cost) {
+            std::ostringstream oss;
+            oss << std::fixed << std::setprecision(2) << cost.tokenCount << " tokens, "
+                << cost.getParseVisitsPerToken() << " parse visits/token, "
+                << cost.getTypeCheckVisitsPerToken() << " type check visits/token, "
+                << cost.getMicrosecondsPerToken() << " us/token";
+            return oss.str();
+        }
+
+        // Runs one input; returns its score if it is worth keeping in the corpus
+        std::optional<double> run(const std::vector<std::string>& tokens, double parentScore) {
+            const auto code = toCode(tokens);
+            const auto cost = meter.measure(code);
+            if (!cost.has_value()) {
+                return std::nullopt;
+            }
+            if (cost->getParseVisitsPerToken() > worstParse.getParseVisitsPerToken()) {
+                worstParse = *cost;
+            }
+            if (cost->getTypeCheckVisitsPerToken() > worstTypeCheck.getTypeCheckVisitsPerToken()) {
+                worstTypeCheck = *cost;
+            }
+            if (cost->exceeds(budget)) {
+                save(code, *cost);
+            }
+
+            bool newCoverage = false;
+            for (const auto& feature : cost->coverage) {
+                newCoverage = coverage.insert(feature).second || newCoverage;
+            }
+            const double score = getScore(*cost);
+            if (newCoverage || score > parentScore) {
+                return score;
+            }
+            return std::nullopt;
+        }
+
+    public:
+        PerfFuzzer(const PerfBudget& budget, const std::filesystem::path& outputDirectory, size_t maxTokens, unsigned int seed)
+            : lexer(), meter(), budget(budget), outputDirectory(outputDirectory), maxTokens(maxTokens), random(seed) {}
+
+        void addSeed(const std::string_view code) {
+            const auto tokens = toTokens(code);
+            if (!tokens.has_value() || tokens->empty()) {
+                return;
+            }
+            const auto score = run(*tokens, -1.0);
+            if (score.has_value()) {
+                corpus.push_back({ *tokens, *score });
+            }
+        }
+
+        void fuzz(size_t iterations) {
+            if (corpus.empty()) {
+                throw std::runtime_error("No seed input could be lexed");
+            }
+            for (size_t i = 0; i < iterations; i++) {
+                // Favour the most expensive inputs found so far, but keep exploring the rest
+                const bool pickBest = std::bernoulli_distribution(0.5)(random);
+                const auto& parent = pickBest
+                    ? *std::max_element(corpus.begin(), corpus.end(), [](const auto& a, const auto& b) { return a.score < b.score; })
+                    : corpus[randomIndex(corpus.size())];
+                const double parentScore = parent.score;
+                auto mutated = mutate(parent.tokens);
+                if (mutated.empty() || mutated.size() > maxTokens) {
+                    continue;
+                }
+                const auto score = run(mutated, parentScore);
+                if (score.has_value()) {
+                    corpus.push_back({ std::move(mutated), *score });
+                }
+            }
+        }
+
+        std::string getSummary() const {
+            std::ostringstream oss;
+            oss << "corpus: " << corpus.size() << " inputs, " << coverage.size() << " coverage features\n"
+                << "worst parse: " << describe(worstParse) << "\n"
+                << "worst type check: " << describe(worstTypeCheck) << "\n"
+                << "saved: " << savedHashes.size() << " inputs over budget";
+            return oss.str();
+        }
+};
+
+std::string readFile(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + path.string());
+    }
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// Usage: perffuzz [--iterations N] [--seed N] [--max-tokens N] [--corpus DIR] [--output DIR]
+//                 [--parse-budget VISITS_PER_TOKEN] [--type-check-budget VISITS_PER_TOKEN]
+int main(int argc, char** argv) {
+    size_t iterations = 10000;
+    unsigned int seed = std::random_device{}();
+    size_t maxTokens = 400;
+    std::vector<std::filesystem::path> corpusDirectories;
+    std::filesystem::path outputDirectory = "test/perf";
+    PerfBudget budget;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string_view option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for option: " << option << std::endl;
+            return 1;
+        }
+        const std::string value = argv[++i];
+        if (option == "--iterations") {
+            iterations = std::stoul(value);
+        } else if (option == "--seed") {
+            seed = std::stoul(value);
+        } else if (option == "--max-tokens") {
+            maxTokens = std::stoul(value);
+        } else if (option == "--corpus") {
+            corpusDirectories.push_back(value);
+        } else if (option == "--output") {
+            outputDirectory = value;
+        } else if (option == "--parse-budget") {
+            budget.parseVisitsPerToken = std::stod(value);
+        } else if (option == "--type-check-budget") {
+            budget.typeCheckVisitsPerToken = std::stod(value);
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "seed: " << seed << std::endl;
+    PerfFuzzer fuzzer(budget, outputDirectory, maxTokens, seed);
+    for (const auto& code : seedPrograms) {
+        fuzzer.addSeed(code);
+    }
+    for (const auto& directory : corpusDirectories) {
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (entry.is_regular_file()) {
+                fuzzer.addSeed(readFile(entry.path()));
+            }
+        }
+    }
+    fuzzer.fuzz(iterations);
+    std::cout << fuzzer.getSummary() << std::endl;
+    return 0;
+}
@@ -0,0 +1,121 @@
+module;
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include <charconv>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+export module outputwriter;
+
+// Buffers output and writes it to a file descriptor in large chunks, so emitting a listing piece by
+// piece costs a copy into the buffer rather than a system call or an allocation per piece. A piece
+// too large for the buffer goes out together with the buffered bytes in one vectored write instead
+// of being copied.
+export class OutputWriter {
+    private:
+        static constexpr size_t DEFAULT_BUFFER_SIZE = 1 << 16;
+
+        int fd;
+        bool ownsFd;
+        std::vector<char> buffer;
+        size_t used = 0;
+
+        void writeAll(iovec* parts, int count) {
+            while (count > 0) {
+                const auto written = ::writev(fd, parts, count);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error(std::string("Failed to write output: ") + std::strerror(errno));
+                }
+                // Skip what was written, which may end partway through a part
+                size_t remaining = written;
+                while (count > 0 && remaining >= parts->iov_len) {
+                    remaining -= parts->iov_len;
+                    parts++;
+                    count--;
+                }
+                if (count > 0) {
+                    parts->iov_base = static_cast<char*>(parts->iov_base) + remaining;
+                    parts->iov_len -= remaining;
+                }
+            }
+        }
+
+    public:
+        // Writes to a descriptor that stays open, such as STDOUT_FILENO
+        OutputWriter(int fd, size_t bufferSize = DEFAULT_BUFFER_SIZE)
+            : fd(fd), ownsFd(false), buffer(std::max<size_t>(bufferSize, 1)) {}
+
+        // Creates or truncates the file and closes it when done
+        OutputWriter(const std::string& filename, size_t bufferSize = DEFAULT_BUFFER_SIZE)
+            : fd(::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)), ownsFd(true), buffer(std::max<size_t>(bufferSize, 1)) {
+            if (fd < 0) {
+                throw std::runtime_error("Failed to open file: " + filename);
+            }
+        }
+
+        OutputWriter(const OutputWriter&) = delete;
+        OutputWriter& operator=(const OutputWriter&) = delete;
+
+        // Flushes what is left; call flush first to see write errors
+        ~OutputWriter() {
+            try {
+                flush();
+            } catch (const std::runtime_error&) {
+            }
+            if (ownsFd) {
+                ::close(fd);
+            }
+        }
+
+        void write(std::string_view data) {
+            if (data.size() <= buffer.size() - used) {
+                std::memcpy(buffer.data() + used, data.data(), data.size());
+                used += data.size();
+                return;
+            }
+            if (data.size() < buffer.size()) {
+                flush();
+                std::memcpy(buffer.data(), data.data(), data.size());
+                used = data.size();
+                return;
+            }
+            iovec parts[2] = {
+                { buffer.data(), used },
+                { const_cast<char*>(data.data()), data.size() },
+            };
+            writeAll(used > 0 ? parts : parts + 1, used > 0 ? 2 : 1);
+            used = 0;
+        }
+
+        void put(char c) {
+            if (used == buffer.size()) {
+                flush();
+            }
+            buffer[used++] = c;
+        }
+
+        void writeNumber(long long value) {
+            char digits[24];
+            const auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+            write(std::string_view(digits, end - digits));
+        }
+
+        void flush() {
+            if (used == 0) {
+                return;
+            }
+            iovec part{ buffer.data(), used };
+            writeAll(&part, 1);
+            used = 0;
+        }
+};
@@ -0,0 +1,407 @@
+module;
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+export module cfg;
+
+import ir;
+
+export constexpr uint32_t NO_BLOCK = UINT32_MAX;
+export constexpr uint32_t NO_LOOP = UINT32_MAX;
+
+// The instructions of one function, from its FUNCTION to its ENDFUNC inclusive
+export struct IrFunctionRange {
+    uint32_t begin;
+    uint32_t end;
+};
+
+export std::vector<IrFunctionRange> findFunctions(std::span<const IrInstruction> instructions) {
+    std::vector<IrFunctionRange> functions;
+    uint32_t begin = UINT32_MAX;
+    for (uint32_t i = 0; i < instructions.size(); i++) {
+        if (instructions[i].opcode == Opcode::FUNCTION) {
+            begin = i;
+        } else if (instructions[i].opcode == Opcode::ENDFUNC && begin != UINT32_MAX) {
+            functions.push_back(IrFunctionRange{ begin, i + 1 });
+            begin = UINT32_MAX;
+        }
+    }
+    return functions;
+}
+
+// Rebuilds the program's instructions, passing each function to the transform, which appends the
+// function's replacement to the output. The instructions outside functions are kept as they are.
+export template<typename Transform>
+void transformFunctions(IrProgram& program, Transform&& transform) {
+    const auto instructions = std::move(program.getInstructions());
+    std::vector<IrInstruction> output;
+    output.reserve(instructions.size());
+    uint32_t next = 0;
+    for (const auto& function : findFunctions(instructions)) {
+        output.insert(output.end(), instructions.begin() + next, instructions.begin() + function.begin);
+        transform(std::span<const IrInstruction>(instructions).subspan(function.begin, function.end - function.begin), output);
+        next = function.end;
+    }
+    output.insert(output.end(), instructions.begin() + next, instructions.end());
+    program.getInstructions() = std::move(output);
+}
+
+// A natural loop: the header and every block that reaches a latch without passing the header.
+// Back edges to the same header make one loop.
+export struct Loop {
+    uint32_t header;
+    // The innermost loop containing this one, NO_LOOP if it is outermost
+    uint32_t parent;
+    // In increasing block order, the header included
+    std::vector<uint32_t> blocks;
+    // The blocks with a back edge to the header
+    std::vector<uint32_t> latches;
+};
+
+// The basic blocks of a function's instructions with their edges, dominators and loops. Blocks are
+// numbered in instruction order, block 0 being the entry, and the edges are stored as offsets into
+// one array per direction. The graph refers to the instructions it was built from, which must
+// outlive it and stay unchanged.
+export class ControlFlowGraph {
+    private:
+        std::span<const IrInstruction> instructions;
+        // Block b spans the instructions from blockStarts[b] up to blockStarts[b + 1]
+        std::vector<uint32_t> blockStarts;
+        std::vector<uint32_t> successorOffsets;
+        std::vector<uint32_t> successors;
+        std::vector<uint32_t> predecessorOffsets;
+        std::vector<uint32_t> predecessors;
+
+        // Only the blocks reachable from the entry
+        std::vector<uint32_t> reversePostorder;
+        // Position of each block in reversePostorder, NO_BLOCK if unreachable
+        std::vector<uint32_t> reversePostorderIndices;
+
+        // NO_BLOCK for unreachable blocks; the entry is its own immediate dominator
+        std::vector<uint32_t> immediateDominators;
+        std::vector<uint32_t> dominatorChildOffsets;
+        std::vector<uint32_t> dominatorChildren;
+        // Preorder number of each block in the dominator tree and the largest number in its subtree
+        std::vector<uint32_t> dominatorPreorder;
+        std::vector<uint32_t> dominatorSubtreeEnd;
+
+        std::vector<Loop> loops;
+        // The innermost loop of each block
+        std::vector<uint32_t> blockLoops;
+
+        static bool endsBlock(Opcode opcode) {
+            return opcode == Opcode::IF || opcode == Opcode::GOTO || opcode == Opcode::RETURN;
+        }
+
+        // Fills the offsets and values of an adjacency list from (from, to) edges
+        static void buildAdjacency(size_t blockCount, const std::vector<std::pair<uint32_t, uint32_t>>& edges, bool reverse,
+            std::vector<uint32_t>& offsets, std::vector<uint32_t>& values) {
+            offsets.assign(blockCount + 1, 0);
+            for (const auto& [from, to] : edges) {
+                offsets[(reverse ? to : from) + 1]++;
+            }
+            for (size_t b = 0; b < blockCount; b++) {
+                offsets[b + 1] += offsets[b];
+            }
+            values.resize(edges.size());
+            std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+            for (const auto& [from, to] : edges) {
+                values[next[reverse ? to : from]++] = reverse ? from : to;
+            }
+        }
+
+        void buildBlocks() {
+            uint32_t labelCount = 0;
+            for (const auto& instruction : instructions) {
+                if (instruction.opcode == Opcode::LABEL) {
+                    labelCount = std::max(labelCount, instruction.arg1.getIndex() + 1);
+                }
+            }
+            std::vector<uint32_t> labelBlocks(labelCount, NO_BLOCK);
+            for (uint32_t i = 0; i < instructions.size(); i++) {
+                const bool isLeader = i == 0 || instructions[i].opcode == Opcode::LABEL || endsBlock(instructions[i - 1].opcode);
+                if (isLeader) {
+                    blockStarts.push_back(i);
+                }
+                if (instructions[i].opcode == Opcode::LABEL) {
+                    labelBlocks[instructions[i].arg1.getIndex()] = blockStarts.size() - 1;
+                }
+            }
+            const uint32_t blockCount = blockStarts.size();
+            blockStarts.push_back(instructions.size());
+
+            const auto getLabelBlock = [&](Operand label) {
+                if (label.getKind() != OperandKind::LABEL || label.getIndex() >= labelCount || labelBlocks[label.getIndex()] == NO_BLOCK) {
+                    throw std::runtime_error("Jump to a label outside the function");
+                }
+                return labelBlocks[label.getIndex()];
+            };
+            std::vector<std::pair<uint32_t, uint32_t>> edges;
+            for (uint32_t b = 0; b < blockCount; b++) {
+                const auto& last = instructions[blockStarts[b + 1] - 1];
+                const bool hasNext = b + 1 < blockCount;
+                switch (last.opcode) {
+                    case Opcode::GOTO:
+                        edges.emplace_back(b, getLabelBlock(last.result));
+                        break;
+                    case Opcode::IF: {
+                        const auto target = getLabelBlock(last.result);
+                        edges.emplace_back(b, target);
+                        if (hasNext && target != b + 1) {
+                            edges.emplace_back(b, b + 1);
+                        }
+                        break;
+                    }
+                    case Opcode::RETURN:
+                    case Opcode::ENDFUNC:
+                        break;
+                    default:
+                        if (hasNext) {
+                            edges.emplace_back(b, b + 1);
+                        }
+                        break;
+                }
+            }
+            buildAdjacency(blockCount, edges, false, successorOffsets, successors);
+            buildAdjacency(blockCount, edges, true, predecessorOffsets, predecessors);
+        }
+
+        void buildReversePostorder() {
+            const auto blockCount = size();
+            reversePostorderIndices.assign(blockCount, NO_BLOCK);
+            if (blockCount == 0) {
+                return;
+            }
+            // Iterative depth-first search; each frame is a block and the next successor to visit
+            std::vector<bool> visited(blockCount, false);
+            std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0, 0 } };
+            visited[0] = true;
+            while (!stack.empty()) {
+                auto& [block, next] = stack.back();
+                const auto blockSuccessors = getSuccessors(block);
+                if (next < blockSuccessors.size()) {
+                    const auto successor = blockSuccessors[next++];
+                    if (!visited[successor]) {
+                        visited[successor] = true;
+                        stack.emplace_back(successor, 0);
+                    }
+                } else {
+                    reversePostorder.push_back(block);
+                    stack.pop_back();
+                }
+            }
+            std::reverse(reversePostorder.begin(), reversePostorder.end());
+            for (uint32_t i = 0; i < reversePostorder.size(); i++) {
+                reversePostorderIndices[reversePostorder[i]] = i;
+            }
+        }
+
+        // Cooper, Harvey and Kennedy's iterative algorithm over the reverse postorder
+        void buildDominators() {
+            const auto blockCount = size();
+            immediateDominators.assign(blockCount, NO_BLOCK);
+            if (blockCount == 0) {
+                return;
+            }
+            immediateDominators[0] = 0;
+            const auto intersect = [&](uint32_t a, uint32_t b) {
+                while (a != b) {
+                    while (reversePostorderIndices[a] > reversePostorderIndices[b]) {
+                        a = immediateDominators[a];
+                    }
+                    while (reversePostorderIndices[b] > reversePostorderIndices[a]) {
+                        b = immediateDominators[b];
+                    }
+                }
+                return a;
+            };
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (size_t i = 1; i < reversePostorder.size(); i++) {
+                    const auto block = reversePostorder[i];
+                    uint32_t newDominator = NO_BLOCK;
+                    for (const auto predecessor : getPredecessors(block)) {
+                        if (immediateDominators[predecessor] == NO_BLOCK) {
+                            continue;
+                        }
+                        newDominator = newDominator == NO_BLOCK ? predecessor : intersect(predecessor, newDominator);
+                    }
+                    if (immediateDominators[block] != newDominator) {
+                        immediateDominators[block] = newDominator;
+                        changed = true;
+                    }
+                }
+            }
+
+            std::vector<std::pair<uint32_t, uint32_t>> treeEdges;
+            for (const auto block : reversePostorder) {
+                if (block != 0) {
+                    treeEdges.emplace_back(immediateDominators[block], block);
+                }
+            }
+            buildAdjacency(blockCount, treeEdges, false, dominatorChildOffsets, dominatorChildren);
+
+            dominatorPreorder.assign(blockCount, NO_BLOCK);
+            dominatorSubtreeEnd.assign(blockCount, NO_BLOCK);
+            uint32_t number = 0;
+            std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0, 0 } };
+            dominatorPreorder[0] = number++;
+            while (!stack.empty()) {
+                auto& [block, next] = stack.back();
+                const auto children = getDominatorChildren(block);
+                if (next < children.size()) {
+                    const auto child = children[next++];
+                    dominatorPreorder[child] = number++;
+                    stack.emplace_back(child, 0);
+                } else {
+                    dominatorSubtreeEnd[block] = number - 1;
+                    stack.pop_back();
+                }
+            }
+        }
+
+        void buildLoops() {
+            const auto blockCount = size();
+            blockLoops.assign(blockCount, NO_LOOP);
+            std::vector<uint32_t> headerLoops(blockCount, NO_LOOP);
+            for (const auto block : reversePostorder) {
+                for (const auto successor : getSuccessors(block)) {
+                    if (!dominates(successor, block)) {
+                        continue;
+                    }
+                    if (headerLoops[successor] == NO_LOOP) {
+                        headerLoops[successor] = loops.size();
+                        loops.push_back(Loop{ successor, NO_LOOP, {}, {} });
+                    }
+                    loops[headerLoops[successor]].latches.push_back(block);
+                }
+            }
+
+            // Walk back from the latches to the header, marking the blocks with the loop they were found for
+            std::vector<uint32_t> marks(blockCount, NO_LOOP);
+            std::vector<uint32_t> worklist;
+            for (uint32_t l = 0; l < loops.size(); l++) {
+                auto& loop = loops[l];
+                marks[loop.header] = l;
+                loop.blocks.push_back(loop.header);
+                for (const auto latch : loop.latches) {
+                    if (marks[latch] != l) {
+                        marks[latch] = l;
+                        loop.blocks.push_back(latch);
+                        worklist.push_back(latch);
+                    }
+                }
+                while (!worklist.empty()) {
+                    const auto block = worklist.back();
+                    worklist.pop_back();
+                    for (const auto predecessor : getPredecessors(block)) {
+                        if (marks[predecessor] != l && isReachable(predecessor)) {
+                            marks[predecessor] = l;
+                            loop.blocks.push_back(predecessor);
+                            worklist.push_back(predecessor);
+                        }
+                    }
+                }
+                std::sort(loop.blocks.begin(), loop.blocks.end());
+            }
+
+            // A loop nested in another has fewer blocks, so assigning the larger loops first leaves
+            // each block with its innermost loop
+            std::vector<uint32_t> bySize(loops.size());
+            for (uint32_t l = 0; l < loops.size(); l++) {
+                bySize[l] = l;
+            }
+            std::sort(bySize.begin(), bySize.end(), [&](uint32_t a, uint32_t b) { return loops[a].blocks.size() > loops[b].blocks.size(); });
+            for (const auto l : bySize) {
+                loops[l].parent = blockLoops[loops[l].header];
+                for (const auto block : loops[l].blocks) {
+                    blockLoops[block] = l;
+                }
+            }
+        }
+
+    public:
+        ControlFlowGraph(std::span<const IrInstruction> instructions) : instructions(instructions) {
+            buildBlocks();
+            buildReversePostorder();
+            buildDominators();
+            buildLoops();
+        }
+
+        size_t size() const {
+            return blockStarts.size() - 1;
+        }
+
+        uint32_t getBlockStart(uint32_t block) const {
+            return blockStarts[block];
+        }
+
+        uint32_t getBlockEnd(uint32_t block) const {
+            return blockStarts[block + 1];
+        }
+
+        std::span<const IrInstruction> getBlockInstructions(uint32_t block) const {
+            return instructions.subspan(blockStarts[block], blockStarts[block + 1] - blockStarts[block]);
+        }
+
+        // The block holding the instruction at the given index
+        uint32_t getBlockOf(uint32_t instruction) const {
+            return std::upper_bound(blockStarts.begin(), blockStarts.end() - 1, instruction) - blockStarts.begin() - 1;
+        }
+
+        std::span<const uint32_t> getSuccessors(uint32_t block) const {
+            return std::span<const uint32_t>(successors).subspan(successorOffsets[block], successorOffsets[block + 1] - successorOffsets[block]);
+        }
+
+        std::span<const uint32_t> getPredecessors(uint32_t block) const {
+            return std::span<const uint32_t>(predecessors).subspan(predecessorOffsets[block], predecessorOffsets[block + 1] - predecessorOffsets[block]);
+        }
+
+        // The reachable blocks, each before its successors except along back edges
+        const std::vector<uint32_t>& getReversePostorder() const {
+            return reversePostorder;
+        }
+
+        bool isReachable(uint32_t block) const {
+            return reversePostorderIndices[block] != NO_BLOCK;
+        }
+
+        uint32_t getImmediateDominator(uint32_t block) const {
+            return immediateDominators[block];
+        }
+
+        std::span<const uint32_t> getDominatorChildren(uint32_t block) const {
+            return std::span<const uint32_t>(dominatorChildren).subspan(dominatorChildOffsets[block], dominatorChildOffsets[block + 1] - dominatorChildOffsets[block]);
+        }
+
+        // Whether every path from the entry to b passes through a; false if either is unreachable
+        bool dominates(uint32_t a, uint32_t b) const {
+            if (!isReachable(a) || !isReachable(b)) {
+                return false;
+            }
+            return dominatorPreorder[a] <= dominatorPreorder[b] && dominatorPreorder[b] <= dominatorSubtreeEnd[a];
+        }
+
+        const std::vector<Loop>& getLoops() const {
+            return loops;
+        }
+
+        // The innermost loop containing the block, NO_LOOP if none
+        uint32_t getLoopOf(uint32_t block) const {
+            return blockLoops[block];
+        }
+
+        uint32_t getLoopDepth(uint32_t block) const {
+            uint32_t depth = 0;
+            for (auto loop = blockLoops[block]; loop != NO_LOOP; loop = loops[loop].parent) {
+                depth++;
+            }
+            return depth;
+        }
+};
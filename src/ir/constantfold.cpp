@@ -0,0 +1,372 @@
+module;
+
+#include <vector>
+#include <span>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <optional>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+export module constantfold;
+
+import ir;
+import cfg;
+
+// Folding evaluates operators whose operands are constants at compile time, following the typing
+// rules of the checker: an int operand is promoted to float when the other one is a float, strings
+// are added and compared with each other only, and comparisons and logical operators give the int 0
+// or 1. Ints are 64-bit; an operation that would overflow, divide by zero or give a float that is not
+// finite is left to run.
+
+// A constant as a number or as the characters of a string without its quotes
+struct ConstantValue {
+    ConstantKind kind;
+    int64_t intValue = 0;
+    double floatValue = 0;
+    std::string_view stringValue;
+};
+
+static std::optional<ConstantValue> parseConstant(const IrConstant& constant) {
+    ConstantValue value{ constant.kind, 0, 0, {} };
+    const auto begin = constant.text.data();
+    const auto end = begin + constant.text.size();
+    switch (constant.kind) {
+        case ConstantKind::INT: {
+            const auto [parsed, error] = std::from_chars(begin, end, value.intValue);
+            return error == std::errc() && parsed == end ? std::optional(value) : std::nullopt;
+        }
+        case ConstantKind::FLOAT: {
+            const auto [parsed, error] = std::from_chars(begin, end, value.floatValue);
+            return error == std::errc() && parsed == end ? std::optional(value) : std::nullopt;
+        }
+        case ConstantKind::STRING:
+            if (constant.text.size() < 2) {
+                return std::nullopt;
+            }
+            value.stringValue = std::string_view(constant.text).substr(1, constant.text.size() - 2);
+            return value;
+    }
+    return std::nullopt;
+}
+
+static IrConstant makeInt(int64_t value) {
+    return IrConstant{ ConstantKind::INT, std::to_string(value) };
+}
+
+static std::optional<IrConstant> makeFloat(double value) {
+    if (!std::isfinite(value)) {
+        return std::nullopt;
+    }
+    // The shortest digits that read back as the same value, written like a float literal
+    char digits[400];
+    const auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed);
+    std::string text(digits, end);
+    if (text.find('.') == std::string::npos) {
+        text += ".0";
+    }
+    return IrConstant{ ConstantKind::FLOAT, std::move(text) };
+}
+
+static double toFloat(const ConstantValue& value) {
+    return value.kind == ConstantKind::FLOAT ? value.floatValue : static_cast<double>(value.intValue);
+}
+
+static bool isTrue(const ConstantValue& value) {
+    return value.kind == ConstantKind::FLOAT ? value.floatValue != 0 : value.intValue != 0;
+}
+
+template<typename T>
+static std::optional<IrConstant> compare(Opcode opcode, const T& left, const T& right) {
+    switch (opcode) {
+        case Opcode::EQUAL: return makeInt(left == right);
+        case Opcode::NOT_EQUAL: return makeInt(left != right);
+        case Opcode::LESS: return makeInt(left < right);
+        case Opcode::LESS_EQUAL: return makeInt(left <= right);
+        case Opcode::GREATER: return makeInt(left > right);
+        case Opcode::GREATER_EQUAL: return makeInt(left >= right);
+        default: return std::nullopt;
+    }
+}
+
+static std::optional<IrConstant> foldInts(Opcode opcode, int64_t left, int64_t right) {
+    constexpr auto MIN = std::numeric_limits<int64_t>::min();
+    constexpr auto MAX = std::numeric_limits<int64_t>::max();
+    switch (opcode) {
+        case Opcode::ADD:
+            if (right > 0 ? left > MAX - right : left < MIN - right) {
+                return std::nullopt;
+            }
+            return makeInt(left + right);
+        case Opcode::SUB:
+            if (right < 0 ? left > MAX + right : left < MIN + right) {
+                return std::nullopt;
+            }
+            return makeInt(left - right);
+        case Opcode::MUL: {
+            const auto product = static_cast<uint64_t>(left) * static_cast<uint64_t>(right);
+            if ((left == -1 && right == MIN) || (left != 0 && static_cast<int64_t>(product) / left != right)) {
+                return std::nullopt;
+            }
+            return makeInt(static_cast<int64_t>(product));
+        }
+        case Opcode::DIV:
+        case Opcode::MOD:
+            if (right == 0 || (left == MIN && right == -1)) {
+                return std::nullopt;
+            }
+            return makeInt(opcode == Opcode::DIV ? left / right : left % right);
+        default:
+            return compare(opcode, left, right);
+    }
+}
+
+static std::optional<IrConstant> foldFloats(Opcode opcode, double left, double right) {
+    switch (opcode) {
+        case Opcode::ADD: return makeFloat(left + right);
+        case Opcode::SUB: return makeFloat(left - right);
+        case Opcode::MUL: return makeFloat(left * right);
+        case Opcode::DIV: return makeFloat(left / right);
+        case Opcode::MOD: return makeFloat(std::fmod(left, right));
+        default: return compare(opcode, left, right);
+    }
+}
+
+// The result of a binary operator on constants, nullopt if it is only known at run time
+export std::optional<IrConstant> foldBinary(Opcode opcode, const IrConstant& left, const IrConstant& right) {
+    const auto leftValue = parseConstant(left);
+    const auto rightValue = parseConstant(right);
+    if (!leftValue || !rightValue) {
+        return std::nullopt;
+    }
+    const bool leftString = leftValue->kind == ConstantKind::STRING;
+    const bool rightString = rightValue->kind == ConstantKind::STRING;
+    if (leftString || rightString) {
+        if (!leftString || !rightString) {
+            return std::nullopt;
+        }
+        if (opcode == Opcode::ADD) {
+            return IrConstant{ ConstantKind::STRING, "\"" + std::string(leftValue->stringValue) + std::string(rightValue->stringValue) + "\"" };
+        }
+        // An escape sequence can spell a character in more than one way
+        if (leftValue->stringValue.find('\\') != std::string_view::npos || rightValue->stringValue.find('\\') != std::string_view::npos) {
+            return std::nullopt;
+        }
+        return compare(opcode, leftValue->stringValue, rightValue->stringValue);
+    }
+    if (opcode == Opcode::OR || opcode == Opcode::AND) {
+        return makeInt(opcode == Opcode::OR ? isTrue(*leftValue) || isTrue(*rightValue) : isTrue(*leftValue) && isTrue(*rightValue));
+    }
+    if (leftValue->kind == ConstantKind::FLOAT || rightValue->kind == ConstantKind::FLOAT) {
+        return foldFloats(opcode, toFloat(*leftValue), toFloat(*rightValue));
+    }
+    return foldInts(opcode, leftValue->intValue, rightValue->intValue);
+}
+
+export std::optional<IrConstant> foldUnary(Opcode opcode, const IrConstant& operand) {
+    const auto value = parseConstant(operand);
+    if (!value || value->kind == ConstantKind::STRING) {
+        return std::nullopt;
+    }
+    switch (opcode) {
+        case Opcode::PLUS:
+            return operand;
+        case Opcode::MINUS:
+            if (value->kind == ConstantKind::FLOAT) {
+                return makeFloat(-value->floatValue);
+            }
+            if (value->intValue == std::numeric_limits<int64_t>::min()) {
+                return std::nullopt;
+            }
+            return makeInt(-value->intValue);
+        case Opcode::NOT:
+            return makeInt(!isTrue(*value));
+        default:
+            return std::nullopt;
+    }
+}
+
+// Whether an if on the constant jumps, nullopt for a string
+export std::optional<bool> isTrueConstant(const IrConstant& constant) {
+    const auto value = parseConstant(constant);
+    if (!value || value->kind == ConstantKind::STRING) {
+        return std::nullopt;
+    }
+    return isTrue(*value);
+}
+
+// Replaces an operator instruction whose operands are constants by an assignment of its result,
+// returning whether it did
+static bool foldInstruction(IrProgram& program, IrInstruction& instruction) {
+    std::optional<IrConstant> result;
+    if (isBinaryOpcode(instruction.opcode) && instruction.arg1.getKind() == OperandKind::CONSTANT && instruction.arg2.getKind() == OperandKind::CONSTANT) {
+        result = foldBinary(instruction.opcode, program.getConstant(instruction.arg1), program.getConstant(instruction.arg2));
+    } else if (isUnaryOpcode(instruction.opcode) && instruction.arg1.getKind() == OperandKind::CONSTANT) {
+        result = foldUnary(instruction.opcode, program.getConstant(instruction.arg1));
+    }
+    if (!result) {
+        return false;
+    }
+    instruction = IrInstruction{ Opcode::ASSIGN, program.internConstant(result->kind, result->text), {}, instruction.result };
+    return true;
+}
+
+// Substitutes known constants for the operands an instruction reads
+template<typename Lookup>
+static void replaceReads(IrInstruction& instruction, Lookup&& lookup) {
+    if (readsArg1(instruction.opcode)) {
+        if (const auto constant = lookup(instruction.arg1)) {
+            instruction.arg1 = *constant;
+        }
+    }
+    if (readsArg2(instruction.opcode)) {
+        if (const auto constant = lookup(instruction.arg2)) {
+            instruction.arg2 = *constant;
+        }
+    }
+}
+
+static bool isAssignedConstant(const IrInstruction& instruction) {
+    return instruction.opcode == Opcode::ASSIGN && instruction.arg1.getKind() == OperandKind::CONSTANT;
+}
+
+// Folds the code outside functions, which runs once in order, and finds the globals it sets to a
+// constant before any call and that nothing else assigns. The constants are by global operand bits.
+export std::unordered_map<uint32_t, Operand> foldGlobalCode(IrProgram& program) {
+    auto& instructions = program.getInstructions();
+    std::unordered_map<uint32_t, uint32_t> globalDefinitions;
+    for (const auto& instruction : instructions) {
+        const auto definition = getDefinition(instruction);
+        if (definition && definition->getKind() == OperandKind::NAME && program.isGlobal(*definition)) {
+            globalDefinitions[definition->getBits()]++;
+        }
+    }
+
+    // The variable and its constant, by variable
+    std::unordered_map<uint32_t, std::pair<Operand, Operand>> known;
+    std::unordered_map<uint32_t, Operand> globalConstants;
+    bool called = false;
+    uint32_t next = 0;
+    const auto functions = findFunctions(instructions);
+    for (size_t f = 0; f <= functions.size(); f++) {
+        const auto end = f < functions.size() ? functions[f].begin : instructions.size();
+        for (; next < end; next++) {
+            auto& instruction = instructions[next];
+            replaceReads(instruction, [&](Operand operand) -> std::optional<Operand> {
+                const auto iter = known.find(operand.getBits());
+                return iter != known.end() ? std::optional(iter->second.second) : std::nullopt;
+            });
+            foldInstruction(program, instruction);
+            if (instruction.opcode == Opcode::CALL) {
+                // The call may assign any global
+                called = true;
+                std::erase_if(known, [&](const auto& entry) { return !program.isLocalVariable(entry.second.first); });
+            }
+            const auto definition = getDefinition(instruction);
+            if (!definition || (definition->getKind() == OperandKind::NAME && program.isArray(*definition))) {
+                continue;
+            }
+            if (!isAssignedConstant(instruction)) {
+                known.erase(definition->getBits());
+                continue;
+            }
+            known[definition->getBits()] = { *definition, instruction.arg1 };
+            if (definition->getKind() == OperandKind::NAME && program.isGlobal(*definition) && !called
+                && globalDefinitions[definition->getBits()] == 1) {
+                globalConstants[definition->getBits()] = instruction.arg1;
+            }
+        }
+        if (f < functions.size()) {
+            next = functions[f].end;
+        }
+    }
+    return globalConstants;
+}
+
+// Folds one function. A local assigned a constant is replaced by it in the rest of its block, and in
+// the blocks its assignment dominates when it is the only assignment, which holds for every value in
+// SSA form. Blocks are visited in reverse postorder, so a value is folded before the blocks it
+// dominates read it.
+static void foldFunction(IrProgram& program, std::span<const IrInstruction> function,
+    const std::unordered_map<uint32_t, Operand>& globalConstants, std::vector<IrInstruction>& output) {
+    const ControlFlowGraph cfg(function);
+    std::vector<IrInstruction> instructions(function.begin(), function.end());
+    const auto functionName = function.front().arg1;
+
+    const auto isFoldable = [&](Operand operand) {
+        return operand.getKind() == OperandKind::VALUE || program.isLocalVariable(operand);
+    };
+    std::unordered_map<uint32_t, uint32_t> definitionCounts;
+    for (const auto& instruction : instructions) {
+        const auto definition = getDefinition(instruction);
+        if (definition && isFoldable(*definition)) {
+            definitionCounts[definition->getBits()]++;
+        }
+    }
+
+    struct SingleConstant {
+        Operand constant;
+        uint32_t block;
+        uint32_t instruction;
+    };
+    std::unordered_map<uint32_t, SingleConstant> singleConstants;
+    std::unordered_map<uint32_t, Operand> known;
+    for (const auto block : cfg.getReversePostorder()) {
+        known.clear();
+        for (auto i = cfg.getBlockStart(block); i < cfg.getBlockEnd(block); i++) {
+            auto& instruction = instructions[i];
+            const auto lookup = [&](Operand operand) -> std::optional<Operand> {
+                if (const auto global = globalConstants.find(operand.getBits());
+                    global != globalConstants.end() && !program.declaresLocal(functionName, operand)) {
+                    return global->second;
+                }
+                if (const auto local = known.find(operand.getBits()); local != known.end()) {
+                    return local->second;
+                }
+                const auto single = singleConstants.find(operand.getBits());
+                if (single != singleConstants.end() && cfg.dominates(single->second.block, block)
+                    && (single->second.block != block || single->second.instruction < i)) {
+                    return single->second.constant;
+                }
+                return std::nullopt;
+            };
+            if (instruction.opcode == Opcode::PHI) {
+                // The assignment of an argument dominates the predecessor it comes from
+                for (auto& argument : program.getPhiArguments(instruction)) {
+                    if (const auto single = singleConstants.find(argument.getBits()); single != singleConstants.end()) {
+                        argument = single->second.constant;
+                    }
+                }
+            } else {
+                replaceReads(instruction, lookup);
+                foldInstruction(program, instruction);
+            }
+            const auto definition = getDefinition(instruction);
+            if (!definition || !isFoldable(*definition)) {
+                continue;
+            }
+            if (!isAssignedConstant(instruction)) {
+                known.erase(definition->getBits());
+            } else if (definitionCounts[definition->getBits()] == 1) {
+                singleConstants[definition->getBits()] = SingleConstant{ instruction.arg1, block, i };
+            } else {
+                known[definition->getBits()] = instruction.arg1;
+            }
+        }
+    }
+    output.insert(output.end(), instructions.begin(), instructions.end());
+}
+
+// Evaluates the operators on constants and propagates the constants assigned to locals, and to
+// globals that the code outside functions sets once, except in the functions with a local of the same
+// name. The assignments themselves are kept.
+export void foldConstants(IrProgram& program) {
+    const auto globalConstants = foldGlobalCode(program);
+    transformFunctions(program, [&](std::span<const IrInstruction> function, std::vector<IrInstruction>& output) {
+        foldFunction(program, function, globalConstants, output);
+    });
+}
@@ -0,0 +1,143 @@
+module;
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <unordered_set>
+
+export module deadcode;
+
+import ir;
+import cfg;
+import liveness;
+
+// Dead code elimination: blocks that cannot be reached are removed, code after a return among
+// them, and so are the computations whose result is never read. An assignment to a temporary or a
+// local is dead when the variable is not live after it; an assignment to a global is only dead when
+// the same block assigns the global again before any read or call, since the rest of the program
+// may read it.
+
+// The instructions that only compute their result. Calls, element stores and pushes change what the
+// rest of the program sees, so they always stay.
+static bool isPure(Opcode opcode) {
+    return opcode == Opcode::ASSIGN || opcode == Opcode::INDEX || opcode == Opcode::PHI
+        || isBinaryOpcode(opcode) || isUnaryOpcode(opcode);
+}
+
+class DeadCodeEliminator {
+    private:
+        IrProgram& program;
+        std::vector<IrInstruction> instructions;
+
+        bool isGlobalScalar(Operand operand) const {
+            return program.isGlobal(operand) && !program.isArray(operand);
+        }
+
+        // Drops the unreachable blocks but the ENDFUNC, along with the phi arguments coming from them
+        void removeUnreachableBlocks() {
+            const ControlFlowGraph cfg(instructions);
+            std::vector<IrInstruction> output;
+            for (uint32_t block = 0; block < cfg.size(); block++) {
+                if (!cfg.isReachable(block)) {
+                    if (cfg.getBlockEnd(block) == instructions.size()) {
+                        output.push_back(instructions.back());
+                    }
+                    continue;
+                }
+                const auto predecessors = cfg.getPredecessors(block);
+                for (auto instruction : cfg.getBlockInstructions(block)) {
+                    if (instruction.opcode == Opcode::PHI) {
+                        const auto arguments = program.getPhiArguments(instruction);
+                        std::vector<Operand> reachableArguments;
+                        for (size_t p = 0; p < predecessors.size(); p++) {
+                            if (cfg.isReachable(predecessors[p])) {
+                                reachableArguments.push_back(arguments[p]);
+                            }
+                        }
+                        if (reachableArguments.size() == 1) {
+                            instruction = IrInstruction{ Opcode::ASSIGN, reachableArguments[0], {}, instruction.result };
+                        } else if (reachableArguments.size() != arguments.size()) {
+                            instruction = program.makePhi(instruction.result, reachableArguments);
+                        }
+                    }
+                    output.push_back(instruction);
+                }
+            }
+            instructions = std::move(output);
+        }
+
+        // Removes the dead assignments found by one liveness analysis, returning whether there was
+        // any. Removing one can make the assignments of the variables it read dead in turn.
+        bool removeDeadAssignments() {
+            const ControlFlowGraph cfg(instructions);
+            const LiveVariables live(program, cfg);
+            std::vector<bool> dead(instructions.size(), false);
+            bool changed = false;
+            for (uint32_t block = 0; block < cfg.size(); block++) {
+                auto liveNow = live.getLiveOut(block);
+                // The globals assigned later in the block with no read or call before
+                std::unordered_set<uint32_t> overwritten;
+                for (auto i = cfg.getBlockEnd(block); i-- > cfg.getBlockStart(block);) {
+                    const auto& instruction = instructions[i];
+                    const auto definition = getDefinition(instruction);
+                    if (definition && isPure(instruction.opcode)) {
+                        const bool isDead = live.isVariable(*definition)
+                            ? !liveNow.contains(live.getId(*definition))
+                            : overwritten.contains(definition->getBits());
+                        if (isDead) {
+                            dead[i] = true;
+                            changed = true;
+                            continue;
+                        }
+                    }
+                    if (definition && live.isVariable(*definition)) {
+                        liveNow.erase(live.getId(*definition));
+                    } else if (definition && isGlobalScalar(*definition)) {
+                        overwritten.insert(definition->getBits());
+                    }
+                    if (instruction.opcode == Opcode::CALL) {
+                        overwritten.clear();
+                    }
+                    const auto read = [&](Operand operand) {
+                        if (live.isVariable(operand)) {
+                            liveNow.insert(live.getId(operand));
+                        } else {
+                            overwritten.erase(operand.getBits());
+                        }
+                    };
+                    if (readsArg1(instruction.opcode)) {
+                        read(instruction.arg1);
+                    }
+                    if (readsArg2(instruction.opcode)) {
+                        read(instruction.arg2);
+                    }
+                }
+            }
+            size_t kept = 0;
+            for (size_t i = 0; i < instructions.size(); i++) {
+                if (!dead[i]) {
+                    instructions[kept++] = instructions[i];
+                }
+            }
+            instructions.resize(kept);
+            return changed;
+        }
+
+    public:
+        DeadCodeEliminator(IrProgram& program, std::span<const IrInstruction> function)
+            : program(program), instructions(function.begin(), function.end()) {}
+
+        void run(std::vector<IrInstruction>& output) {
+            removeUnreachableBlocks();
+            while (removeDeadAssignments()) {}
+            output.insert(output.end(), instructions.begin(), instructions.end());
+        }
+};
+
+// Removes the unreachable code and the dead assignments of every function, in or out of SSA form.
+// Calls, element stores, parameters, pushes and control flow always stay.
+export void eliminateDeadCode(IrProgram& program) {
+    transformFunctions(program, [&](std::span<const IrInstruction> function, std::vector<IrInstruction>& output) {
+        DeadCodeEliminator(program, function).run(output);
+    });
+}
@@ -0,0 +1,559 @@
+module;
+
+#include <vector>
+#include <span>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <algorithm>
+
+export module ir;
+
+import outputwriter;
+
+// The intermediate representation produced from the AST: a list of quadruples with an opcode and up
+// to three operands. Names and constants are interned in the program, so an instruction is 16 bytes
+// and passes compare opcodes and operands as integers.
+
+export enum class Opcode : uint8_t {
+    ASSIGN,
+    INDEX,
+    // ( []=, value, index, array ) stores the value in the element of the array
+    INDEX_STORE,
+    // Binary operators, in the order of the AST kinds
+    OR,
+    AND,
+    EQUAL,
+    NOT_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    // Unary operators
+    PLUS,
+    MINUS,
+    NOT,
+    IF,
+    GOTO,
+    LABEL,
+    FUNCTION,
+    PARAM,
+    ENDFUNC,
+    PUSH,
+    // Calls the function with the pushed arguments, the last pushed first
+    CALL,
+    RETURN,
+    // Only in SSA form: the result takes the argument from the predecessor the block was entered from
+    PHI,
+};
+
+export constexpr bool isBinaryOpcode(Opcode opcode) {
+    return opcode >= Opcode::OR && opcode <= Opcode::MOD;
+}
+
+export constexpr bool isUnaryOpcode(Opcode opcode) {
+    return opcode >= Opcode::PLUS && opcode <= Opcode::NOT;
+}
+
+// The text of the opcode in quadruple listings
+export constexpr std::string_view getOpcodeText(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::ASSIGN: return "=";
+        case Opcode::INDEX: return "[]";
+        case Opcode::INDEX_STORE: return "[]=";
+        case Opcode::OR: return "||";
+        case Opcode::AND: return "&&";
+        case Opcode::EQUAL: return "==";
+        case Opcode::NOT_EQUAL: return "!=";
+        case Opcode::LESS: return "<";
+        case Opcode::LESS_EQUAL: return "<=";
+        case Opcode::GREATER: return ">";
+        case Opcode::GREATER_EQUAL: return ">=";
+        case Opcode::ADD: return "+";
+        case Opcode::SUB: return "-";
+        case Opcode::MUL: return "*";
+        case Opcode::DIV: return "/";
+        case Opcode::MOD: return "%";
+        case Opcode::PLUS: return "+";
+        case Opcode::MINUS: return "-";
+        // Listed like the negation it used to be generated as
+        case Opcode::NOT: return "-";
+        case Opcode::IF: return "if";
+        case Opcode::GOTO: return "goto";
+        case Opcode::LABEL: return "";
+        case Opcode::FUNCTION: return "FUNCTION";
+        case Opcode::PARAM: return "PARAM";
+        case Opcode::ENDFUNC: return "ENDFUNC";
+        case Opcode::PUSH: return "PUSH";
+        case Opcode::CALL: return "CALL";
+        case Opcode::RETURN: return "RETURN";
+        case Opcode::PHI: return "PHI";
+    }
+    throw std::runtime_error("Unknown opcode");
+}
+
+export enum class OperandKind : uint8_t {
+    NONE,
+    // The temporary t<index>
+    TEMP,
+    // A variable or function, by index in the program's names
+    NAME,
+    // A literal, by index in the program's constants
+    CONSTANT,
+    // The label L<index>
+    LABEL,
+    // A plain number, such as the parameter count of a function
+    COUNT,
+    // A version of a variable in SSA form, by index in the program's values
+    VALUE,
+};
+
+// A tagged 32-bit reference: the kind in the top 3 bits and an index in the rest
+export class Operand {
+    private:
+        static constexpr uint32_t INDEX_BITS = 29;
+        static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+        uint32_t bits = 0;
+
+        constexpr Operand(OperandKind kind, uint32_t index) : bits(static_cast<uint32_t>(kind) << INDEX_BITS | index) {
+            if (index > INDEX_MASK) {
+                throw std::runtime_error("Operand index out of range");
+            }
+        }
+
+    public:
+        constexpr Operand() {}
+
+        static constexpr Operand temp(uint32_t index) {
+            return Operand(OperandKind::TEMP, index);
+        }
+
+        static constexpr Operand name(uint32_t index) {
+            return Operand(OperandKind::NAME, index);
+        }
+
+        static constexpr Operand constant(uint32_t index) {
+            return Operand(OperandKind::CONSTANT, index);
+        }
+
+        static constexpr Operand label(uint32_t index) {
+            return Operand(OperandKind::LABEL, index);
+        }
+
+        static constexpr Operand count(uint32_t value) {
+            return Operand(OperandKind::COUNT, value);
+        }
+
+        static constexpr Operand value(uint32_t index) {
+            return Operand(OperandKind::VALUE, index);
+        }
+
+        constexpr OperandKind getKind() const {
+            return static_cast<OperandKind>(bits >> INDEX_BITS);
+        }
+
+        constexpr uint32_t getIndex() const {
+            return bits & INDEX_MASK;
+        }
+
+        constexpr bool isNone() const {
+            return bits == 0;
+        }
+
+        // Distinct for distinct operands, for use as a key
+        constexpr uint32_t getBits() const {
+            return bits;
+        }
+
+        constexpr bool operator==(const Operand&) const = default;
+};
+
+export struct IrInstruction {
+    Opcode opcode;
+    Operand arg1;
+    Operand arg2;
+    Operand result;
+};
+
+static_assert(sizeof(Operand) == 4);
+static_assert(sizeof(IrInstruction) == 16);
+
+// The operand an instruction assigns, nullptr if none. PARAM assigns the parameter it names.
+export constexpr Operand* getDefinition(IrInstruction& instruction) {
+    switch (instruction.opcode) {
+        case Opcode::PARAM:
+            return &instruction.arg1;
+        case Opcode::ASSIGN:
+        case Opcode::INDEX:
+        case Opcode::CALL:
+        case Opcode::PHI:
+            return &instruction.result;
+        default:
+            return isBinaryOpcode(instruction.opcode) || isUnaryOpcode(instruction.opcode) ? &instruction.result : nullptr;
+    }
+}
+
+export constexpr const Operand* getDefinition(const IrInstruction& instruction) {
+    return getDefinition(const_cast<IrInstruction&>(instruction));
+}
+
+// Whether the first and second arguments are values the instruction reads. The arguments of a
+// PHI are kept apart from the instruction, and INDEX reads the array named by its first argument.
+// INDEX_STORE reads both arguments and writes the array named by its result, which is not a
+// definition of a variable.
+export constexpr bool readsArg1(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::ASSIGN:
+        case Opcode::INDEX:
+        case Opcode::INDEX_STORE:
+        case Opcode::IF:
+        case Opcode::PUSH:
+        case Opcode::RETURN:
+            return true;
+        default:
+            return isBinaryOpcode(opcode) || isUnaryOpcode(opcode);
+    }
+}
+
+export constexpr bool readsArg2(Opcode opcode) {
+    return opcode == Opcode::INDEX || opcode == Opcode::INDEX_STORE || isBinaryOpcode(opcode);
+}
+
+// Whether control never continues to the next instruction
+export constexpr bool isUnconditionalJump(Opcode opcode) {
+    return opcode == Opcode::GOTO || opcode == Opcode::RETURN || opcode == Opcode::ENDFUNC;
+}
+
+export enum class ConstantKind : uint8_t {
+    INT,
+    FLOAT,
+    STRING,
+};
+
+export struct IrConstant {
+    ConstantKind kind;
+    // As written in the source, quotes included for strings
+    std::string text;
+
+    bool operator==(const IrConstant&) const = default;
+};
+
+// A version of a variable in SSA form; version 0 is the value the variable has on entry
+export struct SsaValue {
+    Operand variable;
+    uint32_t version;
+};
+
+export class IrProgram {
+    private:
+        static constexpr uint8_t GLOBAL_NAME = 1;
+        static constexpr uint8_t ARRAY_NAME = 2;
+
+        std::vector<IrInstruction> instructions;
+        std::vector<std::string> names;
+        std::unordered_map<std::string, uint32_t> nameIds;
+        std::vector<uint8_t> nameFlags;
+        // The locals and parameters of each function, as the function's name index above the local's
+        std::unordered_set<uint64_t> localDeclarations;
+        std::vector<IrConstant> constants;
+        std::unordered_map<std::string, uint32_t> constantIds;
+        uint32_t labelCount = 0;
+        uint32_t tempCount = 0;
+        std::vector<SsaValue> values;
+        // The arguments of all PHI instructions; each refers to its own range
+        std::vector<Operand> phiArguments;
+
+    public:
+        IrProgram() {}
+
+        std::vector<IrInstruction>& getInstructions() {
+            return instructions;
+        }
+
+        const std::vector<IrInstruction>& getInstructions() const {
+            return instructions;
+        }
+
+        Operand internName(std::string_view name) {
+            const auto [nameIdIter, inserted] = nameIds.try_emplace(std::string(name), names.size());
+            if (inserted) {
+                names.emplace_back(name);
+                nameFlags.push_back(0);
+            }
+            return Operand::name(nameIdIter->second);
+        }
+
+        // A name declared outside the functions, which any function call may change
+        void markGlobal(Operand name) {
+            nameFlags[name.getIndex()] |= GLOBAL_NAME;
+        }
+
+        void markArray(Operand name) {
+            nameFlags[name.getIndex()] |= ARRAY_NAME;
+        }
+
+        // A local or parameter of the function. Its reads and writes in the function use the same name
+        // operand as a global of that name, so passes must not take the function's reads for the global's.
+        void declareLocal(Operand function, Operand name) {
+            localDeclarations.insert(static_cast<uint64_t>(function.getIndex()) << 32 | name.getIndex());
+        }
+
+        bool declaresLocal(Operand function, Operand name) const {
+            return localDeclarations.contains(static_cast<uint64_t>(function.getIndex()) << 32 | name.getIndex());
+        }
+
+        bool isGlobal(Operand name) const {
+            return (nameFlags[name.getIndex()] & GLOBAL_NAME) != 0;
+        }
+
+        bool isArray(Operand name) const {
+            return (nameFlags[name.getIndex()] & ARRAY_NAME) != 0;
+        }
+
+        // Whether the operand is a temporary or a scalar local, which only the function itself reads and writes
+        bool isLocalVariable(Operand operand) const {
+            return operand.getKind() == OperandKind::TEMP || (operand.getKind() == OperandKind::NAME && nameFlags[operand.getIndex()] == 0);
+        }
+
+        Operand newValue(Operand variable, uint32_t version) {
+            values.push_back(SsaValue{ variable, version });
+            return Operand::value(values.size() - 1);
+        }
+
+        const SsaValue& getValue(Operand value) const {
+            return values[value.getIndex()];
+        }
+
+        size_t getValueCount() const {
+            return values.size();
+        }
+
+        IrInstruction makePhi(Operand result, std::span<const Operand> arguments) {
+            const uint32_t offset = phiArguments.size();
+            phiArguments.insert(phiArguments.end(), arguments.begin(), arguments.end());
+            return IrInstruction{ Opcode::PHI, Operand::count(offset), Operand::count(arguments.size()), result };
+        }
+
+        // One per predecessor of the PHI's block, in increasing block order
+        std::span<Operand> getPhiArguments(const IrInstruction& phi) {
+            return std::span<Operand>(phiArguments).subspan(phi.arg1.getIndex(), phi.arg2.getIndex());
+        }
+
+        std::span<const Operand> getPhiArguments(const IrInstruction& phi) const {
+            return std::span<const Operand>(phiArguments).subspan(phi.arg1.getIndex(), phi.arg2.getIndex());
+        }
+
+        // Constants with the same text share an index, so equal constants are equal operands
+        Operand internConstant(ConstantKind kind, std::string_view text) {
+            const auto [constantIdIter, inserted] = constantIds.try_emplace(std::string(text), constants.size());
+            if (inserted) {
+                constants.push_back(IrConstant{ kind, std::string(text) });
+            }
+            return Operand::constant(constantIdIter->second);
+        }
+
+        Operand newLabel() {
+            return Operand::label(labelCount++);
+        }
+
+        // A temporary no instruction uses yet
+        Operand newTemp() {
+            return Operand::temp(tempCount++);
+        }
+
+        Operand temp(uint32_t index) {
+            tempCount = std::max(tempCount, index + 1);
+            return Operand::temp(index);
+        }
+
+        const std::string& getName(Operand operand) const {
+            return names[operand.getIndex()];
+        }
+
+        const IrConstant& getConstant(Operand operand) const {
+            return constants[operand.getIndex()];
+        }
+
+        size_t getNameCount() const {
+            return names.size();
+        }
+
+        size_t getConstantCount() const {
+            return constants.size();
+        }
+
+        uint32_t getLabelCount() const {
+            return labelCount;
+        }
+
+        uint32_t getTempCount() const {
+            return tempCount;
+        }
+};
+
+// The sink that IR generation appends to, in order, so each instruction is built in place once
+export class IRBuilder {
+    private:
+        IrProgram program;
+
+    public:
+        IRBuilder(size_t expectedInstructions = 0) {
+            program.getInstructions().reserve(expectedInstructions);
+        }
+
+        void emit(Opcode opcode, Operand arg1 = {}, Operand arg2 = {}, Operand result = {}) {
+            program.getInstructions().push_back(IrInstruction{ opcode, arg1, arg2, result });
+        }
+
+        void emitLabel(Operand label) {
+            emit(Opcode::LABEL, label);
+        }
+
+        Operand createLabel() {
+            return program.newLabel();
+        }
+
+        Operand temp(uint32_t index) {
+            return program.temp(index);
+        }
+
+        Operand name(std::string_view name) {
+            return program.internName(name);
+        }
+
+        Operand constant(ConstantKind kind, std::string_view text) {
+            return program.internConstant(kind, text);
+        }
+
+        void markGlobal(Operand name) {
+            program.markGlobal(name);
+        }
+
+        void markArray(Operand name) {
+            program.markArray(name);
+        }
+
+        void declareLocal(Operand function, Operand name) {
+            program.declareLocal(function, name);
+        }
+
+        const IrProgram& getProgram() const {
+            return program;
+        }
+
+        // Moves the program out, leaving the builder empty
+        IrProgram take() {
+            return std::exchange(program, IrProgram{});
+        }
+};
+
+// Renders IR in the quadruple listing format: "( op, arg1, arg2, result )" per instruction and
+// "L<n>:" per label, each on its own line
+export class IrPrinter {
+    private:
+        const IrProgram& program;
+
+    public:
+        IrPrinter(const IrProgram& program) : program(program) {}
+
+        void appendOperand(std::string& out, Operand operand) const {
+            switch (operand.getKind()) {
+                case OperandKind::NONE:
+                    break;
+                case OperandKind::TEMP:
+                    out += 't';
+                    out += std::to_string(operand.getIndex());
+                    break;
+                case OperandKind::NAME:
+                    out += program.getName(operand);
+                    break;
+                case OperandKind::CONSTANT:
+                    out += program.getConstant(operand).text;
+                    break;
+                case OperandKind::LABEL:
+                    out += 'L';
+                    out += std::to_string(operand.getIndex());
+                    break;
+                case OperandKind::COUNT:
+                    out += std::to_string(operand.getIndex());
+                    break;
+                case OperandKind::VALUE: {
+                    const auto& value = program.getValue(operand);
+                    appendOperand(out, value.variable);
+                    if (value.version > 0) {
+                        out += '.';
+                        out += std::to_string(value.version);
+                    }
+                    break;
+                }
+            }
+        }
+
+        std::string getOperandText(Operand operand) const {
+            std::string out;
+            appendOperand(out, operand);
+            return out;
+        }
+
+        // Appends the instruction without the line break
+        void appendInstruction(std::string& out, const IrInstruction& instruction) const {
+            if (instruction.opcode == Opcode::LABEL) {
+                appendOperand(out, instruction.arg1);
+                out += ':';
+                return;
+            }
+            out += "( ";
+            out += getOpcodeText(instruction.opcode);
+            out += ", ";
+            if (instruction.opcode == Opcode::PHI) {
+                // The arguments separated by spaces, in predecessor order
+                const auto arguments = program.getPhiArguments(instruction);
+                for (size_t i = 0; i < arguments.size(); i++) {
+                    if (i > 0) {
+                        out += ' ';
+                    }
+                    appendOperand(out, arguments[i]);
+                }
+                out += ", , ";
+                appendOperand(out, instruction.result);
+                out += " )";
+                return;
+            }
+            appendOperand(out, instruction.arg1);
+            out += ", ";
+            appendOperand(out, instruction.arg2);
+            out += ", ";
+            appendOperand(out, instruction.result);
+            out += " )";
+        }
+
+        std::string toString() const {
+            std::string out;
+            for (const auto& instruction : program.getInstructions()) {
+                appendInstruction(out, instruction);
+                out += '\n';
+            }
+            return out;
+        }
+
+        // Streams the listing; only the line being rendered is held in memory
+        void write(OutputWriter& out) const {
+            std::string line;
+            for (const auto& instruction : program.getInstructions()) {
+                line.clear();
+                appendInstruction(line, instruction);
+                line += '\n';
+                out.write(line);
+            }
+        }
+};
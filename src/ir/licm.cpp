@@ -0,0 +1,203 @@
+module;
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <unordered_set>
+#include <algorithm>
+
+export module licm;
+
+import ir;
+import cfg;
+import constantfold;
+
+// Loop-invariant code motion over SSA form. An instruction in a loop is invariant when everything it
+// reads is set before the loop: constants, values assigned outside the loop or by instructions
+// already found invariant, and globals the loop neither assigns nor can have a call change. Element
+// reads are only invariant in a loop without calls or element stores. Invariant operators, copies
+// and element reads are moved to the loop's preheader, the block entered just before the header, so
+// they run once instead of on every iteration.
+
+class LoopInvariantHoister {
+    private:
+        IrProgram& program;
+        std::vector<IrInstruction> instructions;
+
+        // Whether running the instruction where it may not have run can fail: a division by anything but
+        // a nonzero constant. Reading an element has no effect, so it may run ahead of its loop.
+        bool mayFail(const IrInstruction& instruction) const {
+            if (instruction.opcode != Opcode::DIV && instruction.opcode != Opcode::MOD) {
+                return false;
+            }
+            return instruction.arg2.getKind() != OperandKind::CONSTANT
+                || isTrueConstant(program.getConstant(instruction.arg2)) != true;
+        }
+
+        // The instructions of the loop that can move to its preheader, in the order they must run
+        std::vector<uint32_t> findInvariants(const ControlFlowGraph& cfg, const Loop& loop) const {
+            std::vector<bool> inLoop(cfg.size(), false);
+            for (const auto block : loop.blocks) {
+                inLoop[block] = true;
+            }
+            std::unordered_set<uint32_t> definedInLoop;
+            bool hasCall = false;
+            bool changesMemory = false;
+            std::vector<uint32_t> exits;
+            for (const auto block : loop.blocks) {
+                for (const auto& instruction : cfg.getBlockInstructions(block)) {
+                    const auto definition = getDefinition(instruction);
+                    if (definition) {
+                        definedInLoop.insert(definition->getBits());
+                    }
+                    hasCall |= instruction.opcode == Opcode::CALL;
+                    changesMemory |= instruction.opcode == Opcode::CALL || instruction.opcode == Opcode::INDEX_STORE;
+                }
+                const auto successors = cfg.getSuccessors(block);
+                if (std::any_of(successors.begin(), successors.end(), [&](uint32_t successor) { return !inLoop[successor]; })) {
+                    exits.push_back(block);
+                }
+            }
+
+            const auto isInvariant = [&](Operand operand) {
+                switch (operand.getKind()) {
+                    case OperandKind::CONSTANT:
+                        return true;
+                    case OperandKind::VALUE:
+                        return !definedInLoop.contains(operand.getBits());
+                    case OperandKind::NAME:
+                        return program.isGlobal(operand) && !hasCall && !definedInLoop.contains(operand.getBits());
+                    default:
+                        return false;
+                }
+            };
+            std::vector<uint32_t> invariants;
+            for (const auto block : cfg.getReversePostorder()) {
+                if (!inLoop[block]) {
+                    continue;
+                }
+                const bool runsEveryTime = std::all_of(exits.begin(), exits.end(), [&](uint32_t exit) { return cfg.dominates(block, exit); });
+                for (auto i = cfg.getBlockStart(block); i < cfg.getBlockEnd(block); i++) {
+                    const auto& instruction = instructions[i];
+                    const bool isMovable = instruction.opcode == Opcode::ASSIGN || isBinaryOpcode(instruction.opcode)
+                        || isUnaryOpcode(instruction.opcode) || instruction.opcode == Opcode::INDEX;
+                    if (!isMovable || instruction.result.getKind() != OperandKind::VALUE || (!runsEveryTime && mayFail(instruction))) {
+                        continue;
+                    }
+                    const bool readsInvariants = instruction.opcode == Opcode::INDEX
+                        ? !changesMemory && isInvariant(instruction.arg2)
+                        : isInvariant(instruction.arg1) && (!readsArg2(instruction.opcode) || isInvariant(instruction.arg2));
+                    if (readsInvariants) {
+                        invariants.push_back(i);
+                        // What reads the result can move along with it
+                        definedInLoop.erase(instruction.result.getBits());
+                    }
+                }
+            }
+            return invariants;
+        }
+
+        // Moves the invariants of the innermost loop that has any, returning whether there was one
+        bool hoistLoop() {
+            const ControlFlowGraph cfg(instructions);
+            std::vector<const Loop*> loops;
+            for (const auto& loop : cfg.getLoops()) {
+                loops.push_back(&loop);
+            }
+            std::stable_sort(loops.begin(), loops.end(), [](const Loop* a, const Loop* b) { return a->blocks.size() < b->blocks.size(); });
+            for (const auto loop : loops) {
+                const auto predecessors = cfg.getPredecessors(loop->header);
+                std::vector<uint32_t> entries;
+                for (const auto predecessor : predecessors) {
+                    if (cfg.isReachable(predecessor) && !std::binary_search(loop->blocks.begin(), loop->blocks.end(), predecessor)) {
+                        entries.push_back(predecessor);
+                    }
+                }
+                // The generated loops are only entered from the code before them
+                if (entries.size() != 1) {
+                    continue;
+                }
+                const auto invariants = findInvariants(cfg, *loop);
+                if (!invariants.empty()) {
+                    moveToPreheader(cfg, *loop, entries[0], invariants);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Puts the invariants at the end of the entry block when the header is its only successor.
+        // Otherwise they go on a new block on the edge: right after the entry when it falls through
+        // to the header, or before the ENDFUNC with a jump to the header when it branches there.
+        void moveToPreheader(const ControlFlowGraph& cfg, const Loop& loop, uint32_t entry, const std::vector<uint32_t>& invariants) {
+            std::vector<bool> isInvariant(instructions.size(), false);
+            std::vector<IrInstruction> preheader;
+            for (const auto i : invariants) {
+                isInvariant[i] = true;
+                preheader.push_back(instructions[i]);
+            }
+
+            const auto entryEnd = cfg.getBlockEnd(entry);
+            const auto& last = instructions[entryEnd - 1];
+            auto insertAt = entryEnd;
+            bool onEdgeBlock = false;
+            if (cfg.getSuccessors(entry).size() == 1) {
+                if (last.opcode == Opcode::GOTO || last.opcode == Opcode::IF) {
+                    insertAt = entryEnd - 1;
+                }
+            } else if (last.opcode == Opcode::IF && last.result == instructions[cfg.getBlockStart(loop.header)].arg1) {
+                onEdgeBlock = true;
+                const auto label = program.newLabel();
+                preheader.insert(preheader.begin(), IrInstruction{ Opcode::LABEL, label, {}, {} });
+                preheader.push_back(IrInstruction{ Opcode::GOTO, {}, {}, last.result });
+                instructions[entryEnd - 1].result = label;
+                // The new block is the header's last predecessor, so the phis take its argument last
+                const auto predecessors = cfg.getPredecessors(loop.header);
+                const auto position = std::find(predecessors.begin(), predecessors.end(), entry) - predecessors.begin();
+                for (auto i = cfg.getBlockStart(loop.header); i < cfg.getBlockEnd(loop.header); i++) {
+                    if (instructions[i].opcode == Opcode::PHI) {
+                        const auto arguments = program.getPhiArguments(instructions[i]);
+                        std::vector<Operand> reordered(arguments.begin(), arguments.end());
+                        std::rotate(reordered.begin() + position, reordered.begin() + position + 1, reordered.end());
+                        instructions[i] = program.makePhi(instructions[i].result, reordered);
+                    }
+                }
+            }
+
+            std::vector<IrInstruction> output;
+            output.reserve(instructions.size() + preheader.size() + 1);
+            for (uint32_t i = 0; i < instructions.size(); i++) {
+                if (i == insertAt && !onEdgeBlock) {
+                    output.insert(output.end(), preheader.begin(), preheader.end());
+                }
+                if (onEdgeBlock && i + 1 == instructions.size()) {
+                    if (output.back().opcode != Opcode::GOTO && output.back().opcode != Opcode::RETURN) {
+                        output.push_back(IrInstruction{ Opcode::RETURN, {}, {}, {} });
+                    }
+                    output.insert(output.end(), preheader.begin(), preheader.end());
+                }
+                if (!isInvariant[i]) {
+                    output.push_back(instructions[i]);
+                }
+            }
+            instructions = std::move(output);
+        }
+
+    public:
+        LoopInvariantHoister(IrProgram& program, std::span<const IrInstruction> function)
+            : program(program), instructions(function.begin(), function.end()) {}
+
+        void run(std::vector<IrInstruction>& output) {
+            while (hoistLoop()) {}
+            output.insert(output.end(), instructions.begin(), instructions.end());
+        }
+};
+
+// Moves the loop-invariant computations of every function out of their loops, innermost loops first,
+// so an invariant of nested loops ends up before the outermost loop it does not depend on. The
+// program must be in SSA form.
+export void hoistLoopInvariants(IrProgram& program) {
+    transformFunctions(program, [&](std::span<const IrInstruction> function, std::vector<IrInstruction>& output) {
+        LoopInvariantHoister(program, function).run(output);
+    });
+}
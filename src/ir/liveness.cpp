@@ -0,0 +1,183 @@
+module;
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <unordered_map>
+#include <algorithm>
+#include <bit>
+
+export module liveness;
+
+import ir;
+import cfg;
+
+// A set of the variables of one function, numbered from zero
+export class VariableSet {
+    private:
+        std::vector<uint64_t> words;
+
+    public:
+        VariableSet(size_t size = 0) : words((size + 63) / 64) {}
+
+        void insert(uint32_t variable) {
+            words[variable / 64] |= uint64_t(1) << variable % 64;
+        }
+
+        void erase(uint32_t variable) {
+            words[variable / 64] &= ~(uint64_t(1) << variable % 64);
+        }
+
+        bool contains(uint32_t variable) const {
+            return (words[variable / 64] >> variable % 64 & 1) != 0;
+        }
+
+        // Adds the variables of other that are not in excluded, returning whether any was new
+        bool insertAll(const VariableSet& other, const VariableSet* excluded = nullptr) {
+            bool changed = false;
+            for (size_t i = 0; i < words.size(); i++) {
+                const auto added = other.words[i] & ~(excluded ? excluded->words[i] : 0) & ~words[i];
+                words[i] |= added;
+                changed |= added != 0;
+            }
+            return changed;
+        }
+
+        template<typename Visit>
+        void forEach(Visit&& visit) const {
+            for (size_t i = 0; i < words.size(); i++) {
+                for (auto word = words[i]; word != 0; word &= word - 1) {
+                    visit(uint32_t(i * 64 + std::countr_zero(word)));
+                }
+            }
+        }
+};
+
+// The PHI instructions at the start of a block, after its label
+export std::span<const IrInstruction> getPhis(const ControlFlowGraph& cfg, uint32_t block) {
+    const auto instructions = cfg.getBlockInstructions(block);
+    const size_t begin = !instructions.empty() && instructions[0].opcode == Opcode::LABEL ? 1 : 0;
+    size_t end = begin;
+    while (end < instructions.size() && instructions[end].opcode == Opcode::PHI) {
+        end++;
+    }
+    return instructions.subspan(begin, end - begin);
+}
+
+// The argument each phi of the successor takes when entered from the block
+export std::vector<Operand> getPhiArguments(const IrProgram& program, const ControlFlowGraph& cfg, uint32_t block, uint32_t successor) {
+    const auto predecessors = cfg.getPredecessors(successor);
+    const auto position = std::find(predecessors.begin(), predecessors.end(), block) - predecessors.begin();
+    std::vector<Operand> arguments;
+    for (const auto& phi : getPhis(cfg, successor)) {
+        arguments.push_back(program.getPhiArguments(phi)[position]);
+    }
+    return arguments;
+}
+
+// The variables live into and out of each reachable block of a function. The variables are the
+// ones only the function sees: temporaries, scalar locals and SSA values, numbered in order of
+// appearance. A phi's result is assigned on entry to its block and its arguments are read at the
+// end of the predecessors they come from.
+export class LiveVariables {
+    private:
+        const IrProgram& program;
+        std::unordered_map<uint32_t, uint32_t> variableIds;
+        std::vector<Operand> variables;
+        std::vector<VariableSet> liveIn;
+        std::vector<VariableSet> liveOut;
+
+        void addVariable(Operand operand) {
+            if (isVariable(operand) && variableIds.try_emplace(operand.getBits(), variables.size()).second) {
+                variables.push_back(operand);
+            }
+        }
+
+    public:
+        LiveVariables(const IrProgram& program, const ControlFlowGraph& cfg) : program(program) {
+            const auto blockCount = cfg.size();
+            for (uint32_t block = 0; block < blockCount; block++) {
+                for (const auto& instruction : cfg.getBlockInstructions(block)) {
+                    addVariable(instruction.arg1);
+                    addVariable(instruction.arg2);
+                    addVariable(instruction.result);
+                    if (instruction.opcode == Opcode::PHI) {
+                        for (const auto argument : program.getPhiArguments(instruction)) {
+                            addVariable(argument);
+                        }
+                    }
+                }
+            }
+
+            std::vector<VariableSet> upwardExposed(blockCount, VariableSet(size()));
+            std::vector<VariableSet> definitions(blockCount, VariableSet(size()));
+            std::vector<VariableSet> phiUses(blockCount, VariableSet(size()));
+            for (const auto block : cfg.getReversePostorder()) {
+                const auto use = [&](Operand operand) {
+                    if (isVariable(operand) && !definitions[block].contains(getId(operand))) {
+                        upwardExposed[block].insert(getId(operand));
+                    }
+                };
+                for (const auto& instruction : cfg.getBlockInstructions(block)) {
+                    if (readsArg1(instruction.opcode)) {
+                        use(instruction.arg1);
+                    }
+                    if (readsArg2(instruction.opcode)) {
+                        use(instruction.arg2);
+                    }
+                    const auto definition = getDefinition(instruction);
+                    if (definition && isVariable(*definition)) {
+                        definitions[block].insert(getId(*definition));
+                    }
+                }
+                for (const auto successor : cfg.getSuccessors(block)) {
+                    for (const auto argument : getPhiArguments(program, cfg, block, successor)) {
+                        if (isVariable(argument)) {
+                            phiUses[block].insert(getId(argument));
+                        }
+                    }
+                }
+            }
+
+            liveIn.assign(blockCount, VariableSet(size()));
+            liveOut.assign(blockCount, VariableSet(size()));
+            const auto& order = cfg.getReversePostorder();
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (auto iter = order.rbegin(); iter != order.rend(); ++iter) {
+                    const auto block = *iter;
+                    changed |= liveOut[block].insertAll(phiUses[block]);
+                    for (const auto successor : cfg.getSuccessors(block)) {
+                        changed |= liveOut[block].insertAll(liveIn[successor]);
+                    }
+                    changed |= liveIn[block].insertAll(upwardExposed[block]);
+                    changed |= liveIn[block].insertAll(liveOut[block], &definitions[block]);
+                }
+            }
+        }
+
+        bool isVariable(Operand operand) const {
+            return operand.getKind() == OperandKind::VALUE || program.isLocalVariable(operand);
+        }
+
+        uint32_t getId(Operand variable) const {
+            return variableIds.at(variable.getBits());
+        }
+
+        Operand getVariable(uint32_t id) const {
+            return variables[id];
+        }
+
+        size_t size() const {
+            return variables.size();
+        }
+
+        const VariableSet& getLiveIn(uint32_t block) const {
+            return liveIn[block];
+        }
+
+        const VariableSet& getLiveOut(uint32_t block) const {
+            return liveOut[block];
+        }
+};
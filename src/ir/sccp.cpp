@@ -0,0 +1,345 @@
+module;
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+export module sccp;
+
+import ir;
+import cfg;
+import constantfold;
+
+// Sparse conditional constant propagation (Wegman and Zadeck) over SSA form. Each value starts as
+// unknown and is lowered to a constant or to varying; only blocks reached along edges found
+// executable are evaluated, and a phi only meets the arguments of executable edges. A value is then
+// known even when it is only constant on the paths that can run, such as a variable that a dead
+// branch would have changed.
+
+enum class LatticeState : uint8_t {
+    UNKNOWN,
+    CONSTANT,
+    VARYING,
+};
+
+struct LatticeValue {
+    LatticeState state = LatticeState::UNKNOWN;
+    Operand constant;
+
+    bool operator==(const LatticeValue&) const = default;
+};
+
+static LatticeValue meet(const LatticeValue& a, const LatticeValue& b) {
+    if (a.state == LatticeState::UNKNOWN) {
+        return b;
+    }
+    if (b.state == LatticeState::UNKNOWN || a == b) {
+        return a;
+    }
+    return LatticeValue{ LatticeState::VARYING, {} };
+}
+
+class ConditionalConstantPropagator {
+    private:
+        static constexpr LatticeValue VARYING{ LatticeState::VARYING, {} };
+
+        IrProgram& program;
+        const std::unordered_map<uint32_t, Operand>& globalConstants;
+        std::vector<IrInstruction> instructions;
+        ControlFlowGraph cfg;
+
+        std::unordered_map<uint32_t, uint32_t> valueIds;
+        std::vector<LatticeValue> values;
+        // The instructions reading each value, phis included
+        std::vector<std::vector<uint32_t>> uses;
+
+        std::vector<bool> executableBlocks;
+        std::unordered_set<uint64_t> executableEdges;
+        std::vector<std::pair<uint32_t, uint32_t>> edgeWorklist;
+        std::vector<uint32_t> valueWorklist;
+
+        static uint64_t getEdgeKey(uint32_t from, uint32_t to) {
+            return uint64_t(from) << 32 | to;
+        }
+
+        bool isExecutable(uint32_t from, uint32_t to) const {
+            return executableEdges.contains(getEdgeKey(from, to));
+        }
+
+        uint32_t getValueId(Operand value) {
+            const auto [iter, inserted] = valueIds.try_emplace(value.getIndex(), values.size());
+            if (inserted) {
+                values.emplace_back();
+                uses.emplace_back();
+            }
+            return iter->second;
+        }
+
+        LatticeValue getLatticeValue(Operand operand) const {
+            switch (operand.getKind()) {
+                case OperandKind::CONSTANT:
+                    return LatticeValue{ LatticeState::CONSTANT, operand };
+                case OperandKind::VALUE:
+                    return values[valueIds.at(operand.getIndex())];
+                case OperandKind::NAME:
+                    if (const auto global = globalConstants.find(operand.getBits());
+                        global != globalConstants.end() && !program.declaresLocal(instructions.front().arg1, operand)) {
+                        return LatticeValue{ LatticeState::CONSTANT, global->second };
+                    }
+                    return VARYING;
+                default:
+                    return VARYING;
+            }
+        }
+
+        void collectUses() {
+            std::vector<bool> defined;
+            for (uint32_t i = 0; i < instructions.size(); i++) {
+                const auto& instruction = instructions[i];
+                const auto use = [&](Operand operand) {
+                    if (operand.getKind() == OperandKind::VALUE) {
+                        uses[getValueId(operand)].push_back(i);
+                    }
+                };
+                if (instruction.opcode == Opcode::PHI) {
+                    for (const auto argument : program.getPhiArguments(instruction)) {
+                        use(argument);
+                    }
+                } else {
+                    if (readsArg1(instruction.opcode)) {
+                        use(instruction.arg1);
+                    }
+                    if (readsArg2(instruction.opcode)) {
+                        use(instruction.arg2);
+                    }
+                }
+                const auto definition = getDefinition(instruction);
+                if (definition && definition->getKind() == OperandKind::VALUE) {
+                    const auto id = getValueId(*definition);
+                    defined.resize(values.size());
+                    defined[id] = true;
+                }
+            }
+            // A value read without an assignment is the variable's value on entry, which is not known
+            defined.resize(values.size());
+            for (uint32_t id = 0; id < values.size(); id++) {
+                if (!defined[id]) {
+                    values[id] = VARYING;
+                }
+            }
+        }
+
+        LatticeValue evaluatePhi(const IrInstruction& phi, uint32_t block) const {
+            const auto predecessors = cfg.getPredecessors(block);
+            const auto arguments = program.getPhiArguments(phi);
+            LatticeValue result;
+            for (size_t i = 0; i < predecessors.size(); i++) {
+                if (isExecutable(predecessors[i], block)) {
+                    result = meet(result, getLatticeValue(arguments[i]));
+                }
+            }
+            return result;
+        }
+
+        LatticeValue evaluateOperator(const IrInstruction& instruction) {
+            const auto left = getLatticeValue(instruction.arg1);
+            const auto right = isBinaryOpcode(instruction.opcode) ? getLatticeValue(instruction.arg2) : left;
+            if (left.state == LatticeState::VARYING || right.state == LatticeState::VARYING) {
+                return VARYING;
+            }
+            if (left.state == LatticeState::UNKNOWN || right.state == LatticeState::UNKNOWN) {
+                return LatticeValue{};
+            }
+            const auto result = isBinaryOpcode(instruction.opcode)
+                ? foldBinary(instruction.opcode, program.getConstant(left.constant), program.getConstant(right.constant))
+                : foldUnary(instruction.opcode, program.getConstant(left.constant));
+            if (!result) {
+                return VARYING;
+            }
+            return LatticeValue{ LatticeState::CONSTANT, program.internConstant(result->kind, result->text) };
+        }
+
+        void addEdge(uint32_t from, uint32_t to) {
+            if (!isExecutable(from, to)) {
+                edgeWorklist.emplace_back(from, to);
+            }
+        }
+
+        void addBranchEdges(uint32_t block, const IrInstruction& branch) {
+            const auto successors = cfg.getSuccessors(block);
+            if (successors.size() == 1) {
+                addEdge(block, successors[0]);
+                return;
+            }
+            const auto condition = getLatticeValue(branch.arg1);
+            if (condition.state == LatticeState::UNKNOWN) {
+                return;
+            }
+            const auto taken = condition.state == LatticeState::CONSTANT ? isTrueConstant(program.getConstant(condition.constant)) : std::nullopt;
+            if (!taken.has_value() || *taken) {
+                addEdge(block, successors[0]);
+            }
+            if (!taken.has_value() || !*taken) {
+                addEdge(block, successors[1]);
+            }
+        }
+
+        void evaluate(uint32_t index, uint32_t block) {
+            const auto& instruction = instructions[index];
+            if (instruction.opcode == Opcode::IF) {
+                addBranchEdges(block, instruction);
+                return;
+            }
+            const auto definition = getDefinition(instruction);
+            if (!definition || definition->getKind() != OperandKind::VALUE) {
+                return;
+            }
+            LatticeValue result = VARYING;
+            if (instruction.opcode == Opcode::PHI) {
+                result = evaluatePhi(instruction, block);
+            } else if (instruction.opcode == Opcode::ASSIGN) {
+                result = getLatticeValue(instruction.arg1);
+            } else if (isBinaryOpcode(instruction.opcode) || isUnaryOpcode(instruction.opcode)) {
+                result = evaluateOperator(instruction);
+            }
+            const auto id = valueIds.at(definition->getIndex());
+            const auto lowered = meet(values[id], result);
+            if (lowered != values[id]) {
+                values[id] = lowered;
+                valueWorklist.push_back(id);
+            }
+        }
+
+        void visitBlock(uint32_t block) {
+            for (auto i = cfg.getBlockStart(block); i < cfg.getBlockEnd(block); i++) {
+                evaluate(i, block);
+            }
+            if (instructions[cfg.getBlockEnd(block) - 1].opcode != Opcode::IF) {
+                for (const auto successor : cfg.getSuccessors(block)) {
+                    addEdge(block, successor);
+                }
+            }
+        }
+
+        void propagate() {
+            executableBlocks.assign(cfg.size(), false);
+            if (cfg.size() > 0) {
+                executableBlocks[0] = true;
+                visitBlock(0);
+            }
+            while (!edgeWorklist.empty() || !valueWorklist.empty()) {
+                if (!edgeWorklist.empty()) {
+                    const auto [from, to] = edgeWorklist.back();
+                    edgeWorklist.pop_back();
+                    if (!executableEdges.insert(getEdgeKey(from, to)).second) {
+                        continue;
+                    }
+                    if (!executableBlocks[to]) {
+                        executableBlocks[to] = true;
+                        visitBlock(to);
+                        continue;
+                    }
+                    // Only the phis depend on which edges enter the block
+                    for (auto i = cfg.getBlockStart(to); i < cfg.getBlockEnd(to); i++) {
+                        if (instructions[i].opcode == Opcode::PHI) {
+                            evaluate(i, to);
+                        }
+                    }
+                    continue;
+                }
+                const auto id = valueWorklist.back();
+                valueWorklist.pop_back();
+                for (const auto use : uses[id]) {
+                    const auto block = cfg.getBlockOf(use);
+                    if (executableBlocks[block]) {
+                        evaluate(use, block);
+                    }
+                }
+            }
+        }
+
+        Operand replaceConstant(Operand operand) const {
+            const auto value = getLatticeValue(operand);
+            return value.state == LatticeState::CONSTANT ? value.constant : operand;
+        }
+
+        // Appends the block with the constants substituted, its phis reduced to the executable edges
+        // and its branch folded when the condition is known
+        void rewriteBlock(uint32_t block, std::vector<IrInstruction>& output) {
+            for (auto i = cfg.getBlockStart(block); i < cfg.getBlockEnd(block); i++) {
+                auto instruction = instructions[i];
+                if (instruction.opcode == Opcode::PHI) {
+                    // Every read of a constant phi is replaced, so the phi goes. So are the arguments
+                    // of the others, which may be such a phi.
+                    if (getLatticeValue(instruction.result).state == LatticeState::CONSTANT) {
+                        continue;
+                    }
+                    const auto predecessors = cfg.getPredecessors(block);
+                    const auto arguments = program.getPhiArguments(instruction);
+                    std::vector<Operand> executableArguments;
+                    for (size_t p = 0; p < predecessors.size(); p++) {
+                        if (isExecutable(predecessors[p], block)) {
+                            executableArguments.push_back(replaceConstant(arguments[p]));
+                        }
+                    }
+                    // With one predecessor left, every phi of the block is a plain copy
+                    output.push_back(executableArguments.size() == 1
+                        ? IrInstruction{ Opcode::ASSIGN, executableArguments[0], {}, instruction.result }
+                        : program.makePhi(instruction.result, executableArguments));
+                    continue;
+                }
+                if (readsArg1(instruction.opcode)) {
+                    instruction.arg1 = replaceConstant(instruction.arg1);
+                }
+                if (readsArg2(instruction.opcode)) {
+                    instruction.arg2 = replaceConstant(instruction.arg2);
+                }
+                const auto definition = getDefinition(instruction);
+                if (definition && (isBinaryOpcode(instruction.opcode) || isUnaryOpcode(instruction.opcode))) {
+                    const auto result = getLatticeValue(*definition);
+                    if (result.state == LatticeState::CONSTANT) {
+                        instruction = IrInstruction{ Opcode::ASSIGN, result.constant, {}, instruction.result };
+                    }
+                }
+                if (instruction.opcode == Opcode::IF && instruction.arg1.getKind() == OperandKind::CONSTANT) {
+                    const auto taken = isTrueConstant(program.getConstant(instruction.arg1));
+                    if (taken.has_value()) {
+                        if (*taken) {
+                            output.push_back(IrInstruction{ Opcode::GOTO, {}, {}, instruction.result });
+                        }
+                        continue;
+                    }
+                }
+                output.push_back(instruction);
+            }
+        }
+
+    public:
+        ConditionalConstantPropagator(IrProgram& program, std::span<const IrInstruction> function, const std::unordered_map<uint32_t, Operand>& globalConstants)
+            : program(program), globalConstants(globalConstants), instructions(function.begin(), function.end()), cfg(function) {}
+
+        void run(std::vector<IrInstruction>& output) {
+            collectUses();
+            propagate();
+            for (uint32_t block = 0; block < cfg.size(); block++) {
+                if (executableBlocks[block]) {
+                    rewriteBlock(block, output);
+                } else if (cfg.getBlockEnd(block) == instructions.size()) {
+                    output.push_back(instructions.back());
+                }
+            }
+        }
+};
+
+// Replaces the values that are constant on every executable path, folds the branches whose
+// condition is then known and removes the blocks that cannot run. The program must be in SSA form;
+// the assignments of constant values stay for dead code elimination to remove.
+export void propagateConditionalConstants(IrProgram& program) {
+    const auto globalConstants = foldGlobalCode(program);
+    transformFunctions(program, [&](std::span<const IrInstruction> function, std::vector<IrInstruction>& output) {
+        ConditionalConstantPropagator(program, function, globalConstants).run(output);
+    });
+}
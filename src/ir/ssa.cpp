@@ -0,0 +1,455 @@
+module;
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <unordered_map>
+#include <algorithm>
+#include <utility>
+
+export module ssa;
+
+import ir;
+import cfg;
+import liveness;
+
+// Static single assignment form: every temporary and scalar local is split into values that are each
+// assigned once, and where control flow joins, a PHI picks the value from the predecessor the block
+// was entered from. Globals and arrays keep their names, since calls and element stores change them
+// behind the function's back.
+
+// The reachable predecessors of a block, which are the predecessors it keeps in SSA form
+static std::vector<uint32_t> getReachablePredecessors(const ControlFlowGraph& cfg, uint32_t block) {
+    std::vector<uint32_t> result;
+    for (const auto predecessor : cfg.getPredecessors(block)) {
+        if (cfg.isReachable(predecessor)) {
+            result.push_back(predecessor);
+        }
+    }
+    return result;
+}
+
+// Converts one function following Cytron et al.: phis go on the iterated dominance frontier of the
+// blocks assigning a variable, and a walk of the dominator tree renames every assignment to a new
+// value. Only variables read in some block before being assigned there get phis (semi-pruned form).
+// Unreachable blocks are dropped.
+class SsaConstructor {
+    private:
+        IrProgram& program;
+        std::vector<IrInstruction> instructions;
+        ControlFlowGraph cfg;
+
+        std::unordered_map<uint32_t, uint32_t> variableIds;
+        std::vector<Operand> variables;
+        // The blocks assigning each variable
+        std::vector<std::vector<uint32_t>> definitionBlocks;
+        // Whether each variable is read in a block before being assigned there
+        std::vector<bool> crossesBlocks;
+
+        // Per block, the variable of each phi, its result and its arguments in predecessor order
+        std::vector<std::vector<uint32_t>> phiVariables;
+        std::vector<std::vector<Operand>> phiResults;
+        std::vector<std::vector<std::vector<Operand>>> phiArguments;
+
+        std::vector<std::vector<Operand>> valueStacks;
+        std::vector<uint32_t> versions;
+        std::vector<Operand> entryValues;
+        // The variables whose stacks were pushed, to pop them when the walk leaves a block
+        std::vector<uint32_t> pushed;
+
+        uint32_t getVariableId(Operand operand) {
+            const auto [iter, inserted] = variableIds.try_emplace(operand.getBits(), variables.size());
+            if (inserted) {
+                variables.push_back(operand);
+                definitionBlocks.emplace_back();
+                crossesBlocks.push_back(false);
+            }
+            return iter->second;
+        }
+
+        void collectVariables() {
+            std::vector<uint32_t> lastDefinitionBlocks;
+            const auto use = [&](Operand operand, uint32_t block) {
+                if (!program.isLocalVariable(operand)) {
+                    return;
+                }
+                const auto id = getVariableId(operand);
+                lastDefinitionBlocks.resize(variables.size(), NO_BLOCK);
+                if (lastDefinitionBlocks[id] != block) {
+                    crossesBlocks[id] = true;
+                }
+            };
+            for (const auto block : cfg.getReversePostorder()) {
+                for (const auto& instruction : cfg.getBlockInstructions(block)) {
+                    if (readsArg1(instruction.opcode)) {
+                        use(instruction.arg1, block);
+                    }
+                    if (readsArg2(instruction.opcode)) {
+                        use(instruction.arg2, block);
+                    }
+                    const auto definition = getDefinition(instruction);
+                    if (definition && program.isLocalVariable(*definition)) {
+                        const auto id = getVariableId(*definition);
+                        lastDefinitionBlocks.resize(variables.size(), NO_BLOCK);
+                        if (lastDefinitionBlocks[id] != block) {
+                            lastDefinitionBlocks[id] = block;
+                            definitionBlocks[id].push_back(block);
+                        }
+                    }
+                }
+            }
+        }
+
+        std::vector<std::vector<uint32_t>> getDominanceFrontiers() const {
+            std::vector<std::vector<uint32_t>> frontiers(cfg.size());
+            for (const auto block : cfg.getReversePostorder()) {
+                const auto predecessors = getReachablePredecessors(cfg, block);
+                if (predecessors.size() < 2) {
+                    continue;
+                }
+                for (const auto predecessor : predecessors) {
+                    for (auto runner = predecessor; runner != cfg.getImmediateDominator(block); runner = cfg.getImmediateDominator(runner)) {
+                        if (frontiers[runner].empty() || frontiers[runner].back() != block) {
+                            frontiers[runner].push_back(block);
+                        }
+                    }
+                }
+            }
+            return frontiers;
+        }
+
+        void placePhis() {
+            const auto frontiers = getDominanceFrontiers();
+            phiVariables.resize(cfg.size());
+            std::vector<uint32_t> phiMarks(cfg.size(), UINT32_MAX);
+            std::vector<uint32_t> worklistMarks(cfg.size(), UINT32_MAX);
+            std::vector<uint32_t> worklist;
+            for (uint32_t v = 0; v < variables.size(); v++) {
+                if (!crossesBlocks[v]) {
+                    continue;
+                }
+                worklist = definitionBlocks[v];
+                for (const auto block : worklist) {
+                    worklistMarks[block] = v;
+                }
+                while (!worklist.empty()) {
+                    const auto block = worklist.back();
+                    worklist.pop_back();
+                    for (const auto frontier : frontiers[block]) {
+                        if (phiMarks[frontier] == v) {
+                            continue;
+                        }
+                        phiMarks[frontier] = v;
+                        phiVariables[frontier].push_back(v);
+                        if (worklistMarks[frontier] != v) {
+                            worklistMarks[frontier] = v;
+                            worklist.push_back(frontier);
+                        }
+                    }
+                }
+            }
+        }
+
+        Operand getCurrentValue(uint32_t v) {
+            if (!valueStacks[v].empty()) {
+                return valueStacks[v].back();
+            }
+            if (entryValues[v].isNone()) {
+                entryValues[v] = program.newValue(variables[v], 0);
+            }
+            return entryValues[v];
+        }
+
+        Operand defineValue(uint32_t v) {
+            const auto value = program.newValue(variables[v], ++versions[v]);
+            valueStacks[v].push_back(value);
+            pushed.push_back(v);
+            return value;
+        }
+
+        void renameUse(Operand& operand) {
+            if (program.isLocalVariable(operand)) {
+                operand = getCurrentValue(variableIds.at(operand.getBits()));
+            }
+        }
+
+        void renameBlock(uint32_t block) {
+            for (size_t i = 0; i < phiVariables[block].size(); i++) {
+                phiResults[block][i] = defineValue(phiVariables[block][i]);
+            }
+            for (auto i = cfg.getBlockStart(block); i < cfg.getBlockEnd(block); i++) {
+                auto& instruction = instructions[i];
+                if (readsArg1(instruction.opcode)) {
+                    renameUse(instruction.arg1);
+                }
+                if (readsArg2(instruction.opcode)) {
+                    renameUse(instruction.arg2);
+                }
+                const auto definition = getDefinition(instruction);
+                if (definition && program.isLocalVariable(*definition)) {
+                    *definition = defineValue(variableIds.at(definition->getBits()));
+                }
+            }
+            for (const auto successor : cfg.getSuccessors(block)) {
+                const auto predecessors = getReachablePredecessors(cfg, successor);
+                const auto position = std::find(predecessors.begin(), predecessors.end(), block) - predecessors.begin();
+                for (size_t i = 0; i < phiVariables[successor].size(); i++) {
+                    phiArguments[successor][i][position] = getCurrentValue(phiVariables[successor][i]);
+                }
+            }
+        }
+
+        void rename() {
+            phiResults.resize(cfg.size());
+            phiArguments.resize(cfg.size());
+            for (const auto block : cfg.getReversePostorder()) {
+                phiResults[block].resize(phiVariables[block].size());
+                phiArguments[block].assign(phiVariables[block].size(), std::vector<Operand>(getReachablePredecessors(cfg, block).size()));
+            }
+            valueStacks.resize(variables.size());
+            versions.assign(variables.size(), 0);
+            entryValues.resize(variables.size());
+
+            // The block, the next dominator tree child to visit and the pushed count on entry
+            struct Frame {
+                uint32_t block;
+                uint32_t next;
+                size_t pushedCount;
+            };
+            std::vector<Frame> stack;
+            if (cfg.size() > 0) {
+                stack.push_back(Frame{ 0, 0, 0 });
+                renameBlock(0);
+            }
+            while (!stack.empty()) {
+                auto& frame = stack.back();
+                const auto children = cfg.getDominatorChildren(frame.block);
+                if (frame.next < children.size()) {
+                    const auto child = children[frame.next++];
+                    stack.push_back(Frame{ child, 0, pushed.size() });
+                    renameBlock(child);
+                    continue;
+                }
+                while (pushed.size() > frame.pushedCount) {
+                    valueStacks[pushed.back()].pop_back();
+                    pushed.pop_back();
+                }
+                stack.pop_back();
+            }
+        }
+
+    public:
+        SsaConstructor(IrProgram& program, std::span<const IrInstruction> function)
+            : program(program), instructions(function.begin(), function.end()), cfg(function) {}
+
+        void convert(std::vector<IrInstruction>& output) {
+            collectVariables();
+            placePhis();
+            rename();
+            for (uint32_t block = 0; block < cfg.size(); block++) {
+                auto i = cfg.getBlockStart(block);
+                const auto end = cfg.getBlockEnd(block);
+                if (!cfg.isReachable(block)) {
+                    if (end == instructions.size()) {
+                        output.push_back(instructions.back());
+                    }
+                    continue;
+                }
+                if (instructions[i].opcode == Opcode::LABEL) {
+                    output.push_back(instructions[i++]);
+                }
+                for (size_t p = 0; p < phiVariables[block].size(); p++) {
+                    output.push_back(program.makePhi(phiResults[block][p], phiArguments[block][p]));
+                }
+                output.insert(output.end(), instructions.begin() + i, instructions.begin() + end);
+            }
+        }
+};
+
+// Converts one function back, giving each value the storage of its variable unless it would overwrite
+// a value of the same variable that is still live, in which case it gets a new temporary. A phi becomes
+// copies at the end of its predecessors, and the copies that would be left out when the predecessor
+// branches elsewhere go on a block of their own. Phis whose arguments kept the storage of their result
+// need no copy at all.
+class SsaDestructor {
+    private:
+        IrProgram& program;
+        ControlFlowGraph cfg;
+
+        LiveVariables live;
+        // The storage of each variable of the liveness analysis, by id
+        std::vector<Operand> storages;
+
+        Operand getStorage(Operand operand) const {
+            return live.isVariable(operand) ? storages[live.getId(operand)] : operand;
+        }
+
+        // Gives the defined value a new temporary if another live value has the same storage
+        void separate(uint32_t defined, const VariableSet& liveNow) {
+            bool interferes = false;
+            liveNow.forEach([&](uint32_t other) {
+                interferes |= other != defined && storages[other] == storages[defined];
+            });
+            if (interferes) {
+                storages[defined] = program.newTemp();
+            }
+        }
+
+        // Once a value has a storage of its own it interferes with nothing, so one pass is enough
+        void assignStorages() {
+            for (const auto block : cfg.getReversePostorder()) {
+                auto liveNow = live.getLiveOut(block);
+                const auto blockInstructions = cfg.getBlockInstructions(block);
+                for (auto iter = blockInstructions.rbegin(); iter != blockInstructions.rend() && iter->opcode != Opcode::PHI; ++iter) {
+                    const auto definition = getDefinition(*iter);
+                    if (definition && live.isVariable(*definition)) {
+                        const auto defined = live.getId(*definition);
+                        if (definition->getKind() == OperandKind::VALUE) {
+                            separate(defined, liveNow);
+                        }
+                        liveNow.erase(defined);
+                    }
+                    if (readsArg1(iter->opcode) && live.isVariable(iter->arg1)) {
+                        liveNow.insert(live.getId(iter->arg1));
+                    }
+                    if (readsArg2(iter->opcode) && live.isVariable(iter->arg2)) {
+                        liveNow.insert(live.getId(iter->arg2));
+                    }
+                }
+                // The phis of a block assign their results at once, on entry
+                const auto phis = getPhis(cfg, block);
+                for (const auto& phi : phis) {
+                    liveNow.insert(live.getId(phi.result));
+                }
+                for (const auto& phi : phis) {
+                    separate(live.getId(phi.result), liveNow);
+                }
+            }
+        }
+
+        // Emits copies that happen at once as a sequence, moving a destination to a temporary first
+        // when the copies form a cycle
+        void appendParallelCopies(std::vector<std::pair<Operand, Operand>> copies, std::vector<IrInstruction>& output) {
+            std::erase_if(copies, [](const auto& copy) { return copy.first == copy.second; });
+            while (!copies.empty()) {
+                const auto ready = std::find_if(copies.begin(), copies.end(), [&](const auto& copy) {
+                    return std::none_of(copies.begin(), copies.end(), [&](const auto& other) { return other.second == copy.first; });
+                });
+                if (ready != copies.end()) {
+                    output.push_back(IrInstruction{ Opcode::ASSIGN, ready->second, {}, ready->first });
+                    copies.erase(ready);
+                    continue;
+                }
+                const auto saved = copies.front().first;
+                const auto temp = program.newTemp();
+                output.push_back(IrInstruction{ Opcode::ASSIGN, saved, {}, temp });
+                for (auto& copy : copies) {
+                    if (copy.second == saved) {
+                        copy.second = temp;
+                    }
+                }
+            }
+        }
+
+        void appendEdgeCopies(uint32_t block, uint32_t successor, std::vector<IrInstruction>& output) {
+            std::vector<std::pair<Operand, Operand>> copies;
+            const auto arguments = getPhiArguments(program, cfg, block, successor);
+            const auto phis = getPhis(cfg, successor);
+            for (size_t i = 0; i < phis.size(); i++) {
+                copies.emplace_back(getStorage(phis[i].result), getStorage(arguments[i]));
+            }
+            appendParallelCopies(std::move(copies), output);
+        }
+
+        IrInstruction replaceValues(IrInstruction instruction) const {
+            instruction.arg1 = getStorage(instruction.arg1);
+            instruction.arg2 = getStorage(instruction.arg2);
+            instruction.result = getStorage(instruction.result);
+            return instruction;
+        }
+
+    public:
+        SsaDestructor(IrProgram& program, std::span<const IrInstruction> function) : program(program), cfg(function), live(program, cfg) {
+            for (uint32_t id = 0; id < live.size(); id++) {
+                const auto variable = live.getVariable(id);
+                storages.push_back(variable.getKind() == OperandKind::VALUE ? program.getValue(variable).variable : variable);
+            }
+        }
+
+        void convert(std::vector<IrInstruction>& output) {
+            assignStorages();
+
+            // The copies for branches taken to a block with phis, placed before the ENDFUNC
+            std::vector<IrInstruction> edgeBlocks;
+            for (uint32_t block = 0; block < cfg.size(); block++) {
+                const auto blockInstructions = cfg.getBlockInstructions(block);
+                const auto successors = cfg.getSuccessors(block);
+                for (const auto& instruction : blockInstructions.first(blockInstructions.size() - 1)) {
+                    const auto replaced = replaceValues(instruction);
+                    // A copy between values that share a storage is gone
+                    if (instruction.opcode != Opcode::PHI && (instruction.opcode != Opcode::ASSIGN || replaced.arg1 != replaced.result)) {
+                        output.push_back(replaced);
+                    }
+                }
+                const auto last = replaceValues(blockInstructions.back());
+                switch (last.opcode) {
+                    case Opcode::IF: {
+                        const auto taken = successors[0];
+                        auto branch = last;
+                        if (successors.size() == 1) {
+                            // The label is also the next block, so the copies go between the two
+                            if (getPhis(cfg, taken).empty()) {
+                                output.push_back(branch);
+                                break;
+                            }
+                            branch.result = program.newLabel();
+                            output.push_back(branch);
+                            output.push_back(IrInstruction{ Opcode::LABEL, branch.result, {}, {} });
+                            appendEdgeCopies(block, taken, output);
+                            break;
+                        }
+                        if (!getPhis(cfg, taken).empty()) {
+                            branch.result = program.newLabel();
+                            edgeBlocks.push_back(IrInstruction{ Opcode::LABEL, branch.result, {}, {} });
+                            appendEdgeCopies(block, taken, edgeBlocks);
+                            edgeBlocks.push_back(IrInstruction{ Opcode::GOTO, {}, {}, last.result });
+                        }
+                        output.push_back(branch);
+                        appendEdgeCopies(block, successors[1], output);
+                        break;
+                    }
+                    case Opcode::GOTO:
+                        appendEdgeCopies(block, successors[0], output);
+                        output.push_back(last);
+                        break;
+                    case Opcode::ENDFUNC:
+                        if (!edgeBlocks.empty()) {
+                            if (output.back().opcode != Opcode::GOTO && output.back().opcode != Opcode::RETURN) {
+                                output.push_back(IrInstruction{ Opcode::RETURN, {}, {}, {} });
+                            }
+                            output.insert(output.end(), edgeBlocks.begin(), edgeBlocks.end());
+                        }
+                        output.push_back(last);
+                        break;
+                    default:
+                        output.push_back(last);
+                        if (!successors.empty()) {
+                            appendEdgeCopies(block, successors[0], output);
+                        }
+                        break;
+                }
+            }
+        }
+};
+
+export void convertToSsa(IrProgram& program) {
+    transformFunctions(program, [&](std::span<const IrInstruction> function, std::vector<IrInstruction>& output) {
+        SsaConstructor(program, function).convert(output);
+    });
+}
+
+export void convertFromSsa(IrProgram& program) {
+    transformFunctions(program, [&](std::span<const IrInstruction> function, std::vector<IrInstruction>& output) {
+        SsaDestructor(program, function).convert(output);
+    });
+}
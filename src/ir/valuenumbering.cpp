@@ -0,0 +1,266 @@
+module;
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+
+export module valuenumbering;
+
+import ir;
+import cfg;
+
+// Value numbering: operands that hold the same value get the same number, and an operator applied to
+// the same numbers as an earlier one is replaced by a copy of the earlier result. Reads are replaced
+// by the first operand still holding their number, which leaves the copies for dead code elimination.
+//
+// Element reads are numbered together with the state of memory, which changes at every call and
+// element store, so a read is only reused when no store or call came in between.
+// A call also gives every global a new number.
+
+// An operator applied to value numbers; element reads also carry the memory state they read
+struct Expression {
+    Opcode opcode;
+    uint32_t left;
+    uint32_t right;
+    uint32_t memory;
+
+    bool operator==(const Expression&) const = default;
+};
+
+struct ExpressionHash {
+    size_t operator()(const Expression& expression) const {
+        return std::hash<uint64_t>()((uint64_t(expression.left) << 32 | expression.right) * 31 + uint32_t(expression.opcode) * 7 + expression.memory);
+    }
+};
+
+// The operators whose operands can be swapped for any operand type; + also concatenates strings
+static bool isCommutative(Opcode opcode) {
+    return opcode == Opcode::MUL || opcode == Opcode::EQUAL || opcode == Opcode::NOT_EQUAL
+        || opcode == Opcode::AND || opcode == Opcode::OR;
+}
+
+// Numbers one function, either block by block or, in SSA form, along the dominator tree: a value
+// never changes once assigned, so an operator on values and constants computed in a block is also
+// available in every block it dominates. Operators on globals and element reads stay within a block,
+// except that element reads of a function that neither calls nor stores are available like the rest.
+class ValueNumberer {
+    private:
+        IrProgram& program;
+        std::vector<IrInstruction> instructions;
+        ControlFlowGraph cfg;
+        bool acrossBlocks;
+        bool memoryChanges = false;
+
+        uint32_t numberCount = 0;
+        // The first operand given each number, used to replace later operands of the same number
+        std::vector<Operand> holders;
+        // The numbers of constants and array names, which never change
+        std::unordered_map<uint32_t, uint32_t> fixedNumbers;
+        // The numbers of values and the operators on them, seen in the dominators of the block
+        std::unordered_map<uint32_t, uint32_t> scopedNumbers;
+        std::unordered_map<Expression, uint32_t, ExpressionHash> scopedExpressions;
+        std::vector<uint32_t> scopedOperands;
+        std::vector<Expression> scopedKeys;
+        // The numbers of globals, which a call changes, and of the other variables and operators seen
+        // in the block alone
+        std::unordered_map<uint32_t, uint32_t> globalNumbers;
+        std::unordered_map<uint32_t, uint32_t> localNumbers;
+        std::unordered_map<Expression, uint32_t, ExpressionHash> localExpressions;
+        uint32_t memory = 0;
+
+        bool isFixed(Operand operand) const {
+            return operand.getKind() == OperandKind::CONSTANT || (operand.getKind() == OperandKind::NAME && program.isArray(operand));
+        }
+
+        bool isScoped(Operand operand) const {
+            return acrossBlocks && operand.getKind() == OperandKind::VALUE;
+        }
+
+        bool isGlobalScalar(Operand operand) const {
+            return operand.getKind() == OperandKind::NAME && program.isGlobal(operand) && !program.isArray(operand);
+        }
+
+        std::unordered_map<uint32_t, uint32_t>& getNumbers(Operand operand) {
+            return isFixed(operand) ? fixedNumbers : isScoped(operand) ? scopedNumbers : isGlobalScalar(operand) ? globalNumbers : localNumbers;
+        }
+
+        uint32_t newNumber(Operand holder) {
+            holders.push_back(holder);
+            return numberCount++;
+        }
+
+        // The number the operand holds now, or UINT32_MAX if it was not numbered
+        uint32_t findNumber(Operand operand) {
+            const auto& numbers = getNumbers(operand);
+            const auto iter = numbers.find(operand.getBits());
+            return iter != numbers.end() ? iter->second : UINT32_MAX;
+        }
+
+        void setNumber(Operand operand, uint32_t number) {
+            if (isScoped(operand)) {
+                if (scopedNumbers.insert_or_assign(operand.getBits(), number).second) {
+                    scopedOperands.push_back(operand.getBits());
+                }
+            } else {
+                getNumbers(operand)[operand.getBits()] = number;
+            }
+            // The first holder may have been assigned another number since
+            if (findNumber(holders[number]) != number) {
+                holders[number] = operand;
+            }
+        }
+
+        // Numbers an operand read before any assignment in view, such as a parameter or a global
+        uint32_t getNumber(Operand operand) {
+            auto number = findNumber(operand);
+            if (number == UINT32_MAX) {
+                number = newNumber(operand);
+                setNumber(operand, number);
+            }
+            return number;
+        }
+
+        void replaceRead(Operand& operand) {
+            const auto holder = holders[getNumber(operand)];
+            if (findNumber(holder) == findNumber(operand)) {
+                operand = holder;
+            }
+        }
+
+        bool isScopedExpression(const IrInstruction& instruction) const {
+            if (!acrossBlocks) {
+                return false;
+            }
+            const auto isStable = [&](Operand operand) {
+                return operand.getKind() == OperandKind::VALUE || operand.getKind() == OperandKind::CONSTANT;
+            };
+            if (instruction.opcode == Opcode::INDEX) {
+                return !memoryChanges && isStable(instruction.arg2);
+            }
+            return isStable(instruction.arg1) && (isUnaryOpcode(instruction.opcode) || isStable(instruction.arg2));
+        }
+
+        void numberExpression(IrInstruction& instruction) {
+            Expression expression{ instruction.opcode, getNumber(instruction.arg1), 0, 0 };
+            if (!isUnaryOpcode(instruction.opcode)) {
+                expression.right = getNumber(instruction.arg2);
+            }
+            if (isCommutative(instruction.opcode) && expression.left > expression.right) {
+                std::swap(expression.left, expression.right);
+            }
+            if (instruction.opcode == Opcode::INDEX) {
+                expression.memory = memory;
+            }
+            const bool scoped = isScopedExpression(instruction);
+            auto& expressions = scoped ? scopedExpressions : localExpressions;
+            const auto iter = expressions.find(expression);
+            if (iter != expressions.end() && findNumber(holders[iter->second]) == iter->second) {
+                instruction = IrInstruction{ Opcode::ASSIGN, holders[iter->second], {}, instruction.result };
+                setNumber(instruction.result, iter->second);
+                return;
+            }
+            const auto number = newNumber(instruction.result);
+            if (expressions.insert_or_assign(expression, number).second && scoped) {
+                scopedKeys.push_back(expression);
+            }
+            setNumber(instruction.result, number);
+        }
+
+        void numberBlock(uint32_t block) {
+            globalNumbers.clear();
+            localNumbers.clear();
+            localExpressions.clear();
+            for (auto i = cfg.getBlockStart(block); i < cfg.getBlockEnd(block); i++) {
+                auto& instruction = instructions[i];
+                if (readsArg1(instruction.opcode) && instruction.opcode != Opcode::INDEX) {
+                    replaceRead(instruction.arg1);
+                }
+                if (readsArg2(instruction.opcode)) {
+                    replaceRead(instruction.arg2);
+                }
+                if (instruction.opcode == Opcode::ASSIGN) {
+                    setNumber(instruction.result, getNumber(instruction.arg1));
+                } else if (instruction.opcode == Opcode::INDEX || isBinaryOpcode(instruction.opcode) || isUnaryOpcode(instruction.opcode)) {
+                    numberExpression(instruction);
+                } else if (const auto definition = getDefinition(instruction)) {
+                    setNumber(*definition, newNumber(*definition));
+                }
+                if (instruction.opcode == Opcode::CALL) {
+                    memory++;
+                    globalNumbers.clear();
+                } else if (instruction.opcode == Opcode::INDEX_STORE) {
+                    memory++;
+                }
+            }
+        }
+
+        void numberDominatorTree() {
+            // The block, the next dominator tree child to visit and the scoped entry counts on entry
+            struct Frame {
+                uint32_t block;
+                uint32_t next;
+                size_t operandCount;
+                size_t keyCount;
+            };
+            std::vector<Frame> stack;
+            if (cfg.size() > 0) {
+                stack.push_back(Frame{ 0, 0, 0, 0 });
+                numberBlock(0);
+            }
+            while (!stack.empty()) {
+                auto& frame = stack.back();
+                const auto children = cfg.getDominatorChildren(frame.block);
+                if (frame.next < children.size()) {
+                    const auto child = children[frame.next++];
+                    stack.push_back(Frame{ child, 0, scopedOperands.size(), scopedKeys.size() });
+                    numberBlock(child);
+                    continue;
+                }
+                while (scopedOperands.size() > frame.operandCount) {
+                    scopedNumbers.erase(scopedOperands.back());
+                    scopedOperands.pop_back();
+                }
+                while (scopedKeys.size() > frame.keyCount) {
+                    scopedExpressions.erase(scopedKeys.back());
+                    scopedKeys.pop_back();
+                }
+                stack.pop_back();
+            }
+        }
+
+    public:
+        ValueNumberer(IrProgram& program, std::span<const IrInstruction> function, bool acrossBlocks)
+            : program(program), instructions(function.begin(), function.end()), cfg(function), acrossBlocks(acrossBlocks) {
+            for (const auto& instruction : instructions) {
+                memoryChanges |= instruction.opcode == Opcode::CALL || instruction.opcode == Opcode::INDEX_STORE;
+            }
+        }
+
+        void run(std::vector<IrInstruction>& output) {
+            if (acrossBlocks) {
+                numberDominatorTree();
+            } else {
+                for (uint32_t block = 0; block < cfg.size(); block++) {
+                    numberBlock(block);
+                }
+            }
+            output.insert(output.end(), instructions.begin(), instructions.end());
+        }
+};
+
+// Reuses the operators and element reads computed earlier in the same block. Works in or out of
+// SSA form.
+export void numberValuesLocally(IrProgram& program) {
+    transformFunctions(program, [&](std::span<const IrInstruction> function, std::vector<IrInstruction>& output) {
+        ValueNumberer(program, function, false).run(output);
+    });
+}
+
+// Also reuses the operators on values computed in a dominating block. The program must be in SSA form.
+export void numberValuesGlobally(IrProgram& program) {
+    transformFunctions(program, [&](std::span<const IrInstruction> function, std::vector<IrInstruction>& output) {
+        ValueNumberer(program, function, true).run(output);
+    });
+}
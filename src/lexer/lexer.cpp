@@ -4,15 +4,14 @@ module;
 #include <string>
 #include <string_view>
 #include <variant>
-#include <sstream>
 #include <memory>
-#include <numeric>
 #include <algorithm>
 
 export module lexer;
 
 import token;
 import tokenacceptor;
+import outputwriter;
 
 export using LexerError = std::string;
 
@@ -80,14 +79,49 @@ export class Lexer {
             return tokens;
         }
 
+        // The tokens as "<value, type>" separated by commas
         std::string getPrintString(const std::vector<Token>& tokens) const {
-            if (tokens.empty()) {
-                return "";
+            std::string printString;
+            for (const auto& token : tokens) {
+                if (!printString.empty()) {
+                    printString += ", ";
+                }
+                printString += '<';
+                printString += token.getValue();
+                printString += ", ";
+                printString += token.getTypeName();
+                printString += '>';
+            }
+            return printString;
+        }
+
+        // Writes the print string without building it first
+        void writePrintString(const std::vector<Token>& tokens, OutputWriter& out) const {
+            for (size_t i = 0; i < tokens.size(); i++) {
+                if (i > 0) {
+                    out.write(", ");
+                }
+                out.put('<');
+                out.write(tokens[i].getValue());
+                out.write(", ");
+                out.write(tokens[i].getTypeName());
+                out.put('>');
+            }
+        }
+
+        // Writes each token as "id type value positionNumber position ", the format Token::fromFile reads
+        void writeTokenFile(const std::vector<Token>& tokens, OutputWriter& out) const {
+            for (const auto& token : tokens) {
+                out.writeNumber(token.getId());
+                out.put(' ');
+                out.writeNumber(token.getType());
+                out.put(' ');
+                out.write(token.getValue());
+                out.put(' ');
+                out.writeNumber(token.getPositionNumber());
+                out.put(' ');
+                out.write(token.getPosition());
+                out.put(' ');
             }
-            std::ostringstream oss;
-            oss << std::accumulate(tokens.begin() + 1, tokens.end(), tokens[0].toStringPrint(), [](const std::string& acc, const Token& token) {
-                return acc + ", " + token.toStringPrint();
-            });
-            return oss.str();
         }
 };
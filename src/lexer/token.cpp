@@ -1,6 +1,7 @@
 module;
 
 #include <string>
+#include <string_view>
 #include <map>
 #include <vector>
 #include <iostream>
@@ -29,18 +30,28 @@ const std::map<TokenType, std::string_view> tokenTypeNamesMap {
 
 export class Token {
     private:
-        const int id;
-        const TokenType type;
-        const std::string value;
-        const int positionNumber;
-        const std::string position;
+        // Not const, so that moving a token does not copy its strings
+        int id;
+        TokenType type;
+        std::string value;
+        int positionNumber;
+        std::string position;
 
     public:
         Token(int id, TokenType type, std::string_view value, int positionNumber, std::string position)
             : value(value), type(type), id(id), positionNumber(positionNumber), position(position) {}
 
+        Token(const Token&) = default;
+        // Lets vectors of parse tree nodes holding tokens move their subtrees when growing instead of
+        // copying them
+        Token(Token&&) noexcept = default;
+
         std::string toStringPrint() const {
-            return "<" + value + ", " + std::string(tokenTypeNamesMap.at(type)) + ">";
+            return "<" + value + ", " + std::string(getTypeName()) + ">";
+        }
+
+        std::string_view getTypeName() const {
+            return tokenTypeNamesMap.at(type);
         }
 
         int getId() const {
@@ -51,7 +62,7 @@ export class Token {
             return type;
         }
 
-        std::string getValue() const {
+        const std::string& getValue() const {
             return value;
         }
 
@@ -59,7 +70,7 @@ export class Token {
             return positionNumber;
         }
 
-        std::string getPosition() const {
+        const std::string& getPosition() const {
             return position;
         }
 
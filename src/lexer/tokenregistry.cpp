@@ -1,10 +1,24 @@
 module;
 
 #include <map>
+#include <array>
+#include <utility>
 #include <string_view>
+#include <stdexcept>
 
 export module tokenregistry;
 
+// Looks up the id of a fixed token; usable in constant expressions
+template<size_t N>
+constexpr int findTokenId(const std::array<std::pair<std::string_view, int>, N>& ids, std::string_view value) {
+    for (const auto& [idValue, id] : ids) {
+        if (idValue == value) {
+            return id;
+        }
+    }
+    throw std::invalid_argument("Unknown token");
+}
+
 export namespace TokenRegistry {
 
     constexpr int identifierId = 0;
@@ -15,7 +29,7 @@ export namespace TokenRegistry {
 
     constexpr int stringLiteralId = 3;
 
-    const std::map<std::string_view, int> keywordIdMap {
+    constexpr std::array<std::pair<std::string_view, int>, 9> keywordIds {{
         {"int", 100},
         {"float", 101},
         {"str", 102},
@@ -25,9 +39,9 @@ export namespace TokenRegistry {
         {"return", 106},
         {"while", 107},
         {"do", 108},
-    };
+    }};
 
-    const std::map<std::string_view, int> operatorIdMap {
+    constexpr std::array<std::pair<std::string_view, int>, 15> operatorIds {{
         {"=", 200},
         {"==", 201},
         {"!=", 202},
@@ -43,9 +57,9 @@ export namespace TokenRegistry {
         {"&&", 212},
         {"||", 213},
         {"!", 214},
-    };
+    }};
 
-    const std::map<std::string_view, int> punctuatorIdMap {
+    constexpr std::array<std::pair<std::string_view, int>, 8> punctuatorIds {{
         {"{", 300},
         {"}", 301},
         {",", 302},
@@ -54,6 +68,24 @@ export namespace TokenRegistry {
         {")", 305},
         {"[", 306},
         {"]", 307},
-    };
+    }};
+
+    const std::map<std::string_view, int> keywordIdMap(keywordIds.begin(), keywordIds.end());
+
+    const std::map<std::string_view, int> operatorIdMap(operatorIds.begin(), operatorIds.end());
+
+    const std::map<std::string_view, int> punctuatorIdMap(punctuatorIds.begin(), punctuatorIds.end());
+
+    constexpr int getKeywordId(std::string_view keyword) {
+        return findTokenId(keywordIds, keyword);
+    }
+
+    constexpr int getOperatorId(std::string_view op) {
+        return findTokenId(operatorIds, op);
+    }
+
+    constexpr int getPunctuatorId(std::string_view punctuator) {
+        return findTokenId(punctuatorIds, punctuator);
+    }
 
 }
@@ -8,12 +8,27 @@ module;
 #include <variant>
 #include <optional>
 #include <map>
+#include <span>
+#include <string_view>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <utility>
+#include <iterator>
 
 export module ast;
 
 import token;
 import symbol;
 import terminalfactory;
+import flatast;
+import symboltable;
+import ir;
+import threadpool;
 
 export enum DataType {
     INT_T,
@@ -25,6 +40,30 @@ export enum DataType {
     NONE_T
 };
 
+// A set of data types as a bitmask, so that sets can be built and tested at compile time
+export class DataTypeSet {
+    private:
+        uint8_t bits = 0;
+
+    public:
+        constexpr DataTypeSet(std::initializer_list<DataType> types) {
+            for (const auto type : types) {
+                bits |= 1 << type;
+            }
+        }
+
+        constexpr bool contains(DataType type) const {
+            return bits & (1 << type);
+        }
+};
+
+export constexpr DataTypeSet NUMERIC_TYPES{ DataType::INT_T, DataType::FLOAT_T };
+export constexpr DataTypeSet STRING_TYPES{ DataType::STR_T };
+// Conditions and logical operands; an int is true when non-zero
+export constexpr DataTypeSet BOOLEAN_TYPES{ DataType::BOOL_T, DataType::INT_T };
+export constexpr DataTypeSet INDEX_TYPES{ DataType::INT_T };
+export constexpr DataTypeSet ALL_TYPES{ DataType::INT_T, DataType::FLOAT_T, DataType::STR_T, DataType::BOOL_T, DataType::FUNC_T, DataType::ANY_T, DataType::NONE_T };
+
 const std::map<DataType, std::string_view> dataTypeNamesMap {
     {DataType::INT_T, "int"},
     {DataType::FLOAT_T, "float"},
@@ -45,32 +84,42 @@ export struct TypeCheckError {
 export using TypeCheckResult = std::variant<TypeCheckSuccess, TypeCheckError>;
 
 export struct SymbolTableEntry {
-    std::string name;
     DataType type;
     bool isArray;
-
-    SymbolTableEntry(const std::string& name, DataType type, bool isArray)
-        : name(name), type(type), isArray(isArray) {}
+    // The FUNC_DEF, PARAM or VAR node that declared the name
+    AstIndex declaration;
 };
 
-export using SymbolTable = std::map<std::string, SymbolTableEntry>;
+// What type checking found out about each node of a FlatAst, for the passes after it
+export class TypeAnnotations {
+    private:
+        std::vector<DataType> types;
+        std::vector<AstIndex> bindings;
 
-export struct SymbolTableNode {
-    SymbolTable* table;
-    int scope;
-    const SymbolTableNode* parent;
+    public:
+        TypeAnnotations(size_t nodeCount = 0) : types(nodeCount, DataType::NONE_T), bindings(nodeCount, NO_AST_INDEX) {}
 
-    SymbolTableNode(SymbolTable* table)
-        : table(table), scope(0), parent(nullptr) {}
+        void setType(AstIndex node, DataType type) {
+            types[node] = type;
+        }
 
-    SymbolTableNode(SymbolTable* table, int scope, const SymbolTableNode& parent)
-        : table(table), scope(scope), parent(&parent) {}
+        void setBinding(AstIndex node, AstIndex declaration) {
+            bindings[node] = declaration;
+        }
 
-    SymbolTableNode createChild(SymbolTable* childTable) const {
-        return SymbolTableNode{ childTable, scope + 1, *this };
-    }
+        // The type of an expression, none for statements and for nodes that were not checked
+        DataType getType(AstIndex node) const {
+            return types[node];
+        }
+
+        // The declaration a VAR or FUNC_CALL refers to, NO_AST_INDEX if it was not resolved
+        AstIndex getBinding(AstIndex node) const {
+            return bindings[node];
+        }
 };
 
+export using SymbolTable = ScopedSymbolTable<SymbolTableEntry>;
+
 export struct Quadruple {
     std::string op;
     std::string arg1;
@@ -78,9 +127,7 @@ export struct Quadruple {
     std::string result;
 
     std::string toString() const {
-        std::ostringstream oss;
-        oss << "( " << op << ", " << arg1 << ", " << arg2 << ", " << result << " )";
-        return oss.str();
+        return "( " + op + ", " + arg1 + ", " + arg2 + ", " + result + " )";
     }
 };
 
@@ -88,75 +135,144 @@ export struct Label {
     int id;
 
     std::string getName() const {
-        std::ostringstream oss;
-        oss << "L" << id;
-        return oss.str();
+        return "L" + std::to_string(id);
     }
 
     std::string toString() const {
-        std::ostringstream oss;
-        oss << getName() << ":";
-        return oss.str();
+        return getName() + ":";
     }
 };
 
 export using Quadruples = std::vector<std::variant<Quadruple, Label>>;
 
-export struct GeQ {
-    Quadruples quads;
-    std::string result;
+// Helpers shared by the passes over FlatAst
+
+
+// The any type is allowed wherever a type is expected
+constexpr bool isTypeAllowed(const DataType type, const DataTypeSet allowedTypes) {
+    return allowedTypes.contains(type) || type == DataType::ANY_T;
+}
+
+bool isSameType(const DataType type1, const DataType type2) {
+    return type1 == type2 || type1 == DataType::ANY_T || type2 == DataType::ANY_T;
+}
+
+std::string getDataTypeName(const DataType& type) {
+    auto it = dataTypeNamesMap.find(type);
+    if (it != dataTypeNamesMap.end()) {
+        return std::string(it->second);
+    }
+    return "unknown";
+}
+
+// How the type of an operator expression follows from the types of its operands
+enum class OperatorResult : uint8_t {
+    BOOL,
+    // The widest operand type: float, then str, then int
+    WIDEST,
+    // The type of the only operand
+    OPERAND
 };
 
-export class AstNode {
-    private:
-        const std::string name;
+struct OperatorTyping {
+    // Each operand must have one of these types; checked as soon as the operand is checked
+    DataTypeSet operandTypes;
+    std::string_view leftOperandError;
+    std::string_view rightOperandError;
+    // Whether both operands must then be numeric or both be strings
+    bool operandsAlike;
+    std::string_view mismatchError;
+    // Whether the operand types are appended to the mismatch error
+    bool mismatchNamesTypes;
+    OperatorResult result;
+};
 
-    protected:
-        std::string getIntermediate(int intermediateId) const {
-            std::ostringstream oss;
-            oss << "t" << intermediateId;
-            return oss.str();
-        }
+constexpr OperatorTyping LOGICAL_TYPING{ BOOLEAN_TYPES, "Left operand must be boolean", "Right operand must be boolean", false, "", false, OperatorResult::BOOL };
+constexpr OperatorTyping COMPARISON_TYPING{ ALL_TYPES, "", "", true, "Type mismatch in comparison", false, OperatorResult::BOOL };
+constexpr OperatorTyping ADDITION_TYPING{ ALL_TYPES, "", "", true, "Cannot add types ", true, OperatorResult::WIDEST };
+constexpr OperatorTyping ARITHMETIC_TYPING{ NUMERIC_TYPES, "The operands must be numeric", "The operands must be numeric", false, "", false, OperatorResult::WIDEST };
+constexpr OperatorTyping SIGN_TYPING{ NUMERIC_TYPES, "The operand must be numeric", "", false, "", false, OperatorResult::OPERAND };
+constexpr OperatorTyping NOT_TYPING{ BOOLEAN_TYPES, "The operand must be boolean", "", false, "", false, OperatorResult::BOOL };
+
+// The typing rules of the binary and unary expressions, from OR_EXPR to NOT_EXPR in AstKind order
+constexpr std::array<OperatorTyping, 16> operatorTypings{
+    LOGICAL_TYPING, LOGICAL_TYPING,
+    COMPARISON_TYPING, COMPARISON_TYPING, COMPARISON_TYPING, COMPARISON_TYPING, COMPARISON_TYPING, COMPARISON_TYPING,
+    ADDITION_TYPING, ARITHMETIC_TYPING, ARITHMETIC_TYPING, ARITHMETIC_TYPING, ARITHMETIC_TYPING,
+    SIGN_TYPING, SIGN_TYPING, NOT_TYPING
+};
+static_assert(static_cast<int>(AstKind::NOT_EXPR) - static_cast<int>(AstKind::OR_EXPR) + 1 == operatorTypings.size());
+
+constexpr const OperatorTyping& getOperatorTyping(AstKind kind) {
+    return operatorTypings[static_cast<int>(kind) - static_cast<int>(AstKind::OR_EXPR)];
+}
+
+constexpr DataType getOperatorResultType(const OperatorTyping& typing, DataType lexprType, DataType rexprType) {
+    switch (typing.result) {
+        case OperatorResult::BOOL:
+            return DataType::BOOL_T;
+        case OperatorResult::OPERAND:
+            return lexprType;
+        case OperatorResult::WIDEST:
+            break;
+    }
+    if (lexprType == DataType::FLOAT_T || rexprType == DataType::FLOAT_T) {
+        return DataType::FLOAT_T;
+    }
+    else if (lexprType == DataType::STR_T || rexprType == DataType::STR_T) {
+        return DataType::STR_T;
+    }
+    return DataType::INT_T;
+}
 
-        Label getLabel(int& globalLabelId) const {
-            Label label{ globalLabelId };
-            globalLabelId++;
-            return label;
+export std::string quadruplesToString(const Quadruples& quads) {
+    std::ostringstream oss;
+    for (const auto& quad : quads) {
+        if (std::holds_alternative<Quadruple>(quad)) {
+            oss << std::get<Quadruple>(quad).toString() << "\n";
+        } else {
+            oss << std::get<Label>(quad).toString() << "\n";
         }
+    }
+    return oss.str();
+}
 
-        bool checkType(const DataType type, const std::vector<DataType>& allowedTypes) const {
-            for (const auto& allowedType : allowedTypes) {
-                if (type == allowedType) {
-                    return true;
-                }
-            }
-            if (type == DataType::ANY_T) {
-                return true;
-            }
-            return false;
-        }
+// Gives, for a token of the tokens a tree was built from, the token at the same offset in other tokens
+// with the same ids and values, so that a tree can be reused for the same code at another position
+export class TokenRebase {
+    private:
+        std::span<const Token> from;
+        std::span<const Token> to;
 
-        bool typeEquals(const DataType type1, const DataType type2) const {
-            return type1 == type2 || type1 == DataType::ANY_T || type2 == DataType::ANY_T;
-        }
+    public:
+        TokenRebase(std::span<const Token> from, std::span<const Token> to): from(from), to(to) {}
 
-        std::string getTypeName(const DataType& type) const {
-            auto it = dataTypeNamesMap.find(type);
-            if (it != dataTypeNamesMap.end()) {
-                return std::string(it->second);
-            }
-            return "unknown";
+        const Token& operator()(const Token& token) const {
+            const auto tokenIter = std::lower_bound(from.begin(), from.end(), token.getPositionNumber(), [](const Token& fromToken, int positionNumber) {
+                return fromToken.getPositionNumber() < positionNumber;
+            });
+            return to[tokenIter - from.begin()];
         }
+};
 
-        std::optional<SymbolTableEntry> findSymbol(const SymbolTableNode& symbolTableNode, const std::string& name) const {
-            auto it = symbolTableNode.table->find(name);
-            if (it != symbolTableNode.table->end()) {
-                return it->second;
-            }
-            if (symbolTableNode.parent != nullptr) {
-                return findSymbol(*symbolTableNode.parent, name);
-            }
-            return std::nullopt;
+// The tree built by the parser. Passes do not run over it directly: it is flattened into a
+// FlatAst, which FlatAstTypeChecker and FlatAstQuadrupleGenerator below visit without virtual calls.
+// The subtrees are held by the base class, so that the tree can be flattened and destroyed without
+// recursion however deeply it is nested.
+export class AstNode {
+    private:
+        const std::string name;
+
+    protected:
+        // The subtrees in the order they are flattened; nullptr for an absent optional one
+        std::vector<std::unique_ptr<AstNode>> children;
+
+        template <typename... Nodes>
+        static std::vector<std::unique_ptr<AstNode>> childList(Nodes&&... nodes) {
+            std::vector<std::unique_ptr<AstNode>> list;
+            list.reserve(sizeof...(nodes));
+            (list.push_back(std::move(nodes)), ...);
+            return list;
         }
 
         // std::string openString() const {
@@ -181,293 +297,189 @@ export class AstNode {
         // }
 
     public:
-        AstNode(const std::string& name): name(name) {}
-        virtual ~AstNode() = default;
+        AstNode(const std::string& name, std::vector<std::unique_ptr<AstNode>> children = {}): name(name), children(std::move(children)) {}
+
+        virtual ~AstNode() {
+            // The descendants are detached before they are destroyed, so each destructor only frees a node
+            std::vector<std::unique_ptr<AstNode>> pending = std::move(children);
+            while (!pending.empty()) {
+                auto node = std::move(pending.back());
+                pending.pop_back();
+                if (node != nullptr) {
+                    std::move(node->children.begin(), node->children.end(), std::back_inserter(pending));
+                    node->children.clear();
+                }
+            }
+        }
 
         // virtual std::string toString() const = 0;
 
-        virtual std::string getWhere() const = 0;
-
-        virtual GeQ toQuadruples(int& globalLabelId, int intermediateId = 0) const = 0;
-
-        std::string toQuadrupleString() const {
-            int globalLabelId = 0;
-            const auto quads = toQuadruples(globalLabelId, 0).quads;
-            std::ostringstream oss;
-            for (const auto& quad : quads) {
-                if (std::holds_alternative<Quadruple>(quad)) {
-                    oss << std::get<Quadruple>(quad).toString() << "\n";
-                } else {
-                    oss << std::get<Label>(quad).toString() << "\n";
+        // Appends this node to the flat AST once its children are in it, given their indices in the
+        // order of children (NO_AST_INDEX for an absent one), and returns its index
+        virtual AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const = 0;
+
+        // A node of the same kind with its tokens rebased, for clone to give the copied children to
+        virtual std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const = 0;
+
+        // Copies the tree with its tokens rebased, with an explicit stack like toFlatAst
+        std::unique_ptr<AstNode> clone(const TokenRebase& rebase) const {
+            auto root = copyNode(rebase);
+            std::vector<std::pair<AstNode*, const AstNode*>> pending{ { root.get(), this } };
+            while (!pending.empty()) {
+                const auto [copy, original] = pending.back();
+                pending.pop_back();
+                copy->children.clear();
+                copy->children.reserve(original->children.size());
+                for (const auto& child : original->children) {
+                    if (child == nullptr) {
+                        copy->children.push_back(nullptr);
+                    } else {
+                        copy->children.push_back(child->copyNode(rebase));
+                        pending.push_back({ copy->children.back().get(), child.get() });
+                    }
+                }
+            }
+            return root;
+        }
+
+        FlatAst toFlatAst() const {
+            // The node, the next of its children to add and where the indices of its children start
+            struct Frame {
+                const AstNode* node;
+                size_t next;
+                size_t firstIndex;
+            };
+            FlatAst flatAst;
+            std::vector<AstIndex> indices;
+            std::vector<Frame> stack{ Frame{ this, 0, 0 } };
+            while (!stack.empty()) {
+                auto& frame = stack.back();
+                if (frame.next < frame.node->children.size()) {
+                    const auto child = frame.node->children[frame.next++].get();
+                    if (child == nullptr) {
+                        indices.push_back(NO_AST_INDEX);
+                    } else {
+                        stack.push_back(Frame{ child, 0, indices.size() });
+                    }
+                    continue;
                 }
+                const auto childIndices = std::span<const AstIndex>(indices).subspan(frame.firstIndex);
+                const auto index = frame.node->addTo(flatAst, childIndices);
+                indices.resize(frame.firstIndex);
+                indices.push_back(index);
+                stack.pop_back();
             }
-            return oss.str();
+            return flatAst;
         }
 
-        virtual TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const = 0;
+        std::string getWhere() const;
 
-        TypeCheckResult startTypeCheck() const {
-            SymbolTable symbolTable{}; // starting table
-            SymbolTableNode symbolTableNode{&symbolTable};
-            return this->typeCheck(symbolTableNode, DataType::NONE_T);
-        }
+        std::string toQuadrupleString() const;
+
+        TypeCheckResult startTypeCheck() const;
 };
 
 export class Start : public AstNode {
-    private:
-        std::vector<std::unique_ptr<AstNode>> declarations;
-
     public:
-        Start(std::vector<std::unique_ptr<AstNode>> declarations): AstNode("Start"), declarations(std::move(declarations)) {}
+        Start(std::vector<std::unique_ptr<AstNode>> declarations): AstNode("Start", std::move(declarations)) {}
         ~Start() = default;
 
-        std::string getWhere() const override {
-            return declarations[0]->getWhere();
-        }
-
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            for (const auto& decl : declarations) {
-                const auto declGeQ = decl->toQuadruples(globalLabelId);
-                const auto declQuads = declGeQ.quads;
-                quads.insert(quads.end(), declQuads.begin(), declQuads.end());
-            }
-            return { quads, "" };
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<Start>(std::vector<std::unique_ptr<AstNode>>());
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            for (const auto& decl : declarations) {
-                const auto result = decl->typeCheck(symbolTableNode, DataType::NONE_T);
-                if (std::holds_alternative<TypeCheckError>(result)) {
-                    return result;
-                }
-            }
-            return TypeCheckSuccess{ DataType::NONE_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::START, childIndices);
         }
 }; // declarations: AstNode[]
 
 export class FuncDef : public AstNode {
     private:
-        std::unique_ptr<AstNode> type;
         Token id;
-        std::vector<std::unique_ptr<AstNode>> params;
-        std::unique_ptr<AstNode> body;
 
     public:
         FuncDef(std::unique_ptr<AstNode> type, Token id, std::vector<std::unique_ptr<AstNode>> params, std::unique_ptr<AstNode> body)
-            : AstNode("FuncDef"), type(std::move(type)), id(id), params(std::move(params)), body(std::move(body)) {}
+            : AstNode("FuncDef", childList(std::move(type))), id(id) {
+            std::move(params.begin(), params.end(), std::back_inserter(children));
+            children.push_back(std::move(body));
+        }
         ~FuncDef() = default;
 
-        std::string getWhere() const override {
-            return type->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<FuncDef>(nullptr, rebase(id), std::vector<std::unique_ptr<AstNode>>(), nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            quads.emplace_back(Quadruple{"FUNCTION", id.getValue(), std::to_string(params.size()), ""});
-            for (int i = 0; i < params.size(); ++i) {
-                const auto paramsGeQ = params[i]->toQuadruples(globalLabelId);
-                quads.emplace_back(Quadruple{"PARAM", paramsGeQ.result, std::to_string(i + 1), ""});
-            }
-            const auto bodyGeQ = body->toQuadruples(globalLabelId);
-            quads.insert(quads.end(), bodyGeQ.quads.begin(), bodyGeQ.quads.end());
-            quads.emplace_back(Quadruple{"ENDFUNC", id.getValue(), "", ""});
-            return { quads, "" };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            SymbolTable symbolTable{};
-            SymbolTableNode newSymbolTableNode = symbolTableNode.createChild(&symbolTable);
-            const auto typeResult = type->typeCheck(newSymbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(typeResult)) {
-                return typeResult;
-            }
-            symbolTableNode.table->emplace(id.getValue(), SymbolTableEntry{id.getValue(), DataType::FUNC_T, false});
-            for (const auto& param : params) {
-                const auto result = param->typeCheck(newSymbolTableNode, DataType::NONE_T);
-                if (std::holds_alternative<TypeCheckError>(result)) {
-                    return result;
-                }
-            }
-            return body->typeCheck(newSymbolTableNode, DataType::NONE_T);
+        // The children are flattened in source order, but the body goes right after the type in the layout
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            std::vector<AstIndex> layout{ childIndices[0], childIndices.back() };
+            layout.insert(layout.end(), childIndices.begin() + 1, childIndices.end() - 1);
+            return flatAst.addNode(AstKind::FUNC_DEF, layout, id);
         }
 }; // type: Token, id: Token, params: AstNode[], body: AstNode
 
 export class Param : public AstNode {
     private:
-        std::unique_ptr<AstNode> type;
         Token id;
         bool array;
 
     public:
-        Param(std::unique_ptr<AstNode> type, Token id, bool array): AstNode("Param"), type(std::move(type)), id(id), array(array) {}
+        Param(std::unique_ptr<AstNode> type, Token id, bool array): AstNode("Param", childList(std::move(type))), id(id), array(array) {}
         ~Param() = default;
 
-        std::string getWhere() const override {
-            return type->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<Param>(nullptr, rebase(id), array);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            return { {}, id.getValue() };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto typeResult = type->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(typeResult)) {
-                return typeResult;
-            }
-            const auto typeType = std::get<TypeCheckSuccess>(typeResult).type;
-            SymbolTableEntry entry{id.getValue(), typeType, array};
-            symbolTableNode.table->emplace(id.getValue(), entry);
-            return TypeCheckSuccess{ DataType::NONE_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::PARAM, childIndices, id, array);
         }
 }; // type: Token, id: Token, array: bool
 
 export class VarDecl : public AstNode {
-    private:
-        std::unique_ptr<AstNode> type;
-        std::vector<std::unique_ptr<AstNode>> varAssignables;
-
     public:
-        VarDecl(std::unique_ptr<AstNode> type, std::vector<std::unique_ptr<AstNode>> varAssignables): AstNode("VarDecl"), type(std::move(type)), varAssignables(std::move(varAssignables)) {}
-        ~VarDecl() = default;
-
-        std::string getWhere() const override {
-            return type->getWhere();
+        VarDecl(std::unique_ptr<AstNode> type, std::vector<std::unique_ptr<AstNode>> varAssignables): AstNode("VarDecl", childList(std::move(type))) {
+            std::move(varAssignables.begin(), varAssignables.end(), std::back_inserter(children));
         }
+        ~VarDecl() = default;
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            for (const auto& var : varAssignables) {
-                const auto varGeQ = var->toQuadruples(globalLabelId);
-                const auto varQuads = varGeQ.quads;
-                quads.insert(quads.end(), varQuads.begin(), varQuads.end());
-            }
-            return { quads, "" };
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<VarDecl>(nullptr, std::vector<std::unique_ptr<AstNode>>());
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto typeResult = type->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(typeResult)) {
-                return typeResult;
-            }
-            const auto typeType = std::get<TypeCheckSuccess>(typeResult).type;
-            for (const auto& var : varAssignables) {
-                const auto result = var->typeCheck(symbolTableNode, typeType);
-                if (std::holds_alternative<TypeCheckError>(result)) {
-                    return result;
-                }
-            }
-            return TypeCheckSuccess{ DataType::NONE_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::VAR_DECL, childIndices);
         }
 }; // type: Token, varAssignables: AstNode[]
 
 export class VarAssignable : public AstNode {
-    private:
-        std::unique_ptr<AstNode> var;
-        std::optional<std::unique_ptr<AstNode>> expr;
-
     public:
         VarAssignable(std::unique_ptr<AstNode> var, std::optional<std::unique_ptr<AstNode>> expr)
-            : AstNode("VarAssignable"), var(std::move(var)), expr(std::move(expr)) {}
+            : AstNode("VarAssignable", childList(std::move(var), std::move(expr).value_or(nullptr))) {}
         ~VarAssignable() = default;
 
-        std::string getWhere() const override {
-            return var->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<VarAssignable>(nullptr, std::nullopt);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            if (expr) {
-                const auto varGeQ = var->toQuadruples(globalLabelId);
-                const auto varResult = varGeQ.result;
-
-                const auto valueGeQ = (*expr)->toQuadruples(globalLabelId, intermediateId + 1);
-                const auto valueQuads = valueGeQ.quads;
-                const auto valueResult = valueGeQ.result;
-                quads.insert(quads.end(), valueQuads.begin(), valueQuads.end());
-                quads.emplace_back(Quadruple{"=", valueResult, "", varResult});
-            }
-            return { quads, "" };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            DataType valueType = DataType::NONE_T;
-            if (expr) {
-                const auto valueResult = (*expr)->typeCheck(symbolTableNode, DataType::NONE_T);
-                if (std::holds_alternative<TypeCheckError>(valueResult)) {
-                    return valueResult;
-                }
-                valueType = std::get<TypeCheckSuccess>(valueResult).type;
-            }
-            const auto varResult = var->typeCheck(symbolTableNode, assignedType);
-            if (std::holds_alternative<TypeCheckError>(varResult)) {
-                return varResult;
-            }
-            const auto varType = std::get<TypeCheckSuccess>(varResult).type;
-            if (expr) {
-                if (expr && !typeEquals(varType, valueType)) {
-                    return TypeCheckError{ "Type mismatch: " + getTypeName(varType) + " and " + getTypeName(valueType), getWhere() };
-                }
-                return TypeCheckSuccess{ valueType };
-            }
-            return TypeCheckSuccess{ DataType::NONE_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::VAR_ASSIGNABLE, childIndices);
         }
 }; // var: AstNode, expr?: AstNode
 
 export class Var : public AstNode {
     private:
         Token id;
-        std::optional<std::unique_ptr<AstNode>> arrayIndex;
 
     public:
-        Var(Token id, std::optional<std::unique_ptr<AstNode>> arrayIndex): AstNode("Var"), id(id), arrayIndex(std::move(arrayIndex)) {}
+        Var(Token id, std::optional<std::unique_ptr<AstNode>> arrayIndex): AstNode("Var", childList(std::move(arrayIndex).value_or(nullptr))), id(id) {}
         ~Var() = default;
 
-        std::string getWhere() const override {
-            return id.getPosition();
-        }
-
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            if (arrayIndex) {
-                Quadruples quads;
-                const auto arrayIndexGeQ = (*arrayIndex)->toQuadruples(globalLabelId, intermediateId + 1);
-                quads.insert(quads.end(), arrayIndexGeQ.quads.begin(), arrayIndexGeQ.quads.end());
-                const auto intermediate = getIntermediate(intermediateId);
-                quads.emplace_back(Quadruple{"[]", id.getValue(), arrayIndexGeQ.result, intermediate});
-                return { quads, intermediate };
-            }
-            return { {}, id.getValue() };
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<Var>(rebase(id), std::nullopt);
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            if (assignedType != DataType::NONE_T) {
-                SymbolTableEntry entry{id.getValue(), assignedType, arrayIndex.has_value()};
-                symbolTableNode.table->insert_or_assign(id.getValue(), entry);
-            }
-            auto entry = findSymbol(symbolTableNode, id.getValue());
-            if (entry.has_value()) {
-                if (entry->isArray) {
-                    if (!arrayIndex.has_value()) {
-                        return TypeCheckError{ "Array variable used without index: " + id.getValue(), getWhere() };
-                    }
-                    const auto arrayIndexResult = (*arrayIndex)->typeCheck(symbolTableNode, DataType::NONE_T);
-                    if (std::holds_alternative<TypeCheckError>(arrayIndexResult)) {
-                        return arrayIndexResult;
-                    }
-                    const auto arrayIndexType = std::get<TypeCheckSuccess>(arrayIndexResult).type;
-                    if (!checkType(arrayIndexType, {DataType::INT_T})) {
-                        return TypeCheckError{ "Array index must be int: " + id.getValue(), getWhere() };
-                    }
-                }
-                else {
-                    if (arrayIndex.has_value()) {
-                        return TypeCheckError{ "Non-array variable used with index: " + id.getValue(), getWhere() };
-                    }
-                }
-                return TypeCheckSuccess{ entry.value().type }; // has type
-            }
-            return TypeCheckError{ "Variable not found: " + id.getValue(), getWhere() };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::VAR, childIndices, id);
         }
 }; // id: Token, arrayIndex?: Token
 
@@ -479,25 +491,12 @@ export class Type : public AstNode {
         Type(Token type): AstNode("Type"), type(type) {}
         ~Type() = default;
 
-        std::string getWhere() const override {
-            return type.getPosition();
-        }
-
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            return { {}, type.getValue() };
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<Type>(rebase(type));
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            if (TerminalFactory::getKeyword("int").matchesToken(type)) {
-                return TypeCheckSuccess{ DataType::INT_T };
-            }
-            else if (TerminalFactory::getKeyword("float").matchesToken(type)) {
-                return TypeCheckSuccess{ DataType::FLOAT_T };
-            }
-            else if (TerminalFactory::getKeyword("str").matchesToken(type)) {
-                return TypeCheckSuccess{ DataType::STR_T };
-            }
-            return TypeCheckError{ "Invalid type", getWhere() };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::TYPE, {}, type);
         }
 }; // type: Token
 
@@ -509,1191 +508,1536 @@ export class Constant : public AstNode {
         Constant(Token value): AstNode("Constant"), value(value) {}
         ~Constant() = default;
 
-        std::string getWhere() const override {
-            return value.getPosition();
-        }
-
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            return { {}, value.getValue() };
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<Constant>(rebase(value));
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            if (value.getType() == TokenType::INTEGER) {
-                return TypeCheckSuccess{ DataType::INT_T };
-            }
-            else if (value.getType() == TokenType::FLOAT) {
-                return TypeCheckSuccess{ DataType::FLOAT_T };
-            }
-            else if (value.getType() == TokenType::STRING) {
-                return TypeCheckSuccess{ DataType::STR_T };
-            }
-            return TypeCheckError{ "Invalid constant type", getWhere() };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::CONSTANT, {}, value);
         }
 }; // value: Token
 
 export class BlockStmt : public AstNode {
-    private:
-        std::vector<std::unique_ptr<AstNode>> statements;
-
     public:
-        BlockStmt(std::vector<std::unique_ptr<AstNode>> stmts): AstNode("BlockStmt"), statements(std::move(stmts)) {}
+        BlockStmt(std::vector<std::unique_ptr<AstNode>> stmts): AstNode("BlockStmt", std::move(stmts)) {}
         ~BlockStmt() = default;
 
-        std::string getWhere() const override {
-            return statements[0]->getWhere();
-        }
-
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            for (const auto& stmt : statements) {
-                const auto stmtGeQ = stmt->toQuadruples(globalLabelId);
-                const auto stmtQuads = stmtGeQ.quads;
-                quads.insert(quads.end(), stmtQuads.begin(), stmtQuads.end());
-            }
-            return { quads, "" };
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<BlockStmt>(std::vector<std::unique_ptr<AstNode>>());
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            SymbolTable symbolTable{};
-            SymbolTableNode newSymbolTableNode = symbolTableNode.createChild(&symbolTable);
-            for (const auto& stmt : statements) {
-                const auto result = stmt->typeCheck(newSymbolTableNode, DataType::NONE_T);
-                if (std::holds_alternative<TypeCheckError>(result)) {
-                    return result;
-                }
-            }
-            return TypeCheckSuccess{ DataType::NONE_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::BLOCK_STMT, childIndices);
         }
 }; // stmts: AstNode[]
 
 export class IfStmt : public AstNode {
-    private:
-        std::unique_ptr<AstNode> condExpr;
-        std::unique_ptr<AstNode> thenBody;
-        std::optional<std::unique_ptr<AstNode>> elseBody;
-
     public:
         IfStmt(std::unique_ptr<AstNode> condExpr, std::unique_ptr<AstNode> thenBody, std::optional<std::unique_ptr<AstNode>> elseBody)
-            : AstNode("IfStmt"), condExpr(std::move(condExpr)), thenBody(std::move(thenBody)), elseBody(std::move(elseBody)) {}
+            : AstNode("IfStmt", childList(std::move(condExpr), std::move(thenBody), std::move(elseBody).value_or(nullptr))) {}
         ~IfStmt() = default;
 
-        std::string getWhere() const override {
-            return condExpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<IfStmt>(nullptr, nullptr, std::nullopt);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto label1 = getLabel(globalLabelId);
-            const auto label2 = getLabel(globalLabelId);
-
-            const auto condGeQ = condExpr->toQuadruples(globalLabelId, intermediateId + 1);
-            quads.insert(quads.end(), condGeQ.quads.begin(), condGeQ.quads.end());
-            quads.emplace_back(Quadruple{"if", condGeQ.result, "", label1.getName()});
-            quads.emplace_back(Quadruple{"goto", "", "", label2.getName()});
-
-            quads.emplace_back(label1);
-            const auto thenGeQ = thenBody->toQuadruples(globalLabelId);
-            const auto thenQuads = thenGeQ.quads;
-            quads.insert(quads.end(), thenQuads.begin(), thenQuads.end());
-
-            if (elseBody) {
-                const auto label3 = getLabel(globalLabelId);
-                quads.emplace_back(Quadruple{"goto", "", "", label3.getName()});
-
-                quads.emplace_back(label2);
-                const auto elseGeQ = (*elseBody)->toQuadruples(globalLabelId);
-                const auto elseQuads = elseGeQ.quads;
-                quads.insert(quads.end(), elseQuads.begin(), elseQuads.end());
-
-                quads.emplace_back(label3);
-            }
-            else {
-                quads.emplace_back(label2);
-            }
-            return { quads, "" };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            SymbolTable symbolTable{};
-            SymbolTableNode newSymbolTableNode = symbolTableNode.createChild(&symbolTable);
-            const auto condResult = condExpr->typeCheck(newSymbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(condResult)) {
-                return condResult;
-            }
-            if (!checkType(std::get<TypeCheckSuccess>(condResult).type, {DataType::BOOL_T, DataType::INT_T})) {
-                return TypeCheckError{ "Condition must be boolean", condExpr->getWhere() };
-            }
-            const auto thenResult = thenBody->typeCheck(newSymbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(thenResult)) {
-                return thenResult;
-            }
-            if (elseBody) {
-                const auto elseResult = (*elseBody)->typeCheck(newSymbolTableNode, DataType::NONE_T);
-                if (std::holds_alternative<TypeCheckError>(elseResult)) {
-                    return elseResult;
-                }
-            }
-            return TypeCheckSuccess{ DataType::NONE_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::IF_STMT, childIndices);
         }
 }; // condExpr: AstNode, thenBody: AstNode, elseBody: AstNode
 
 export class WhileStmt : public AstNode {
-    private:
-        std::unique_ptr<AstNode> condExpr;
-        std::unique_ptr<AstNode> body;
-
     public:
         WhileStmt(std::unique_ptr<AstNode> condExpr, std::unique_ptr<AstNode> body)
-            : AstNode("WhileStmt"), condExpr(std::move(condExpr)), body(std::move(body)) {}
+            : AstNode("WhileStmt", childList(std::move(condExpr), std::move(body))) {}
         ~WhileStmt() = default;
 
-        std::string getWhere() const override {
-            return condExpr->getWhere();
-        }
-
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto label1 = getLabel(globalLabelId);
-            const auto label2 = getLabel(globalLabelId);
-            const auto label3 = getLabel(globalLabelId);
-
-            quads.emplace_back(label1);
-            const auto condGeQ = condExpr->toQuadruples(globalLabelId, intermediateId + 1);
-            quads.insert(quads.end(), condGeQ.quads.begin(), condGeQ.quads.end());
-            quads.emplace_back(Quadruple{"if", condGeQ.result, "", label2.getName()});
-            quads.emplace_back(Quadruple{"goto", "", "", label3.getName()});
-
-            quads.emplace_back(label2);
-            const auto bodyGeQ = body->toQuadruples(globalLabelId);
-            const auto bodyQuads = bodyGeQ.quads;
-            quads.insert(quads.end(), bodyQuads.begin(), bodyQuads.end());
-            quads.emplace_back(Quadruple{"goto", "", "", label1.getName()});
-
-            quads.emplace_back(label3);
-
-            return { quads, "" };
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<WhileStmt>(nullptr, nullptr);
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            SymbolTable symbolTable{};
-            SymbolTableNode newSymbolTableNode = symbolTableNode.createChild(&symbolTable);
-            const auto condResult = condExpr->typeCheck(newSymbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(condResult)) {
-                return condResult;
-            }
-            if (!checkType(std::get<TypeCheckSuccess>(condResult).type, {DataType::BOOL_T, DataType::INT_T})) {
-                return TypeCheckError{ "Condition must be boolean", condExpr->getWhere() };
-            }
-            const auto bodyResult = body->typeCheck(newSymbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(bodyResult)) {
-                return bodyResult;
-            }
-            return TypeCheckSuccess{ DataType::NONE_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::WHILE_STMT, childIndices);
         }
 }; // condExpr: AstNode, body: AstNode
 
 export class ForStmt : public AstNode {
-    private:
-        std::unique_ptr<AstNode> forVarDecl;
-        std::unique_ptr<AstNode> condExpr;
-        std::unique_ptr<AstNode> incrExpr;
-        std::unique_ptr<AstNode> body;
-
     public:
         ForStmt(std::unique_ptr<AstNode> forVarDecl, std::unique_ptr<AstNode> condExpr, std::unique_ptr<AstNode> incrExpr, std::unique_ptr<AstNode> body)
-            : AstNode("ForStmt"), forVarDecl(std::move(forVarDecl)), condExpr(std::move(condExpr)), incrExpr(std::move(incrExpr)), body(std::move(body)) {}
+            : AstNode("ForStmt", childList(std::move(forVarDecl), std::move(condExpr), std::move(incrExpr), std::move(body))) {}
         ~ForStmt() = default;
 
-        std::string getWhere() const override {
-            return forVarDecl->getWhere();
-        }
-
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto label1 = getLabel(globalLabelId);
-            const auto label2 = getLabel(globalLabelId);
-            const auto label3 = getLabel(globalLabelId);
-
-            const auto varGeQ = forVarDecl->toQuadruples(globalLabelId);
-            const auto varQuads = varGeQ.quads;
-            quads.insert(quads.end(), varQuads.begin(), varQuads.end());
-
-            quads.emplace_back(label1);
-            const auto condGeQ = condExpr->toQuadruples(globalLabelId, intermediateId + 1);
-            quads.insert(quads.end(), condGeQ.quads.begin(), condGeQ.quads.end());
-            quads.emplace_back(Quadruple{"if", condGeQ.result, "", label2.getName()});
-            quads.emplace_back(Quadruple{"goto", "", "", label3.getName()});
-
-            quads.emplace_back(label2);
-            const auto bodyGeQ = body->toQuadruples(globalLabelId);
-            const auto bodyQuads = bodyGeQ.quads;
-            quads.insert(quads.end(), bodyQuads.begin(), bodyQuads.end());
-            const auto incrGeQ = incrExpr->toQuadruples(globalLabelId);
-            const auto incrQuads = incrGeQ.quads;
-            quads.insert(quads.end(), incrQuads.begin(), incrQuads.end());
-            quads.emplace_back(Quadruple{"goto", "", "", label1.getName()});
-
-            quads.emplace_back(label3);
-
-            return { quads, "" };
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<ForStmt>(nullptr, nullptr, nullptr, nullptr);
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            SymbolTable symbolTable{};
-            SymbolTableNode newSymbolTableNode = symbolTableNode.createChild(&symbolTable);
-            const auto varResult = forVarDecl->typeCheck(newSymbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(varResult)) {
-                return varResult;
-            }
-            const auto condResult = condExpr->typeCheck(newSymbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(condResult)) {
-                return condResult;
-            }
-            if (!checkType(std::get<TypeCheckSuccess>(condResult).type, {DataType::BOOL_T, DataType::INT_T})) {
-                return TypeCheckError{ "Condition must be boolean", condExpr->getWhere() };
-            }
-            const auto incrResult = incrExpr->typeCheck(newSymbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(incrResult)) {
-                return incrResult;
-            }
-            const auto bodyResult = body->typeCheck(newSymbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(bodyResult)) {
-                return bodyResult;
-            }
-            return TypeCheckSuccess{ DataType::NONE_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::FOR_STMT, childIndices);
         }
 }; // type?: Token, forVarDecl: AstNode[], condExpr: AstNode, incrExpr: AstNode
 
 export class VarAssign : public AstNode {
-    private:
-        std::unique_ptr<AstNode> var;
-        std::unique_ptr<AstNode> expr;
-
     public:
         VarAssign(std::unique_ptr<AstNode> var, std::unique_ptr<AstNode> expr)
-            : AstNode("VarAssign"), var(std::move(var)), expr(std::move(expr)) {}
+            : AstNode("VarAssign", childList(std::move(var), std::move(expr))) {}
         ~VarAssign() = default;
 
-        std::string getWhere() const override {
-            return var->getWhere();
-        }
-
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto varGeQ = var->toQuadruples(globalLabelId);
-            const auto varResult = varGeQ.result;
-
-            const auto valueGeQ = expr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto valueQuads = valueGeQ.quads;
-            const auto valueResult = valueGeQ.result;
-            quads.insert(quads.end(), valueQuads.begin(), valueQuads.end());
-            quads.emplace_back(Quadruple{"=", valueResult, "", varResult});
-            return { quads, "" };
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<VarAssign>(nullptr, nullptr);
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto valueResult = expr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(valueResult)) {
-                return valueResult;
-            }
-            const auto valueType = std::get<TypeCheckSuccess>(valueResult).type;
-            const auto varResult = var->typeCheck(symbolTableNode, assignedType);
-            if (std::holds_alternative<TypeCheckError>(varResult)) {
-                return varResult;
-            }
-            const auto varType = std::get<TypeCheckSuccess>(varResult).type;
-            if (!typeEquals(varType, valueType)) {
-                return TypeCheckError{ "Type mismatch: " + getTypeName(varType) + " and " + getTypeName(valueType), getWhere() };
-            }
-            return TypeCheckSuccess{ valueType };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::VAR_ASSIGN, childIndices);
         }
 }; // var: AstNode, expr: AstNode
 
 export class ForVarDecl : public AstNode {
-    private:
-        std::vector<std::unique_ptr<AstNode>> varAssigns;
-
     public:
-        ForVarDecl(std::vector<std::unique_ptr<AstNode>> varAssigns): AstNode("ForVarDecl"), varAssigns(std::move(varAssigns)) {}
+        ForVarDecl(std::vector<std::unique_ptr<AstNode>> varAssigns): AstNode("ForVarDecl", std::move(varAssigns)) {}
         ~ForVarDecl() = default;
 
-        std::string getWhere() const override {
-            return varAssigns[0]->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<ForVarDecl>(std::vector<std::unique_ptr<AstNode>>());
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            for (const auto& var : varAssigns) {
-                const auto varGeQ = var->toQuadruples(globalLabelId);
-                const auto varQuads = varGeQ.quads;
-                quads.insert(quads.end(), varQuads.begin(), varQuads.end());
-            }
-            return { quads, "" };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            // if (type) {
-            //     const auto typeResult = (*type)->typeCheck(symbolTableNode, DataType::NONE_T);
-            //     if (std::holds_alternative<TypeCheckError>(typeResult)) {
-            //         return typeResult;
-            //     }
-            //     const auto typeType = std::get<TypeCheckSuccess>(typeResult).type;
-            //     for (const auto& var : varAssigns) {
-            //         const auto result = var->typeCheck(symbolTableNode, typeType);
-            //         if (std::holds_alternative<TypeCheckError>(result)) {
-            //             return result;
-            //         }
-            //     }
-            // }
-            for (const auto& var : varAssigns) {
-                const auto result = var->typeCheck(symbolTableNode, DataType::NONE_T);
-                if (std::holds_alternative<TypeCheckError>(result)) {
-                    return result;
-                }
-            }
-            return TypeCheckSuccess{ DataType::NONE_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::FOR_VAR_DECL, childIndices);
         }
 }; // type: Token, varAssigns: AstNode[]
 
 export class ReturnStmt : public AstNode {
-    private:
-        std::optional<std::unique_ptr<AstNode>> expr;
-
     public:
-        ReturnStmt(std::optional<std::unique_ptr<AstNode>> expr): AstNode("ReturnStmt"), expr(std::move(expr)) {}
+        ReturnStmt(std::optional<std::unique_ptr<AstNode>> expr): AstNode("ReturnStmt", childList(std::move(expr).value_or(nullptr))) {}
         ~ReturnStmt() = default;
 
-        std::string getWhere() const override {
-            return expr ? (*expr)->getWhere() : "return";
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<ReturnStmt>(std::nullopt);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            if (expr) {
-                const auto valueGeQ = (*expr)->toQuadruples(globalLabelId, intermediateId + 1);
-                quads.insert(quads.end(), valueGeQ.quads.begin(), valueGeQ.quads.end());
-                quads.emplace_back(Quadruple{"RETURN", valueGeQ.result, "", ""});
-            } else {
-                quads.emplace_back(Quadruple{"RETURN", "", "", ""});
-            }
-            return { quads, "" };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            if (expr) {
-                const auto valueResult = (*expr)->typeCheck(symbolTableNode, DataType::NONE_T);
-                if (std::holds_alternative<TypeCheckError>(valueResult)) {
-                    return valueResult;
-                }
-                // No return type checking for now
-            }
-            return TypeCheckSuccess{ DataType::NONE_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::RETURN_STMT, childIndices);
         }
 }; // expr?: AstNode
 
 export class AssignExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> var;
-        std::unique_ptr<AstNode> expr;
-
     public:
         AssignExpr(std::unique_ptr<AstNode> var, std::unique_ptr<AstNode> expr)
-            : AstNode("AssignExpr"), var(std::move(var)), expr(std::move(expr)) {}
+            : AstNode("AssignExpr", childList(std::move(var), std::move(expr))) {}
         ~AssignExpr() = default;
 
-        std::string getWhere() const override {
-            return var->getWhere();
-        }
-
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto varGeQ = var->toQuadruples(globalLabelId);
-            const auto varResult = varGeQ.result;
-
-            const auto valueGeQ = expr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto valueQuads = valueGeQ.quads;
-            const auto valueResult = valueGeQ.result;
-            quads.insert(quads.end(), valueQuads.begin(), valueQuads.end());
-            quads.emplace_back(Quadruple{"=", valueResult, "", varResult});
-            return { quads, varResult };
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<AssignExpr>(nullptr, nullptr);
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto varResult = var->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(varResult)) {
-                return varResult;
-            }
-            const auto varType = std::get<TypeCheckSuccess>(varResult).type;
-            const auto valueResult = expr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(valueResult)) {
-                return valueResult;
-            }
-            const auto valueType = std::get<TypeCheckSuccess>(valueResult).type;
-            if (!typeEquals(varType, valueType)) {
-                return TypeCheckError{ "Type mismatch: " + getTypeName(varType) + " and " + getTypeName(valueType), getWhere() };
-            }
-            return TypeCheckSuccess{ valueType };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::ASSIGN_EXPR, childIndices);
         }
 }; // var: AstNode, expr: AstNode
 
 export class OrExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
-
     public:
         OrExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("OrExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
+            : AstNode("OrExpr", childList(std::move(lexpr), std::move(rexpr))) {}
         ~OrExpr() = default;
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<OrExpr>(nullptr, nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"||", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
-            }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            if (!checkType(lexprType, {DataType::BOOL_T, DataType::INT_T})) {
-                return TypeCheckError{ "Left operand must be boolean", lexpr->getWhere() };
-            }
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
-            }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!checkType(rexprType, {DataType::BOOL_T, DataType::INT_T})) {
-                return TypeCheckError{ "Right operand must be boolean", rexpr->getWhere() };
-            }
-            return TypeCheckSuccess{ DataType::BOOL_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::OR_EXPR, childIndices);
         }
 }; // lexpr: AstNode, rexpr: AstNode
 
 export class AndExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
-
     public:
         AndExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("AndExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
+            : AstNode("AndExpr", childList(std::move(lexpr), std::move(rexpr))) {}
         ~AndExpr() = default;
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<AndExpr>(nullptr, nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"&&", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::AND_EXPR, childIndices);
         }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
-            }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            if (!checkType(lexprType, {DataType::BOOL_T, DataType::INT_T})) {
-                return TypeCheckError{ "Left operand must be boolean", lexpr->getWhere() };
-            }
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
-            }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!checkType(rexprType, {DataType::BOOL_T, DataType::INT_T})) {
-                return TypeCheckError{ "Right operand must be boolean", rexpr->getWhere() };
-            }
-            return TypeCheckSuccess{ DataType::BOOL_T };
-        }
-}; // lexpr: AstNode, rexpr: AstNode
+}; // lexpr: AstNode, rexpr: AstNode
 
 export class EqualExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
-
     public:
         EqualExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("EqualExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
+            : AstNode("EqualExpr", childList(std::move(lexpr), std::move(rexpr))) {}
         ~EqualExpr() = default;
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<EqualExpr>(nullptr, nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"==", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
-            }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
-            }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!(
-                checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T}) && checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T}) ||
-                checkType(lexprType, {DataType::STR_T}) && checkType(rexprType, {DataType::STR_T})
-            )) {
-                return TypeCheckError{ "Type mismatch in comparison", getWhere() };
-            }
-            return TypeCheckSuccess{ DataType::BOOL_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::EQUAL_EXPR, childIndices);
         }
 }; // lexpr: AstNode, rexpr: AstNode
 
 export class NotEqualExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
-
     public:
         NotEqualExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("NotEqualExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
+            : AstNode("NotEqualExpr", childList(std::move(lexpr), std::move(rexpr))) {}
         ~NotEqualExpr() = default;
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<NotEqualExpr>(nullptr, nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"!=", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
-            }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
-            }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!(
-                checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T}) && checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T}) ||
-                checkType(lexprType, {DataType::STR_T}) && checkType(rexprType, {DataType::STR_T})
-            )) {
-                return TypeCheckError{ "Type mismatch in comparison", getWhere() };
-            }
-            return TypeCheckSuccess{ DataType::BOOL_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::NOT_EQUAL_EXPR, childIndices);
         }
 }; // lexpr: AstNode, rexpr: AstNode
 
 export class LessExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
-
     public:
         LessExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("LessExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
+            : AstNode("LessExpr", childList(std::move(lexpr), std::move(rexpr))) {}
         ~LessExpr() = default;
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<LessExpr>(nullptr, nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"<", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
-            }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
-            }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!(
-                checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T}) && checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T}) ||
-                checkType(lexprType, {DataType::STR_T}) && checkType(rexprType, {DataType::STR_T})
-            )) {
-                return TypeCheckError{ "Type mismatch in comparison", getWhere() };
-            }
-            return TypeCheckSuccess{ DataType::BOOL_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::LESS_EXPR, childIndices);
         }
 }; // lexpr: AstNode, rexpr: AstNode
 
 export class LessEqualExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
-
     public:
         LessEqualExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("LessEqualExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
+            : AstNode("LessEqualExpr", childList(std::move(lexpr), std::move(rexpr))) {}
         ~LessEqualExpr() = default;
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<LessEqualExpr>(nullptr, nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"<=", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
-            }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
-            }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!(
-                checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T}) && checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T}) ||
-                checkType(lexprType, {DataType::STR_T}) && checkType(rexprType, {DataType::STR_T})
-            )) {
-                return TypeCheckError{ "Type mismatch in comparison", getWhere() };
-            }
-            return TypeCheckSuccess{ DataType::BOOL_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::LESS_EQUAL_EXPR, childIndices);
         }
 }; // lexpr: AstNode, rexpr: AstNode
 
 export class GreaterExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
-
     public:
         GreaterExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("GreaterExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
+            : AstNode("GreaterExpr", childList(std::move(lexpr), std::move(rexpr))) {}
         ~GreaterExpr() = default;
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<GreaterExpr>(nullptr, nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{">", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
-            }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
-            }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!(
-                checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T}) && checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T}) ||
-                checkType(lexprType, {DataType::STR_T}) && checkType(rexprType, {DataType::STR_T})
-            )) {
-                return TypeCheckError{ "Type mismatch in comparison", getWhere() };
-            }
-            return TypeCheckSuccess{ DataType::BOOL_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::GREATER_EXPR, childIndices);
         }
 }; // lexpr: AstNode, rexpr: AstNode
 
 export class GreaterEqualExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
-
     public:
         GreaterEqualExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("GreaterEqualExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
+            : AstNode("GreaterEqualExpr", childList(std::move(lexpr), std::move(rexpr))) {}
         ~GreaterEqualExpr() = default;
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<GreaterEqualExpr>(nullptr, nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{">=", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
-            }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
-            }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!(
-                checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T}) && checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T}) ||
-                checkType(lexprType, {DataType::STR_T}) && checkType(rexprType, {DataType::STR_T})
-            )) {
-                return TypeCheckError{ "Type mismatch in comparison", getWhere() };
-            }
-            return TypeCheckSuccess{ DataType::BOOL_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::GREATER_EQUAL_EXPR, childIndices);
         }
 }; // lexpr: AstNode, rexpr: AstNode
 
 export class AddExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
-
     public:
         AddExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("AddExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
+            : AstNode("AddExpr", childList(std::move(lexpr), std::move(rexpr))) {}
         ~AddExpr() = default;
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<AddExpr>(nullptr, nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"+", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
-        }
-
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
-            }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
-            }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!(
-                checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T}) && checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T}) ||
-                checkType(lexprType, {DataType::STR_T}) && checkType(rexprType, {DataType::STR_T})
-            )) {
-                return TypeCheckError{ "Cannot add types " + getTypeName(lexprType) + " and " + getTypeName(rexprType), getWhere() };
-            }
-            if (lexprType == DataType::FLOAT_T || rexprType == DataType::FLOAT_T) {
-                return TypeCheckSuccess{ DataType::FLOAT_T };
-            }
-            else if (lexprType == DataType::STR_T || rexprType == DataType::STR_T) {
-                return TypeCheckSuccess{ DataType::STR_T };
-            }
-            return TypeCheckSuccess{ DataType::INT_T };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::ADD_EXPR, childIndices);
         }
 }; // lexpr: AstNode, rexpr: AstNode
 
 export class SubExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
-
     public:
         SubExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("SubExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
+            : AstNode("SubExpr", childList(std::move(lexpr), std::move(rexpr))) {}
         ~SubExpr() = default;
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<SubExpr>(nullptr, nullptr);
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"-", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::SUB_EXPR, childIndices);
+        }
+}; // lexpr: AstNode, rexpr: AstNode
+
+export class MulExpr : public AstNode {
+    public:
+        MulExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
+            : AstNode("MulExpr", childList(std::move(lexpr), std::move(rexpr))) {}
+        ~MulExpr() = default;
+
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<MulExpr>(nullptr, nullptr);
+        }
+
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::MUL_EXPR, childIndices);
+        }
+}; // lexpr: AstNode, rexpr: AstNode
+
+export class DivExpr : public AstNode {
+    public:
+        DivExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
+            : AstNode("DivExpr", childList(std::move(lexpr), std::move(rexpr))) {}
+        ~DivExpr() = default;
+
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<DivExpr>(nullptr, nullptr);
+        }
+
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::DIV_EXPR, childIndices);
+        }
+}; // lexpr: AstNode, rexpr: AstNode
+
+export class ModExpr : public AstNode {
+    public:
+        ModExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
+            : AstNode("ModExpr", childList(std::move(lexpr), std::move(rexpr))) {}
+        ~ModExpr() = default;
+
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<ModExpr>(nullptr, nullptr);
+        }
+
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::MOD_EXPR, childIndices);
+        }
+}; // lexpr: AstNode, rexpr: AstNode
+
+export class UnaryPlusExpr : public AstNode {
+    public:
+        UnaryPlusExpr(std::unique_ptr<AstNode> expr): AstNode("UnaryPlusExpr", childList(std::move(expr))) {}
+        ~UnaryPlusExpr() = default;
+
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<UnaryPlusExpr>(nullptr);
+        }
+
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::UNARY_PLUS_EXPR, childIndices);
+        }
+}; // expr: AstNode
+
+export class UnaryMinusExpr : public AstNode {
+    public:
+        UnaryMinusExpr(std::unique_ptr<AstNode> expr): AstNode("UnaryMinusExpr", childList(std::move(expr))) {}
+        ~UnaryMinusExpr() = default;
+
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<UnaryMinusExpr>(nullptr);
+        }
+
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::UNARY_MINUS_EXPR, childIndices);
+        }
+}; // expr: AstNode
+
+export class NotExpr : public AstNode {
+    public:
+        NotExpr(std::unique_ptr<AstNode> expr): AstNode("NotExpr", childList(std::move(expr))) {}
+        ~NotExpr() = default;
+
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<NotExpr>(nullptr);
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::NOT_EXPR, childIndices);
+        }
+}; // expr: AstNode
+
+export class FuncCall : public AstNode {
+    private:
+        Token id;
+
+    public:
+        FuncCall(Token id, std::vector<std::unique_ptr<AstNode>> arguments): AstNode("FuncCall", std::move(arguments)), id(id) {}
+        ~FuncCall() = default;
+
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            return std::make_unique<FuncCall>(rebase(id), std::vector<std::unique_ptr<AstNode>>());
+        }
+
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::FUNC_CALL, childIndices, id);
+        }
+}; // id: Token, exprs: AstNode[]
+
+export class SyntaxError : public AstNode {
+    private:
+        std::vector<Token> tokens;
+
+    public:
+        SyntaxError(std::vector<Token> tokens): AstNode("SyntaxError"), tokens(std::move(tokens)) {}
+        ~SyntaxError() = default;
+
+        std::unique_ptr<AstNode> copyNode(const TokenRebase& rebase) const override {
+            std::vector<Token> rebased;
+            rebased.reserve(tokens.size());
+            for (const auto& token : tokens) {
+                rebased.push_back(rebase(token));
             }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            if (!checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T})) {
-                return TypeCheckError{ "The operands must be numeric", lexpr->getWhere() };
+            return std::make_unique<SyntaxError>(std::move(rebased));
+        }
+
+        AstIndex addTo(FlatAst& flatAst, std::span<const AstIndex> childIndices) const override {
+            return flatAst.addNode(AstKind::SYNTAX_ERROR, {}, tokens.empty() ? std::nullopt : std::optional<Token>(tokens[0]));
+        }
+}; // tokens: Token[]
+
+// The global declarations of a program in source order, so that a function body can be checked
+// against the globals declared before it without replaying the declarations
+class GlobalSymbols {
+    private:
+        struct Version {
+            // Index among the top-level declarations of the declaration that made it
+            uint32_t position;
+            SymbolTableEntry entry;
+        };
+
+        // Indexed by name id; in order of position
+        std::vector<std::vector<Version>> versions;
+
+    public:
+        GlobalSymbols(size_t nameCount = 0) : versions(nameCount) {}
+
+        void add(uint32_t nameId, uint32_t position, const SymbolTableEntry& entry) {
+            versions[nameId].push_back(Version{ position, entry });
+        }
+
+        // The entry in scope after the declaration at the given position, nullptr if none
+        const SymbolTableEntry* lookup(uint32_t nameId, uint32_t position) const {
+            const auto& nameVersions = versions[nameId];
+            for (auto it = nameVersions.rbegin(); it != nameVersions.rend(); ++it) {
+                if (it->position <= position) {
+                    return &it->entry;
+                }
             }
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
+            return nullptr;
+        }
+};
+
+// What type checking a top-level declaration found, relative to its first node so that it can be
+// reused wherever the declaration moves to
+struct CachedDeclarationCheck {
+    // Marks a binding to a declaration outside the checked one, which is looked up again on reuse
+    static constexpr AstIndex GLOBAL_BINDING = NO_AST_INDEX - 1;
+
+    struct Signature {
+        DataType type;
+        bool isArray;
+
+        bool operator==(const Signature&) const = default;
+    };
+
+    struct Export {
+        AstIndex declaration;
+        Signature signature;
+        bool replace;
+    };
+
+    std::vector<DataType> types;
+    std::vector<AstIndex> bindings;
+    // The globals declared elsewhere that the declaration depends on, by name, with the signature
+    // they had or nullopt if the name was not declared
+    std::map<std::string, std::optional<Signature>> dependencies;
+    // The globals the declaration declares, in order
+    std::vector<Export> exports;
+};
+
+// Type check results of top-level declarations kept between checks of successive versions of a
+// program, keyed by the structure and tokens of the declaration
+export class TypeCheckCache {
+    private:
+        std::map<std::string, CachedDeclarationCheck> declarations;
+        int reusedCount = 0;
+        int recheckedCount = 0;
+
+    public:
+        TypeCheckCache() {}
+
+        const CachedDeclarationCheck* find(const std::string& key) const {
+            auto declarationIter = declarations.find(key);
+            if (declarationIter == declarations.end()) {
+                return nullptr;
             }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T})) {
-                return TypeCheckError{ "The operands must be numeric", rexpr->getWhere() };
+            return &declarationIter->second;
+        }
+
+        // Replaces the cached declarations with those of the latest check, dropping the ones that no longer exist
+        void update(std::map<std::string, CachedDeclarationCheck> newDeclarations, int reused, int rechecked) {
+            declarations = std::move(newDeclarations);
+            reusedCount = reused;
+            recheckedCount = rechecked;
+        }
+
+        void clear() {
+            declarations.clear();
+            reusedCount = 0;
+            recheckedCount = 0;
+        }
+
+        // Number of declarations whose results the latest check took from the cache
+        int getReusedCount() const {
+            return reusedCount;
+        }
+
+        // Number of declarations that the latest check had to type check
+        int getRecheckedCount() const {
+            return recheckedCount;
+        }
+};
+
+// A node being type checked, with the type given to the variables it declares, if any
+struct TypeCheckFrame {
+    AstIndex node;
+    DataType assignedType = DataType::NONE_T;
+    uint32_t step = 0;
+    // The type of the first operand or the declared type, kept for a later step
+    DataType firstType = DataType::NONE_T;
+    // Whether the node entered a scope
+    bool scoped = false;
+};
+
+// Type checks a FlatAst. Each node is checked in the current scope and, for variables being
+// declared, with the declared type.
+export class FlatAstTypeChecker : public FlatAstVisitor<FlatAstTypeChecker, TypeCheckFrame, TypeCheckResult> {
+    private:
+        friend class FlatAstVisitor<FlatAstTypeChecker, TypeCheckFrame, TypeCheckResult>;
+
+        // Enters a scope for the lifetime of the object
+        class Scope {
+            private:
+                SymbolTable& symbolTable;
+
+            public:
+                Scope(SymbolTable& symbolTable) : symbolTable(symbolTable) {
+                    symbolTable.enterScope();
+                }
+
+                ~Scope() {
+                    symbolTable.leaveScope();
+                }
+        };
+
+        SymbolTable symbolTable;
+        TypeAnnotations ownAnnotations;
+        // The checker's own annotations, or those of the checker that started it on another thread
+        TypeAnnotations* annotations;
+        // Number of nodes type checked, counting nodes that are checked more than once each time
+        long visits = 0;
+
+        // When checking a function body apart from the rest of the program, the globals declared up
+        // to its position among the top-level declarations; while collecting them, where to record them
+        const GlobalSymbols* globals = nullptr;
+        GlobalSymbols* recordedGlobals = nullptr;
+        uint32_t globalPosition = 0;
+
+        // While checking a top-level declaration for the cache, the nodes it spans and where to
+        // record the globals it depends on and declares
+        CachedDeclarationCheck* recording = nullptr;
+        AstIndex recordingFirst = 0;
+        AstIndex recordingLast = 0;
+
+        FlatAstTypeChecker(const FlatAst& ast, const GlobalSymbols& globals, uint32_t globalPosition, TypeAnnotations& annotations)
+            : FlatAstVisitor(ast), symbolTable(ast.getNameCount()), annotations(&annotations), globals(&globals), globalPosition(globalPosition) {}
+
+        bool isRecordedDependency(const SymbolTableEntry* entry) const {
+            return recording != nullptr && (entry == nullptr || entry->declaration < recordingFirst || entry->declaration > recordingLast);
+        }
+
+        void recordDependency(AstIndex node, const SymbolTableEntry* entry) {
+            recording->dependencies.emplace(ast.getToken(node).getValue(), entry == nullptr
+                ? std::nullopt
+                : std::make_optional(CachedDeclarationCheck::Signature{ entry->type, entry->isArray }));
+        }
+
+        void declare(uint32_t nameId, const SymbolTableEntry& entry, bool replace) {
+            if (recording != nullptr && symbolTable.getScope() == 0) {
+                // Whether a declaration that keeps an existing one takes effect depends on what was declared before
+                const auto previous = symbolTable.lookup(nameId);
+                if (!replace && isRecordedDependency(previous)) {
+                    recordDependency(entry.declaration, previous);
+                }
+                recording->exports.push_back(CachedDeclarationCheck::Export{ entry.declaration - recordingFirst, { entry.type, entry.isArray }, replace });
             }
-            if (lexprType == DataType::FLOAT_T || rexprType == DataType::FLOAT_T) {
-                return TypeCheckSuccess{ DataType::FLOAT_T };
+            if (replace) {
+                symbolTable.redeclare(nameId, entry);
+            } else {
+                symbolTable.declare(nameId, entry);
+            }
+            if (recordedGlobals != nullptr && symbolTable.getScope() == 0) {
+                recordedGlobals->add(nameId, globalPosition, *symbolTable.lookup(nameId));
             }
-            return TypeCheckSuccess{ DataType::INT_T };
         }
 
-}; // lexpr: AstNode, rexpr: AstNode
-export class MulExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
+        // The declaration the name of the node refers to
+        const SymbolTableEntry* lookup(AstIndex node) {
+            const auto nameId = ast.getNameId(node);
+            auto entry = symbolTable.lookup(nameId);
+            if (entry == nullptr && globals != nullptr) {
+                entry = globals->lookup(nameId, globalPosition);
+            }
+            if (entry != nullptr && isRecordedDependency(entry)) {
+                recordDependency(node, entry);
+            }
+            return entry;
+        }
 
-    public:
-        MulExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("MulExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
-        ~MulExpr() = default;
+        static bool isError(const TypeCheckResult& result) {
+            return std::holds_alternative<TypeCheckError>(result);
+        }
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        static DataType getType(const TypeCheckResult& result) {
+            return std::get<TypeCheckSuccess>(result).type;
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"*", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
+        // Leaves the scope entered for the node, and records the node's type if it checked
+        void leaveNode(TypeCheckFrame& frame, TypeCheckResult& result) {
+            if (frame.scoped) {
+                symbolTable.leaveScope();
+            }
+            if (!isError(result)) {
+                annotations->setType(frame.node, getType(result));
+            }
+        }
+
+        void enterNode(TypeCheckFrame& frame) {
+            visits++;
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
+        // An error is the result of every node up to the root
+        bool isFailure(const TypeCheckResult& result) const {
+            return isError(result);
+        }
+
+        // Enters a scope that is left along with the node
+        void enterScope(TypeCheckFrame& frame) {
+            symbolTable.enterScope();
+            frame.scoped = true;
+        }
+
+        TypeCheckResult typeCheck(AstIndex node, const DataType assignedType) {
+            return visit(TypeCheckFrame{ node, assignedType });
+        }
+
+        // Checks the nodes one per step from firstStep on, then gives the none type
+        Step typeCheckAll(const TypeCheckFrame& frame, std::span<const AstIndex> nodes, const DataType assignedType, uint32_t firstStep = 0) {
+            const auto index = frame.step - firstStep;
+            if (index < nodes.size()) {
+                return TypeCheckFrame{ nodes[index], assignedType };
             }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            if (!checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T})) {
-                return TypeCheckError{ "The operands must be numeric", lexpr->getWhere() };
+            return TypeCheckSuccess{ DataType::NONE_T };
+        }
+
+        // The error if a checked operand does not have one of the operand types
+        std::optional<TypeCheckError> checkOperand(AstIndex operand, const TypeCheckResult& result, DataTypeSet operandTypes, std::string_view error) const {
+            if (!isTypeAllowed(getType(result), operandTypes)) {
+                return TypeCheckError{ std::string(error), ast.getWhere(operand) };
             }
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
+            return std::nullopt;
+        }
+
+        // A variable declaration with a value checks the value first, so the variable is not in scope in it
+        Step typeCheckAssignment(TypeCheckFrame& frame, const TypeCheckResult& childResult, const DataType assignedType, bool varFirst) {
+            const auto var = ast.getChild(frame.node, 0);
+            const auto expr = ast.getChild(frame.node, 1);
+            if (frame.step == 0) {
+                return varFirst ? TypeCheckFrame{ var, assignedType } : TypeCheckFrame{ expr, DataType::NONE_T };
             }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T})) {
-                return TypeCheckError{ "The operands must be numeric", rexpr->getWhere() };
+            if (frame.step == 1) {
+                frame.firstType = getType(childResult);
+                return varFirst ? TypeCheckFrame{ expr, DataType::NONE_T } : TypeCheckFrame{ var, assignedType };
             }
-            if (lexprType == DataType::FLOAT_T || rexprType == DataType::FLOAT_T) {
-                return TypeCheckSuccess{ DataType::FLOAT_T };
+            const auto varType = varFirst ? frame.firstType : getType(childResult);
+            const auto valueType = varFirst ? getType(childResult) : frame.firstType;
+            if (!isSameType(varType, valueType)) {
+                return TypeCheckError{ "Type mismatch: " + getDataTypeName(varType) + " and " + getDataTypeName(valueType), ast.getWhere(frame.node) };
             }
-            return TypeCheckSuccess{ DataType::INT_T };
+            return TypeCheckSuccess{ valueType };
         }
-}; // lexpr: AstNode, rexpr: AstNode
 
-export class DivExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
+        Step visitStart(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            return typeCheckAll(frame, ast.getChildren(frame.node), DataType::NONE_T);
+        }
 
-    public:
-        DivExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("DivExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
-        ~DivExpr() = default;
+        void declareFunction(AstIndex node) {
+            declare(ast.getNameId(node), SymbolTableEntry{DataType::FUNC_T, false, node}, false);
+        }
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        // Declares the function; its parameters and body only need the globals declared so far
+        TypeCheckResult typeCheckSignature(AstIndex node) {
+            const auto typeResult = typeCheck(ast.getChild(node, 0), DataType::NONE_T);
+            if (isError(typeResult)) {
+                return typeResult;
+            }
+            declareFunction(node);
+            return TypeCheckSuccess{ DataType::NONE_T };
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"/", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
+        TypeCheckResult typeCheckBody(AstIndex node) {
+            const auto children = ast.getChildren(node);
+            const Scope scope(symbolTable);
+            for (const auto param : children.subspan(2)) {
+                const auto paramResult = typeCheck(param, DataType::NONE_T);
+                if (isError(paramResult)) {
+                    return paramResult;
+                }
+            }
+            return typeCheck(children[1], DataType::NONE_T);
+        }
+
+        // The type, then the parameters and the body in the function's scope
+        Step visitFuncDef(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto children = ast.getChildren(frame.node);
+            if (frame.step == 0) {
+                return TypeCheckFrame{ children[0], DataType::NONE_T };
+            }
+            if (frame.step == 1) {
+                declareFunction(frame.node);
+                enterScope(frame);
+            }
+            const auto paramCount = children.size() - 2;
+            if (frame.step <= paramCount) {
+                return TypeCheckFrame{ children[frame.step + 1], DataType::NONE_T };
+            }
+            if (frame.step == paramCount + 1) {
+                return TypeCheckFrame{ children[1], DataType::NONE_T };
+            }
+            return childResult;
+        }
+
+        Step visitParam(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            if (frame.step == 0) {
+                return TypeCheckFrame{ ast.getChild(frame.node, 0), DataType::NONE_T };
+            }
+            declare(ast.getNameId(frame.node), SymbolTableEntry{getType(childResult), ast.isArray(frame.node), frame.node}, false);
+            return TypeCheckSuccess{ DataType::NONE_T };
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
+        Step visitVarDecl(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto children = ast.getChildren(frame.node);
+            if (frame.step == 0) {
+                return TypeCheckFrame{ children[0], DataType::NONE_T };
             }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            if (!checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T})) {
-                return TypeCheckError{ "The operands must be numeric", lexpr->getWhere() };
+            if (frame.step == 1) {
+                frame.firstType = getType(childResult);
+            }
+            return typeCheckAll(frame, children.subspan(1), frame.firstType, 1);
+        }
+
+        Step visitVarAssignable(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            if (ast.getChild(frame.node, 1) != NO_AST_INDEX) {
+                return typeCheckAssignment(frame, childResult, frame.assignedType, false);
+            }
+            if (frame.step == 0) {
+                return TypeCheckFrame{ ast.getChild(frame.node, 0), frame.assignedType };
+            }
+            return TypeCheckSuccess{ DataType::NONE_T };
+        }
+
+        Step visitVar(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto node = frame.node;
+            const auto arrayIndex = ast.getChild(node, 0);
+            if (frame.step == 1) {
+                if (!isTypeAllowed(getType(childResult), INDEX_TYPES)) {
+                    return TypeCheckError{ "Array index must be int: " + ast.getToken(node).getValue(), ast.getWhere(node) };
+                }
+                return TypeCheckSuccess{ frame.firstType };
+            }
+            const auto nameId = ast.getNameId(node);
+            if (frame.assignedType != DataType::NONE_T) {
+                declare(nameId, SymbolTableEntry{frame.assignedType, arrayIndex != NO_AST_INDEX, node}, true);
+            }
+            const auto found = lookup(node);
+            if (found == nullptr) {
+                return TypeCheckError{ "Variable not found: " + ast.getToken(node).getValue(), ast.getWhere(node) };
+            }
+            const auto entry = *found;
+            annotations->setBinding(node, entry.declaration);
+            if (entry.isArray) {
+                if (arrayIndex == NO_AST_INDEX) {
+                    return TypeCheckError{ "Array variable used without index: " + ast.getToken(node).getValue(), ast.getWhere(node) };
+                }
+                frame.firstType = entry.type;
+                return TypeCheckFrame{ arrayIndex, DataType::NONE_T };
             }
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
+            else if (arrayIndex != NO_AST_INDEX) {
+                return TypeCheckError{ "Non-array variable used with index: " + ast.getToken(node).getValue(), ast.getWhere(node) };
             }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T})) {
-                return TypeCheckError{ "The operands must be numeric", rexpr->getWhere() };
+            return TypeCheckSuccess{ entry.type };
+        }
+
+        Step visitType(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto& type = ast.getToken(frame.node);
+            if (TerminalFactory::getKeyword("int").matchesToken(type)) {
+                return TypeCheckSuccess{ DataType::INT_T };
             }
-            if (lexprType == DataType::FLOAT_T || rexprType == DataType::FLOAT_T) {
+            else if (TerminalFactory::getKeyword("float").matchesToken(type)) {
                 return TypeCheckSuccess{ DataType::FLOAT_T };
             }
-            return TypeCheckSuccess{ DataType::INT_T };
+            else if (TerminalFactory::getKeyword("str").matchesToken(type)) {
+                return TypeCheckSuccess{ DataType::STR_T };
+            }
+            return TypeCheckError{ "Invalid type", ast.getWhere(frame.node) };
         }
-}; // lexpr: AstNode, rexpr: AstNode
 
-export class ModExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> lexpr;
-        std::unique_ptr<AstNode> rexpr;
+        Step visitConstant(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto& value = ast.getToken(frame.node);
+            if (value.getType() == TokenType::INTEGER) {
+                return TypeCheckSuccess{ DataType::INT_T };
+            }
+            else if (value.getType() == TokenType::FLOAT) {
+                return TypeCheckSuccess{ DataType::FLOAT_T };
+            }
+            else if (value.getType() == TokenType::STRING) {
+                return TypeCheckSuccess{ DataType::STR_T };
+            }
+            return TypeCheckError{ "Invalid constant type", ast.getWhere(frame.node) };
+        }
 
-    public:
-        ModExpr(std::unique_ptr<AstNode> lexpr, std::unique_ptr<AstNode> rexpr)
-            : AstNode("ModExpr"), lexpr(std::move(lexpr)), rexpr(std::move(rexpr)) {}
-        ~ModExpr() = default;
+        Step visitBlockStmt(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            if (frame.step == 0) {
+                enterScope(frame);
+            }
+            return typeCheckAll(frame, ast.getChildren(frame.node), DataType::NONE_T);
+        }
 
-        std::string getWhere() const override {
-            return lexpr->getWhere();
+        Step visitIfStmt(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto condExpr = ast.getChild(frame.node, 0);
+            const auto elseBody = ast.getChild(frame.node, 2);
+            switch (frame.step) {
+                case 0:
+                    enterScope(frame);
+                    return TypeCheckFrame{ condExpr, DataType::NONE_T };
+                case 1:
+                    if (const auto error = checkOperand(condExpr, childResult, BOOLEAN_TYPES, "Condition must be boolean")) {
+                        return *error;
+                    }
+                    return TypeCheckFrame{ ast.getChild(frame.node, 1), DataType::NONE_T };
+                case 2:
+                    if (elseBody != NO_AST_INDEX) {
+                        return TypeCheckFrame{ elseBody, DataType::NONE_T };
+                    }
+                    return TypeCheckSuccess{ DataType::NONE_T };
+                default:
+                    return childResult;
+            }
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto lexprGeQ = lexpr->toQuadruples(globalLabelId, intermediateId + 1);
-            const auto rexprGeQ = rexpr->toQuadruples(globalLabelId, intermediateId + 2);
-            quads.insert(quads.end(), lexprGeQ.quads.begin(), lexprGeQ.quads.end());
-            quads.insert(quads.end(), rexprGeQ.quads.begin(), rexprGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"%", lexprGeQ.result, rexprGeQ.result, intermediate});
-            return { quads, intermediate };
+        Step visitWhileStmt(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto condExpr = ast.getChild(frame.node, 0);
+            switch (frame.step) {
+                case 0:
+                    enterScope(frame);
+                    return TypeCheckFrame{ condExpr, DataType::NONE_T };
+                case 1:
+                    if (const auto error = checkOperand(condExpr, childResult, BOOLEAN_TYPES, "Condition must be boolean")) {
+                        return *error;
+                    }
+                    return TypeCheckFrame{ ast.getChild(frame.node, 1), DataType::NONE_T };
+                default:
+                    return childResult;
+            }
+        }
+
+        Step visitForStmt(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto children = ast.getChildren(frame.node);
+            if (frame.step == 0) {
+                enterScope(frame);
+            }
+            if (frame.step < 2) {
+                return TypeCheckFrame{ children[frame.step], DataType::NONE_T };
+            }
+            if (frame.step == 2) {
+                if (const auto error = checkOperand(children[1], childResult, BOOLEAN_TYPES, "Condition must be boolean")) {
+                    return *error;
+                }
+            }
+            // The increment is checked before the body
+            return typeCheckAll(frame, children.subspan(2), DataType::NONE_T, 2);
+        }
+
+        Step visitVarAssign(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            return typeCheckAssignment(frame, childResult, frame.assignedType, false);
+        }
+
+        Step visitForVarDecl(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            return typeCheckAll(frame, ast.getChildren(frame.node), DataType::NONE_T);
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto lexprResult = lexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(lexprResult)) {
-                return lexprResult;
+        Step visitReturnStmt(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto expr = ast.getChild(frame.node, 0);
+            if (frame.step == 0 && expr != NO_AST_INDEX) {
+                return TypeCheckFrame{ expr, DataType::NONE_T };
             }
-            const auto lexprType = std::get<TypeCheckSuccess>(lexprResult).type;
-            if (!checkType(lexprType, {DataType::INT_T, DataType::FLOAT_T})) {
-                return TypeCheckError{ "The operands must be numeric", lexpr->getWhere() };
+            // No return type checking for now
+            return TypeCheckSuccess{ DataType::NONE_T };
+        }
+
+        Step visitAssignExpr(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            return typeCheckAssignment(frame, childResult, DataType::NONE_T, true);
+        }
+
+        Step visitBinaryExpr(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto& typing = getOperatorTyping(ast.getKind(frame.node));
+            const auto lexpr = ast.getChild(frame.node, 0);
+            const auto rexpr = ast.getChild(frame.node, 1);
+            if (frame.step == 0) {
+                return TypeCheckFrame{ lexpr, DataType::NONE_T };
             }
-            const auto rexprResult = rexpr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(rexprResult)) {
-                return rexprResult;
+            if (frame.step == 1) {
+                if (const auto error = checkOperand(lexpr, childResult, typing.operandTypes, typing.leftOperandError)) {
+                    return *error;
+                }
+                frame.firstType = getType(childResult);
+                return TypeCheckFrame{ rexpr, DataType::NONE_T };
             }
-            const auto rexprType = std::get<TypeCheckSuccess>(rexprResult).type;
-            if (!checkType(rexprType, {DataType::INT_T, DataType::FLOAT_T})) {
-                return TypeCheckError{ "The operands must be numeric", rexpr->getWhere() };
+            if (const auto error = checkOperand(rexpr, childResult, typing.operandTypes, typing.rightOperandError)) {
+                return *error;
             }
-            if (lexprType == DataType::FLOAT_T || rexprType == DataType::FLOAT_T) {
-                return TypeCheckSuccess{ DataType::FLOAT_T };
+            const auto lexprType = frame.firstType;
+            const auto rexprType = getType(childResult);
+            if (typing.operandsAlike && !(
+                (isTypeAllowed(lexprType, NUMERIC_TYPES) && isTypeAllowed(rexprType, NUMERIC_TYPES)) ||
+                (isTypeAllowed(lexprType, STRING_TYPES) && isTypeAllowed(rexprType, STRING_TYPES))
+            )) {
+                auto message = std::string(typing.mismatchError);
+                if (typing.mismatchNamesTypes) {
+                    message += getDataTypeName(lexprType) + " and " + getDataTypeName(rexprType);
+                }
+                return TypeCheckError{ message, ast.getWhere(frame.node) };
             }
-            return TypeCheckSuccess{ DataType::INT_T };
+            return TypeCheckSuccess{ getOperatorResultType(typing, lexprType, rexprType) };
         }
-}; // lexpr: AstNode, rexpr: AstNode
 
-export class UnaryPlusExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> expr;
+        Step visitUnaryExpr(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto& typing = getOperatorTyping(ast.getKind(frame.node));
+            const auto expr = ast.getChild(frame.node, 0);
+            if (frame.step == 0) {
+                return TypeCheckFrame{ expr, DataType::NONE_T };
+            }
+            if (const auto error = checkOperand(expr, childResult, typing.operandTypes, typing.leftOperandError)) {
+                return *error;
+            }
+            const auto valueType = getType(childResult);
+            return TypeCheckSuccess{ getOperatorResultType(typing, valueType, valueType) };
+        }
 
-    public:
-        UnaryPlusExpr(std::unique_ptr<AstNode> expr): AstNode("UnaryPlusExpr"), expr(std::move(expr)) {}
-        ~UnaryPlusExpr() = default;
+        Step visitFuncCall(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            const auto node = frame.node;
+            if (frame.step == 0) {
+                const auto& id = ast.getToken(node);
+                const auto entry = lookup(node);
+                if (entry == nullptr) {
+                    return TypeCheckError{ "Function not found", id.getPosition() };
+                }
+                if (entry->type != DataType::FUNC_T) {
+                    return TypeCheckError{ "Function call on a non-function", id.getPosition() };
+                }
+                annotations->setBinding(node, entry->declaration);
+            }
+            // No argument type check for now
+            const auto args = ast.getChildren(node);
+            if (frame.step < args.size()) {
+                return TypeCheckFrame{ args[frame.step], DataType::NONE_T };
+            }
+            // Function call returns the any type for now
+            return TypeCheckSuccess{ DataType::ANY_T };
+        }
 
-        std::string getWhere() const override {
-            return expr->getWhere();
+        Step visitSyntaxError(TypeCheckFrame& frame, const TypeCheckResult& childResult) {
+            return TypeCheckError{ "Syntax error", ast.getWhere(frame.node) };
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto valueGeQ = expr->toQuadruples(globalLabelId, intermediateId + 1);
-            quads.insert(quads.end(), valueGeQ.quads.begin(), valueGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"+", valueGeQ.result, "", intermediate});
-            return { quads, intermediate };
+        // Whether the globals a cached declaration depends on still have the signatures it was checked with
+        bool isReusable(const CachedDeclarationCheck& cached) const {
+            for (const auto& [name, signature] : cached.dependencies) {
+                const auto nameId = ast.findNameId(name);
+                const auto entry = nameId.has_value() ? symbolTable.lookup(*nameId) : nullptr;
+                if (entry == nullptr ? signature.has_value()
+                    : !signature.has_value() || *signature != CachedDeclarationCheck::Signature{ entry->type, entry->isArray }) {
+                    return false;
+                }
+            }
+            return true;
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto valueResult = expr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(valueResult)) {
-                return valueResult;
+        // Applies a cached declaration's annotations and global declarations to the declaration
+        // spanning the nodes from first to last
+        void reuse(const CachedDeclarationCheck& cached, AstIndex first, AstIndex last) {
+            // The globals it refers to are looked up before it declares its own, as when it was checked
+            for (AstIndex node = first; node <= last; node++) {
+                const auto binding = cached.bindings[node - first];
+                ownAnnotations.setType(node, cached.types[node - first]);
+                if (binding == CachedDeclarationCheck::GLOBAL_BINDING) {
+                    const auto entry = symbolTable.lookup(ast.getNameId(node));
+                    if (entry == nullptr) {
+                        throw std::runtime_error("Cached declaration refers to an undeclared global");
+                    }
+                    ownAnnotations.setBinding(node, entry->declaration);
+                } else if (binding != NO_AST_INDEX) {
+                    ownAnnotations.setBinding(node, first + binding);
+                }
             }
-            const auto valueType = std::get<TypeCheckSuccess>(valueResult).type;
-            if (!checkType(valueType, {DataType::INT_T, DataType::FLOAT_T})) {
-                return TypeCheckError{ "The operand must be numeric", expr->getWhere() };
+            for (const auto& exported : cached.exports) {
+                const auto declaration = first + exported.declaration;
+                declare(ast.getNameId(declaration), SymbolTableEntry{ exported.signature.type, exported.signature.isArray, declaration }, exported.replace);
             }
-            return TypeCheckSuccess{ valueType };
         }
-}; // expr: AstNode
 
-export class UnaryMinusExpr : public AstNode {
+    public:
+        FlatAstTypeChecker(const FlatAst& ast) : FlatAstVisitor(ast), symbolTable(ast.getNameCount()), ownAnnotations(ast.size()), annotations(&ownAnnotations) {}
+        FlatAstTypeChecker(const FlatAstTypeChecker&) = delete;
+        FlatAstTypeChecker& operator=(const FlatAstTypeChecker&) = delete;
+
+        TypeCheckResult startTypeCheck() {
+            symbolTable = SymbolTable(ast.getNameCount());
+            ownAnnotations = TypeAnnotations(ast.size());
+            return typeCheck(ast.getRoot(), DataType::NONE_T);
+        }
+
+        // Gives the same result and annotations as startTypeCheck, but checks the function bodies on up
+        // to threadCount threads, the calling one and those of the shared ThreadPool. The top-level
+        // declarations are first checked in order without the function bodies, collecting the globals
+        // each body can see; then the bodies are checked apart from each other, and the error of the
+        // first declaration in source order is reported.
+        TypeCheckResult startTypeCheckParallel(unsigned int threadCount = std::thread::hardware_concurrency()) {
+            const auto root = ast.getRoot();
+            if (ast.getKind(root) != AstKind::START) {
+                return startTypeCheck();
+            }
+            symbolTable = SymbolTable(ast.getNameCount());
+            ownAnnotations = TypeAnnotations(ast.size());
+            const auto declarations = ast.getChildren(root);
+
+            GlobalSymbols collectedGlobals(ast.getNameCount());
+            recordedGlobals = &collectedGlobals;
+            std::vector<uint32_t> functions;
+            std::optional<TypeCheckResult> firstError;
+            uint32_t firstErrorPosition = declarations.size();
+            visits++;
+            for (uint32_t position = 0; position < declarations.size(); position++) {
+                const auto declaration = declarations[position];
+                globalPosition = position;
+                const auto isFunction = ast.getKind(declaration) == AstKind::FUNC_DEF;
+                if (isFunction) {
+                    visits++;
+                }
+                const auto result = isFunction ? typeCheckSignature(declaration) : typeCheck(declaration, DataType::NONE_T);
+                if (isError(result)) {
+                    firstError = result;
+                    firstErrorPosition = position;
+                    break;
+                }
+                if (isFunction) {
+                    functions.push_back(position);
+                }
+            }
+            recordedGlobals = nullptr;
+
+            const size_t workerCount = std::min<size_t>(std::max(threadCount, 1u), std::max<size_t>(functions.size(), 1));
+            std::vector<std::optional<TypeCheckResult>> bodyResults(functions.size());
+            std::vector<long> workerVisits(workerCount);
+            std::atomic<size_t> nextIndex = 0;
+            const auto worker = [&](size_t workerIndex) {
+                // Each body leaves the checker's symbol table empty, so one checker serves all the bodies of a worker
+                FlatAstTypeChecker bodyChecker(ast, collectedGlobals, 0, ownAnnotations);
+                while (true) {
+                    const size_t index = nextIndex++;
+                    if (index >= functions.size()) {
+                        break;
+                    }
+                    bodyChecker.globalPosition = functions[index];
+                    bodyResults[index] = bodyChecker.typeCheckBody(declarations[functions[index]]);
+                }
+                workerVisits[workerIndex] = bodyChecker.visits;
+            };
+
+            ThreadPool::getShared().run(workerCount, worker);
+
+            for (const auto workerVisitCount : workerVisits) {
+                visits += workerVisitCount;
+            }
+            for (size_t index = 0; index < functions.size(); index++) {
+                if (functions[index] < firstErrorPosition && isError(*bodyResults[index])) {
+                    firstError = bodyResults[index];
+                    firstErrorPosition = functions[index];
+                }
+            }
+            if (firstError.has_value()) {
+                return *firstError;
+            }
+            return TypeCheckSuccess{ DataType::NONE_T };
+        }
+
+        // Gives the same result and annotations as startTypeCheck, but only checks the top-level
+        // declarations that changed since the check that filled the cache, or whose dependencies
+        // changed signature. The other declarations take their results from the cache; the
+        // declarations after an error are dropped from it.
+        TypeCheckResult startTypeCheckIncremental(TypeCheckCache& cache) {
+            const auto root = ast.getRoot();
+            if (ast.getKind(root) != AstKind::START) {
+                cache.clear();
+                return startTypeCheck();
+            }
+            symbolTable = SymbolTable(ast.getNameCount());
+            ownAnnotations = TypeAnnotations(ast.size());
+            visits++;
+
+            std::map<std::string, CachedDeclarationCheck> newDeclarations;
+            int reused = 0;
+            int rechecked = 0;
+            for (const auto declaration : ast.getChildren(root)) {
+                const auto first = ast.getFirstNode(declaration);
+                const auto key = ast.getSubtreeKey(declaration);
+
+                const CachedDeclarationCheck* cached = cache.find(key);
+                if (cached == nullptr) {
+                    auto found = newDeclarations.find(key);
+                    if (found != newDeclarations.end()) {
+                        cached = &found->second;
+                    }
+                }
+                if (cached != nullptr && isReusable(*cached)) {
+                    reuse(*cached, first, declaration);
+                    newDeclarations.emplace(key, *cached);
+                    reused++;
+                    continue;
+                }
+
+                CachedDeclarationCheck check;
+                recording = &check;
+                recordingFirst = first;
+                recordingLast = declaration;
+                const auto result = typeCheck(declaration, DataType::NONE_T);
+                recording = nullptr;
+                rechecked++;
+                if (isError(result)) {
+                    cache.update(std::move(newDeclarations), reused, rechecked);
+                    return result;
+                }
+                for (AstIndex node = first; node <= declaration; node++) {
+                    const auto binding = ownAnnotations.getBinding(node);
+                    check.types.push_back(ownAnnotations.getType(node));
+                    check.bindings.push_back(binding == NO_AST_INDEX ? NO_AST_INDEX
+                        : binding < first || binding > declaration ? CachedDeclarationCheck::GLOBAL_BINDING
+                        : binding - first);
+                }
+                newDeclarations.emplace(key, std::move(check));
+            }
+
+            cache.update(std::move(newDeclarations), reused, rechecked);
+            return TypeCheckSuccess{ DataType::NONE_T };
+        }
+
+        // Complete only if the type check succeeded
+        const TypeAnnotations& getAnnotations() const {
+            return *annotations;
+        }
+
+        long getVisits() const {
+            return visits;
+        }
+};
+
+// A node whose IR is being generated, with the number of the first temporary its expression may use
+struct GeneratorFrame {
+    AstIndex node;
+    int intermediateId = 0;
+    uint32_t step = 0;
+    // Operands kept between the steps of the node: its labels, its name or an evaluated operand
+    std::array<Operand, 3> saved{};
+};
+
+// Generates the IR of a FlatAst. Each node appends its instructions to the builder and gives the
+// operand holding its value; intermediateId numbers the temporaries of an expression.
+export class FlatAstQuadrupleGenerator : public FlatAstVisitor<FlatAstQuadrupleGenerator, GeneratorFrame, Operand> {
     private:
-        std::unique_ptr<AstNode> expr;
+        friend class FlatAstVisitor<FlatAstQuadrupleGenerator, GeneratorFrame, Operand>;
 
-    public:
-        UnaryMinusExpr(std::unique_ptr<AstNode> expr): AstNode("UnaryMinusExpr"), expr(std::move(expr)) {}
-        ~UnaryMinusExpr() = default;
+        // Set while generate runs
+        IRBuilder* builder = nullptr;
+
+        // The function whose declarations are being visited, none outside functions
+        Operand function;
+
+        // The operator opcodes are in the same order as the operator kinds
+        static_assert(static_cast<int>(Opcode::NOT) - static_cast<int>(Opcode::OR) == static_cast<int>(AstKind::NOT_EXPR) - static_cast<int>(AstKind::OR_EXPR));
 
-        std::string getWhere() const override {
-            return expr->getWhere();
+        static Opcode getOpcode(AstKind kind) {
+            if (kind < AstKind::OR_EXPR || kind > AstKind::NOT_EXPR) {
+                throw std::runtime_error("Not an operator expression");
+            }
+            return static_cast<Opcode>(static_cast<int>(Opcode::OR) + static_cast<int>(kind) - static_cast<int>(AstKind::OR_EXPR));
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto valueGeQ = expr->toQuadruples(globalLabelId, intermediateId + 1);
-            quads.insert(quads.end(), valueGeQ.quads.begin(), valueGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"-", valueGeQ.result, "", intermediate});
-            return { quads, intermediate };
+        static ConstantKind getConstantKind(const Token& value) {
+            switch (value.getType()) {
+                case TokenType::INTEGER: return ConstantKind::INT;
+                case TokenType::FLOAT: return ConstantKind::FLOAT;
+                case TokenType::STRING: return ConstantKind::STRING;
+                default: throw std::runtime_error("Invalid constant type");
+            }
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto valueResult = expr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(valueResult)) {
-                return valueResult;
+        void emitConditionalJump(Operand condResult, Operand trueLabel, Operand falseLabel) {
+            builder->emit(Opcode::IF, condResult, {}, trueLabel);
+            builder->emit(Opcode::GOTO, {}, {}, falseLabel);
+        }
+
+        // Generates the nodes one per step from firstStep on, each with its own temporaries
+        Step generateAll(const GeneratorFrame& frame, std::span<const AstIndex> nodes, uint32_t firstStep = 0) {
+            const auto index = frame.step - firstStep;
+            if (index < nodes.size()) {
+                return GeneratorFrame{ nodes[index], 0 };
             }
-            const auto valueType = std::get<TypeCheckSuccess>(valueResult).type;
-            if (!checkType(valueType, {DataType::INT_T, DataType::FLOAT_T})) {
-                return TypeCheckError{ "The operand must be numeric", expr->getWhere() };
+            return Operand{};
+        }
+
+        // A scalar target is assigned the value. An array element is stored to after evaluating the
+        // value, then the index; the value is the result, evaluated into this node's temporary so an
+        // enclosing expression can read it.
+        Step appendAssignment(GeneratorFrame& frame, Operand childResult) {
+            const auto var = ast.getChild(frame.node, 0);
+            const auto arrayIndex = ast.getChild(var, 0);
+            auto& id = frame.saved[0];
+            auto& value = frame.saved[1];
+            switch (frame.step) {
+                case 0:
+                    id = builder->name(ast.getToken(var).getValue());
+                    return GeneratorFrame{ ast.getChild(frame.node, 1), frame.intermediateId + (arrayIndex == NO_AST_INDEX ? 1 : 0) };
+                case 1:
+                    if (arrayIndex == NO_AST_INDEX) {
+                        builder->emit(Opcode::ASSIGN, childResult, {}, id);
+                        return id;
+                    }
+                    value = childResult;
+                    return GeneratorFrame{ arrayIndex, frame.intermediateId + 1 };
+                default:
+                    builder->emit(Opcode::INDEX_STORE, value, childResult, id);
+                    return value;
             }
-            return TypeCheckSuccess{ valueType };
         }
-}; // expr: AstNode
 
-export class NotExpr : public AstNode {
-    private:
-        std::unique_ptr<AstNode> expr;
+        // An assignment as a statement has no value
+        Step appendAssignmentStmt(GeneratorFrame& frame, Operand childResult) {
+            const auto step = appendAssignment(frame, childResult);
+            if (std::holds_alternative<Operand>(step)) {
+                return Operand{};
+            }
+            return step;
+        }
 
-    public:
-        NotExpr(std::unique_ptr<AstNode> expr): AstNode("NotExpr"), expr(std::move(expr)) {}
-        ~NotExpr() = default;
+        Step visitStart(GeneratorFrame& frame, Operand childResult) {
+            return generateAll(frame, ast.getChildren(frame.node));
+        }
 
-        std::string getWhere() const override {
-            return expr->getWhere();
+        Step visitFuncDef(GeneratorFrame& frame, Operand childResult) {
+            const auto params = ast.getChildren(frame.node).subspan(2);
+            auto& id = frame.saved[0];
+            if (frame.step == 0) {
+                id = builder->name(ast.getToken(frame.node).getValue());
+                builder->markGlobal(id);
+                function = id;
+                builder->emit(Opcode::FUNCTION, id, Operand::count(params.size()));
+            } else if (frame.step <= params.size()) {
+                builder->emit(Opcode::PARAM, childResult, Operand::count(frame.step));
+            }
+            if (frame.step < params.size()) {
+                return GeneratorFrame{ params[frame.step], 0 };
+            }
+            if (frame.step == params.size()) {
+                return GeneratorFrame{ ast.getChild(frame.node, 1), 0 };
+            }
+            builder->emit(Opcode::ENDFUNC, id);
+            function = Operand{};
+            return Operand{};
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            const auto valueGeQ = expr->toQuadruples(globalLabelId, intermediateId + 1);
-            quads.insert(quads.end(), valueGeQ.quads.begin(), valueGeQ.quads.end());
-            const auto intermediate = getIntermediate(intermediateId);
-            quads.emplace_back(Quadruple{"-", valueGeQ.result, "", intermediate});
-            return { quads, intermediate };
+        Step visitParam(GeneratorFrame& frame, Operand childResult) {
+            const auto id = builder->name(ast.getToken(frame.node).getValue());
+            builder->declareLocal(function, id);
+            if (ast.isArray(frame.node)) {
+                builder->markArray(id);
+            }
+            return id;
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto valueResult = expr->typeCheck(symbolTableNode, DataType::NONE_T);
-            if (std::holds_alternative<TypeCheckError>(valueResult)) {
-                return valueResult;
+        Step visitVarDecl(GeneratorFrame& frame, Operand childResult) {
+            const auto assignables = ast.getChildren(frame.node).subspan(1);
+            if (frame.step == 0) {
+                for (const auto assignable : assignables) {
+                    const auto var = ast.getChild(assignable, 0);
+                    const auto id = builder->name(ast.getToken(var).getValue());
+                    if (function.getKind() == OperandKind::NONE) {
+                        builder->markGlobal(id);
+                    } else {
+                        builder->declareLocal(function, id);
+                    }
+                    if (ast.getChild(var, 0) != NO_AST_INDEX) {
+                        builder->markArray(id);
+                    }
+                }
             }
-            const auto valueType = std::get<TypeCheckSuccess>(valueResult).type;
-            if (!checkType(valueType, {DataType::BOOL_T, DataType::INT_T})) {
-                return TypeCheckError{ "The operand must be boolean", expr->getWhere() };
+            // The type generates nothing
+            return generateAll(frame, assignables);
+        }
+
+        Step visitVarAssignable(GeneratorFrame& frame, Operand childResult) {
+            if (ast.getChild(frame.node, 1) != NO_AST_INDEX) {
+                return appendAssignmentStmt(frame, childResult);
             }
-            return TypeCheckSuccess{ DataType::BOOL_T };
+            return Operand{};
         }
-}; // expr: AstNode
 
-export class FuncCall : public AstNode {
-    private:
-        Token id;
-        std::vector<std::unique_ptr<AstNode>> exprs;
+        Step visitVar(GeneratorFrame& frame, Operand childResult) {
+            const auto arrayIndex = ast.getChild(frame.node, 0);
+            auto& id = frame.saved[0];
+            if (frame.step == 0) {
+                id = builder->name(ast.getToken(frame.node).getValue());
+                if (arrayIndex == NO_AST_INDEX) {
+                    return id;
+                }
+                return GeneratorFrame{ arrayIndex, frame.intermediateId + 1 };
+            }
+            const auto intermediate = builder->temp(frame.intermediateId);
+            builder->emit(Opcode::INDEX, id, childResult, intermediate);
+            return intermediate;
+        }
 
-    public:
-        FuncCall(Token id, std::vector<std::unique_ptr<AstNode>> arguments): AstNode("FuncCall"), id(id), exprs(std::move(arguments)) {}
-        ~FuncCall() = default;
+        Step visitType(GeneratorFrame& frame, Operand childResult) {
+            return Operand{};
+        }
 
-        std::string getWhere() const override {
-            return id.getPosition();
+        Step visitConstant(GeneratorFrame& frame, Operand childResult) {
+            const auto& value = ast.getToken(frame.node);
+            return builder->constant(getConstantKind(value), value.getValue());
         }
 
-        GeQ toQuadruples(int& globalLabelId, int intermediateId) const override {
-            Quadruples quads;
-            for (int i = exprs.size() - 1; i >= 0; --i) {
-                const auto argGeQ = exprs[i]->toQuadruples(globalLabelId, intermediateId + 1);
-                quads.insert(quads.end(), argGeQ.quads.begin(), argGeQ.quads.end());
-                quads.emplace_back(Quadruple{"PUSH", argGeQ.result, "", ""});
+        Step visitBlockStmt(GeneratorFrame& frame, Operand childResult) {
+            return generateAll(frame, ast.getChildren(frame.node));
+        }
+
+        Step visitIfStmt(GeneratorFrame& frame, Operand childResult) {
+            auto& [label1, label2, label3] = frame.saved;
+            const auto elseBody = ast.getChild(frame.node, 2);
+            switch (frame.step) {
+                case 0:
+                    label1 = builder->createLabel();
+                    label2 = builder->createLabel();
+                    return GeneratorFrame{ ast.getChild(frame.node, 0), frame.intermediateId + 1 };
+                case 1:
+                    emitConditionalJump(childResult, label1, label2);
+                    builder->emitLabel(label1);
+                    return GeneratorFrame{ ast.getChild(frame.node, 1), 0 };
+                case 2:
+                    if (elseBody != NO_AST_INDEX) {
+                        label3 = builder->createLabel();
+                        builder->emit(Opcode::GOTO, {}, {}, label3);
+                        builder->emitLabel(label2);
+                        return GeneratorFrame{ elseBody, 0 };
+                    }
+                    builder->emitLabel(label2);
+                    return Operand{};
+                default:
+                    builder->emitLabel(label3);
+                    return Operand{};
+            }
+        }
+
+        Step visitWhileStmt(GeneratorFrame& frame, Operand childResult) {
+            auto& [label1, label2, label3] = frame.saved;
+            switch (frame.step) {
+                case 0:
+                    label1 = builder->createLabel();
+                    label2 = builder->createLabel();
+                    label3 = builder->createLabel();
+                    builder->emitLabel(label1);
+                    return GeneratorFrame{ ast.getChild(frame.node, 0), frame.intermediateId + 1 };
+                case 1:
+                    emitConditionalJump(childResult, label2, label3);
+                    builder->emitLabel(label2);
+                    return GeneratorFrame{ ast.getChild(frame.node, 1), 0 };
+                default:
+                    builder->emit(Opcode::GOTO, {}, {}, label1);
+                    builder->emitLabel(label3);
+                    return Operand{};
+            }
+        }
+
+        // The body is generated before the increment
+        Step visitForStmt(GeneratorFrame& frame, Operand childResult) {
+            auto& [label1, label2, label3] = frame.saved;
+            switch (frame.step) {
+                case 0:
+                    label1 = builder->createLabel();
+                    label2 = builder->createLabel();
+                    label3 = builder->createLabel();
+                    return GeneratorFrame{ ast.getChild(frame.node, 0), 0 };
+                case 1:
+                    builder->emitLabel(label1);
+                    return GeneratorFrame{ ast.getChild(frame.node, 1), frame.intermediateId + 1 };
+                case 2:
+                    emitConditionalJump(childResult, label2, label3);
+                    builder->emitLabel(label2);
+                    return GeneratorFrame{ ast.getChild(frame.node, 3), 0 };
+                case 3:
+                    return GeneratorFrame{ ast.getChild(frame.node, 2), 0 };
+                default:
+                    builder->emit(Opcode::GOTO, {}, {}, label1);
+                    builder->emitLabel(label3);
+                    return Operand{};
+            }
+        }
+
+        Step visitVarAssign(GeneratorFrame& frame, Operand childResult) {
+            return appendAssignmentStmt(frame, childResult);
+        }
+
+        Step visitForVarDecl(GeneratorFrame& frame, Operand childResult) {
+            return generateAll(frame, ast.getChildren(frame.node));
+        }
+
+        Step visitReturnStmt(GeneratorFrame& frame, Operand childResult) {
+            const auto expr = ast.getChild(frame.node, 0);
+            if (expr == NO_AST_INDEX) {
+                builder->emit(Opcode::RETURN);
+                return Operand{};
+            }
+            if (frame.step == 0) {
+                return GeneratorFrame{ expr, frame.intermediateId + 1 };
+            }
+            builder->emit(Opcode::RETURN, childResult);
+            return Operand{};
+        }
+
+        Step visitAssignExpr(GeneratorFrame& frame, Operand childResult) {
+            return appendAssignment(frame, childResult);
+        }
+
+        Step visitBinaryExpr(GeneratorFrame& frame, Operand childResult) {
+            auto& lexprResult = frame.saved[0];
+            switch (frame.step) {
+                case 0:
+                    return GeneratorFrame{ ast.getChild(frame.node, 0), frame.intermediateId + 1 };
+                case 1:
+                    lexprResult = childResult;
+                    return GeneratorFrame{ ast.getChild(frame.node, 1), frame.intermediateId + 2 };
+                default: {
+                    const auto intermediate = builder->temp(frame.intermediateId);
+                    builder->emit(getOpcode(ast.getKind(frame.node)), lexprResult, childResult, intermediate);
+                    return intermediate;
+                }
+            }
+        }
+
+        Step visitUnaryExpr(GeneratorFrame& frame, Operand childResult) {
+            if (frame.step == 0) {
+                return GeneratorFrame{ ast.getChild(frame.node, 0), frame.intermediateId + 1 };
             }
-            const auto intermediate = getIntermediate(intermediateId);
-            return { quads, intermediate };
+            const auto intermediate = builder->temp(frame.intermediateId);
+            builder->emit(getOpcode(ast.getKind(frame.node)), childResult, {}, intermediate);
+            return intermediate;
         }
 
-        TypeCheckResult typeCheck(const SymbolTableNode& symbolTableNode, const DataType assignedType) const override {
-            const auto entry = findSymbol(symbolTableNode, id.getValue());
-            if (!entry.has_value()) {
-                return TypeCheckError{ "Function not found", id.getPosition() };
+        // The arguments are pushed last to first
+        Step visitFuncCall(GeneratorFrame& frame, Operand childResult) {
+            const auto args = ast.getChildren(frame.node);
+            if (frame.step > 0) {
+                builder->emit(Opcode::PUSH, childResult);
             }
-            if (entry.value().type != DataType::FUNC_T) {
-                return TypeCheckError{ "Function call on a non-function", id.getPosition() };
+            if (frame.step < args.size()) {
+                return GeneratorFrame{ args[args.size() - 1 - frame.step], frame.intermediateId + 1 };
             }
-            for (const auto& arg : exprs) {
-                const auto argResult = arg->typeCheck(symbolTableNode, DataType::NONE_T);
-                if (std::holds_alternative<TypeCheckError>(argResult)) {
-                    return argResult;
+            const auto intermediate = builder->temp(frame.intermediateId);
+            builder->emit(Opcode::CALL, builder->name(ast.getToken(frame.node).getValue()), Operand::count(args.size()), intermediate);
+            return intermediate;
+        }
+
+        Step visitSyntaxError(GeneratorFrame& frame, Operand childResult) {
+            return Operand{};
+        }
+
+    public:
+        FlatAstQuadrupleGenerator(const FlatAst& ast) : FlatAstVisitor(ast) {}
+
+        // Appends the IR of the whole AST to the builder
+        void generate(IRBuilder& builder) {
+            this->builder = &builder;
+            visit(GeneratorFrame{ ast.getRoot(), 0 });
+            this->builder = nullptr;
+        }
+
+        IrProgram toIr() {
+            // Most nodes generate at most one instruction
+            IRBuilder builder(ast.size());
+            generate(builder);
+            return builder.take();
+        }
+
+        // The IR as text quadruples
+        Quadruples toQuadruples() {
+            const auto program = toIr();
+            const IrPrinter printer(program);
+            Quadruples quads;
+            quads.reserve(program.getInstructions().size());
+            for (const auto& instruction : program.getInstructions()) {
+                if (instruction.opcode == Opcode::LABEL) {
+                    quads.emplace_back(Label{ static_cast<int>(instruction.arg1.getIndex()) });
+                } else {
+                    quads.emplace_back(Quadruple{
+                        std::string(getOpcodeText(instruction.opcode)),
+                        printer.getOperandText(instruction.arg1),
+                        printer.getOperandText(instruction.arg2),
+                        printer.getOperandText(instruction.result),
+                    });
                 }
-                // No argument type check for now
             }
-            // Function call returns the any type for now
-            return TypeCheckSuccess{ DataType::ANY_T };
+            return quads;
         }
-}; // id: Token, exprs: AstNode[]
+
+        std::string toQuadrupleString() {
+            return IrPrinter(toIr()).toString();
+        }
+};
+
+std::string AstNode::getWhere() const {
+    const auto flatAst = toFlatAst();
+    return flatAst.getWhere(flatAst.getRoot());
+}
+
+std::string AstNode::toQuadrupleString() const {
+    const auto flatAst = toFlatAst();
+    return FlatAstQuadrupleGenerator(flatAst).toQuadrupleString();
+}
+
+TypeCheckResult AstNode::startTypeCheck() const {
+    const auto flatAst = toFlatAst();
+    return FlatAstTypeChecker(flatAst).startTypeCheck();
+}
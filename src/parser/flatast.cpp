@@ -0,0 +1,384 @@
+module;
+
+#include <vector>
+#include <string>
+#include <span>
+#include <cstdint>
+#include <optional>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include <unordered_map>
+#include <algorithm>
+#include <variant>
+
+export module flatast;
+
+import token;
+
+export enum class AstKind : uint8_t {
+    START,
+    FUNC_DEF,
+    PARAM,
+    VAR_DECL,
+    VAR_ASSIGNABLE,
+    VAR,
+    TYPE,
+    CONSTANT,
+    BLOCK_STMT,
+    IF_STMT,
+    WHILE_STMT,
+    FOR_STMT,
+    VAR_ASSIGN,
+    FOR_VAR_DECL,
+    RETURN_STMT,
+    ASSIGN_EXPR,
+    OR_EXPR,
+    AND_EXPR,
+    EQUAL_EXPR,
+    NOT_EQUAL_EXPR,
+    LESS_EXPR,
+    LESS_EQUAL_EXPR,
+    GREATER_EXPR,
+    GREATER_EQUAL_EXPR,
+    ADD_EXPR,
+    SUB_EXPR,
+    MUL_EXPR,
+    DIV_EXPR,
+    MOD_EXPR,
+    UNARY_PLUS_EXPR,
+    UNARY_MINUS_EXPR,
+    NOT_EXPR,
+    FUNC_CALL,
+    SYNTAX_ERROR
+};
+
+export using AstIndex = uint32_t;
+
+// Marks an optional child that is absent, such as the else body of an if statement
+export constexpr AstIndex NO_AST_INDEX = UINT32_MAX;
+
+// An AST stored as columns indexed by node instead of as a tree of heap objects. Nodes are added
+// after their children, so the indices run in post-order and the root is the last node.
+//
+// The children of each node have a fixed layout per kind:
+//     START: declarations...                  FUNC_DEF: type, body, params...
+//     PARAM: type                             VAR_DECL: type, varAssignables...
+//     VAR_ASSIGNABLE: var, expr?              VAR: arrayIndex?
+//     BLOCK_STMT: statements...               IF_STMT: condExpr, thenBody, elseBody?
+//     WHILE_STMT: condExpr, body              FOR_STMT: forVarDecl, condExpr, incrExpr, body
+//     VAR_ASSIGN, ASSIGN_EXPR: var, expr      FOR_VAR_DECL: varAssigns...
+//     RETURN_STMT: expr?                      binary expressions: lexpr, rexpr
+//     unary expressions: expr                 FUNC_CALL: arguments...
+// where an absent optional child is NO_AST_INDEX. FUNC_DEF, PARAM, VAR, TYPE, CONSTANT and FUNC_CALL
+// have a token (the identifier, type keyword or value), as does a SYNTAX_ERROR with any tokens.
+export class FlatAst {
+    private:
+        static constexpr uint32_t NO_TOKEN = UINT32_MAX;
+
+        std::vector<AstKind> kinds;
+        // The children of node i are children[childOffsets[i]] up to children[childOffsets[i + 1]]
+        std::vector<uint32_t> childOffsets{ 0 };
+        std::vector<AstIndex> children;
+        std::vector<uint32_t> tokenIndices;
+        // Only set for PARAM, for array parameters
+        std::vector<bool> arrayFlags;
+        std::vector<Token> tokens;
+        // The token values interned, so that equal names have the same id
+        std::vector<uint32_t> tokenNameIds;
+        std::unordered_map<std::string, uint32_t> nameIds;
+
+    public:
+        FlatAst() {}
+
+        AstIndex addNode(AstKind kind, std::span<const AstIndex> nodeChildren, std::optional<Token> token = std::nullopt, bool isArray = false) {
+            if (kinds.size() >= NO_AST_INDEX) {
+                throw std::runtime_error("Too many AST nodes");
+            }
+            kinds.push_back(kind);
+            children.insert(children.end(), nodeChildren.begin(), nodeChildren.end());
+            childOffsets.push_back(children.size());
+            if (token.has_value()) {
+                tokenIndices.push_back(tokens.size());
+                const auto [nameIdIter, _] = nameIds.try_emplace(token->getValue(), nameIds.size());
+                tokenNameIds.push_back(nameIdIter->second);
+                tokens.push_back(std::move(*token));
+            } else {
+                tokenIndices.push_back(NO_TOKEN);
+            }
+            arrayFlags.push_back(isArray);
+            return kinds.size() - 1;
+        }
+
+        AstIndex addNode(AstKind kind, std::initializer_list<AstIndex> nodeChildren, std::optional<Token> token = std::nullopt, bool isArray = false) {
+            return addNode(kind, std::span<const AstIndex>(nodeChildren.begin(), nodeChildren.size()), std::move(token), isArray);
+        }
+
+        size_t size() const {
+            return kinds.size();
+        }
+
+        AstIndex getRoot() const {
+            if (kinds.empty()) {
+                throw std::runtime_error("Empty AST has no root");
+            }
+            return kinds.size() - 1;
+        }
+
+        AstKind getKind(AstIndex node) const {
+            return kinds[node];
+        }
+
+        std::span<const AstIndex> getChildren(AstIndex node) const {
+            return std::span<const AstIndex>(children).subspan(childOffsets[node], childOffsets[node + 1] - childOffsets[node]);
+        }
+
+        // The child in the given slot of the node's layout; NO_AST_INDEX if an optional child is absent
+        AstIndex getChild(AstIndex node, size_t slot) const {
+            return children[childOffsets[node] + slot];
+        }
+
+        bool hasToken(AstIndex node) const {
+            return tokenIndices[node] != NO_TOKEN;
+        }
+
+        const Token& getToken(AstIndex node) const {
+            return tokens[tokenIndices[node]];
+        }
+
+        // The interned value of the node's token, from 0 up to getNameCount()
+        uint32_t getNameId(AstIndex node) const {
+            return tokenNameIds[tokenIndices[node]];
+        }
+
+        size_t getNameCount() const {
+            return nameIds.size();
+        }
+
+        std::optional<uint32_t> findNameId(const std::string& name) const {
+            const auto nameIdIter = nameIds.find(name);
+            if (nameIdIter == nameIds.end()) {
+                return std::nullopt;
+            }
+            return nameIdIter->second;
+        }
+
+        // The first node of the subtree rooted at the node, which spans from there up to the node
+        AstIndex getFirstNode(AstIndex node) const {
+            while (true) {
+                const auto nodeChildren = getChildren(node);
+                const auto firstChild = std::find_if(nodeChildren.begin(), nodeChildren.end(), [](AstIndex child) { return child != NO_AST_INDEX; });
+                if (firstChild == nodeChildren.end()) {
+                    return node;
+                }
+                node = *firstChild;
+            }
+        }
+
+        // Equal for subtrees with the same shape, kinds and token values, wherever they are in the source
+        std::string getSubtreeKey(AstIndex node) const {
+            const auto first = getFirstNode(node);
+            std::string key;
+            for (AstIndex current = first; current <= node; current++) {
+                key += static_cast<char>(kinds[current]);
+                key += arrayFlags[current] ? '1' : '0';
+                for (const auto child : getChildren(current)) {
+                    key += child == NO_AST_INDEX ? "-" : std::to_string(child - first);
+                    key += ',';
+                }
+                if (hasToken(current)) {
+                    const auto value = getToken(current).getValue();
+                    key += std::to_string(value.size()) + ':' + value;
+                }
+                key += ';';
+            }
+            return key;
+        }
+
+        bool isArray(AstIndex node) const {
+            return arrayFlags[node];
+        }
+
+        // The position reported in errors about the node, the same as AstNode::getWhere
+        std::string getWhere(AstIndex node) const {
+            while (true) {
+                const auto kind = kinds[node];
+                if (hasToken(node) && kind != AstKind::FUNC_DEF && kind != AstKind::PARAM) {
+                    return getToken(node).getPosition();
+                }
+                const auto nodeChildren = getChildren(node);
+                if (kind == AstKind::SYNTAX_ERROR || nodeChildren.empty() || nodeChildren[0] == NO_AST_INDEX) {
+                    return kind == AstKind::RETURN_STMT ? "return" : "unknown";
+                }
+                node = nodeChildren[0];
+            }
+        }
+};
+
+// Base of the passes over a FlatAst. The nodes are visited with an explicit stack of Frames instead
+// of recursion, so deeply nested input cannot exhaust the call stack. A Frame holds the node and the
+// number of steps taken on it so far, plus whatever state the pass keeps for the node between steps.
+//
+// Each step calls the visit method of Derived for the node's kind directly, so there is no virtual
+// call and the handlers can be inlined. The method gets the frame and, after the first step, the
+// result of the child it asked for last. It returns either the Frame of a child to visit next or the
+// node's Result. Binary and unary expressions go to visitBinaryExpr and visitUnaryExpr unless Derived
+// handles the kind itself; every other kind must be handled by Derived.
+//
+// Derived may also define enterNode and leaveNode, called when a node is entered and with its result
+// when it is left, and isFailure: a child result it accepts is returned for every node up to the root
+// without taking more steps on them, though leaveNode is still called.
+export template <typename Derived, typename Frame, typename Result>
+class FlatAstVisitor {
+    protected:
+        using Step = std::variant<Frame, Result>;
+
+        const FlatAst& ast;
+
+        FlatAstVisitor(const FlatAst& ast) : ast(ast) {}
+
+        void enterNode(Frame& frame) {}
+
+        void leaveNode(Frame& frame, Result& result) {}
+
+        bool isFailure(const Result& result) const {
+            return false;
+        }
+
+        Step visitOrExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitAndExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitEqualExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitNotEqualExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitLessExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitLessEqualExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitGreaterExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitGreaterEqualExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitAddExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitSubExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitMulExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitDivExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitModExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitBinaryExpr(frame, childResult);
+        }
+
+        Step visitUnaryPlusExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitUnaryExpr(frame, childResult);
+        }
+
+        Step visitUnaryMinusExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitUnaryExpr(frame, childResult);
+        }
+
+        Step visitNotExpr(Frame& frame, const Result& childResult) {
+            return static_cast<Derived&>(*this).visitUnaryExpr(frame, childResult);
+        }
+
+    private:
+        Step visitNode(Frame& frame, const Result& childResult) {
+            auto& self = static_cast<Derived&>(*this);
+            switch (ast.getKind(frame.node)) {
+                case AstKind::START: return self.visitStart(frame, childResult);
+                case AstKind::FUNC_DEF: return self.visitFuncDef(frame, childResult);
+                case AstKind::PARAM: return self.visitParam(frame, childResult);
+                case AstKind::VAR_DECL: return self.visitVarDecl(frame, childResult);
+                case AstKind::VAR_ASSIGNABLE: return self.visitVarAssignable(frame, childResult);
+                case AstKind::VAR: return self.visitVar(frame, childResult);
+                case AstKind::TYPE: return self.visitType(frame, childResult);
+                case AstKind::CONSTANT: return self.visitConstant(frame, childResult);
+                case AstKind::BLOCK_STMT: return self.visitBlockStmt(frame, childResult);
+                case AstKind::IF_STMT: return self.visitIfStmt(frame, childResult);
+                case AstKind::WHILE_STMT: return self.visitWhileStmt(frame, childResult);
+                case AstKind::FOR_STMT: return self.visitForStmt(frame, childResult);
+                case AstKind::VAR_ASSIGN: return self.visitVarAssign(frame, childResult);
+                case AstKind::FOR_VAR_DECL: return self.visitForVarDecl(frame, childResult);
+                case AstKind::RETURN_STMT: return self.visitReturnStmt(frame, childResult);
+                case AstKind::ASSIGN_EXPR: return self.visitAssignExpr(frame, childResult);
+                case AstKind::OR_EXPR: return self.visitOrExpr(frame, childResult);
+                case AstKind::AND_EXPR: return self.visitAndExpr(frame, childResult);
+                case AstKind::EQUAL_EXPR: return self.visitEqualExpr(frame, childResult);
+                case AstKind::NOT_EQUAL_EXPR: return self.visitNotEqualExpr(frame, childResult);
+                case AstKind::LESS_EXPR: return self.visitLessExpr(frame, childResult);
+                case AstKind::LESS_EQUAL_EXPR: return self.visitLessEqualExpr(frame, childResult);
+                case AstKind::GREATER_EXPR: return self.visitGreaterExpr(frame, childResult);
+                case AstKind::GREATER_EQUAL_EXPR: return self.visitGreaterEqualExpr(frame, childResult);
+                case AstKind::ADD_EXPR: return self.visitAddExpr(frame, childResult);
+                case AstKind::SUB_EXPR: return self.visitSubExpr(frame, childResult);
+                case AstKind::MUL_EXPR: return self.visitMulExpr(frame, childResult);
+                case AstKind::DIV_EXPR: return self.visitDivExpr(frame, childResult);
+                case AstKind::MOD_EXPR: return self.visitModExpr(frame, childResult);
+                case AstKind::UNARY_PLUS_EXPR: return self.visitUnaryPlusExpr(frame, childResult);
+                case AstKind::UNARY_MINUS_EXPR: return self.visitUnaryMinusExpr(frame, childResult);
+                case AstKind::NOT_EXPR: return self.visitNotExpr(frame, childResult);
+                case AstKind::FUNC_CALL: return self.visitFuncCall(frame, childResult);
+                case AstKind::SYNTAX_ERROR: return self.visitSyntaxError(frame, childResult);
+            }
+            throw std::runtime_error("Unknown AST node kind");
+        }
+
+    public:
+        // Visits the subtree of the root frame's node and returns the result of the root
+        Result visit(Frame root) {
+            auto& self = static_cast<Derived&>(*this);
+            std::vector<Frame> stack;
+            stack.push_back(std::move(root));
+            self.enterNode(stack.back());
+            Result result{};
+            bool entered = true;
+            while (true) {
+                if (entered || !self.isFailure(result)) {
+                    auto step = visitNode(stack.back(), result);
+                    stack.back().step++;
+                    if (std::holds_alternative<Frame>(step)) {
+                        stack.push_back(std::get<Frame>(std::move(step)));
+                        self.enterNode(stack.back());
+                        result = Result{};
+                        entered = true;
+                        continue;
+                    }
+                    result = std::get<Result>(std::move(step));
+                }
+                self.leaveNode(stack.back(), result);
+                stack.pop_back();
+                if (stack.empty()) {
+                    return result;
+                }
+                entered = false;
+            }
+        }
+};
@@ -7,123 +7,66 @@ module;
 #include <stack>
 #include <stdexcept>
 #include <optional>
+#include <chrono>
+#include <iterator>
+#include <algorithm>
 
 export module ll1parser;
 
 import token;
 import symbol;
 import parserbase;
+import parsertrace;
 import terminalfactory;
 
-export class LL1ParseTree; // forward declaration
-
-export using LL1PTChild = std::variant<Terminal, Token, LL1ParseTree>;
+// A non-terminal whose production is being matched, with the number of its symbols still to match
+struct LL1TreeFrame {
+    ParseTree parseTree;
+    size_t remaining;
+};
 
-class LL1ParseTree {
+// Builds the parse tree as the LL(1) parser expands non-terminals and matches tokens, which it does in
+// the order of the tree's nodes, so only the path to the node being matched is open at a time
+class LL1TreeBuilder {
     private:
-        const NonTerminal nonTerminal;
-        std::vector<LL1PTChild> children;
-        bool hasProduction = false;
-
-        bool placeInner(const Production& production) {
-            if (!hasProduction) {
-                if (nonTerminal == production.first) {
-                    for (const auto& symbol : production.second) {
-                        if (std::holds_alternative<Terminal>(symbol)) {
-                            children.push_back(std::get<Terminal>(symbol));
-                        } else if (std::holds_alternative<NonTerminal>(symbol)) {
-                            children.push_back(std::get<NonTerminal>(symbol));
-                        } else {
-                            throw std::runtime_error("Unknown symbol type in production");
-                        }
-                    }
-                    hasProduction = true;
-                    return true;
-                } else {
-                    throw std::runtime_error("First non-terminal do not match production: " + std::string{nonTerminal.getName()} + " and " + std::string{production.first.getName()});
-                }
-            }
-            for (auto& child : children) {
-                if (std::holds_alternative<Token>(child)) {
-                    // Do nothing
-                } else if (std::holds_alternative<LL1ParseTree>(child)) {
-                    auto& childParseTree = std::get<LL1ParseTree>(child);
-                    bool result = childParseTree.placeInner(production);
-                    if (result) {
-                        return true;
-                    }
-                } else if (std::holds_alternative<Terminal>(child)) {
-                    throw std::runtime_error("First empty child of parse tree is a terminal when trying to place production");
-                }
-            }
-            return false;
-        }
-
-        bool placeInner(const Token& token) {
-            if (!hasProduction) {
-                throw std::runtime_error("First empty child of parse tree is a non-terminal when trying to place token");
-            }
-            for (auto& child : children) {
-                if (std::holds_alternative<Token>(child)) {
-                    // Do nothing
-                } else if (std::holds_alternative<LL1ParseTree>(child)) {
-                        bool result = std::get<LL1ParseTree>(child).placeInner(token);
-                        if (result) {
-                            return true;
-                        }
-                } else if (std::holds_alternative<Terminal>(child)) {
-                    const auto& childTerminal = std::get<Terminal>(child);
-                    if (childTerminal.matchesToken(token)) {
-                        child.emplace<Token>(token);
-                        return true;
-                    } else {
-                        throw std::runtime_error("First terminal do not match token: " + std::string{childTerminal.getName()} + " and " + token.toStringPrint());
-                    }
-                }
+        std::vector<LL1TreeFrame> stack;
+
+        // Adds the completed non-terminals to their parents
+        void closeCompleted() {
+            while (stack.size() > 1 && stack.back().remaining == 0) {
+                auto completed = std::move(stack.back().parseTree);
+                stack.pop_back();
+                stack.back().parseTree.addChild(std::move(completed));
+                stack.back().remaining--;
             }
-            return false;
         }
 
     public:
-        LL1ParseTree(const NonTerminal& nonTerminal) : nonTerminal(nonTerminal) {}
+        LL1TreeBuilder() {}
 
-        void place(const Production& production) {
-            bool result = placeInner(production);
-            if (!result) {
+        void expand(const NonTerminal& nonTerminal, size_t symbolCount) {
+            if (!stack.empty() && stack.back().remaining == 0) {
                 throw std::runtime_error("Failed to place production in parse tree");
             }
+            stack.push_back({ ParseTree(nonTerminal), symbolCount });
+            closeCompleted();
         }
 
-        void place(const Token& token) {
-            bool result = placeInner(token);
-            if (!result) {
+        void match(const Token& token) {
+            if (stack.empty() || stack.back().remaining == 0) {
                 throw std::runtime_error("Failed to place token in parse tree");
             }
+            stack.back().parseTree.addChild(token);
+            stack.back().remaining--;
+            closeCompleted();
         }
 
-        NonTerminal getNonTerminal() const {
-            return nonTerminal;
-        }
-
-        ParseTree toParseTree() const {
-            ParseTree parseTree(nonTerminal);
-            for (const auto& child : children) {
-                if (std::holds_alternative<Token>(child)) {
-                    parseTree.addChild(std::get<Token>(child));
-                } else if (std::holds_alternative<LL1ParseTree>(child)) {
-                    if (hasProduction) {
-                        parseTree.addChild(std::get<LL1ParseTree>(child).toParseTree());
-                    } else {
-                        throw std::runtime_error("Cannot add non-terminal to parse tree");
-                    }
-                } else if (std::holds_alternative<Terminal>(child)) {
-                    // It is assumed that all tokens become terminals at this point
-                    throw std::runtime_error("Cannot add terminal to parse tree");
-                } else {
-                    throw std::runtime_error("Unknown child type in parse tree");
-                }
+        // The tree of the non-terminal the start symbol was expanded to
+        ParseTree take() {
+            if (stack.size() != 1 || stack.back().remaining != 0) {
+                throw std::runtime_error("Parse tree is not complete");
             }
-            return parseTree;
+            return std::move(stack.back().parseTree).withoutStartSymbol();
         }
 };
 
@@ -136,16 +79,12 @@ export class LL1Parser : public ParserBase {
         const NonTerminal startSymbol;
         const LL1ParsingTable parsingTable;
 
-    public:
-        LL1Parser(const NonTerminal startSymbol, const LL1ParsingTable& parsingTable)
-            : startSymbol(startSymbol), parsingTable(parsingTable) {}
-
-        ParsingResult parse(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd) const override {
+        ParsingResult parseUntraced(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, ParserContext& context) const {
             auto nextTokenIter = tokenIter;
             LL1SymbolStack symbolStack;
             bool assumeEndOfLine = false;
 
-            LL1ParseTree parseTree(startSymbol);
+            LL1TreeBuilder treeBuilder;
             symbolStack.push(startSymbol);
 
             while (true) {
@@ -163,15 +102,18 @@ export class LL1Parser : public ParserBase {
                     // The top of symbol stack is EOL
 
                     symbolStack.pop();
-                    return ParserAcceptResult{parseTree.toParseTree().withoutStartSymbol(), nextTokenIter, nextTokenIter};
+                    return ParserAcceptResult{treeBuilder.take(), nextTokenIter, nextTokenIter};
                 }
                 else if (std::holds_alternative<Terminal>(currentSymbol)) {
                     // The top of symbol stack is a terminal
                     // Check if it matches current token
 
                     const auto& stackTerminal = std::get<Terminal>(currentSymbol);
+                    if (context.trace != nullptr) {
+                        context.trace->addTokenVisit();
+                    }
                     if (stackTerminal.matchesToken(*nextTokenIter)) {
-                        parseTree.place(*nextTokenIter);
+                        treeBuilder.match(*nextTokenIter);
                         nextTokenIter++;
                         symbolStack.pop();
                     } else {
@@ -202,6 +144,14 @@ export class LL1Parser : public ParserBase {
                     };
 
                     const auto production = findProduction();
+                    if (context.trace != nullptr) {
+                        auto& traceEntry = context.trace->getEntry("LL1 " + std::string{stackNonTerminal.getName()});
+                        traceEntry.attempts++;
+                        context.trace->addTokenVisit();
+                        if (!production.has_value()) {
+                            traceEntry.failedAlternatives++;
+                        }
+                    }
                     if (!production.has_value()) {
                         return ParserRejectResult{"No production found for non-terminal: " + std::string{stackNonTerminal.getName()}, nextTokenIter};
                     }
@@ -233,18 +183,11 @@ export class LL1Parser : public ParserBase {
                         tempStack.pop();
                     }
 
-                    // Push symbols to parse tree
-                    std::vector<Symbol> product;
-                    for (const auto& symbol : production.value()) {
-                        if (std::holds_alternative<Terminal>(symbol)) {
-                            const auto& terminalSymbol = std::get<Terminal>(symbol);
-                            product.push_back(terminalSymbol);
-                        } else if (std::holds_alternative<NonTerminal>(symbol)) {
-                            const auto& nonTerminalSymbol = std::get<NonTerminal>(symbol);
-                            product.push_back(nonTerminalSymbol);
-                        }
-                    }
-                    parseTree.place(Production{stackNonTerminal, product});
+                    // Push the non-terminal to the parse tree, to be completed by its terminals and non-terminals
+                    const auto symbolCount = std::count_if(production->begin(), production->end(), [](const SymbolOrEOL& symbol) {
+                        return !std::holds_alternative<char>(symbol);
+                    });
+                    treeBuilder.expand(stackNonTerminal, symbolCount);
                 }
                 else {
                     throw std::runtime_error("Unknown symbol type in parsing stack");
@@ -253,4 +196,27 @@ export class LL1Parser : public ParserBase {
 
             return ParserRejectResult{"Unexpected end of symbol stack", nextTokenIter};
         }
+
+    public:
+        LL1Parser(const NonTerminal startSymbol, const LL1ParsingTable& parsingTable)
+            : startSymbol(startSymbol), parsingTable(parsingTable) {}
+
+        using ParserBase::parse;
+
+        ParsingResult parse(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, ParserContext& context) const override {
+            if (context.trace == nullptr) {
+                return parseUntraced(tokenIter, tokenEnd, context);
+            }
+            auto& traceEntry = context.trace->getEntry("LL1Parser(" + std::string{startSymbol.getName()} + ")");
+            traceEntry.attempts++;
+            const auto startTime = std::chrono::steady_clock::now();
+            auto result = parseUntraced(tokenIter, tokenEnd, context);
+            traceEntry.time += std::chrono::steady_clock::now() - startTime;
+            if (std::holds_alternative<ParserAcceptResult>(result)) {
+                traceEntry.tokensConsumed += std::distance(tokenIter, std::get<ParserAcceptResult>(result).next);
+            } else {
+                traceEntry.failedAlternatives++;
+            }
+            return result;
+        }
 };
@@ -7,6 +7,12 @@ module;
 #include <string>
 #include <variant>
 #include <functional>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <span>
+#include <string_view>
 
 export module parser;
 
@@ -14,18 +20,320 @@ import token;
 import symbol;
 import ast;
 import parserbase;
+import parsertrace;
 import rdparser;
+import staticparser;
 import ll1parser;
 import slr1parser;
 import terminalfactory;
+import threadpool;
 
 export using ParserError = std::string;
 
-export class Parser {
+export constexpr size_t DEFAULT_MAX_DEPTH = 1000;
+
+export struct ParserRecoveryResult {
+    // Damaged regions are represented by SyntaxError nodes; null if nothing could be parsed
+    std::unique_ptr<AstNode> ast;
+    std::vector<ParserError> errors;
+};
+
+// Keeps the ASTs of top-level declarations between calls to Parser::parseIncremental, keyed by a hash
+// of the ids and values of their tokens so that a declaration that moved is still found
+export class ParseCache {
+    public:
+        // The tokens a declaration's AST was built from, for rebasing it onto the same tokens elsewhere
+        struct Declaration {
+            std::vector<Token> tokens;
+            std::unique_ptr<AstNode> ast;
+        };
+        using DeclarationMap = std::unordered_multimap<size_t, Declaration>;
+
+        static size_t hashTokens(std::span<const Token> tokens) {
+            size_t hash = tokens.size();
+            for (const auto& token : tokens) {
+                hash = (hash * 31 + token.getId()) * 31 + std::hash<std::string_view>()(token.getValue());
+            }
+            return hash;
+        }
+
+        // The declaration in declarations with the same token ids and values, or end() if there is none
+        static DeclarationMap::iterator find(DeclarationMap& declarations, size_t hash, std::span<const Token> tokens) {
+            const auto [begin, end] = declarations.equal_range(hash);
+            const auto declarationIter = std::find_if(begin, end, [&](const auto& entry) {
+                return std::equal(tokens.begin(), tokens.end(), entry.second.tokens.begin(), entry.second.tokens.end(), [](const Token& a, const Token& b) {
+                    return a.getId() == b.getId() && a.getValue() == b.getValue();
+                });
+            });
+            return declarationIter == end ? declarations.end() : declarationIter;
+        }
+
+    private:
+        DeclarationMap declarations;
+        int reusedCount = 0;
+        int reparsedCount = 0;
+
+    public:
+        ParseCache() {}
+
+        // Moves the declaration with the same tokens out of the cache; an empty handle if there is none
+        DeclarationMap::node_type take(size_t hash, std::span<const Token> tokens) {
+            const auto declarationIter = find(declarations, hash, tokens);
+            if (declarationIter == declarations.end()) {
+                return {};
+            }
+            return declarations.extract(declarationIter);
+        }
+
+        // Replaces the cached declarations with those of the latest parse, dropping the ones that no longer exist
+        void update(DeclarationMap newDeclarations, int reused, int reparsed) {
+            declarations = std::move(newDeclarations);
+            reusedCount = reused;
+            reparsedCount = reparsed;
+        }
+
+        void clear() {
+            declarations.clear();
+            reusedCount = 0;
+            reparsedCount = 0;
+        }
+
+        // Number of declarations taken from the cache by the latest parse
+        int getReusedCount() const {
+            return reusedCount;
+        }
+
+        // Number of declarations that the latest parse had to run the parser on
+        int getReparsedCount() const {
+            return reparsedCount;
+        }
+};
+
+// Tag type for the grammar of the language
+struct LanguageGrammar {};
+
+enum SubParserIndex : size_t {
+    VAR_CONST_PARSER,
+    PARAM_LIST_PARSER,
+};
+
+namespace StaticGrammar {
+    template<> struct Rule<LanguageGrammar, "Start"> : Alt<
+        Seq<NT<"DeclList">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "DeclList"> : Alt<
+        Seq<NT<"Decl">, NT<"DeclList">>,
+        Seq<NT<"Decl">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "Decl"> : Alt<
+        Seq<NT<"FuncDef">>,
+        Seq<NT<"VarDecl">>
+    > {};
+
+    template<> struct Rule<LanguageGrammar, "FuncDef"> : Alt<
+        Seq<NT<"Type">, Identifier, Punctuator<"(">, Sub<PARAM_LIST_PARSER>, Punctuator<")">, NT<"BlockStmt">>
+    > {};
+
+    template<> struct Rule<LanguageGrammar, "VarDecl"> : Alt<
+        Seq<NT<"Type">, NT<"VarAssignableList">, Punctuator<";">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "VarAssignableList"> : Alt<
+        Seq<NT<"VarAssignable">, Punctuator<",">, NT<"VarAssignableList">>,
+        Seq<NT<"VarAssignable">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "VarAssignable"> : Alt<
+        Seq<Identifier, Operator<"=">, NT<"Expr">>,
+        Seq<Identifier, Punctuator<"[">, IntegerLiteral, Punctuator<"]">>,
+        Seq<Identifier>
+    > {};
+
+    template<> struct Rule<LanguageGrammar, "VarConst"> : Alt<
+        Seq<NT<"Var">>,
+        Seq<NT<"Constant">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "Constant"> : Alt<
+        Seq<IntegerLiteral>,
+        Seq<FloatLiteral>,
+        Seq<StringLiteral>
+    > {};
+    template<> struct Rule<LanguageGrammar, "Var"> : Alt<
+        Seq<Identifier, Punctuator<"[">, NT<"VarConst">, Punctuator<"]">>,
+        Seq<Identifier>
+    > {};
+    template<> struct Rule<LanguageGrammar, "Type"> : Alt<
+        Seq<Keyword<"int">>,
+        Seq<Keyword<"float">>,
+        Seq<Keyword<"str">>
+    > {};
+
+    template<> struct Rule<LanguageGrammar, "BlockStmt"> : Alt<
+        Seq<Punctuator<"{">, NT<"StmtList">, Punctuator<"}">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "StmtList"> : Alt<
+        Seq<NT<"Stmt">, NT<"StmtList">>,
+        Seq<>
+    > {};
+    template<> struct Rule<LanguageGrammar, "Stmt"> : Alt<
+        Seq<NT<"VarDecl">>,
+        Seq<NT<"IfStmt">>,
+        Seq<NT<"WhileStmt">>,
+        Seq<NT<"ForStmt">>,
+        Seq<NT<"ReturnStmt">>,
+        Seq<NT<"Expr">, Punctuator<";">>,
+        Seq<Punctuator<";">>
+    > {};
+
+    // The else branch is factored out so that the then branch is parsed once; trying both
+    // forms of the statement in turn made nested ifs without else take exponential time
+    template<> struct Rule<LanguageGrammar, "IfStmt"> : Alt<
+        Seq<Keyword<"if">, Punctuator<"(">, NT<"Expr">, Punctuator<")">, NT<"BlockStmt">, NT<"IfStmt'">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "IfStmt'"> : Alt<
+        Seq<Keyword<"else">, NT<"BlockStmt">>,
+        Seq<>
+    > {};
+
+    template<> struct Rule<LanguageGrammar, "WhileStmt"> : Alt<
+        Seq<Keyword<"while">, Punctuator<"(">, NT<"Expr">, Punctuator<")">, NT<"BlockStmt">>
+    > {};
+
+    template<> struct Rule<LanguageGrammar, "ForStmt"> : Alt<
+        Seq<Keyword<"for">, Punctuator<"(">, NT<"ForVarDecl">, Punctuator<";">, NT<"Expr">, Punctuator<";">, NT<"Expr">, Punctuator<")">, NT<"BlockStmt">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "ForVarDecl"> : Alt<
+        Seq<NT<"VarAssignList">>,
+        Seq<>
+    > {};
+    template<> struct Rule<LanguageGrammar, "VarAssignList"> : Alt<
+        Seq<NT<"VarAssign">, Punctuator<",">, NT<"VarAssignList">>,
+        Seq<NT<"VarAssign">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "VarAssign"> : Alt<
+        Seq<NT<"Var">, Operator<"=">, NT<"Expr">>
+    > {};
+
+    template<> struct Rule<LanguageGrammar, "ReturnStmt"> : Alt<
+        Seq<Keyword<"return">, NT<"Expr">, Punctuator<";">>,
+        Seq<Keyword<"return">, Punctuator<";">>
+    > {};
+
+    template<> struct Rule<LanguageGrammar, "Expr"> : Alt<
+        Seq<NT<"AssignExpr">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "AssignExpr"> : Alt<
+        Seq<NT<"Var">, Operator<"=">, NT<"Expr">>,
+        Seq<NT<"OrExpr">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "OrExpr"> : Alt<
+        Seq<NT<"AndExpr">, NT<"OrExpr'">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "OrExpr'"> : Alt<
+        Seq<Operator<"||">, NT<"AndExpr">, NT<"OrExpr'">>,
+        Seq<>
+    > {};
+    template<> struct Rule<LanguageGrammar, "AndExpr"> : Alt<
+        Seq<NT<"EqualityExpr">, NT<"AndExpr'">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "AndExpr'"> : Alt<
+        Seq<Operator<"&&">, NT<"EqualityExpr">, NT<"AndExpr'">>,
+        Seq<>
+    > {};
+    template<> struct Rule<LanguageGrammar, "EqualityExpr"> : Alt<
+        Seq<NT<"RelationalExpr">, NT<"EqualityExpr'">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "EqualityExpr'"> : Alt<
+        Seq<NT<"EqualityOp">, NT<"RelationalExpr">, NT<"EqualityExpr'">>,
+        Seq<>
+    > {};
+    template<> struct Rule<LanguageGrammar, "RelationalExpr"> : Alt<
+        Seq<NT<"SumExpr">, NT<"RelationalExpr'">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "RelationalExpr'"> : Alt<
+        Seq<NT<"RelationalOp">, NT<"SumExpr">, NT<"RelationalExpr'">>,
+        Seq<>
+    > {};
+    template<> struct Rule<LanguageGrammar, "SumExpr"> : Alt<
+        Seq<NT<"MulExpr">, NT<"SumExpr'">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "SumExpr'"> : Alt<
+        Seq<NT<"SumOp">, NT<"MulExpr">, NT<"SumExpr'">>,
+        Seq<>
+    > {};
+    template<> struct Rule<LanguageGrammar, "MulExpr"> : Alt<
+        Seq<NT<"UnaryExpr">, NT<"MulExpr'">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "MulExpr'"> : Alt<
+        Seq<NT<"MulOp">, NT<"UnaryExpr">, NT<"MulExpr'">>,
+        Seq<>
+    > {};
+    template<> struct Rule<LanguageGrammar, "UnaryExpr"> : Alt<
+        Seq<NT<"UnaryOp">, NT<"UnaryExpr">>,
+        Seq<NT<"FuncCall">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "FuncCall"> : Alt<
+        Seq<Identifier, Punctuator<"(">, NT<"ArgList">, Punctuator<")">>,
+        Seq<NT<"Factor">>
+    > {};
+    // Factored like IfStmt, so that nested calls do not parse their last argument twice
+    template<> struct Rule<LanguageGrammar, "ArgList"> : Alt<
+        Seq<NT<"Expr">, NT<"ArgList'">>,
+        Seq<>
+    > {};
+    template<> struct Rule<LanguageGrammar, "ArgList'"> : Alt<
+        Seq<Punctuator<",">, NT<"ArgList">>,
+        Seq<>
+    > {};
+    template<> struct Rule<LanguageGrammar, "Factor"> : Alt<
+        Seq<Punctuator<"(">, NT<"Expr">, Punctuator<")">>,
+        Seq<Sub<VAR_CONST_PARSER>>
+    > {};
+    template<> struct Rule<LanguageGrammar, "EqualityOp"> : Alt<
+        Seq<Operator<"==">>,
+        Seq<Operator<"!=">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "RelationalOp"> : Alt<
+        Seq<Operator<"<">>,
+        Seq<Operator<"<=">>,
+        Seq<Operator<">">>,
+        Seq<Operator<">=">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "SumOp"> : Alt<
+        Seq<Operator<"+">>,
+        Seq<Operator<"-">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "MulOp"> : Alt<
+        Seq<Operator<"*">>,
+        Seq<Operator<"/">>,
+        Seq<Operator<"%">>
+    > {};
+    template<> struct Rule<LanguageGrammar, "UnaryOp"> : Alt<
+        Seq<Operator<"+">>,
+        Seq<Operator<"-">>,
+        Seq<Operator<"!">>
+    > {};
+
+    using LanguageRules = RuleList<LanguageGrammar,
+        NT<"Start">, NT<"DeclList">, NT<"Decl">, NT<"FuncDef">, NT<"VarDecl">, NT<"VarAssignableList">, NT<"VarAssignable">,
+        NT<"VarConst">, NT<"Constant">, NT<"Var">, NT<"Type">, NT<"BlockStmt">, NT<"StmtList">, NT<"Stmt">,
+        NT<"IfStmt">, NT<"IfStmt'">, NT<"WhileStmt">, NT<"ForStmt">, NT<"ForVarDecl">, NT<"VarAssignList">, NT<"VarAssign">, NT<"ReturnStmt">,
+        NT<"Expr">, NT<"AssignExpr">, NT<"OrExpr">, NT<"OrExpr'">, NT<"AndExpr">, NT<"AndExpr'">,
+        NT<"EqualityExpr">, NT<"EqualityExpr'">, NT<"RelationalExpr">, NT<"RelationalExpr'">, NT<"SumExpr">, NT<"SumExpr'">,
+        NT<"MulExpr">, NT<"MulExpr'">, NT<"UnaryExpr">, NT<"FuncCall">, NT<"ArgList">, NT<"ArgList'">, NT<"Factor">,
+        NT<"EqualityOp">, NT<"RelationalOp">, NT<"SumOp">, NT<"MulOp">, NT<"UnaryOp">
+    >;
+}
+
+using LanguageParser = StaticParser<LanguageGrammar, StaticGrammar::NT<"Start">>;
+
+// The grammar tables and AST handlers are immutable after construction,
+// so a single instance is built on first use and shared by every Parser
+class ParserTables {
     private:
+        // Subparsers must be declared before the parser that refers to them
         const std::unique_ptr<ParserBase> varConstParser;
         const std::unique_ptr<ParserBase> paramListParser;
-        const std::unique_ptr<ParserBase> parser;
+        const std::unique_ptr<RecursiveDescentParser> parser;
+        const std::unique_ptr<LanguageParser> staticParser;
         const SimplifyInstructionMap simplifyInstructionMap;
         const AstHandlerMap astHandlerMap;
 
@@ -179,338 +487,56 @@ export class Parser {
 
                     { { State("S12"), getPunctuator(",") }, 5 },
                     { { State("S12"), EOL }, 5 },
+                },
+                SLR1RecoveryRule{
+                    NonTerminal("SyntaxError"),
+                    NonTerminal("Param"),
+                    { getPunctuator(","), getPunctuator(")"), getPunctuator("{"), getPunctuator(";") }
                 }
             );
 
             return paramListParser;
         }
 
-        std::unique_ptr<ParserBase> createParser() const {
+        // In the order of SubParserIndex
+        std::vector<ParserBase*> getSubParsers() const {
+            return { varConstParser.get(), paramListParser.get() };
+        }
+
+        std::unique_ptr<RecursiveDescentParser> createParser() const {
             const auto id = TerminalFactory::getIdentifier();
-            const auto intLiteral = TerminalFactory::getIntegerLiteral();
-            const auto floatLiteral = TerminalFactory::getFloatLiteral();
-            const auto strLiteral = TerminalFactory::getStringLiteral();
             const auto getKeyword = TerminalFactory::getKeyword;
-            const auto getOperator = TerminalFactory::getOperator;
             const auto getPunctuator = TerminalFactory::getPunctuator;
 
-            std::unique_ptr<ParserBase> parser = std::make_unique<RecursiveDescentParser>(
+            // The productions come from the grammar of the static parser, so both parsers accept the same language
+            std::unique_ptr<RecursiveDescentParser> parser = std::make_unique<RecursiveDescentParser>(
                 NonTerminal("Start"),
-                RdpProductMap{
-                    {
-                        NonTerminal("Start"),
-                        {
-                            { NonTerminal("DeclList") }
-                        }
-                    },
-                    {
-                        NonTerminal("DeclList"),
-                        {
-                            { NonTerminal("Decl"), NonTerminal("DeclList") },
-                            { NonTerminal("Decl") }
-                        }
-                    },
+                StaticGrammar::LanguageRules::toRdpProductMap(getSubParsers()),
+                RdpRecoveryMap{
                     {
                         NonTerminal("Decl"),
                         {
-                            { NonTerminal("FuncDef") },
-                            { NonTerminal("VarDecl") }
-                        }
-                    },
-
-                    {
-                        NonTerminal("FuncDef"),
-                        {
-                            { NonTerminal("Type"), id, getPunctuator("("), paramListParser.get(), getPunctuator(")"), NonTerminal("BlockStmt") }
-                        }
-                    },
-
-                    {
-                        NonTerminal("VarDecl"),
-                        {
-                            { NonTerminal("Type"), NonTerminal("VarAssignableList"), getPunctuator(";") }
-                        }
-                    },
-                    {
-                        NonTerminal("VarAssignableList"),
-                        {
-                            { NonTerminal("VarAssignable"), getPunctuator(","), NonTerminal("VarAssignableList") },
-                            { NonTerminal("VarAssignable") }
-                        }
-                    },
-                    {
-                        NonTerminal("VarAssignable"),
-                        {
-                            { id, getOperator("="), NonTerminal("Expr") },
-                            { id, getPunctuator("["), intLiteral, getPunctuator("]") },
-                            { id }
-                        }
-                    },
-
-                    {
-                        NonTerminal("VarConst"),
-                        {
-                            { NonTerminal("Var") },
-                            { NonTerminal("Constant") },
-                        }
-                    },
-                    {
-                        NonTerminal("Constant"),
-                        {
-                            { intLiteral },
-                            { floatLiteral },
-                            { strLiteral }
-                        }
-                    },
-                    {
-                        NonTerminal("Var"),
-                        {
-                            { id, getPunctuator("["), NonTerminal("VarConst"), getPunctuator("]") },
-                            { id }
-                        }
-                    },
-                    {
-                        NonTerminal("Type"),
-                        {
-                            { getKeyword("int") },
-                            { getKeyword("float") },
-                            { getKeyword("str") }
-                        }
-                    },
-
-                    {
-                        NonTerminal("BlockStmt"),
-                        {
-                            { getPunctuator("{"), NonTerminal("StmtList"), getPunctuator("}") }
-                        }
-                    },
-                    {
-                        NonTerminal("StmtList"),
-                        {
-                            { NonTerminal("Stmt"), NonTerminal("StmtList") },
-                            {}
+                            NonTerminal("SyntaxError"),
+                            { getPunctuator(";") },
+                            {},
+                            {
+                                { getKeyword("int"), id },
+                                { getKeyword("float"), id },
+                                { getKeyword("str"), id }
+                            },
+                            getPunctuator("{"),
+                            getPunctuator("}")
                         }
                     },
                     {
                         NonTerminal("Stmt"),
                         {
-                            { NonTerminal("VarDecl") },
-                            { NonTerminal("IfStmt") },
-                            { NonTerminal("WhileStmt") },
-                            { NonTerminal("ForStmt") },
-                            { NonTerminal("ReturnStmt") },
-                            { NonTerminal("Expr"), getPunctuator(";") },
-                            { getPunctuator(";") }
-                        }
-                    },
-
-                    {
-                        NonTerminal("IfStmt"),
-                        {
-                            { getKeyword("if"), getPunctuator("("), NonTerminal("Expr"), getPunctuator(")"), NonTerminal("BlockStmt"), getKeyword("else"), NonTerminal("BlockStmt") },
-                            { getKeyword("if"), getPunctuator("("), NonTerminal("Expr"), getPunctuator(")"), NonTerminal("BlockStmt") }
-                        }
-                    },
-
-                    {
-                        NonTerminal("WhileStmt"),
-                        {
-                            { getKeyword("while"), getPunctuator("("), NonTerminal("Expr"), getPunctuator(")"), NonTerminal("BlockStmt") }
-                        }
-                    },
-
-                    {
-                        NonTerminal("ForStmt"),
-                        {
-                            { getKeyword("for"), getPunctuator("("), NonTerminal("ForVarDecl"), getPunctuator(";"), NonTerminal("Expr"), getPunctuator(";"), NonTerminal("Expr"), getPunctuator(")"), NonTerminal("BlockStmt") }
-                        }
-                    },
-                    {
-                        NonTerminal("ForVarDecl"),
-                        {
-                            { NonTerminal("VarAssignList") },
-                            {}
-                        }
-                    },
-                    {
-                        NonTerminal("VarAssignList"),
-                        {
-                            { NonTerminal("VarAssign"), getPunctuator(","), NonTerminal("VarAssignList") },
-                            { NonTerminal("VarAssign") }
-                        }
-                    },
-                    {
-                        NonTerminal("VarAssign"),
-                        {
-                            { NonTerminal("Var"), getOperator("="), NonTerminal("Expr") }
-                        }
-                    },
-
-                    {
-                        NonTerminal("ReturnStmt"),
-                        {
-                            { getKeyword("return"), NonTerminal("Expr"), getPunctuator(";") },
-                            { getKeyword("return"), getPunctuator(";") }
-                        }
-                    },
-
-                    {
-                        NonTerminal("Expr"),
-                        {
-                            { NonTerminal("AssignExpr") }
-                        }
-                    },
-                    {
-                        NonTerminal("AssignExpr"),
-                        {
-                            { NonTerminal("Var"), getOperator("="), NonTerminal("Expr") },
-                            { NonTerminal("OrExpr") }
-                        }
-                    },
-                    {
-                        NonTerminal("OrExpr"),
-                        {
-                            { NonTerminal("AndExpr"), NonTerminal("OrExpr'") }
-                        }
-                    },
-                    {
-                        NonTerminal("OrExpr'"),
-                        {
-                            { getOperator("||"), NonTerminal("AndExpr"), NonTerminal("OrExpr'") },
-                            {}
-                        }
-                    },
-                    {
-                        NonTerminal("AndExpr"),
-                        {
-                            { NonTerminal("EqualityExpr"), NonTerminal("AndExpr'") }
-                        }
-                    },
-                    {
-                        NonTerminal("AndExpr'"),
-                        {
-                            { getOperator("&&"), NonTerminal("EqualityExpr"), NonTerminal("AndExpr'") },
-                            {}
-                        }
-                    },
-                    {
-                        NonTerminal("EqualityExpr"),
-                        {
-                            { NonTerminal("RelationalExpr"), NonTerminal("EqualityExpr'") }
-                        }
-                    },
-                    {
-                        NonTerminal("EqualityExpr'"),
-                        {
-                            { NonTerminal("EqualityOp"), NonTerminal("RelationalExpr"), NonTerminal("EqualityExpr'") },
-                            {}
-                        }
-                    },
-                    {
-                        NonTerminal("RelationalExpr"),
-                        {
-                            { NonTerminal("SumExpr"), NonTerminal("RelationalExpr'") }
-                        }
-                    },
-                    {
-                        NonTerminal("RelationalExpr'"),
-                        {
-                            { NonTerminal("RelationalOp"), NonTerminal("SumExpr"), NonTerminal("RelationalExpr'") },
-                            {}
-                        }
-                    },
-                    {
-                        NonTerminal("SumExpr"),
-                        {
-                            { NonTerminal("MulExpr"), NonTerminal("SumExpr'") }
-                        }
-                    },
-                    {
-                        NonTerminal("SumExpr'"),
-                        {
-                            { NonTerminal("SumOp"), NonTerminal("MulExpr"), NonTerminal("SumExpr'") },
-                            {}
-                        }
-                    },
-                    {
-                        NonTerminal("MulExpr"),
-                        {
-                            { NonTerminal("UnaryExpr"), NonTerminal("MulExpr'") }
-                        }
-                    },
-                    {
-                        NonTerminal("MulExpr'"),
-                        {
-                            { NonTerminal("MulOp"), NonTerminal("UnaryExpr"), NonTerminal("MulExpr'") },
-                            {}
-                        }
-                    },
-                    {
-                        NonTerminal("UnaryExpr"),
-                        {
-                            { NonTerminal("UnaryOp"), NonTerminal("UnaryExpr") },
-                            { NonTerminal("FuncCall") },
-                        }
-                    },
-                    {
-                        NonTerminal("FuncCall"),
-                        {
-                            { id, getPunctuator("("), NonTerminal("ArgList"), getPunctuator(")") },
-                            { NonTerminal("Factor") }
-                        }
-                    },
-                    {
-                        NonTerminal("ArgList"),
-                        {
-                            { NonTerminal("Expr"), getPunctuator(","), NonTerminal("ArgList") },
-                            { NonTerminal("Expr") },
-                            {}
-                        }
-                    },
-                    {
-                        NonTerminal("Factor"),
-                        {
-                            { getPunctuator("("), NonTerminal("Expr"), getPunctuator(")") },
-                            { varConstParser.get() }
-                        }
-                    },
-                    {
-                        NonTerminal("EqualityOp"),
-                        {
-                            { getOperator("==") },
-                            { getOperator("!=") }
-                        }
-                    },
-                    {
-                        NonTerminal("RelationalOp"),
-                        {
-                            { getOperator("<") },
-                            { getOperator("<=") },
-                            { getOperator(">") },
-                            { getOperator(">=") }
-                        }
-                    },
-                    {
-                        NonTerminal("SumOp"),
-                        {
-                            { getOperator("+") },
-                            { getOperator("-") }
-                        }
-                    },
-                    {
-                        NonTerminal("MulOp"),
-                        {
-                            { getOperator("*") },
-                            { getOperator("/") },
-                            { getOperator("%") }
-                        }
-                    },
-                    {
-                        NonTerminal("UnaryOp"),
-                        {
-                            { getOperator("+") },
-                            { getOperator("-") },
-                            { getOperator("!") }
+                            NonTerminal("SyntaxError"),
+                            { getPunctuator(";") },
+                            { getPunctuator("}") },
+                            {},
+                            getPunctuator("{"),
+                            getPunctuator("}")
                         }
                     }
                 }
@@ -537,6 +563,7 @@ export class Parser {
                 { NonTerminal("StmtList"), SimplifyInstruction::MERGE_UP },
                 { NonTerminal("Stmt"), SimplifyInstruction::MERGE_UP },
                 { NonTerminal("IfStmt"), SimplifyInstruction::RETAIN },
+                { NonTerminal("IfStmt'"), SimplifyInstruction::MERGE_UP },
                 { NonTerminal("WhileStmt"), SimplifyInstruction::RETAIN },
                 { NonTerminal("ForStmt"), SimplifyInstruction::RETAIN },
                 { NonTerminal("ForVarDecl"), SimplifyInstruction::RETAIN },
@@ -560,6 +587,7 @@ export class Parser {
                 { NonTerminal("UnaryExpr"), SimplifyInstruction::RETAIN_IF_MULTIPLE_CHILDREN },
                 { NonTerminal("FuncCall"), SimplifyInstruction::RETAIN_IF_MULTIPLE_CHILDREN },
                 { NonTerminal("ArgList"), SimplifyInstruction::MERGE_UP },
+                { NonTerminal("ArgList'"), SimplifyInstruction::MERGE_UP },
                 { NonTerminal("Factor"), SimplifyInstruction::RETAIN_IF_MULTIPLE_CHILDREN },
                 { NonTerminal("EqualityOp"), SimplifyInstruction::MERGE_UP },
                 { NonTerminal("RelationalOp"), SimplifyInstruction::MERGE_UP },
@@ -568,7 +596,8 @@ export class Parser {
                 { NonTerminal("UnaryOp"), SimplifyInstruction::MERGE_UP },
                 { NonTerminal("VarConst"), SimplifyInstruction::MERGE_UP },
                 { NonTerminal("Constant"), SimplifyInstruction::RETAIN },
-                { NonTerminal("Var'"), SimplifyInstruction::MERGE_UP }
+                { NonTerminal("Var'"), SimplifyInstruction::MERGE_UP },
+                { NonTerminal("SyntaxError"), SimplifyInstruction::RETAIN }
             };
 
             return simplifyInstructionMap;
@@ -577,12 +606,11 @@ export class Parser {
         AstHandlerMap createAstHandlerMap() const {
             const AstHandlerMap astHandlerMap{
                 {
-                    NonTerminal("Start"), [](const SPTChildren& children) {
+                    NonTerminal("Start"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::vector<std::unique_ptr<AstNode>> astChildren;
-                        for (const auto& child : children) {
-                            if (std::holds_alternative<SimpleParseTree>(child)) {
-                                const auto& parseTree = std::get<SimpleParseTree>(child);
-                                astChildren.push_back(parseTree.toAst());
+                        for (auto& childAst : childAsts) {
+                            if (childAst != nullptr) {
+                                astChildren.push_back(std::move(childAst));
                             }
                         }
                         std::unique_ptr<AstNode> start = std::make_unique<Start>(std::move(astChildren));
@@ -590,42 +618,36 @@ export class Parser {
                     }
                 },
                 {
-                    NonTerminal("FuncDef"), [](const SPTChildren& children) {
-                        const auto& type = std::get<SimpleParseTree>(children[0]);
+                    NonTerminal("FuncDef"), [](const SPTChildren& children, ChildAsts childAsts) {
                         const auto& id = std::get<Token>(children[1]);
                         std::vector<std::unique_ptr<AstNode>> params;
-                        for (int i = 3; i < children.size() - 2; i += 2) {
-                            const auto& param = std::get<SimpleParseTree>(children[i]);
-                            params.push_back(param.toAst());
+                        for (size_t i = 3; i < children.size() - 2; i += 2) {
+                            params.push_back(std::move(childAsts[i]));
                         }
-                        const auto& blockStmt = std::get<SimpleParseTree>(children[children.size() - 1]);
-                        std::unique_ptr<AstNode> funcDef = std::make_unique<FuncDef>(type.toAst(), id, std::move(params), blockStmt.toAst());
+                        std::unique_ptr<AstNode> funcDef = std::make_unique<FuncDef>(std::move(childAsts[0]), id, std::move(params), std::move(childAsts[children.size() - 1]));
                         return funcDef;
                     }
                 },
                 {
-                    NonTerminal("Param"), [](const SPTChildren& children) {
-                        const auto& type = std::get<SimpleParseTree>(children[0]);
+                    NonTerminal("Param"), [](const SPTChildren& children, ChildAsts childAsts) {
                         const auto& id = std::get<Token>(children[1]);
                         bool array = children.size() > 2;
-                        std::unique_ptr<AstNode> param = std::make_unique<Param>(type.toAst(), id, array);
+                        std::unique_ptr<AstNode> param = std::make_unique<Param>(std::move(childAsts[0]), id, array);
                         return param;
                     }
                 },
                 {
-                    NonTerminal("VarDecl"), [](const SPTChildren& children) {
-                        const auto& type = std::get<SimpleParseTree>(children[0]);
+                    NonTerminal("VarDecl"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::vector<std::unique_ptr<AstNode>> varAssignables;
-                        for (int i = 1; i < children.size() - 1; i += 2) {
-                            const auto& varAssignable = std::get<SimpleParseTree>(children[i]);
-                            varAssignables.push_back(varAssignable.toAst());
+                        for (size_t i = 1; i < children.size() - 1; i += 2) {
+                            varAssignables.push_back(std::move(childAsts[i]));
                         }
-                        std::unique_ptr<AstNode> varDecl = std::make_unique<VarDecl>(type.toAst(), std::move(varAssignables));
+                        std::unique_ptr<AstNode> varDecl = std::make_unique<VarDecl>(std::move(childAsts[0]), std::move(varAssignables));
                         return varDecl;
                     }
                 },
                 {
-                    NonTerminal("VarAssignable"), [](const SPTChildren& children) {
+                    NonTerminal("VarAssignable"), [](const SPTChildren& children, ChildAsts childAsts) {
                         const auto& id = std::get<Token>(children[0]);
                         std::optional<std::unique_ptr<AstNode>> arrayIndex;
                         std::optional<std::unique_ptr<AstNode>> expr;
@@ -635,8 +657,7 @@ export class Parser {
                         }
                         else {
                             if (children.size() > 1) {
-                                const auto& exprChild = std::get<SimpleParseTree>(children[children.size() - 1]);
-                                expr = exprChild.toAst();
+                                expr = std::move(childAsts[children.size() - 1]);
                             }
                         }
                         std::unique_ptr<AstNode> var = std::make_unique<Var>(id, std::move(arrayIndex));
@@ -645,39 +666,36 @@ export class Parser {
                     }
                 },
                 {
-                    NonTerminal("Var"), [](const SPTChildren& children) {
+                    NonTerminal("Var"), [](const SPTChildren& children, ChildAsts childAsts) {
                         const auto& id = std::get<Token>(children[0]);
                         std::optional<std::unique_ptr<AstNode>> arrayIndex;
                         if (children.size() > 1) {
-                            const auto& arrayIndexChild = std::get<SimpleParseTree>(children[2]);
-                            arrayIndex = arrayIndexChild.toAst();
+                            arrayIndex = std::move(childAsts[2]);
                         }
                         std::unique_ptr<AstNode> var = std::make_unique<Var>(id, std::move(arrayIndex));
                         return var;
                     }
                 },
                 {
-                    NonTerminal("Type"), [](const SPTChildren& children) {
+                    NonTerminal("Type"), [](const SPTChildren& children, ChildAsts childAsts) {
                         const auto& type = std::get<Token>(children[0]);
                         std::unique_ptr<AstNode> typeNode = std::make_unique<Type>(type);
                         return typeNode;
                     }
                 },
                 {
-                    NonTerminal("Constant"), [](const SPTChildren& children) {
+                    NonTerminal("Constant"), [](const SPTChildren& children, ChildAsts childAsts) {
                         const auto& value = std::get<Token>(children[0]);
                         std::unique_ptr<AstNode> constant = std::make_unique<Constant>(value);
                         return constant;
                     }
                 },
                 {
-                    NonTerminal("BlockStmt"), [](const SPTChildren& children) {
+                    NonTerminal("BlockStmt"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::vector<std::unique_ptr<AstNode>> statements;
-                        for (int i = 1; i < children.size() - 1; ++i) {
-                            const auto& child = children[i];
-                            if (std::holds_alternative<SimpleParseTree>(child)) {
-                                const auto& parseTree = std::get<SimpleParseTree>(child);
-                                statements.push_back(parseTree.toAst());
+                        for (size_t i = 1; i < children.size() - 1; ++i) {
+                            if (childAsts[i] != nullptr) {
+                                statements.push_back(std::move(childAsts[i]));
                             }
                         }
                         std::unique_ptr<AstNode> blockStmt = std::make_unique<BlockStmt>(std::move(statements));
@@ -685,114 +703,97 @@ export class Parser {
                     }
                 },
                 {
-                    NonTerminal("IfStmt"), [](const SPTChildren& children) {
-                        const auto& expr = std::get<SimpleParseTree>(children[2]);
-                        const auto& blockStmt = std::get<SimpleParseTree>(children[4]);
+                    NonTerminal("IfStmt"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::optional<std::unique_ptr<AstNode>> elseBlockStmt;
                         if (children.size() > 6) {
-                            const auto& elseBlock = std::get<SimpleParseTree>(children[6]);
-                            elseBlockStmt = elseBlock.toAst();
+                            elseBlockStmt = std::move(childAsts[6]);
                         }
-                        std::unique_ptr<AstNode> ifStmt = std::make_unique<IfStmt>(expr.toAst(), blockStmt.toAst(), std::move(elseBlockStmt));
+                        std::unique_ptr<AstNode> ifStmt = std::make_unique<IfStmt>(std::move(childAsts[2]), std::move(childAsts[4]), std::move(elseBlockStmt));
                         return ifStmt;
                     }
                 },
                 {
-                    NonTerminal("WhileStmt"), [](const SPTChildren& children) {
-                        const auto& expr = std::get<SimpleParseTree>(children[2]);
-                        const auto& blockStmt = std::get<SimpleParseTree>(children[4]);
-                        std::unique_ptr<AstNode> whileStmt = std::make_unique<WhileStmt>(expr.toAst(), blockStmt.toAst());
+                    NonTerminal("WhileStmt"), [](const SPTChildren& children, ChildAsts childAsts) {
+                        std::unique_ptr<AstNode> whileStmt = std::make_unique<WhileStmt>(std::move(childAsts[2]), std::move(childAsts[4]));
                         return whileStmt;
                     }
                 },
                 {
-                    NonTerminal("ForStmt"), [](const SPTChildren& children) {
-                        const auto& forVarDecl = std::get<SimpleParseTree>(children[2]);
-                        const auto& condExpr = std::get<SimpleParseTree>(children[4]);
-                        const auto& incrExpr = std::get<SimpleParseTree>(children[6]);
-                        const auto& blockStmt = std::get<SimpleParseTree>(children[8]);
-                        std::unique_ptr<AstNode> forStmt = std::make_unique<ForStmt>(forVarDecl.toAst(), condExpr.toAst(), incrExpr.toAst(), blockStmt.toAst());
+                    NonTerminal("ForStmt"), [](const SPTChildren& children, ChildAsts childAsts) {
+                        std::unique_ptr<AstNode> forStmt = std::make_unique<ForStmt>(std::move(childAsts[2]), std::move(childAsts[4]), std::move(childAsts[6]), std::move(childAsts[8]));
                         return forStmt;
                     }
                 },
                 {
-                    NonTerminal("ForVarDecl"), [](const SPTChildren& children) {
+                    NonTerminal("ForVarDecl"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::vector<std::unique_ptr<AstNode>> varAssigns;
-                        for (int i = 0; i < children.size(); i += 2) {
-                            const auto& varAssign = std::get<SimpleParseTree>(children[i]);
-                            varAssigns.push_back(varAssign.toAst());
+                        for (size_t i = 0; i < children.size(); i += 2) {
+                            varAssigns.push_back(std::move(childAsts[i]));
                         }
                         std::unique_ptr<AstNode> forVarDecl = std::make_unique<ForVarDecl>(std::move(varAssigns));
                         return forVarDecl;
                     }
                 },
                 {
-                    NonTerminal("VarAssign"), [](const SPTChildren& children) {
-                        const auto& var = std::get<SimpleParseTree>(children[0]);
-                        const auto& expr = std::get<SimpleParseTree>(children[2]);
-                        std::unique_ptr<AstNode> varAssign = std::make_unique<VarAssign>(var.toAst(), expr.toAst());
+                    NonTerminal("VarAssign"), [](const SPTChildren& children, ChildAsts childAsts) {
+                        std::unique_ptr<AstNode> varAssign = std::make_unique<VarAssign>(std::move(childAsts[0]), std::move(childAsts[2]));
                         return varAssign;
                     }
                 },
                 {
-                    NonTerminal("ReturnStmt"), [](const SPTChildren& children) {
+                    NonTerminal("ReturnStmt"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::optional<std::unique_ptr<AstNode>> expr;
                         if (children.size() > 2) {
-                            const auto& exprChild = std::get<SimpleParseTree>(children[1]);
-                            expr = exprChild.toAst();
+                            expr = std::move(childAsts[1]);
                         }
                         std::unique_ptr<AstNode> returnStmt = std::make_unique<ReturnStmt>(std::move(expr));
                         return returnStmt;
                     }
                 },
                 {
-                    NonTerminal("AssignExpr"), [](const SPTChildren& children) {
-                        const auto& var = std::get<SimpleParseTree>(children[0]);
-                        const auto& expr = std::get<SimpleParseTree>(children[2]);
-                        std::unique_ptr<AstNode> assignExpr = std::make_unique<AssignExpr>(var.toAst(), expr.toAst());
+                    NonTerminal("AssignExpr"), [](const SPTChildren& children, ChildAsts childAsts) {
+                        std::unique_ptr<AstNode> assignExpr = std::make_unique<AssignExpr>(std::move(childAsts[0]), std::move(childAsts[2]));
                         return assignExpr;
                     }
                 },
                 {
-                    NonTerminal("OrExpr"), [](const SPTChildren& children) {
+                    NonTerminal("OrExpr"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::vector<std::unique_ptr<AstNode>> orExprs;
-                        for (const auto& child : children) {
-                            if (std::holds_alternative<SimpleParseTree>(child)) {
-                                const auto& parseTree = std::get<SimpleParseTree>(child);
-                                orExprs.push_back(parseTree.toAst());
+                        for (auto& childAst : childAsts) {
+                            if (childAst != nullptr) {
+                                orExprs.push_back(std::move(childAst));
                             }
                         }
                         std::unique_ptr<AstNode> orExpr = std::make_unique<OrExpr>(std::move(orExprs[0]), std::move(orExprs[1]));
-                        for (int i = 2; i < orExprs.size(); ++i) {
+                        for (size_t i = 2; i < orExprs.size(); ++i) {
                             orExpr = std::make_unique<OrExpr>(std::move(orExpr), std::move(orExprs[i]));
                         }
                         return orExpr;
                     }
                 },
                 {
-                    NonTerminal("AndExpr"), [](const SPTChildren& children) {
+                    NonTerminal("AndExpr"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::vector<std::unique_ptr<AstNode>> andExprs;
-                        for (const auto& child : children) {
-                            if (std::holds_alternative<SimpleParseTree>(child)) {
-                                const auto& parseTree = std::get<SimpleParseTree>(child);
-                                andExprs.push_back(parseTree.toAst());
+                        for (auto& childAst : childAsts) {
+                            if (childAst != nullptr) {
+                                andExprs.push_back(std::move(childAst));
                             }
                         }
                         std::unique_ptr<AstNode> andExpr = std::make_unique<AndExpr>(std::move(andExprs[0]), std::move(andExprs[1]));
-                        for (int i = 2; i < andExprs.size(); ++i) {
+                        for (size_t i = 2; i < andExprs.size(); ++i) {
                             andExpr = std::make_unique<AndExpr>(std::move(andExpr), std::move(andExprs[i]));
                         }
                         return andExpr;
                     }
                 },
                 {
-                    NonTerminal("EqualityExpr"), [](const SPTChildren& children) {
+                    NonTerminal("EqualityExpr"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::vector<std::unique_ptr<AstNode>> equalityExprs;
                         std::vector<std::string> equalityOps;
-                        for (const auto& child : children) {
+                        for (size_t i = 0; i < children.size(); ++i) {
+                            const auto& child = children[i];
                             if (std::holds_alternative<SimpleParseTree>(child)) {
-                                const auto& parseTree = std::get<SimpleParseTree>(child);
-                                equalityExprs.push_back(parseTree.toAst());
+                                equalityExprs.push_back(std::move(childAsts[i]));
                             }
                             if (std::holds_alternative<Token>(child)) {
                                 const auto& token = std::get<Token>(child);
@@ -802,7 +803,7 @@ export class Parser {
                         std::unique_ptr<AstNode> equalityExpr = equalityOps[0] == "==" ?
                             static_cast<std::unique_ptr<AstNode>>(std::make_unique<EqualExpr>(std::move(equalityExprs[0]), std::move(equalityExprs[1]))) :
                             static_cast<std::unique_ptr<AstNode>>(std::make_unique<NotEqualExpr>(std::move(equalityExprs[0]), std::move(equalityExprs[1])));
-                        for (int i = 2; i < equalityExprs.size(); ++i) {
+                        for (size_t i = 2; i < equalityExprs.size(); ++i) {
                             equalityExpr = equalityOps[i - 1] == "==" ?
                                 static_cast<std::unique_ptr<AstNode>>(std::make_unique<EqualExpr>(std::move(equalityExpr), std::move(equalityExprs[i]))) :
                                 static_cast<std::unique_ptr<AstNode>>(std::make_unique<NotEqualExpr>(std::move(equalityExpr), std::move(equalityExprs[i])));
@@ -811,13 +812,13 @@ export class Parser {
                     }
                 },
                 {
-                    NonTerminal("RelationalExpr"), [](const SPTChildren& children) {
+                    NonTerminal("RelationalExpr"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::vector<std::unique_ptr<AstNode>> relationalExprs;
                         std::vector<std::string> relationalOps;
-                        for (const auto& child : children) {
+                        for (size_t i = 0; i < children.size(); ++i) {
+                            const auto& child = children[i];
                             if (std::holds_alternative<SimpleParseTree>(child)) {
-                                const auto& parseTree = std::get<SimpleParseTree>(child);
-                                relationalExprs.push_back(parseTree.toAst());
+                                relationalExprs.push_back(std::move(childAsts[i]));
                             }
                             if (std::holds_alternative<Token>(child)) {
                                 const auto& token = std::get<Token>(child);
@@ -831,7 +832,7 @@ export class Parser {
                             relationalOps[0] == ">" ?
                             static_cast<std::unique_ptr<AstNode>>(std::make_unique<GreaterExpr>(std::move(relationalExprs[0]), std::move(relationalExprs[1]))) :
                             static_cast<std::unique_ptr<AstNode>>(std::make_unique<GreaterEqualExpr>(std::move(relationalExprs[0]), std::move(relationalExprs[1])));
-                        for (int i = 2; i < relationalExprs.size(); ++i) {
+                        for (size_t i = 2; i < relationalExprs.size(); ++i) {
                             relationalExpr = relationalOps[i - 1] == "<" ?
                                 static_cast<std::unique_ptr<AstNode>>(std::make_unique<LessExpr>(std::move(relationalExpr), std::move(relationalExprs[i]))) :
                                 relationalOps[i - 1] == "<=" ?
@@ -844,13 +845,13 @@ export class Parser {
                     }
                 },
                 {
-                    NonTerminal("SumExpr"), [](const SPTChildren& children) {
+                    NonTerminal("SumExpr"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::vector<std::unique_ptr<AstNode>> sumExprs;
                         std::vector<std::string> sumOps;
-                        for (const auto& child : children) {
+                        for (size_t i = 0; i < children.size(); ++i) {
+                            const auto& child = children[i];
                             if (std::holds_alternative<SimpleParseTree>(child)) {
-                                const auto& parseTree = std::get<SimpleParseTree>(child);
-                                sumExprs.push_back(parseTree.toAst());
+                                sumExprs.push_back(std::move(childAsts[i]));
                             }
                             if (std::holds_alternative<Token>(child)) {
                                 const auto& token = std::get<Token>(child);
@@ -860,7 +861,7 @@ export class Parser {
                         std::unique_ptr<AstNode> sumExpr = sumOps[0] == "+" ?
                             static_cast<std::unique_ptr<AstNode>>(std::make_unique<AddExpr>(std::move(sumExprs[0]), std::move(sumExprs[1]))) :
                             static_cast<std::unique_ptr<AstNode>>(std::make_unique<SubExpr>(std::move(sumExprs[0]), std::move(sumExprs[1])));
-                        for (int i = 2; i < sumExprs.size(); ++i) {
+                        for (size_t i = 2; i < sumExprs.size(); ++i) {
                             sumExpr = sumOps[i - 1] == "+" ?
                                 static_cast<std::unique_ptr<AstNode>>(std::make_unique<AddExpr>(std::move(sumExpr), std::move(sumExprs[i]))) :
                                 static_cast<std::unique_ptr<AstNode>>(std::make_unique<SubExpr>(std::move(sumExpr), std::move(sumExprs[i])));
@@ -869,13 +870,13 @@ export class Parser {
                     }
                 },
                 {
-                    NonTerminal("MulExpr"), [](const SPTChildren& children) {
+                    NonTerminal("MulExpr"), [](const SPTChildren& children, ChildAsts childAsts) {
                         std::vector<std::unique_ptr<AstNode>> mulExprs;
                         std::vector<std::string> mulOps;
-                        for (const auto& child : children) {
+                        for (size_t i = 0; i < children.size(); ++i) {
+                            const auto& child = children[i];
                             if (std::holds_alternative<SimpleParseTree>(child)) {
-                                const auto& parseTree = std::get<SimpleParseTree>(child);
-                                mulExprs.push_back(parseTree.toAst());
+                                mulExprs.push_back(std::move(childAsts[i]));
                             }
                             if (std::holds_alternative<Token>(child)) {
                                 const auto& token = std::get<Token>(child);
@@ -887,7 +888,7 @@ export class Parser {
                             mulOps[0] == "/" ?
                             static_cast<std::unique_ptr<AstNode>>(std::make_unique<DivExpr>(std::move(mulExprs[0]), std::move(mulExprs[1]))) :
                             static_cast<std::unique_ptr<AstNode>>(std::make_unique<ModExpr>(std::move(mulExprs[0]), std::move(mulExprs[1])));
-                        for (int i = 2; i < mulExprs.size(); ++i) {
+                        for (size_t i = 2; i < mulExprs.size(); ++i) {
                             mulExpr = mulOps[i - 1] == "*" ?
                                 static_cast<std::unique_ptr<AstNode>>(std::make_unique<MulExpr>(std::move(mulExpr), std::move(mulExprs[i]))) :
                                 mulOps[i - 1] == "/" ?
@@ -898,34 +899,43 @@ export class Parser {
                     }
                 },
                 {
-                    NonTerminal("UnaryExpr"), [](const SPTChildren& children) {
+                    NonTerminal("UnaryExpr"), [](const SPTChildren& children, ChildAsts childAsts) {
                         const auto& unaryOp = std::get<Token>(children[0]);
-                        const auto& expr = std::get<SimpleParseTree>(children[1]);
                         std::string op = unaryOp.getValue();
                         std::unique_ptr<AstNode> unaryExpr = op == "+" ?
-                            static_cast<std::unique_ptr<AstNode>>(std::make_unique<UnaryPlusExpr>(expr.toAst())) :
+                            static_cast<std::unique_ptr<AstNode>>(std::make_unique<UnaryPlusExpr>(std::move(childAsts[1]))) :
                             op == "-" ?
-                            static_cast<std::unique_ptr<AstNode>>(std::make_unique<UnaryMinusExpr>(expr.toAst())) :
-                            static_cast<std::unique_ptr<AstNode>>(std::make_unique<NotExpr>(expr.toAst()));
+                            static_cast<std::unique_ptr<AstNode>>(std::make_unique<UnaryMinusExpr>(std::move(childAsts[1]))) :
+                            static_cast<std::unique_ptr<AstNode>>(std::make_unique<NotExpr>(std::move(childAsts[1])));
                         return unaryExpr;
                     }
                 },
                 {
-                    NonTerminal("FuncCall"), [](const SPTChildren& children) {
+                    NonTerminal("FuncCall"), [](const SPTChildren& children, ChildAsts childAsts) {
                         const auto& id = std::get<Token>(children[0]);
                         std::vector<std::unique_ptr<AstNode>> exprs;
-                        for (int i = 2; i < children.size() - 1; i += 2) {
-                            const auto& arg = std::get<SimpleParseTree>(children[i]);
-                            exprs.push_back(arg.toAst());
+                        for (size_t i = 2; i < children.size() - 1; i += 2) {
+                            exprs.push_back(std::move(childAsts[i]));
                         }
                         std::unique_ptr<AstNode> funcCall = std::make_unique<FuncCall>(id, std::move(exprs));
                         return funcCall;
                     }
                 },
                 {
-                    NonTerminal("Factor"), [](const SPTChildren& children) {
-                        const auto& expr = std::get<SimpleParseTree>(children[1]);
-                        return expr.toAst();
+                    NonTerminal("Factor"), [](const SPTChildren& children, ChildAsts childAsts) {
+                        return std::move(childAsts[1]);
+                    }
+                },
+                {
+                    NonTerminal("SyntaxError"), [](const SPTChildren& children, ChildAsts childAsts) {
+                        std::vector<Token> tokens;
+                        for (const auto& child : children) {
+                            if (std::holds_alternative<Token>(child)) {
+                                tokens.push_back(std::get<Token>(child));
+                            }
+                        }
+                        std::unique_ptr<AstNode> syntaxError = std::make_unique<SyntaxError>(std::move(tokens));
+                        return syntaxError;
                     }
                 }
             };
@@ -934,33 +944,288 @@ export class Parser {
         }
 
     public:
-        Parser()
+        ParserTables()
             : varConstParser(createVarConstParser()),
               paramListParser(createParamListParser()),
               parser(createParser()),
+              staticParser(std::make_unique<LanguageParser>(getSubParsers(), *parser)),
               simplifyInstructionMap(createSimplifyInstructionMap()),
               astHandlerMap(createAstHandlerMap()) {}
 
-        std::variant<std::unique_ptr<AstNode>, ParserError> parse(const std::vector<Token>& tokens) const {
+        ParserTables(const ParserTables&) = delete;
+        ParserTables& operator=(const ParserTables&) = delete;
+
+        static const ParserTables& getInstance() {
+            // Initialization of a function-local static is thread-safe since C++11
+            static const ParserTables instance;
+            return instance;
+        }
+
+        const RecursiveDescentParser& getParser() const {
+            return *parser;
+        }
+
+        // Faster than getParser, but does not recover from errors
+        const LanguageParser& getStaticParser() const {
+            return *staticParser;
+        }
+
+        const SimplifyInstructionMap& getSimplifyInstructionMap() const {
+            return simplifyInstructionMap;
+        }
+
+        const AstHandlerMap& getAstHandlerMap() const {
+            return astHandlerMap;
+        }
+};
+
+// Parsing does not modify the shared tables, so a Parser is cheap to construct
+// and may be used from several threads at the same time
+export class Parser {
+    private:
+        const ParserTables& tables;
+        const size_t maxDepth;
+
+        ParserContext createContext(ParserTrace* trace = nullptr) const {
+            ParserContext context;
+            context.trace = trace;
+            return context;
+        }
+
+        // The error for the first bracket opened more than maxDepth levels deep, counting '(', '[' and '{'
+        std::optional<ParserError> findNestingError(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd) const {
+            const auto openParen = TerminalFactory::getPunctuator("(");
+            const auto closeParen = TerminalFactory::getPunctuator(")");
+            const auto openBracket = TerminalFactory::getPunctuator("[");
+            const auto closeBracket = TerminalFactory::getPunctuator("]");
+            const auto openBrace = TerminalFactory::getPunctuator("{");
+            const auto closeBrace = TerminalFactory::getPunctuator("}");
+
+            size_t depth = 0;
+            for (; tokenIter != tokenEnd; tokenIter++) {
+                const auto& token = *tokenIter;
+                if (openParen.matchesToken(token) || openBracket.matchesToken(token) || openBrace.matchesToken(token)) {
+                    if (++depth > maxDepth) {
+                        return ParserError("Error: nesting depth limit of " + std::to_string(maxDepth) + " exceeded (at position " + token.getPosition() + ")");
+                    }
+                }
+                else if (depth > 0 && (closeParen.matchesToken(token) || closeBracket.matchesToken(token) || closeBrace.matchesToken(token))) {
+                    depth--;
+                }
+            }
+            return std::nullopt;
+        }
+
+        // Splits the tokens into the token ranges of the top-level declarations. A declaration ends with a ';'
+        // or a '}' outside of any braces. Returns nothing if the braces are unbalanced.
+        static std::optional<std::vector<std::pair<size_t, size_t>>> findDeclarations(const std::vector<Token>& tokens) {
+            const auto openBrace = TerminalFactory::getPunctuator("{");
+            const auto closeBrace = TerminalFactory::getPunctuator("}");
+            const auto semicolon = TerminalFactory::getPunctuator(";");
+
+            std::vector<std::pair<size_t, size_t>> declarations;
+            size_t begin = 0;
+            int depth = 0;
+            for (size_t i = 0; i < tokens.size(); i++) {
+                const auto& token = tokens[i];
+                if (openBrace.matchesToken(token)) {
+                    depth++;
+                }
+                else if (closeBrace.matchesToken(token)) {
+                    depth--;
+                    if (depth < 0) {
+                        return std::nullopt;
+                    }
+                    if (depth == 0) {
+                        declarations.push_back({ begin, i + 1 });
+                        begin = i + 1;
+                    }
+                }
+                else if (depth == 0 && semicolon.matchesToken(token)) {
+                    declarations.push_back({ begin, i + 1 });
+                    begin = i + 1;
+                }
+            }
+            if (begin != tokens.size()) {
+                return std::nullopt;
+            }
+            return declarations;
+        }
+
+        // Parses the tokens of a single top-level declaration
+        std::optional<SimpleParseTree> parseDeclaration(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd) const {
+            if (findNestingError(tokenIter, tokenEnd).has_value()) {
+                return std::nullopt;
+            }
+            auto context = createContext();
+            auto result = tables.getStaticParser().parseSymbol<StaticGrammar::NT<"Decl">>(tokenIter, tokenEnd, context);
+            if (std::holds_alternative<ParserRejectResult>(result)) {
+                return std::nullopt;
+            }
+            const auto& acceptResult = std::get<ParserAcceptResult>(result);
+            if (acceptResult.next != tokenEnd) {
+                return std::nullopt;
+            }
+            return acceptResult.parseTree.simplify(tables.getSimplifyInstructionMap(), tables.getAstHandlerMap());
+        }
+
+        // Parses all the tokens with the given parser, adding its statistics to trace if one is given
+        std::variant<std::unique_ptr<AstNode>, ParserError> parseWith(const ParserBase& parser, const std::vector<Token>& tokens, ParserTrace* trace) const {
             if (tokens.empty()) {
                 return ParserError("Error: empty input");
             }
+            if (auto error = findNestingError(tokens.begin(), tokens.end())) {
+                return *error;
+            }
 
-            auto result = parser->parse(tokens.begin(), tokens.end());
+            auto context = createContext(trace);
+            auto result = parser.parse(tokens.begin(), tokens.end(), context);
 
             if (std::holds_alternative<ParserRejectResult>(result)) {
-                const auto rejectResult = std::get<ParserRejectResult>(result);
+                const auto& rejectResult = std::get<ParserRejectResult>(result);
                 return ParserError(rejectResult.message + " (at position " + rejectResult.where->getPosition() + ")");
             }
 
-            const auto acceptResult = std::get<ParserAcceptResult>(result);
+            const auto& acceptResult = std::get<ParserAcceptResult>(result);
             if (acceptResult.next != tokens.end()) {
                 return ParserError("Error: parsing ended before the end of program (" + acceptResult.next->getPosition() + ")");
             }
 
             // std::cout << acceptResult.parseTree.toString() << std::endl;
-            const auto simplified = acceptResult.parseTree.simplify(simplifyInstructionMap, astHandlerMap);
+            const auto simplified = acceptResult.parseTree.simplify(tables.getSimplifyInstructionMap(), tables.getAstHandlerMap());
             // std::cout << simplified.toString() << std::endl;
             return simplified.toAst();
         }
+
+    public:
+        // Input that opens brackets more than maxDepth levels deep is rejected before it is parsed. Any
+        // depth can be parsed without exhausting the stack; the limit bounds the memory and time spent.
+        explicit Parser(size_t maxDepth = DEFAULT_MAX_DEPTH): tables(ParserTables::getInstance()), maxDepth(maxDepth) {}
+
+        // Statistics per non-terminal are added to trace if one is given; tracing does not change the parser
+        std::variant<std::unique_ptr<AstNode>, ParserError> parse(const std::vector<Token>& tokens, ParserTrace* trace = nullptr) const {
+            return parseWith(tables.getStaticParser(), tokens, trace);
+        }
+
+        // Parses as parse does, with the table-driven parser that the static one is generated alongside
+        std::variant<std::unique_ptr<AstNode>, ParserError> parseWithTable(const std::vector<Token>& tokens, ParserTrace* trace = nullptr) const {
+            return parseWith(tables.getParser(), tokens, trace);
+        }
+
+        // Produces the same AST as parse, but only runs the parser on the top-level declarations whose tokens
+        // are not in the cache; the others are copied from their cached ASTs with the tokens of their new position
+        std::variant<std::unique_ptr<AstNode>, ParserError> parseIncremental(const std::vector<Token>& tokens, ParseCache& cache) const {
+            const auto declarations = findDeclarations(tokens);
+            if (tokens.empty() || !declarations.has_value() || findNestingError(tokens.begin(), tokens.end()).has_value()) {
+                cache.clear();
+                return parse(tokens);
+            }
+
+            std::vector<std::unique_ptr<AstNode>> asts;
+            ParseCache::DeclarationMap newDeclarations;
+            int reused = 0;
+            int reparsed = 0;
+            for (const auto& [begin, end] : *declarations) {
+                const auto declarationTokens = std::span<const Token>(tokens).subspan(begin, end - begin);
+                const auto hash = ParseCache::hashTokens(declarationTokens);
+
+                auto declarationIter = ParseCache::find(newDeclarations, hash, declarationTokens);
+                if (declarationIter == newDeclarations.end()) {
+                    auto cached = cache.take(hash, declarationTokens);
+                    if (!cached.empty()) {
+                        declarationIter = newDeclarations.insert(std::move(cached));
+                    }
+                }
+                if (declarationIter != newDeclarations.end()) {
+                    reused++;
+                } else {
+                    const auto declaration = parseDeclaration(tokens.begin() + begin, tokens.begin() + end);
+                    if (!declaration.has_value()) {
+                        // Let a full parse report the error exactly as it would without the cache
+                        cache.clear();
+                        return parse(tokens);
+                    }
+                    reparsed++;
+                    ParseCache::Declaration parsed{ std::vector<Token>(declarationTokens.begin(), declarationTokens.end()), declaration->toAst() };
+                    declarationIter = newDeclarations.emplace(hash, std::move(parsed));
+                }
+
+                const auto& [cachedTokens, cachedAst] = declarationIter->second;
+                asts.push_back(cachedAst->clone(TokenRebase(cachedTokens, declarationTokens)));
+            }
+
+            cache.update(std::move(newDeclarations), reused, reparsed);
+            return std::make_unique<Start>(std::move(asts));
+        }
+
+        // Produces the same AST and errors as parse, but parses the top-level declarations on up to threadCount
+        // threads, the calling one and those of the shared ThreadPool
+        std::variant<std::unique_ptr<AstNode>, ParserError> parseParallel(const std::vector<Token>& tokens, unsigned int threadCount = std::thread::hardware_concurrency()) const {
+            const auto declarations = findDeclarations(tokens);
+            if (tokens.empty() || !declarations.has_value()) {
+                return parse(tokens);
+            }
+
+            std::vector<std::unique_ptr<AstNode>> asts(declarations->size());
+            std::atomic<size_t> nextIndex = 0;
+            std::atomic<bool> failed = false;
+            const auto worker = [&]() {
+                while (!failed) {
+                    const size_t index = nextIndex++;
+                    if (index >= declarations->size()) {
+                        return;
+                    }
+                    const auto [begin, end] = (*declarations)[index];
+                    const auto declaration = parseDeclaration(tokens.begin() + begin, tokens.begin() + end);
+                    if (!declaration.has_value()) {
+                        failed = true;
+                        return;
+                    }
+                    asts[index] = declaration->toAst();
+                }
+            };
+
+            const size_t workerCount = std::min<size_t>(std::max(threadCount, 1u), declarations->size());
+            ThreadPool::getShared().run(workerCount, [&](size_t) { worker(); });
+
+            if (failed) {
+                // Let a serial parse report the error exactly as it would without threads
+                return parse(tokens);
+            }
+            std::unique_ptr<AstNode> start = std::make_unique<Start>(std::move(asts));
+            return start;
+        }
+
+        // Unlike parse, keeps going after a syntax error so that every error is reported in one run
+        ParserRecoveryResult parseWithRecovery(const std::vector<Token>& tokens, ParserTrace* trace = nullptr) const {
+            if (tokens.empty()) {
+                return { nullptr, { ParserError("Error: empty input") } };
+            }
+            if (auto error = findNestingError(tokens.begin(), tokens.end())) {
+                return { nullptr, { *error } };
+            }
+
+            auto context = createContext(trace);
+            context.recover = true;
+            auto result = tables.getParser().parse(tokens.begin(), tokens.end(), context);
+
+            std::vector<ParserError> errors;
+            for (const auto& diagnostic : context.diagnostics) {
+                errors.push_back(diagnostic.message + " (at position " + diagnostic.where->getPosition() + ")");
+            }
+
+            if (std::holds_alternative<ParserRejectResult>(result)) {
+                const auto& rejectResult = std::get<ParserRejectResult>(result);
+                errors.push_back(rejectResult.message + " (at position " + rejectResult.where->getPosition() + ")");
+                return { nullptr, errors };
+            }
+
+            const auto& acceptResult = std::get<ParserAcceptResult>(result);
+            if (acceptResult.next != tokens.end()) {
+                errors.push_back("Error: parsing ended before the end of program (" + acceptResult.next->getPosition() + ")");
+            }
+
+            const auto simplified = acceptResult.parseTree.simplify(tables.getSimplifyInstructionMap(), tables.getAstHandlerMap());
+            return { simplified.toAst(), errors };
+        }
 };
@@ -9,12 +9,15 @@ module;
 #include <memory>
 #include <functional>
 #include <iostream>
+#include <span>
+#include <iterator>
 
 export module parserbase;
 
 import symbol;
 import ast;
 import token;
+import parsertrace;
 
 // helper type for the visitor
 template<class... Ts>
@@ -32,18 +35,65 @@ export using SimplifyInstructionMap = std::map<NonTerminal, SimplifyInstruction>
 
 export using SPTChildren = std::vector<std::variant<Token, SimpleParseTree>>;
 
-export using AstHandler = std::function<std::unique_ptr<AstNode>(const SPTChildren& children)>;
+// The ASTs already built for the children of a simplified tree, at the same positions as the
+// children; nullptr for the tokens. A handler moves out the ones it uses.
+export using ChildAsts = std::span<std::unique_ptr<AstNode>>;
+
+// Builds the AST of a non-terminal from its children
+export using AstHandler = std::function<std::unique_ptr<AstNode>(const SPTChildren& children, ChildAsts childAsts)>;
 export using AstHandlerMap = std::map<NonTerminal, AstHandler>;
 
 class SimpleParseTree {
     private:
-        const NonTerminal nonTerminal;
+        NonTerminal nonTerminal;
         std::vector<std::variant<Token, SimpleParseTree>> children;
-        const AstHandlerMap astHandlerMap;
+        // Refers to the handler map shared by the parser instead of copying it into every node
+        const AstHandlerMap& astHandlerMap;
 
     public:
         SimpleParseTree(const NonTerminal& nonTerminal, const AstHandlerMap& astHandlerMap) : nonTerminal(nonTerminal), astHandlerMap(astHandlerMap) {}
 
+        // Copies with an explicit stack, so a deeply nested tree does not recurse once per level
+        SimpleParseTree(const SimpleParseTree& other) : nonTerminal(other.nonTerminal), astHandlerMap(other.astHandlerMap) {
+            std::vector<std::pair<SimpleParseTree*, const SimpleParseTree*>> pending{ { this, &other } };
+            while (!pending.empty()) {
+                const auto [copy, original] = pending.back();
+                pending.pop_back();
+                // Reserved so that the subtrees copied into stay where they are
+                copy->children.reserve(original->children.size());
+                for (const auto& child : original->children) {
+                    if (std::holds_alternative<Token>(child)) {
+                        copy->children.push_back(std::get<Token>(child));
+                    } else {
+                        const auto& subtree = std::get<SimpleParseTree>(child);
+                        copy->children.push_back(SimpleParseTree(subtree.nonTerminal, subtree.astHandlerMap));
+                        pending.push_back({ &std::get<SimpleParseTree>(copy->children.back()), &subtree });
+                    }
+                }
+            }
+        }
+
+        // Vectors only move their elements when growing if the move is noexcept; otherwise whole subtrees are copied
+        SimpleParseTree(SimpleParseTree&&) noexcept = default;
+
+        // Takes the subtrees apart from a work-list, so a deeply nested tree does not recurse once per level
+        ~SimpleParseTree() {
+            std::vector<SimpleParseTree> pending;
+            const auto takeSubtrees = [&pending](std::vector<std::variant<Token, SimpleParseTree>>& children) {
+                for (auto& child : children) {
+                    if (std::holds_alternative<SimpleParseTree>(child)) {
+                        pending.push_back(std::move(std::get<SimpleParseTree>(child)));
+                    }
+                }
+            };
+            takeSubtrees(children);
+            while (!pending.empty()) {
+                auto tree = std::move(pending.back());
+                pending.pop_back();
+                takeSubtrees(tree.children);
+            }
+        }
+
         NonTerminal getNonTerminal() const {
             return nonTerminal;
         }
@@ -52,14 +102,50 @@ class SimpleParseTree {
             children.push_back(child);
         }
 
+        void addChild(std::variant<Token, SimpleParseTree>&& child) {
+            children.push_back(std::move(child));
+        }
+
+        // Builds the ASTs of the subtrees before those of their parents, with an explicit stack instead
+        // of the call stack
         std::unique_ptr<AstNode> toAst() const {
-            auto handlerIter = astHandlerMap.find(nonTerminal);
-            if (handlerIter == astHandlerMap.end()) {
-                throw std::runtime_error("No handler found for non-terminal: " + std::string{nonTerminal.getName()});
-            }
-            const auto& handler = handlerIter->second;
+            struct Frame {
+                const SimpleParseTree& tree;
+                size_t childIndex;
+                // Where the ASTs of the tree's children start in builtAsts
+                size_t firstChildAst;
+            };
+            std::vector<std::unique_ptr<AstNode>> builtAsts;
+            std::vector<Frame> stack{ { *this, 0, 0 } };
 
-            return handler(children);
+            while (true) {
+                auto& frame = stack.back();
+                if (frame.childIndex < frame.tree.children.size()) {
+                    const auto& child = frame.tree.children[frame.childIndex];
+                    frame.childIndex++;
+                    if (std::holds_alternative<Token>(child)) {
+                        builtAsts.push_back(nullptr);
+                    } else {
+                        // Invalidates frame
+                        stack.push_back({ std::get<SimpleParseTree>(child), 0, builtAsts.size() });
+                    }
+                    continue;
+                }
+
+                auto handlerIter = astHandlerMap.find(frame.tree.nonTerminal);
+                if (handlerIter == astHandlerMap.end()) {
+                    throw std::runtime_error("No handler found for non-terminal: " + std::string{frame.tree.nonTerminal.getName()});
+                }
+                const auto& handler = handlerIter->second;
+                auto ast = handler(frame.tree.children, ChildAsts(builtAsts).subspan(frame.firstChildAst));
+                builtAsts.erase(builtAsts.begin() + frame.firstChildAst, builtAsts.end());
+
+                stack.pop_back();
+                if (stack.empty()) {
+                    return ast;
+                }
+                builtAsts.push_back(std::move(ast));
+            }
         }
 
         std::string toString() const {
@@ -82,48 +168,112 @@ class SimpleParseTree {
 
 class ParseTree {
     private:
-        const NonTerminal nonTerminal;
+        NonTerminal nonTerminal;
         std::vector<std::variant<Token, ParseTree>> children;
 
+        // A tree being simplified, kept on an explicit stack instead of the call stack
+        struct SimplifyFrame {
+            const ParseTree& tree;
+            size_t childIndex;
+            // Where the simplified children of the tree start in the output
+            size_t firstOutput;
+        };
+
+        // The simplified children of every tree being simplified are kept in one output, each tree's
+        // after its parent's earlier children. A tree merged up leaves its children there for its parent,
+        // and a retained one takes them out into a new node, so every node is moved once.
         std::vector<std::variant<Token, SimpleParseTree>> simplifyInner(const SimplifyInstructionMap& instructionMap, const AstHandlerMap& astHandlerMap) const {
-            // Simplify the children first
-            std::vector<std::variant<Token, SimpleParseTree>> simplified;
-            for (const auto& child : children) {
-                if (std::holds_alternative<Token>(child)) {
-                    simplified.push_back(std::get<Token>(child));
-                } else if (std::holds_alternative<ParseTree>(child)) {
-                    auto parseTreeChild = std::get<ParseTree>(child);
-                    auto simplifiedChildren = parseTreeChild.simplifyInner(instructionMap, astHandlerMap);
-                    for (const auto& simplifiedChild : simplifiedChildren) {
-                        simplified.push_back(simplifiedChild);
+            std::vector<std::variant<Token, SimpleParseTree>> output;
+            std::vector<SimplifyFrame> stack;
+            stack.push_back({ *this, 0, 0 });
+
+            while (!stack.empty()) {
+                auto& frame = stack.back();
+
+                // Simplify the children first
+                if (frame.childIndex < frame.tree.children.size()) {
+                    const auto& child = frame.tree.children[frame.childIndex];
+                    frame.childIndex++;
+                    if (std::holds_alternative<Token>(child)) {
+                        output.push_back(std::get<Token>(child));
+                    } else if (std::holds_alternative<ParseTree>(child)) {
+                        // Invalidates frame
+                        stack.push_back({ std::get<ParseTree>(child), 0, output.size() });
                     }
+                    continue;
                 }
-            }
 
-            // Make simplification based on instruction
-            auto instructionIter = instructionMap.find(nonTerminal);
-            if (instructionIter == instructionMap.end()) {
-                throw std::runtime_error("No instruction found for non-terminal: " + std::string{nonTerminal.getName()});
-            }
-            const auto& instruction = instructionIter->second;
-            bool toMergeUp = instruction == SimplifyInstruction::MERGE_UP;
-            if (instruction == SimplifyInstruction::RETAIN_IF_MULTIPLE_CHILDREN) {
-                toMergeUp = simplified.size() < 2;
-            }
-            if (toMergeUp) {
-                return simplified;
-            } else {
-                SimpleParseTree simplifiedTree(nonTerminal, astHandlerMap);
-                for (const auto& child : simplified) {
-                    simplifiedTree.addChild(child);
+                // Make simplification based on instruction
+                const auto& nonTerminal = frame.tree.nonTerminal;
+                auto instructionIter = instructionMap.find(nonTerminal);
+                if (instructionIter == instructionMap.end()) {
+                    throw std::runtime_error("No instruction found for non-terminal: " + std::string{nonTerminal.getName()});
+                }
+                const auto& instruction = instructionIter->second;
+                bool toMergeUp = instruction == SimplifyInstruction::MERGE_UP;
+                if (instruction == SimplifyInstruction::RETAIN_IF_MULTIPLE_CHILDREN) {
+                    toMergeUp = output.size() - frame.firstOutput < 2;
+                }
+                if (!toMergeUp) {
+                    SimpleParseTree simplifiedTree(nonTerminal, astHandlerMap);
+                    for (auto child = output.begin() + frame.firstOutput; child != output.end(); ++child) {
+                        simplifiedTree.addChild(std::move(*child));
+                    }
+                    // Tokens cannot be assigned, so the tail is popped rather than erased
+                    while (output.size() > frame.firstOutput) {
+                        output.pop_back();
+                    }
+                    output.push_back(std::move(simplifiedTree));
                 }
-                return { simplifiedTree };
+                stack.pop_back();
             }
+            return output;
         }
 
     public:
         ParseTree(const NonTerminal& nonTerminal) : nonTerminal(nonTerminal) {}
 
+        // Copies with an explicit stack, so a deeply nested tree does not recurse once per level
+        ParseTree(const ParseTree& other) : nonTerminal(other.nonTerminal) {
+            std::vector<std::pair<ParseTree*, const ParseTree*>> pending{ { this, &other } };
+            while (!pending.empty()) {
+                const auto [copy, original] = pending.back();
+                pending.pop_back();
+                // Reserved so that the subtrees copied into stay where they are
+                copy->children.reserve(original->children.size());
+                for (const auto& child : original->children) {
+                    if (std::holds_alternative<Token>(child)) {
+                        copy->children.push_back(std::get<Token>(child));
+                    } else {
+                        const auto& subtree = std::get<ParseTree>(child);
+                        copy->children.push_back(ParseTree(subtree.nonTerminal));
+                        pending.push_back({ &std::get<ParseTree>(copy->children.back()), &subtree });
+                    }
+                }
+            }
+        }
+
+        // Vectors only move their elements when growing if the move is noexcept; otherwise whole subtrees are copied
+        ParseTree(ParseTree&&) noexcept = default;
+
+        // Takes the subtrees apart from a work-list, so a deeply nested tree does not recurse once per level
+        ~ParseTree() {
+            std::vector<ParseTree> pending;
+            const auto takeSubtrees = [&pending](std::vector<std::variant<Token, ParseTree>>& children) {
+                for (auto& child : children) {
+                    if (std::holds_alternative<ParseTree>(child)) {
+                        pending.push_back(std::move(std::get<ParseTree>(child)));
+                    }
+                }
+            };
+            takeSubtrees(children);
+            while (!pending.empty()) {
+                auto tree = std::move(pending.back());
+                pending.pop_back();
+                takeSubtrees(tree.children);
+            }
+        }
+
         NonTerminal getNonTerminal() const {
             return nonTerminal;
         }
@@ -132,18 +282,22 @@ class ParseTree {
             children.push_back(child);
         }
 
-        ParseTree withoutStartSymbol() const {
+        void addChild(std::variant<Token, ParseTree>&& child) {
+            children.push_back(std::move(child));
+        }
+
+        ParseTree withoutStartSymbol() && {
             if (children.size() == 1 && std::holds_alternative<ParseTree>(children[0])) {
-                return std::get<ParseTree>(children[0]);
+                return std::move(std::get<ParseTree>(children[0]));
             }
             throw std::runtime_error("Parse tree of " + std::string{nonTerminal.getName()} + " have "
                 + std::to_string(children.size()) + " children, expected 1");
         }
 
         SimpleParseTree simplify(const SimplifyInstructionMap& instructionMap, const AstHandlerMap& astHandlerMap) const {
-            const auto simplified = simplifyInner(instructionMap, astHandlerMap);
+            auto simplified = simplifyInner(instructionMap, astHandlerMap);
             if (simplified.size() == 1 && std::holds_alternative<SimpleParseTree>(simplified[0])) {
-                return std::get<SimpleParseTree>(simplified[0]);
+                return std::move(std::get<SimpleParseTree>(simplified[0]));
             }
             throw std::runtime_error("Error when simplifying parse tree");
         }
@@ -179,9 +333,24 @@ export struct ParserRejectResult {
 
 export using ParsingResult = std::variant<ParserAcceptResult, ParserRejectResult>;
 
+export struct ParserContext {
+    // When set, parsers skip to a synchronization point on a syntax error and keep going
+    bool recover = false;
+    // Syntax errors that were recovered from, in the order they were found
+    std::vector<ParserRejectResult> diagnostics;
+    // Statistics are collected here if set; a null trace costs one branch per non-terminal
+    ParserTrace* trace = nullptr;
+};
+
 export class ParserBase {
     public:
         ParserBase() {}
         virtual ~ParserBase() = default;
-        virtual ParsingResult parse(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd) const = 0;
+
+        ParsingResult parse(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd) const {
+            ParserContext context;
+            return parse(tokenIter, tokenEnd, context);
+        }
+
+        virtual ParsingResult parse(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, ParserContext& context) const = 0;
 };
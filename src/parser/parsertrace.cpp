@@ -0,0 +1,123 @@
+module;
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+
+export module parsertrace;
+
+// Counters for one non-terminal or parser state
+export struct ParserTraceEntry {
+    // Number of times parsing it was started
+    long attempts = 0;
+    // Number of alternatives (or lookups, for table-driven parsers) that failed
+    long failedAlternatives = 0;
+    // Number of tokens consumed by successful attempts
+    long tokensConsumed = 0;
+    // Time spent in it, including nested non-terminals
+    std::chrono::steady_clock::duration time{};
+};
+
+// Collects statistics while parsing. Tracing is enabled by giving one to the parser;
+// without it the parsers skip all bookkeeping.
+export class ParserTrace {
+    private:
+        std::map<std::string, ParserTraceEntry, std::less<>> entries;
+        // Number of times a parser compared a token against a terminal or looked it up in a table.
+        // Backtracking visits tokens again, so this grows faster than the input when parsing is super-linear.
+        long tokenVisits = 0;
+
+        static std::string escapeJson(std::string_view text) {
+            std::string escaped;
+            for (const char c : text) {
+                if (c == '"' || c == '\\') {
+                    escaped += '\\';
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+
+        static long toMicroseconds(std::chrono::steady_clock::duration time) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+        }
+
+        // Most expensive first
+        std::vector<std::pair<std::string, ParserTraceEntry>> getSortedEntries() const {
+            std::vector<std::pair<std::string, ParserTraceEntry>> sorted(entries.begin(), entries.end());
+            std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+                if (a.second.time != b.second.time) {
+                    return a.second.time > b.second.time;
+                }
+                return a.second.attempts > b.second.attempts;
+            });
+            return sorted;
+        }
+
+    public:
+        ParserTrace() {}
+
+        ParserTraceEntry& getEntry(std::string_view name) {
+            auto entryIter = entries.find(name);
+            if (entryIter == entries.end()) {
+                entryIter = entries.emplace(std::string{name}, ParserTraceEntry{}).first;
+            }
+            return entryIter->second;
+        }
+
+        const std::map<std::string, ParserTraceEntry, std::less<>>& getEntries() const {
+            return entries;
+        }
+
+        void addTokenVisit() {
+            tokenVisits++;
+        }
+
+        long getTokenVisits() const {
+            return tokenVisits;
+        }
+
+        std::string toTable() const {
+            const auto sorted = getSortedEntries();
+            size_t nameWidth = std::string_view("symbol").size();
+            for (const auto& [name, entry] : sorted) {
+                nameWidth = std::max(nameWidth, name.size());
+            }
+
+            std::ostringstream oss;
+            oss << std::left << std::setw(nameWidth) << "symbol" << std::right
+                << std::setw(12) << "attempts" << std::setw(12) << "failed"
+                << std::setw(12) << "tokens" << std::setw(12) << "time (us)" << "\n";
+            for (const auto& [name, entry] : sorted) {
+                oss << std::left << std::setw(nameWidth) << name << std::right
+                    << std::setw(12) << entry.attempts << std::setw(12) << entry.failedAlternatives
+                    << std::setw(12) << entry.tokensConsumed << std::setw(12) << toMicroseconds(entry.time) << "\n";
+            }
+            return oss.str();
+        }
+
+        std::string toJson() const {
+            const auto sorted = getSortedEntries();
+            std::ostringstream oss;
+            oss << "[";
+            for (auto entryIter = sorted.begin(); entryIter != sorted.end(); ++entryIter) {
+                if (entryIter != sorted.begin()) {
+                    oss << ",";
+                }
+                const auto& [name, entry] = *entryIter;
+                oss << "\n  {\"symbol\": \"" << escapeJson(name) << "\""
+                    << ", \"attempts\": " << entry.attempts
+                    << ", \"failedAlternatives\": " << entry.failedAlternatives
+                    << ", \"tokensConsumed\": " << entry.tokensConsumed
+                    << ", \"timeMicroseconds\": " << toMicroseconds(entry.time) << "}";
+            }
+            oss << "\n]";
+            return oss.str();
+        }
+};
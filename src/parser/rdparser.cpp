@@ -6,97 +6,279 @@ module;
 #include <map>
 #include <stdexcept>
 #include <memory>
+#include <optional>
+#include <chrono>
+#include <iterator>
 
 export module rdparser;
 
 import token;
 import symbol;
 import parserbase;
+import parsertrace;
 
 export using RdpProduct = std::vector<std::variant<NonTerminal, Terminal, ParserBase*>>;
 export using RdpProductMap = std::map<NonTerminal, std::vector<RdpProduct>>;
 
+// Describes how to skip past a syntax error in a non-terminal (panic-mode recovery)
+export struct RdpRecoveryRule {
+    // The skipped tokens are placed under this non-terminal
+    NonTerminal errorSymbol;
+    // Skipping ends after one of these terminals (outside of brackets)
+    std::vector<Terminal> syncTerminals;
+    // Skipping ends before one of these terminals (outside of brackets); recovery is not attempted at one
+    std::vector<Terminal> stopTerminals;
+    // Skipping ends before one of these terminal sequences (outside of brackets)
+    std::vector<std::vector<Terminal>> resumeSequences;
+    // Tokens between a pair of brackets are skipped as a whole
+    Terminal openBracket;
+    Terminal closeBracket;
+};
+export using RdpRecoveryMap = std::map<NonTerminal, RdpRecoveryRule>;
+
+bool matchesAnyTerminal(const std::vector<Terminal>& terminals, const Token& token) {
+    for (const auto& terminal : terminals) {
+        if (terminal.matchesToken(token)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool startsAnySequence(const std::vector<std::vector<Terminal>>& sequences, std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd) {
+    for (const auto& sequence : sequences) {
+        auto nextTokenIter = tokenIter;
+        bool matches = true;
+        for (const auto& terminal : sequence) {
+            if (nextTokenIter == tokenEnd || !terminal.matchesToken(*nextTokenIter)) {
+                matches = false;
+                break;
+            }
+            nextTokenIter++;
+        }
+        if (matches) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A non-terminal being parsed, kept on an explicit stack instead of the call stack
+struct RdpFrame {
+    const NonTerminal& nonTerminal;
+    const std::vector<RdpProduct>& products;
+    // Where the non-terminal starts
+    const std::vector<Token>::const_iterator tokenIter;
+    std::vector<Token>::const_iterator bestIter;
+    size_t productIndex = 0;
+    size_t symbolIndex = 0;
+    size_t diagnosticsCount = 0;
+    // The alternative being parsed
+    std::optional<ParseTree> parseTree;
+    std::vector<Token>::const_iterator nextTokenIter;
+    // Only set when tracing
+    ParserTraceEntry* traceEntry = nullptr;
+    std::chrono::steady_clock::time_point startTime;
+};
+
 export class RecursiveDescentParser : public ParserBase {
     private:
         const NonTerminal startSymbol;
         const RdpProductMap productMap;
+        const RdpRecoveryMap recoveryMap;
+
+        std::optional<ParserAcceptResult> recover(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, const NonTerminal& nonTerminal, const std::vector<Token>::const_iterator bestIter, ParserContext& context) const {
+            auto ruleIter = recoveryMap.find(nonTerminal);
+            if (ruleIter == recoveryMap.end()) {
+                return std::nullopt;
+            }
+            const auto& rule = ruleIter->second;
+            if (tokenIter == tokenEnd || matchesAnyTerminal(rule.stopTerminals, *tokenIter)) {
+                // The enclosing construct legitimately ends here
+                return std::nullopt;
+            }
+
+            context.diagnostics.push_back(ParserRejectResult{"Parsing error", bestIter});
+
+            ParseTree errorTree(rule.errorSymbol);
+            auto nextTokenIter = tokenIter;
+            int depth = 0;
+            while (nextTokenIter != tokenEnd) {
+                const auto& token = *nextTokenIter;
+                if (depth == 0 && nextTokenIter != tokenIter) {
+                    if (matchesAnyTerminal(rule.stopTerminals, token) || startsAnySequence(rule.resumeSequences, nextTokenIter, tokenEnd)) {
+                        break;
+                    }
+                }
+                errorTree.addChild(token);
+                nextTokenIter++;
+                if (rule.openBracket.matchesToken(token)) {
+                    depth++;
+                }
+                else if (rule.closeBracket.matchesToken(token)) {
+                    if (depth > 0) {
+                        depth--;
+                    }
+                    if (depth == 0) {
+                        break;
+                    }
+                }
+                else if (depth == 0 && matchesAnyTerminal(rule.syncTerminals, token)) {
+                    break;
+                }
+            }
+
+            ParseTree parseTree(nonTerminal);
+            parseTree.addChild(std::move(errorTree));
+            return ParserAcceptResult{std::move(parseTree), nextTokenIter, bestIter};
+        }
 
-        ParsingResult parseNonTerminal(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, const NonTerminal& nonTerminal) const {
+        // Starts parsing a non-terminal from its first alternative
+        RdpFrame createFrame(const NonTerminal& nonTerminal, std::vector<Token>::const_iterator tokenIter, const ParserContext& context) const {
             auto productsIter = productMap.find(nonTerminal);
             if (productsIter == productMap.end()) {
                 throw std::runtime_error("No production or subparser found for non-terminal: " + std::string{nonTerminal.getName()});
             }
-            auto& products = productsIter->second;
+            RdpFrame frame{productsIter->first, productsIter->second, tokenIter, tokenIter, 0, 0, 0, std::nullopt, tokenIter, nullptr, {}};
+            if (context.trace != nullptr) {
+                frame.traceEntry = &context.trace->getEntry(nonTerminal.getName());
+                frame.traceEntry->attempts++;
+                frame.startTime = std::chrono::steady_clock::now();
+            }
+            startAlternative(frame, context);
+            return frame;
+        }
 
-            std::vector<Token>::const_iterator bestIter = tokenIter;
+        static void startAlternative(RdpFrame& frame, const ParserContext& context) {
+            frame.symbolIndex = 0;
+            frame.diagnosticsCount = context.diagnostics.size();
+            frame.parseTree.emplace(frame.nonTerminal);
+            frame.nextTokenIter = frame.tokenIter;
+        }
 
-            for (const auto& product : products) {
-                ParseTree parseTree(nonTerminal);
-                auto nextTokenIter = tokenIter;
-                bool success = true;
-                for (const auto& symbol : product) {
+        // Adds the result of a child non-terminal or subparser to the alternative being parsed
+        static bool addChildResult(RdpFrame& frame, ParsingResult&& result) {
+            if (std::holds_alternative<ParserRejectResult>(result)) {
+                const auto& rejectResult = std::get<ParserRejectResult>(result);
+                if (rejectResult.where->getPositionNumber() > frame.bestIter->getPositionNumber()) {
+                    frame.bestIter = rejectResult.where;
+                }
+                return false;
+            }
+            auto& acceptResult = std::get<ParserAcceptResult>(result);
+            frame.parseTree->addChild(std::move(acceptResult.parseTree));
+            frame.nextTokenIter = acceptResult.next;
+            if (acceptResult.bestIter->getPositionNumber() > frame.bestIter->getPositionNumber()) {
+                frame.bestIter = acceptResult.bestIter;
+            }
+            return true;
+        }
+
+        // Non-terminals are parsed with an explicit stack, so deeply nested input is not limited by
+        // the size of the call stack
+        ParsingResult parseNonTerminal(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, const NonTerminal& nonTerminal, ParserContext& context) const {
+            std::vector<RdpFrame> stack;
+            stack.push_back(createFrame(nonTerminal, tokenIter, context));
+            std::optional<ParsingResult> childResult;
+
+            while (true) {
+                auto& frame = stack.back();
+                bool success = frame.productIndex < frame.products.size();
+                if (childResult.has_value()) {
+                    success = addChildResult(frame, std::move(*childResult));
+                    childResult.reset();
+                }
+
+                // Continue the current alternative until it fails, ends or needs a child non-terminal
+                bool descend = false;
+                while (success && frame.symbolIndex < frame.products[frame.productIndex].size()) {
+                    const auto& symbol = frame.products[frame.productIndex][frame.symbolIndex];
+                    frame.symbolIndex++;
                     if (std::holds_alternative<Terminal>(symbol)) {
                         const auto& terminalSymbol = std::get<Terminal>(symbol);
-                        if (nextTokenIter == tokenEnd || !terminalSymbol.matchesToken(*nextTokenIter)) {
+                        if (context.trace != nullptr && frame.nextTokenIter != tokenEnd) {
+                            context.trace->addTokenVisit();
+                        }
+                        if (frame.nextTokenIter == tokenEnd || !terminalSymbol.matchesToken(*frame.nextTokenIter)) {
                             success = false;
                             break;
                         }
-                        parseTree.addChild(*nextTokenIter);
-                        nextTokenIter++;
+                        frame.parseTree->addChild(*frame.nextTokenIter);
+                        frame.nextTokenIter++;
                     }
                     else if (std::holds_alternative<NonTerminal>(symbol)) {
-                        const auto& nonTerminalSymbol = std::get<NonTerminal>(symbol);
-                        ParsingResult result = parseNonTerminal(nextTokenIter, tokenEnd, nonTerminalSymbol);
-                        if (std::holds_alternative<ParserRejectResult>(result)) {
-                            auto rejectResult = std::get<ParserRejectResult>(result);
-                            if (rejectResult.where->getPositionNumber() > bestIter->getPositionNumber()) {
-                                bestIter = rejectResult.where;
-                            }
-                            success = false;
-                            break;
-                        }
-                        auto acceptResult = std::get<ParserAcceptResult>(result);
-                        parseTree.addChild(acceptResult.parseTree);
-                        nextTokenIter = acceptResult.next;
-                        if (acceptResult.bestIter->getPositionNumber() > bestIter->getPositionNumber()) {
-                            bestIter = acceptResult.bestIter;
-                        }
+                        descend = true;
+                        break;
                     }
                     else if (std::holds_alternative<ParserBase*>(symbol)) {
                         const auto& subParser = std::get<ParserBase*>(symbol);
-                        ParsingResult result = subParser->parse(nextTokenIter, tokenEnd);
-                        if (std::holds_alternative<ParserRejectResult>(result)) {
-                            auto rejectResult = std::get<ParserRejectResult>(result);
-                            if (rejectResult.where->getPositionNumber() > bestIter->getPositionNumber()) {
-                                bestIter = rejectResult.where;
-                            }
-                            success = false;
-                            break;
-                        }
-                        auto acceptResult = std::get<ParserAcceptResult>(result);
-                        parseTree.addChild(acceptResult.parseTree);
-                        nextTokenIter = acceptResult.next;
-                        if (acceptResult.bestIter->getPositionNumber() > bestIter->getPositionNumber()) {
-                            bestIter = acceptResult.bestIter;
-                        }
+                        success = addChildResult(frame, subParser->parse(frame.nextTokenIter, tokenEnd, context));
                     }
                     else {
                         throw std::runtime_error("Unknown symbol type");
                     }
                 }
+
+                if (descend) {
+                    const auto& nonTerminalSymbol = std::get<NonTerminal>(frame.products[frame.productIndex][frame.symbolIndex - 1]);
+                    // Invalidates frame
+                    stack.push_back(createFrame(nonTerminalSymbol, frame.nextTokenIter, context));
+                    continue;
+                }
+
+                std::optional<ParsingResult> result;
                 if (success) {
-                    return ParserAcceptResult{parseTree, nextTokenIter, bestIter};
+                    result.emplace(ParserAcceptResult{std::move(*frame.parseTree), frame.nextTokenIter, frame.bestIter});
+                }
+                else {
+                    // Errors recovered inside an alternative are discarded if the alternative fails
+                    context.diagnostics.erase(context.diagnostics.begin() + frame.diagnosticsCount, context.diagnostics.end());
+                    if (frame.traceEntry != nullptr && frame.productIndex < frame.products.size()) {
+                        frame.traceEntry->failedAlternatives++;
+                    }
+                    frame.productIndex++;
+                    if (frame.productIndex < frame.products.size()) {
+                        startAlternative(frame, context);
+                        continue;
+                    }
+                    if (context.recover) {
+                        auto recovered = recover(frame.tokenIter, tokenEnd, frame.nonTerminal, frame.bestIter, context);
+                        if (recovered.has_value()) {
+                            result.emplace(std::move(recovered.value()));
+                        }
+                    }
+                    if (!result.has_value()) {
+                        result.emplace(ParserRejectResult{"Parsing error", frame.bestIter});
+                    }
                 }
-            }
 
-            return ParserRejectResult{"Parsing error", bestIter};
+                if (frame.traceEntry != nullptr) {
+                    frame.traceEntry->time += std::chrono::steady_clock::now() - frame.startTime;
+                    if (std::holds_alternative<ParserAcceptResult>(*result)) {
+                        frame.traceEntry->tokensConsumed += std::distance(frame.tokenIter, std::get<ParserAcceptResult>(*result).next);
+                    }
+                }
+
+                stack.pop_back();
+                if (stack.empty()) {
+                    return std::move(*result);
+                }
+                childResult.emplace(std::move(*result));
+            }
         }
 
     public:
-        RecursiveDescentParser(const NonTerminal& startSymbol, const RdpProductMap& productMap)
-            : startSymbol(startSymbol), productMap(productMap) {}
+        RecursiveDescentParser(const NonTerminal& startSymbol, const RdpProductMap& productMap, const RdpRecoveryMap& recoveryMap = {})
+            : startSymbol(startSymbol), productMap(productMap), recoveryMap(recoveryMap) {}
+
+        using ParserBase::parse;
+
+        ParsingResult parse(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, ParserContext& context) const override {
+            return parseNonTerminal(tokenIter, tokenEnd, startSymbol, context);
+        }
 
-        ParsingResult parse(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd) const override {
-            return parseNonTerminal(tokenIter, tokenEnd, startSymbol);
+        // Parses the given non-terminal instead of the start symbol
+        ParsingResult parseSymbol(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, const NonTerminal& symbol, ParserContext& context) const {
+            return parseNonTerminal(tokenIter, tokenEnd, symbol, context);
         }
 };
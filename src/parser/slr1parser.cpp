@@ -6,6 +6,8 @@ module;
 #include <map>
 #include <stack>
 #include <optional>
+#include <chrono>
+#include <iterator>
 #include <stdexcept>
 
 export module slr1parser;
@@ -13,6 +15,7 @@ export module slr1parser;
 import token;
 import symbol;
 import parserbase;
+import parsertrace;
 import terminalfactory;
 
 export class State {
@@ -43,17 +46,24 @@ export using ProductionMap = std::map<int, Production>;
 
 export using SLR1ParsingTable = std::map<std::pair<State, SymbolOrEOL>, Instruction>;
 
+// Describes how to skip past a syntax error (panic-mode recovery)
+export struct SLR1RecoveryRule {
+    // The discarded symbols and skipped tokens are placed under this non-terminal
+    NonTerminal errorSymbol;
+    // States are popped until one has a goto on this non-terminal, which stands in for the damaged input
+    NonTerminal recoverySymbol;
+    // Input tokens are skipped until one of these terminals
+    std::vector<Terminal> syncTerminals;
+};
+
 export class SLR1Parser : public ParserBase {
     private:
         const State startState;
         const ProductionMap productionMap;
         const SLR1ParsingTable parsingTable;
+        const std::optional<SLR1RecoveryRule> recoveryRule;
 
-    public:
-        SLR1Parser(const State startState, const ProductionMap productionMap, const SLR1ParsingTable& parsingTable)
-            : startState(startState), productionMap(productionMap), parsingTable(parsingTable) {}
-
-        ParsingResult parse(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd) const override {
+        ParsingResult parseUntraced(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, ParserContext& context) const {
             auto nextTokenIter = tokenIter;
             bool assumeEndOfLine = false;
             std::stack<std::pair<State, std::variant<Token, ParseTree>>> stateSymbolStack;
@@ -83,8 +93,76 @@ export class SLR1Parser : public ParserBase {
                     return std::nullopt;
                 };
 
+                const auto recoverFromError = [&]()->bool {
+                    if (!context.recover || !recoveryRule.has_value()) {
+                        return false;
+                    }
+                    const auto& rule = recoveryRule.value();
+                    const auto isSyncToken = [&](const Token& token) {
+                        for (const auto& terminal : rule.syncTerminals) {
+                            if (terminal.matchesToken(token)) {
+                                return true;
+                            }
+                        }
+                        return false;
+                    };
+
+                    // Pop states until one has a goto on the recovery symbol
+                    // The stack is only left in a broken state when recovery fails and parsing is abandoned
+                    std::stack<std::variant<Token, ParseTree>> discarded;
+                    const auto findRecoveryGoto = [&]() {
+                        return parsingTable.find(std::make_pair(getCurrentState(), SymbolOrEOL{rule.recoverySymbol}));
+                    };
+                    auto gotoIter = findRecoveryGoto();
+                    while (gotoIter == parsingTable.end() && !stateSymbolStack.empty()) {
+                        discarded.push(stateSymbolStack.top().second);
+                        stateSymbolStack.pop();
+                        gotoIter = findRecoveryGoto();
+                    }
+                    if (gotoIter == parsingTable.end() || !std::holds_alternative<State>(gotoIter->second)) {
+                        return false;
+                    }
+
+                    ParseTree errorTree(rule.errorSymbol);
+                    bool hasToken = false;
+                    while (!discarded.empty()) {
+                        hasToken = hasToken || std::holds_alternative<Token>(discarded.top());
+                        errorTree.addChild(discarded.top());
+                        discarded.pop();
+                    }
+
+                    // Skip input until a synchronization token
+                    auto skipIter = nextTokenIter;
+                    while (skipIter != tokenEnd && !isSyncToken(*skipIter)) {
+                        errorTree.addChild(*skipIter);
+                        skipIter++;
+                        hasToken = true;
+                    }
+                    if (!hasToken) {
+                        // Nothing would be discarded, so recovering cannot make progress
+                        return false;
+                    }
+
+                    context.diagnostics.push_back(ParserRejectResult{"No production found", nextTokenIter});
+                    stateSymbolStack.push(std::make_pair(std::get<State>(gotoIter->second), errorTree));
+                    nextTokenIter = skipIter;
+                    assumeEndOfLine = false;
+                    return true;
+                };
+
                 const auto instructionIter = findInstruction();
+                if (context.trace != nullptr) {
+                    auto& traceEntry = context.trace->getEntry("SLR1 state " + std::string{getCurrentState().getName()});
+                    traceEntry.attempts++;
+                    context.trace->addTokenVisit();
+                    if (!instructionIter.has_value()) {
+                        traceEntry.failedAlternatives++;
+                    }
+                }
                 if (!instructionIter.has_value()) {
+                    if (recoverFromError()) {
+                        continue;
+                    }
                     return ParserRejectResult{"No production found", nextTokenIter};
                 }
                 const auto& instruction = instructionIter.value();
@@ -152,4 +230,27 @@ export class SLR1Parser : public ParserBase {
                 }
             }
         }
+
+    public:
+        SLR1Parser(const State startState, const ProductionMap productionMap, const SLR1ParsingTable& parsingTable, const std::optional<SLR1RecoveryRule>& recoveryRule = std::nullopt)
+            : startState(startState), productionMap(productionMap), parsingTable(parsingTable), recoveryRule(recoveryRule) {}
+
+        using ParserBase::parse;
+
+        ParsingResult parse(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, ParserContext& context) const override {
+            if (context.trace == nullptr) {
+                return parseUntraced(tokenIter, tokenEnd, context);
+            }
+            auto& traceEntry = context.trace->getEntry("SLR1Parser(" + std::string{startState.getName()} + ")");
+            traceEntry.attempts++;
+            const auto startTime = std::chrono::steady_clock::now();
+            auto result = parseUntraced(tokenIter, tokenEnd, context);
+            traceEntry.time += std::chrono::steady_clock::now() - startTime;
+            if (std::holds_alternative<ParserAcceptResult>(result)) {
+                traceEntry.tokensConsumed += std::distance(tokenIter, std::get<ParserAcceptResult>(result).next);
+            } else {
+                traceEntry.failedAlternatives++;
+            }
+            return result;
+        }
 };
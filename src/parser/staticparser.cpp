@@ -0,0 +1,275 @@
+module;
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <optional>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <chrono>
+#include <iterator>
+
+export module staticparser;
+
+import token;
+import tokenregistry;
+import symbol;
+import parserbase;
+import rdparser;
+import parsertrace;
+
+// A grammar written as types, so that the compiler generates a parse function for each production
+// with the terminal checks inlined. The same grammar also produces the table of the equivalent
+// RecursiveDescentParser, which is still used for error recovery, and which takes over input nested
+// too deeply for the parse functions to call each other on the call stack. Given a trace, the parse
+// functions record the same statistics as that parser.
+//
+// A non-terminal is defined by specializing Rule for a grammar tag type:
+//     template<> struct StaticGrammar::Rule<MyGrammar, "Factor">
+//         : Alt<Seq<Punctuator<"(">, NT<"Expr">, Punctuator<")">>, Seq<Sub<0>>> {};
+export namespace StaticGrammar {
+
+    template<size_t N>
+    struct FixedString {
+        char value[N];
+
+        constexpr FixedString(const char (&string)[N]) {
+            std::copy_n(string, N, value);
+        }
+
+        constexpr std::string_view view() const {
+            return { value, N - 1 };
+        }
+    };
+
+    // How many non-terminals deep the parse functions call each other. A level takes under 600 bytes
+    // of stack in an optimized build, so a parse stays under 1 MB of stack wherever it runs; the
+    // non-terminals nested deeper are parsed by the RecursiveDescentParser, whose stack is on the heap.
+    constexpr size_t MAX_NATIVE_DEPTH = 1000;
+
+    // State shared by the parse functions during one parse
+    struct ParseState {
+        const std::vector<Token>::const_iterator tokenEnd;
+        ParserContext& context;
+        const std::vector<ParserBase*>& subParsers;
+        const RecursiveDescentParser& fallbackParser;
+        size_t depth = 0;
+    };
+
+    using TokenIter = std::vector<Token>::const_iterator;
+
+    // Keeps the furthest position reached, as RecursiveDescentParser does
+    inline void updateBestIter(TokenIter& bestIter, const TokenIter& iter) {
+        if (iter->getPositionNumber() > bestIter->getPositionNumber()) {
+            bestIter = iter;
+        }
+    }
+
+    // Adds the result of a child non-terminal or subparser to the tree of the alternative being parsed
+    inline bool addChildResult(ParsingResult&& result, ParseTree& parseTree, TokenIter& nextTokenIter, TokenIter& bestIter) {
+        if (std::holds_alternative<ParserRejectResult>(result)) {
+            updateBestIter(bestIter, std::get<ParserRejectResult>(result).where);
+            return false;
+        }
+        auto& acceptResult = std::get<ParserAcceptResult>(result);
+        parseTree.addChild(std::move(acceptResult.parseTree));
+        nextTokenIter = acceptResult.next;
+        updateBestIter(bestIter, acceptResult.bestIter);
+        return true;
+    }
+
+    template<typename Grammar, FixedString Name>
+    struct Rule;
+
+    // Matches a token by id
+    template<int Id, FixedString Name>
+    struct TokenTerminal {
+        template<typename Grammar>
+        static bool parse(ParseState& state, ParseTree& parseTree, TokenIter& nextTokenIter, TokenIter& bestIter) {
+            if (nextTokenIter == state.tokenEnd) {
+                return false;
+            }
+            if (state.context.trace != nullptr) {
+                state.context.trace->addTokenVisit();
+            }
+            if (nextTokenIter->getId() != Id) {
+                return false;
+            }
+            parseTree.addChild(*nextTokenIter);
+            nextTokenIter++;
+            return true;
+        }
+
+        static RdpProduct::value_type toRdpSymbol(const std::vector<ParserBase*>& subParsers) {
+            return Terminal{ Id, Name.view() };
+        }
+    };
+
+    using Identifier = TokenTerminal<TokenRegistry::identifierId, "identifier">;
+    using IntegerLiteral = TokenTerminal<TokenRegistry::integerLiteralId, "integerLiteral">;
+    using FloatLiteral = TokenTerminal<TokenRegistry::floatLiteralId, "floatLiteral">;
+    using StringLiteral = TokenTerminal<TokenRegistry::stringLiteralId, "stringLiteral">;
+
+    template<FixedString Value>
+    using Keyword = TokenTerminal<TokenRegistry::getKeywordId(Value.view()), Value>;
+
+    template<FixedString Value>
+    using Operator = TokenTerminal<TokenRegistry::getOperatorId(Value.view()), Value>;
+
+    template<FixedString Value>
+    using Punctuator = TokenTerminal<TokenRegistry::getPunctuatorId(Value.view()), Value>;
+
+    // Parses a non-terminal defined by a Rule of the grammar
+    template<FixedString Name>
+    struct NT {
+        static const NonTerminal& getNonTerminal() {
+            static const NonTerminal nonTerminal{ std::string{Name.view()} };
+            return nonTerminal;
+        }
+
+        template<typename Grammar>
+        static ParsingResult parseNonTerminal(ParseState& state, TokenIter tokenIter) {
+            if (state.depth >= MAX_NATIVE_DEPTH) {
+                return state.fallbackParser.parseSymbol(tokenIter, state.tokenEnd, getNonTerminal(), state.context);
+            }
+            ParserTraceEntry* traceEntry = nullptr;
+            std::chrono::steady_clock::time_point startTime;
+            if (state.context.trace != nullptr) {
+                traceEntry = &state.context.trace->getEntry(Name.view());
+                traceEntry->attempts++;
+                startTime = std::chrono::steady_clock::now();
+            }
+            state.depth++;
+            TokenIter bestIter = tokenIter;
+            auto result = Rule<Grammar, Name>::template parseAlternatives<Grammar>(state, getNonTerminal(), tokenIter, bestIter, traceEntry);
+            state.depth--;
+            if (traceEntry != nullptr) {
+                traceEntry->time += std::chrono::steady_clock::now() - startTime;
+                if (result.has_value()) {
+                    traceEntry->tokensConsumed += std::distance(tokenIter, result->next);
+                }
+            }
+            if (result.has_value()) {
+                return std::move(*result);
+            }
+            return ParserRejectResult{"Parsing error", bestIter};
+        }
+
+        template<typename Grammar>
+        static bool parse(ParseState& state, ParseTree& parseTree, TokenIter& nextTokenIter, TokenIter& bestIter) {
+            return addChildResult(parseNonTerminal<Grammar>(state, nextTokenIter), parseTree, nextTokenIter, bestIter);
+        }
+
+        static RdpProduct::value_type toRdpSymbol(const std::vector<ParserBase*>& subParsers) {
+            return getNonTerminal();
+        }
+    };
+
+    // Runs the subparser at the given index of those given to the StaticParser
+    template<size_t Index>
+    struct Sub {
+        template<typename Grammar>
+        static bool parse(ParseState& state, ParseTree& parseTree, TokenIter& nextTokenIter, TokenIter& bestIter) {
+            return addChildResult(state.subParsers[Index]->parse(nextTokenIter, state.tokenEnd, state.context), parseTree, nextTokenIter, bestIter);
+        }
+
+        static RdpProduct::value_type toRdpSymbol(const std::vector<ParserBase*>& subParsers) {
+            return subParsers[Index];
+        }
+    };
+
+    // A production: its symbols are parsed in order
+    template<typename... Symbols>
+    struct Seq {
+        template<typename Grammar>
+        static std::optional<ParserAcceptResult> parse(ParseState& state, const NonTerminal& nonTerminal, TokenIter tokenIter, TokenIter& bestIter) {
+            ParseTree parseTree(nonTerminal);
+            auto nextTokenIter = tokenIter;
+            if ((Symbols::template parse<Grammar>(state, parseTree, nextTokenIter, bestIter) && ...)) {
+                return ParserAcceptResult{std::move(parseTree), nextTokenIter, bestIter};
+            }
+            return std::nullopt;
+        }
+
+        static RdpProduct toRdpProduct(const std::vector<ParserBase*>& subParsers) {
+            return { Symbols::toRdpSymbol(subParsers)... };
+        }
+    };
+
+    // The productions of a non-terminal, tried in order. Failed productions are counted in traceEntry if set.
+    template<typename... Productions>
+    struct Alt {
+        template<typename Grammar>
+        static std::optional<ParserAcceptResult> parseAlternatives(ParseState& state, const NonTerminal& nonTerminal, TokenIter tokenIter, TokenIter& bestIter, ParserTraceEntry* traceEntry) {
+            std::optional<ParserAcceptResult> result;
+            const auto tryProduction = [&]<typename Production>() {
+                auto productionResult = Production::template parse<Grammar>(state, nonTerminal, tokenIter, bestIter);
+                if (productionResult.has_value()) {
+                    result.emplace(std::move(*productionResult));
+                    return true;
+                }
+                if (traceEntry != nullptr) {
+                    traceEntry->failedAlternatives++;
+                }
+                return false;
+            };
+            (tryProduction.template operator()<Productions>() || ...);
+            return result;
+        }
+
+        static std::vector<RdpProduct> toRdpProducts(const std::vector<ParserBase*>& subParsers) {
+            return { Productions::toRdpProduct(subParsers)... };
+        }
+    };
+
+    // The non-terminals of a grammar, for building the table of a RecursiveDescentParser
+    template<typename Grammar, typename... Symbols>
+    struct RuleList {
+        static RdpProductMap toRdpProductMap(const std::vector<ParserBase*>& subParsers) {
+            return { { Symbols::getNonTerminal(), RuleOf<Symbols>::toRdpProducts(subParsers) }... };
+        }
+
+    private:
+        template<typename Symbol>
+        struct RuleOfImpl;
+
+        template<FixedString Name>
+        struct RuleOfImpl<NT<Name>> {
+            using type = Rule<Grammar, Name>;
+        };
+
+        template<typename Symbol>
+        using RuleOf = typename RuleOfImpl<Symbol>::type;
+    };
+
+}
+
+// Parses with the parse functions generated from a grammar. Produces the same results as a
+// RecursiveDescentParser built from the same grammar, except that errors are not recovered from.
+// That parser, given as fallbackParser, parses what is nested beyond MAX_NATIVE_DEPTH.
+export template<typename Grammar, typename StartSymbol>
+class StaticParser : public ParserBase {
+    private:
+        const std::vector<ParserBase*> subParsers;
+        const RecursiveDescentParser& fallbackParser;
+
+    public:
+        StaticParser(const std::vector<ParserBase*>& subParsers, const RecursiveDescentParser& fallbackParser)
+            : subParsers(subParsers), fallbackParser(fallbackParser) {}
+
+        using ParserBase::parse;
+
+        ParsingResult parse(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, ParserContext& context) const override {
+            StaticGrammar::ParseState state{ tokenEnd, context, subParsers, fallbackParser, 0 };
+            return StartSymbol::template parseNonTerminal<Grammar>(state, tokenIter);
+        }
+
+        // Parses the given non-terminal instead of the start symbol
+        template<typename Symbol>
+        ParsingResult parseSymbol(std::vector<Token>::const_iterator tokenIter, const std::vector<Token>::const_iterator tokenEnd, ParserContext& context) const {
+            StaticGrammar::ParseState state{ tokenEnd, context, subParsers, fallbackParser, 0 };
+            return Symbol::template parseNonTerminal<Grammar>(state, tokenIter);
+        }
+};
@@ -31,7 +31,7 @@ export class Terminal {
 
 export class NonTerminal {
     private:
-        const std::string name;
+        std::string name;
 
     public:
         NonTerminal(const std::string& name) : name(name) {}
@@ -0,0 +1,137 @@
+module;
+
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+export module symboltable;
+
+// Names declared in nested scopes, keyed by interned name id. All scopes share one open-addressing
+// table that maps each name to its innermost declaration. A declaration that shadows an outer one
+// remembers it, so leaving a scope restores the outer declarations; entering and leaving a scope
+// cost only the names declared in it and nothing is allocated per scope.
+export template <typename Entry>
+class ScopedSymbolTable {
+    private:
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+        struct Slot {
+            uint32_t nameId = NONE;
+            // Index in declarations of the innermost declaration of the name, NONE if out of scope
+            uint32_t declaration = NONE;
+        };
+
+        struct Declaration {
+            uint32_t nameId;
+            uint32_t scope;
+            // The declaration it shadows, restored when its scope is left
+            uint32_t shadowed;
+            Entry entry;
+        };
+
+        // Power of two in size and at most half full
+        std::vector<Slot> slots;
+        // The declarations in scope, outermost scope first
+        std::vector<Declaration> declarations;
+        // The size of declarations when each open scope was entered
+        std::vector<uint32_t> scopeStarts;
+        uint32_t usedSlots = 0;
+
+        static uint32_t hash(uint32_t nameId) {
+            // Fibonacci hashing spreads consecutive ids over the table
+            return nameId * 2654435769u;
+        }
+
+        // The slot of the name, or the empty slot where it would go
+        uint32_t findSlot(uint32_t nameId) const {
+            const uint32_t mask = slots.size() - 1;
+            uint32_t index = hash(nameId) & mask;
+            while (slots[index].nameId != nameId && slots[index].nameId != NONE) {
+                index = (index + 1) & mask;
+            }
+            return index;
+        }
+
+        void grow() {
+            std::vector<Slot> oldSlots(slots.size() * 2);
+            oldSlots.swap(slots);
+            for (const auto& slot : oldSlots) {
+                if (slot.nameId != NONE) {
+                    slots[findSlot(slot.nameId)] = slot;
+                }
+            }
+        }
+
+        Slot& claimSlot(uint32_t nameId) {
+            if ((usedSlots + 1) * 2 > slots.size()) {
+                grow();
+            }
+            auto& slot = slots[findSlot(nameId)];
+            if (slot.nameId == NONE) {
+                slot.nameId = nameId;
+                usedSlots++;
+            }
+            return slot;
+        }
+
+    public:
+        // Starts in the global scope; expectedNames sizes the table so it does not need to grow
+        ScopedSymbolTable(size_t expectedNames = 8) {
+            size_t size = 16;
+            while (size < expectedNames * 2) {
+                size *= 2;
+            }
+            slots.resize(size);
+        }
+
+        // The nesting depth of the current scope, 0 for the global scope
+        uint32_t getScope() const {
+            return scopeStarts.size();
+        }
+
+        void enterScope() {
+            scopeStarts.push_back(declarations.size());
+        }
+
+        void leaveScope() {
+            if (scopeStarts.empty()) {
+                throw std::runtime_error("Cannot leave the global scope");
+            }
+            while (declarations.size() > scopeStarts.back()) {
+                const auto& declaration = declarations.back();
+                slots[findSlot(declaration.nameId)].declaration = declaration.shadowed;
+                declarations.pop_back();
+            }
+            scopeStarts.pop_back();
+        }
+
+        // Declares the name in the current scope unless it is already declared there
+        void declare(uint32_t nameId, const Entry& entry) {
+            auto& slot = claimSlot(nameId);
+            if (slot.declaration != NONE && declarations[slot.declaration].scope == getScope()) {
+                return;
+            }
+            const auto shadowed = slot.declaration;
+            slot.declaration = declarations.size();
+            declarations.push_back(Declaration{ nameId, getScope(), shadowed, entry });
+        }
+
+        // Declares the name in the current scope, replacing any declaration of it there
+        void redeclare(uint32_t nameId, const Entry& entry) {
+            auto& slot = claimSlot(nameId);
+            if (slot.declaration != NONE && declarations[slot.declaration].scope == getScope()) {
+                declarations[slot.declaration].entry = entry;
+                return;
+            }
+            const auto shadowed = slot.declaration;
+            slot.declaration = declarations.size();
+            declarations.push_back(Declaration{ nameId, getScope(), shadowed, entry });
+        }
+
+        // The innermost declaration of the name, nullptr if it is not in scope. The pointer is
+        // invalidated by the next declaration.
+        const Entry* lookup(uint32_t nameId) const {
+            const auto& slot = slots[findSlot(nameId)];
+            return slot.declaration == NONE ? nullptr : &declarations[slot.declaration].entry;
+        }
+};
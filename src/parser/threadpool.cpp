@@ -0,0 +1,124 @@
+module;
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <exception>
+
+export module threadpool;
+
+// Threads kept for the passes that work on several threads, so that a call does not start its own.
+// The calling thread works too: it runs the first worker, then takes queued tasks while it waits, so
+// a call finishes even when every thread of the pool is busy with other calls, or there is none.
+export class ThreadPool {
+    private:
+        std::mutex mutex;
+        std::condition_variable taskAdded;
+        std::condition_variable taskDone;
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::thread> threads;
+        bool stopping = false;
+
+        // Runs the next queued task with the lock released; lock must be held
+        void runNextTask(std::unique_lock<std::mutex>& lock) {
+            auto task = std::move(tasks.front());
+            tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+
+        void work() {
+            std::unique_lock lock(mutex);
+            while (true) {
+                taskAdded.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                runNextTask(lock);
+            }
+        }
+
+        // Runs a worker, returning what it threw so that a task never lets an exception escape
+        static std::exception_ptr runWorker(const std::function<void(size_t)>& worker, size_t index) noexcept {
+            try {
+                worker(index);
+            } catch (...) {
+                return std::current_exception();
+            }
+            return nullptr;
+        }
+
+    public:
+        explicit ThreadPool(unsigned int threadCount) {
+            for (unsigned int i = 0; i < threadCount; i++) {
+                threads.emplace_back([this] { work(); });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard lock(mutex);
+                stopping = true;
+            }
+            taskAdded.notify_all();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+
+        // The pool shared by the whole program, started on first use with a thread for each core but
+        // the one of the calling thread
+        static ThreadPool& getShared() {
+            static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+            return pool;
+        }
+
+        // Runs worker(index) for every index below workerCount, index 0 on the calling thread, and
+        // returns once they have all finished. The first exception thrown by a worker is then rethrown.
+        void run(size_t workerCount, const std::function<void(size_t)>& worker) {
+            // Guarded by mutex
+            size_t running = 0;
+            std::exception_ptr exception;
+            {
+                std::lock_guard lock(mutex);
+                for (size_t index = 1; index < workerCount; index++) {
+                    running++;
+                    tasks.push_back([this, &worker, &running, &exception, index] {
+                        const auto workerException = runWorker(worker, index);
+                        // Notified under the lock, since run may return and end running as soon as it is released
+                        std::lock_guard lock(mutex);
+                        if (workerException && !exception) {
+                            exception = workerException;
+                        }
+                        running--;
+                        taskDone.notify_all();
+                    });
+                }
+            }
+            taskAdded.notify_all();
+
+            const auto workerException = runWorker(worker, 0);
+            std::unique_lock lock(mutex);
+            if (workerException && !exception) {
+                exception = workerException;
+            }
+            // The tasks refer to this frame, so they are waited for even when a worker failed
+            while (running > 0) {
+                if (!tasks.empty()) {
+                    runNextTask(lock);
+                } else {
+                    taskDone.wait(lock);
+                }
+            }
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        }
+};
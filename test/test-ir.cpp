@@ -0,0 +1,1003 @@
+#include <catch2/catch_all.hpp>
+#include <string>
+#include <memory>
+#include <variant>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+import token;
+import lexer;
+import ir;
+import cfg;
+import ssa;
+import constantfold;
+import sccp;
+import deadcode;
+import valuenumbering;
+import licm;
+import ast;
+import parser;
+
+inline std::vector<Token> getLexerOutput(const Lexer& lexer, const std::string_view code) {
+    auto result = lexer.acceptCode(code);
+    REQUIRE(std::holds_alternative<std::vector<Token>>(result));
+    return std::get<std::vector<Token>>(result);
+}
+
+inline std::unique_ptr<AstNode> getParserOutput(const Lexer& lexer, const Parser& parser, const std::string_view code) {
+    auto result = parser.parse(getLexerOutput(lexer, code));
+    REQUIRE(std::holds_alternative<std::unique_ptr<AstNode>>(result));
+    return std::move(std::get<std::unique_ptr<AstNode>>(result));
+}
+
+inline IrProgram getIrOutput(const Lexer& lexer, const Parser& parser, const std::string_view code) {
+    return FlatAstQuadrupleGenerator(getParserOutput(lexer, parser, code)->toFlatAst()).toIr();
+}
+
+// Runs a program without phis: the top-level code, then main. Arrays are kept by name, shared by
+// every call, and their elements read as zero until stored to. A function without RETURN gives
+// zero. The result describes what main returned and the final globals, so programs can be compared
+// before and after a pass.
+class IrInterpreter {
+    private:
+        using Value = std::variant<long long, double, std::string>;
+
+        static constexpr size_t MAX_STEPS = 1000000;
+
+        const IrProgram& program;
+        const std::vector<IrInstruction>& instructions;
+        std::unordered_map<uint32_t, size_t> labels;
+        std::unordered_map<uint32_t, size_t> functions;
+        std::map<std::string, Value> globals;
+        std::map<std::string, std::map<long long, Value>> arrays;
+        std::vector<Value> arguments;
+        size_t steps = 0;
+
+        static bool isTrue(const Value& value) {
+            if (const auto number = std::get_if<long long>(&value)) {
+                return *number != 0;
+            }
+            if (const auto number = std::get_if<double>(&value)) {
+                return *number != 0;
+            }
+            return true;
+        }
+
+        static double toDouble(const Value& value) {
+            return std::holds_alternative<long long>(value) ? std::get<long long>(value) : std::get<double>(value);
+        }
+
+        static Value evaluate(Opcode opcode, const Value& left, const Value& right) {
+            if (opcode == Opcode::OR || opcode == Opcode::AND) {
+                return (long long)(opcode == Opcode::OR ? isTrue(left) || isTrue(right) : isTrue(left) && isTrue(right));
+            }
+            if (std::holds_alternative<std::string>(left) && std::holds_alternative<std::string>(right)) {
+                // Strings keep their quotes
+                const auto& a = std::get<std::string>(left);
+                const auto& b = std::get<std::string>(right);
+                switch (opcode) {
+                    case Opcode::ADD: return a.substr(0, a.size() - 1) + b.substr(1);
+                    case Opcode::EQUAL: return (long long)(a == b);
+                    case Opcode::NOT_EQUAL: return (long long)(a != b);
+                    case Opcode::LESS: return (long long)(a < b);
+                    case Opcode::LESS_EQUAL: return (long long)(a <= b);
+                    case Opcode::GREATER: return (long long)(a > b);
+                    case Opcode::GREATER_EQUAL: return (long long)(a >= b);
+                    default: throw std::runtime_error("Not a string operator");
+                }
+            }
+            if (std::holds_alternative<long long>(left) && std::holds_alternative<long long>(right)) {
+                const auto a = std::get<long long>(left);
+                const auto b = std::get<long long>(right);
+                switch (opcode) {
+                    case Opcode::EQUAL: return (long long)(a == b);
+                    case Opcode::NOT_EQUAL: return (long long)(a != b);
+                    case Opcode::LESS: return (long long)(a < b);
+                    case Opcode::LESS_EQUAL: return (long long)(a <= b);
+                    case Opcode::GREATER: return (long long)(a > b);
+                    case Opcode::GREATER_EQUAL: return (long long)(a >= b);
+                    case Opcode::ADD: return a + b;
+                    case Opcode::SUB: return a - b;
+                    case Opcode::MUL: return a * b;
+                    case Opcode::DIV: return b == 0 ? 0 : a / b;
+                    case Opcode::MOD: return b == 0 ? 0 : a % b;
+                    default: throw std::runtime_error("Not a binary opcode");
+                }
+            }
+            const auto a = toDouble(left);
+            const auto b = toDouble(right);
+            switch (opcode) {
+                case Opcode::EQUAL: return (long long)(a == b);
+                case Opcode::NOT_EQUAL: return (long long)(a != b);
+                case Opcode::LESS: return (long long)(a < b);
+                case Opcode::LESS_EQUAL: return (long long)(a <= b);
+                case Opcode::GREATER: return (long long)(a > b);
+                case Opcode::GREATER_EQUAL: return (long long)(a >= b);
+                case Opcode::ADD: return a + b;
+                case Opcode::SUB: return a - b;
+                case Opcode::MUL: return a * b;
+                case Opcode::DIV: return a / b;
+                case Opcode::MOD: return std::fmod(a, b);
+                default: throw std::runtime_error("Not a binary opcode");
+            }
+        }
+
+        Value read(Operand operand, std::unordered_map<uint32_t, Value>& locals) {
+            if (operand.getKind() == OperandKind::CONSTANT) {
+                const auto& constant = program.getConstant(operand);
+                switch (constant.kind) {
+                    case ConstantKind::INT: return std::stoll(constant.text);
+                    case ConstantKind::FLOAT: return std::stod(constant.text);
+                    case ConstantKind::STRING: return constant.text;
+                }
+            }
+            if (operand.getKind() == OperandKind::NAME && program.isGlobal(operand)) {
+                return globals.try_emplace(program.getName(operand), 0LL).first->second;
+            }
+            if (operand.getKind() == OperandKind::VALUE || operand.getKind() == OperandKind::NONE) {
+                throw std::runtime_error("Cannot read the operand");
+            }
+            return locals.try_emplace(operand.getBits(), 0LL).first->second;
+        }
+
+        void write(Operand operand, Value value, std::unordered_map<uint32_t, Value>& locals) {
+            if (operand.getKind() == OperandKind::NAME && program.isGlobal(operand)) {
+                globals[program.getName(operand)] = std::move(value);
+            } else {
+                locals[operand.getBits()] = std::move(value);
+            }
+        }
+
+        // Runs from the instruction until a RETURN or ENDFUNC, or the end of the program
+        Value run(size_t next, std::vector<Value> parameters) {
+            std::unordered_map<uint32_t, Value> locals;
+            while (next < instructions.size()) {
+                if (++steps > MAX_STEPS) {
+                    throw std::runtime_error("Too many steps");
+                }
+                const auto& instruction = instructions[next++];
+                switch (instruction.opcode) {
+                    case Opcode::FUNCTION:
+                        while (instructions[next - 1].opcode != Opcode::ENDFUNC) {
+                            next++;
+                        }
+                        break;
+                    case Opcode::ASSIGN:
+                        write(instruction.result, read(instruction.arg1, locals), locals);
+                        break;
+                    case Opcode::INDEX: {
+                        const auto& elements = arrays[program.getName(instruction.arg1)];
+                        const auto element = elements.find((long long)toDouble(read(instruction.arg2, locals)));
+                        write(instruction.result, element != elements.end() ? element->second : Value(0LL), locals);
+                        break;
+                    }
+                    case Opcode::INDEX_STORE:
+                        arrays[program.getName(instruction.result)][(long long)toDouble(read(instruction.arg2, locals))] = read(instruction.arg1, locals);
+                        break;
+                    case Opcode::PLUS:
+                        write(instruction.result, read(instruction.arg1, locals), locals);
+                        break;
+                    case Opcode::MINUS: {
+                        const auto value = read(instruction.arg1, locals);
+                        write(instruction.result, std::holds_alternative<double>(value) ? Value(-std::get<double>(value)) : Value(-std::get<long long>(value)), locals);
+                        break;
+                    }
+                    case Opcode::NOT:
+                        write(instruction.result, (long long)!isTrue(read(instruction.arg1, locals)), locals);
+                        break;
+                    case Opcode::IF:
+                        if (isTrue(read(instruction.arg1, locals))) {
+                            next = labels.at(instruction.result.getIndex());
+                        }
+                        break;
+                    case Opcode::GOTO:
+                        next = labels.at(instruction.result.getIndex());
+                        break;
+                    case Opcode::PARAM:
+                        write(instruction.arg1, parameters.at(instruction.arg2.getIndex() - 1), locals);
+                        break;
+                    case Opcode::PUSH:
+                        arguments.push_back(read(instruction.arg1, locals));
+                        break;
+                    case Opcode::CALL: {
+                        std::vector<Value> callArguments;
+                        for (uint32_t i = 0; i < instruction.arg2.getIndex(); i++) {
+                            callArguments.push_back(arguments.back());
+                            arguments.pop_back();
+                        }
+                        write(instruction.result, run(functions.at(instruction.arg1.getIndex()) + 1, std::move(callArguments)), locals);
+                        break;
+                    }
+                    case Opcode::RETURN:
+                        return instruction.arg1.isNone() ? Value(0LL) : read(instruction.arg1, locals);
+                    case Opcode::ENDFUNC:
+                        return 0LL;
+                    case Opcode::LABEL:
+                        break;
+                    case Opcode::PHI:
+                        throw std::runtime_error("Cannot run a PHI");
+                    default:
+                        write(instruction.result, evaluate(instruction.opcode, read(instruction.arg1, locals), read(instruction.arg2, locals)), locals);
+                        break;
+                }
+            }
+            return 0LL;
+        }
+
+        static std::string toString(const Value& value) {
+            if (const auto number = std::get_if<long long>(&value)) {
+                return std::to_string(*number);
+            }
+            if (const auto number = std::get_if<double>(&value)) {
+                return std::to_string(*number);
+            }
+            return std::get<std::string>(value);
+        }
+
+    public:
+        IrInterpreter(const IrProgram& program) : program(program), instructions(program.getInstructions()) {
+            for (size_t i = 0; i < instructions.size(); i++) {
+                if (instructions[i].opcode == Opcode::LABEL) {
+                    labels[instructions[i].arg1.getIndex()] = i;
+                } else if (instructions[i].opcode == Opcode::FUNCTION) {
+                    functions[instructions[i].arg1.getIndex()] = i;
+                }
+            }
+        }
+
+        std::string run() {
+            run(0, {});
+            std::string result = "main=";
+            for (const auto& [name, start] : functions) {
+                if (program.getName(Operand::name(name)) == "main") {
+                    result += toString(run(start + 1, {}));
+                }
+            }
+            for (const auto& [name, value] : globals) {
+                result += " " + name + "=" + toString(value);
+            }
+            return result;
+        }
+};
+
+TEST_CASE("Encode operands and instructions") {
+    STATIC_REQUIRE(sizeof(IrInstruction) == 16);
+    STATIC_REQUIRE(Operand().isNone());
+    STATIC_REQUIRE(Operand::temp(0).getKind() == OperandKind::TEMP);
+    STATIC_REQUIRE(Operand::label(12345).getIndex() == 12345);
+    STATIC_REQUIRE(Operand::name(3) != Operand::constant(3));
+    STATIC_REQUIRE(isBinaryOpcode(Opcode::MOD));
+    STATIC_REQUIRE(isUnaryOpcode(Opcode::NOT));
+    STATIC_REQUIRE_FALSE(isBinaryOpcode(Opcode::ASSIGN));
+}
+
+TEST_CASE("Intern names and constants") {
+    IrProgram program;
+    CHECK(program.internName("a") == program.internName("a"));
+    CHECK(program.internName("a") != program.internName("b"));
+    CHECK(program.internConstant(ConstantKind::INT, "1") == program.internConstant(ConstantKind::INT, "1"));
+    CHECK(program.getConstant(program.internConstant(ConstantKind::STRING, "\"s\"")).kind == ConstantKind::STRING);
+    CHECK(program.getNameCount() == 2);
+    CHECK(program.getConstantCount() == 2);
+    CHECK(program.newLabel() == Operand::label(0));
+    CHECK(program.temp(4) == Operand::temp(4));
+    CHECK(program.newTemp() == Operand::temp(5));
+}
+
+TEST_CASE("Print the IR as quadruples") {
+    Lexer lexer;
+    Parser parser;
+
+    const std::string code = "int a[10]; int f(int x, float y) { a[x] = -x * 2.5; if (!(x < 1) && y) { return f(x - 1, \"s\"); } else { return; } }";
+    const auto program = getIrOutput(lexer, parser, code);
+    const auto ast = getParserOutput(lexer, parser, code);
+
+    SECTION("Reproduce the quadruple listing") {
+        CHECK(IrPrinter(program).toString() == ast->toQuadrupleString());
+        CHECK(IrPrinter(program).toString() ==
+            "( FUNCTION, f, 2,  )\n"
+            "( PARAM, x, 1,  )\n"
+            "( PARAM, y, 2,  )\n"
+            "( -, x, , t1 )\n"
+            "( *, t1, 2.5, t0 )\n"
+            "( []=, t0, x, a )\n"
+            "( <, x, 1, t3 )\n"
+            "( -, t3, , t2 )\n"
+            "( &&, t2, y, t1 )\n"
+            "( if, t1, , L0 )\n"
+            "( goto, , , L1 )\n"
+            "L0:\n"
+            "( PUSH, \"s\", ,  )\n"
+            "( -, x, 1, t2 )\n"
+            "( PUSH, t2, ,  )\n"
+            "( CALL, f, 2, t1 )\n"
+            "( RETURN, t1, ,  )\n"
+            "( goto, , , L2 )\n"
+            "L1:\n"
+            "( RETURN, , ,  )\n"
+            "L2:\n"
+            "( ENDFUNC, f, ,  )\n");
+    }
+
+    SECTION("Give the same text quadruples") {
+        const auto quads = FlatAstQuadrupleGenerator(ast->toFlatAst()).toQuadruples();
+        REQUIRE(quads.size() == program.getInstructions().size());
+        CHECK(std::get<Quadruple>(quads[0]).op == "FUNCTION");
+        CHECK(std::get<Quadruple>(quads[0]).arg2 == "2");
+        CHECK(std::get<Label>(quads[11]).id == 0);
+    }
+
+    SECTION("Keep the opcodes and operand kinds") {
+        const auto& instructions = program.getInstructions();
+        CHECK(instructions[3].opcode == Opcode::MINUS);
+        CHECK(instructions[4].arg2.getKind() == OperandKind::CONSTANT);
+        CHECK(program.getConstant(instructions[4].arg2).kind == ConstantKind::FLOAT);
+        CHECK(instructions[5].opcode == Opcode::INDEX_STORE);
+        CHECK(instructions[5].arg1.getKind() == OperandKind::TEMP);
+        CHECK(program.getName(instructions[5].result) == "a");
+        CHECK(instructions[7].opcode == Opcode::NOT);
+        CHECK(instructions[9].result == Operand::label(0));
+        CHECK(program.getLabelCount() == 3);
+    }
+}
+
+TEST_CASE("Build the control-flow graph") {
+    Lexer lexer;
+    Parser parser;
+
+    const auto getSuccessors = [](const ControlFlowGraph& cfg, uint32_t block) {
+        const auto successors = cfg.getSuccessors(block);
+        return std::vector<uint32_t>(successors.begin(), successors.end());
+    };
+
+    SECTION("Split functions") {
+        const auto program = getIrOutput(lexer, parser, "int a = 1; int f() { return 1; } int g() { a = 2; }");
+        const auto functions = findFunctions(program.getInstructions());
+        REQUIRE(functions.size() == 2);
+        CHECK(functions[0].begin == 1);
+        CHECK(functions[0].end == 4);
+        CHECK(functions[1].end == program.getInstructions().size());
+    }
+
+    SECTION("Branch and join") {
+        const auto program = getIrOutput(lexer, parser, "int main() { int a = 1; if (a < 2) { a = 3; } else { a = 4; } return a; }");
+        const ControlFlowGraph cfg(program.getInstructions());
+        REQUIRE(cfg.size() == 6);
+        CHECK(cfg.getBlockStart(2) == 5);
+        CHECK(cfg.getBlockEnd(2) == 8);
+        CHECK(cfg.getBlockOf(9) == 3);
+        CHECK((getSuccessors(cfg, 0) == std::vector<uint32_t>{ 2, 1 }));
+        CHECK(getSuccessors(cfg, 1) == std::vector<uint32_t>{ 3 });
+        CHECK(getSuccessors(cfg, 4).empty());
+        CHECK(cfg.getPredecessors(4).size() == 2);
+        CHECK_FALSE(cfg.isReachable(5));
+        CHECK(cfg.getImmediateDominator(3) == 1);
+        CHECK(cfg.getImmediateDominator(4) == 0);
+        CHECK(cfg.dominates(0, 3));
+        CHECK_FALSE(cfg.dominates(2, 4));
+        CHECK(cfg.getReversePostorder().front() == 0);
+        CHECK(cfg.getLoops().empty());
+    }
+
+    SECTION("Find nested loops") {
+        const auto program = getIrOutput(lexer, parser, "int main() { int i = 0; while (i < 10) { int j = 0; while (j < i) { j = j + 1; } i = i + 1; } }");
+        const ControlFlowGraph cfg(program.getInstructions());
+        REQUIRE(cfg.size() == 9);
+        CHECK(getSuccessors(cfg, 6) == std::vector<uint32_t>{ 4 });
+        CHECK(getSuccessors(cfg, 7) == std::vector<uint32_t>{ 1 });
+        CHECK(cfg.getImmediateDominator(7) == 5);
+        CHECK(cfg.getImmediateDominator(8) == 2);
+        REQUIRE(cfg.getLoops().size() == 2);
+        const auto outer = cfg.getLoopOf(3);
+        const auto inner = cfg.getLoopOf(6);
+        REQUIRE(outer != NO_LOOP);
+        REQUIRE(inner != NO_LOOP);
+        CHECK(cfg.getLoops()[outer].header == 1);
+        CHECK((cfg.getLoops()[outer].blocks == std::vector<uint32_t>{ 1, 3, 4, 5, 6, 7 }));
+        CHECK(cfg.getLoops()[outer].latches == std::vector<uint32_t>{ 7 });
+        CHECK(cfg.getLoops()[inner].header == 4);
+        CHECK((cfg.getLoops()[inner].blocks == std::vector<uint32_t>{ 4, 6 }));
+        CHECK(cfg.getLoops()[inner].parent == outer);
+        CHECK(cfg.getLoopDepth(6) == 2);
+        CHECK(cfg.getLoopDepth(8) == 0);
+    }
+}
+
+// Programs with loops, branches, calls, globals and floats, run before and after each pass
+const std::vector<std::string> samplePrograms = {
+    "int main() { int i = 0; int s = 0; while (i < 10) { s = s + i; i = i + 1; } return s; }",
+    "int main() { int a = 1; int b = 2; int t; int i = 0; while (i < 3) { t = a; a = b; b = t; i = i + 1; } return a * 10 + b; }",
+    "int main() { int x = 1; int y = x; int i; for (i = 0; i < 5; i = i + 1) { y = x; x = x + y; } return y; }",
+    "int g = 0; int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); } int main() { g = fib(10); return g; }",
+    "float h; int main() { int i = 0; float f = 0.5; while (i < 4) { if (i % 2 == 0) { f = f * 2; } else { h = h + f; } i = i + 1; } return i; }",
+    "int main() { int a = 1; int b = 2; if (a < b) { a = b; } else { b = a; } return a - b; }",
+    "int debug = 0; int main() { int x = 1; int i; for (i = 0; i < 3; i = i + 1) { if (debug) { x = x * 100; } else { x = x + 1; } } return x; }",
+    "str s; int main() { int n = 3; str t = \"a\"; while (n > 0) { t = t + \"b\"; n = n - 1; } s = t; if (t == \"abbb\") { return 1; } return 0; }",
+    "int f(int n) { int x = 1; if (n) { if (n > 5) { x = 1; } } else { x = n; } return x; } int main() { return f(7); }",
+};
+
+// Replaces every use of a value copied from another value by the original, as passes on SSA form do
+inline void propagateCopies(IrProgram& program) {
+    std::unordered_map<uint32_t, Operand> sources;
+    for (const auto& instruction : program.getInstructions()) {
+        if (instruction.opcode == Opcode::ASSIGN && instruction.arg1.getKind() == OperandKind::VALUE) {
+            sources[instruction.result.getBits()] = instruction.arg1;
+        }
+    }
+    const auto replace = [&](Operand& operand) {
+        for (auto source = sources.find(operand.getBits()); source != sources.end(); source = sources.find(operand.getBits())) {
+            operand = source->second;
+        }
+    };
+    for (auto& instruction : program.getInstructions()) {
+        if (instruction.opcode == Opcode::PHI) {
+            for (auto& argument : program.getPhiArguments(instruction)) {
+                replace(argument);
+            }
+            continue;
+        }
+        if (readsArg1(instruction.opcode)) {
+            replace(instruction.arg1);
+        }
+        if (readsArg2(instruction.opcode)) {
+            replace(instruction.arg2);
+        }
+    }
+}
+
+TEST_CASE("Convert to SSA form") {
+    Lexer lexer;
+    Parser parser;
+
+    SECTION("Join the assignments at phis") {
+        auto program = getIrOutput(lexer, parser, "int main() { int a = 1; if (a < 2) { a = 3; } else { a = 4; } return a; }");
+        convertToSsa(program);
+        CHECK(IrPrinter(program).toString() ==
+            "( FUNCTION, main, 0,  )\n"
+            "( =, 1, , a.1 )\n"
+            "( <, a.1, 2, t1.1 )\n"
+            "( if, t1.1, , L0 )\n"
+            "( goto, , , L1 )\n"
+            "L0:\n"
+            "( =, 3, , a.3 )\n"
+            "( goto, , , L2 )\n"
+            "L1:\n"
+            "( =, 4, , a.2 )\n"
+            "L2:\n"
+            "( PHI, a.3 a.2, , a.4 )\n"
+            "( RETURN, a.4, ,  )\n"
+            "( ENDFUNC, main, ,  )\n");
+    }
+
+    SECTION("Assign each value once") {
+        auto program = getIrOutput(lexer, parser, "int g; int a[4]; int f(int n) { int i = 0; while (i < n) { int j = i; while (j > 0) { g = g + a[j]; j = j - 1; } i = i + 1; } return i; }");
+        convertToSsa(program);
+        std::unordered_set<uint32_t> defined;
+        size_t phiCount = 0;
+        for (const auto& instruction : program.getInstructions()) {
+            const auto definition = getDefinition(instruction);
+            if (definition == nullptr) {
+                continue;
+            }
+            if (definition->getKind() == OperandKind::VALUE) {
+                CHECK(defined.insert(definition->getIndex()).second);
+            } else {
+                CHECK(program.getName(*definition) == "g");
+            }
+            phiCount += instruction.opcode == Opcode::PHI;
+        }
+        // i at the outer header, and i and j at the inner one
+        CHECK(phiCount == 3);
+        const auto functions = findFunctions(program.getInstructions());
+        const ControlFlowGraph cfg(std::span(program.getInstructions()).subspan(functions[0].begin, functions[0].end - functions[0].begin));
+        for (const auto& loop : cfg.getLoops()) {
+            CHECK(cfg.getBlockInstructions(loop.header)[1].opcode == Opcode::PHI);
+        }
+    }
+
+    SECTION("Drop unreachable blocks") {
+        auto program = getIrOutput(lexer, parser, "int main() { int a = 1; return a; a = 2; }");
+        convertToSsa(program);
+        CHECK(IrPrinter(program).toString() ==
+            "( FUNCTION, main, 0,  )\n"
+            "( =, 1, , a.1 )\n"
+            "( RETURN, a.1, ,  )\n"
+            "( ENDFUNC, main, ,  )\n");
+    }
+}
+
+TEST_CASE("Convert out of SSA form") {
+    Lexer lexer;
+    Parser parser;
+
+    const auto checkRoundTrip = [&](const std::string& code, bool withCopiesPropagated) {
+        auto program = getIrOutput(lexer, parser, code);
+        const auto expected = IrInterpreter(program).run();
+        convertToSsa(program);
+        if (withCopiesPropagated) {
+            propagateCopies(program);
+        }
+        convertFromSsa(program);
+        for (const auto& instruction : program.getInstructions()) {
+            CHECK(instruction.opcode != Opcode::PHI);
+            for (const auto operand : { instruction.arg1, instruction.arg2, instruction.result }) {
+                CHECK(operand.getKind() != OperandKind::VALUE);
+            }
+        }
+        CHECK(IrInterpreter(program).run() == expected);
+        return program;
+    };
+
+    SECTION("Keep the program's behavior") {
+        for (const auto& code : samplePrograms) {
+            checkRoundTrip(code, false);
+        }
+    }
+
+    SECTION("Coalesce the variables back") {
+        const auto program = checkRoundTrip(samplePrograms[0], false);
+        CHECK(IrPrinter(program).toString() == IrPrinter(getIrOutput(lexer, parser, samplePrograms[0])).toString());
+    }
+
+    SECTION("Split a branch to a block with phis") {
+        IrProgram program;
+        const auto main = program.internName("main");
+        const auto x = program.internName("x");
+        const auto x1 = program.newValue(x, 1);
+        const auto x2 = program.newValue(x, 2);
+        const auto x3 = program.newValue(x, 3);
+        const auto condition = program.newValue(program.newTemp(), 1);
+        const auto sum = program.newValue(program.newTemp(), 1);
+        const auto label = program.newLabel();
+        const auto constant = [&](const char* text) { return program.internConstant(ConstantKind::INT, text); };
+        const std::vector<Operand> arguments{ x1, x2 };
+        auto& instructions = program.getInstructions();
+        instructions.push_back({ Opcode::FUNCTION, main, Operand::count(0), {} });
+        instructions.push_back({ Opcode::ASSIGN, constant("1"), {}, x1 });
+        instructions.push_back({ Opcode::LESS, x1, constant("2"), condition });
+        instructions.push_back({ Opcode::IF, condition, {}, label });
+        instructions.push_back({ Opcode::ASSIGN, constant("2"), {}, x2 });
+        instructions.push_back({ Opcode::LABEL, label, {}, {} });
+        instructions.push_back(program.makePhi(x3, arguments));
+        // x.1 is still live after the phi, so the phi's result needs a storage of its own
+        instructions.push_back({ Opcode::MUL, x3, constant("10"), sum });
+        instructions.push_back({ Opcode::ADD, sum, x1, sum });
+        instructions.push_back({ Opcode::RETURN, sum, {}, {} });
+        instructions.push_back({ Opcode::ENDFUNC, main, {}, {} });
+
+        convertFromSsa(program);
+        CHECK(IrInterpreter(program).run() == "main=11");
+        CHECK(program.getInstructions()[3].result != label);
+        CHECK(program.getInstructions()[program.getInstructions().size() - 2].opcode == Opcode::GOTO);
+    }
+
+    SECTION("Copy overlapping values") {
+        // Without the copies, the phis swap a and b, and x is read after it is overwritten
+        for (const auto& code : samplePrograms) {
+            checkRoundTrip(code, true);
+        }
+        // The swap at the loop header is a cycle of copies, broken with a temporary
+        const auto program = checkRoundTrip(samplePrograms[1], true);
+        CHECK(IrPrinter(program).toString().find("( =, a, , t5 )\n( =, b, , a )\n( =, t5, , b )\n( goto, , , L0 )\n") != std::string::npos);
+    }
+}
+
+TEST_CASE("Fold constants") {
+    Lexer lexer;
+    Parser parser;
+
+    const auto fold = [](Opcode opcode, IrConstant left, IrConstant right) {
+        const auto result = foldBinary(opcode, left, right);
+        return result ? result->text : "";
+    };
+    const IrConstant two{ ConstantKind::INT, "2" };
+    const IrConstant seven{ ConstantKind::INT, "7" };
+    const IrConstant half{ ConstantKind::FLOAT, "0.5" };
+    const IrConstant ab{ ConstantKind::STRING, "\"ab\"" };
+    const IrConstant cd{ ConstantKind::STRING, "\"cd\"" };
+
+    SECTION("Evaluate operators") {
+        CHECK(fold(Opcode::DIV, seven, two) == "3");
+        CHECK(fold(Opcode::MOD, seven, two) == "1");
+        CHECK(fold(Opcode::ADD, seven, half) == "7.5");
+        CHECK(foldBinary(Opcode::ADD, seven, half)->kind == ConstantKind::FLOAT);
+        CHECK(fold(Opcode::MUL, two, half) == "1.0");
+        CHECK(fold(Opcode::LESS, half, two) == "1");
+        CHECK(fold(Opcode::AND, seven, IrConstant{ ConstantKind::INT, "0" }) == "0");
+        CHECK(fold(Opcode::ADD, ab, cd) == "\"abcd\"");
+        CHECK(fold(Opcode::LESS, ab, cd) == "1");
+        CHECK(fold(Opcode::ADD, ab, two).empty());
+        CHECK(fold(Opcode::DIV, seven, IrConstant{ ConstantKind::INT, "0" }).empty());
+        CHECK(fold(Opcode::MUL, IrConstant{ ConstantKind::INT, "9223372036854775807" }, two).empty());
+        CHECK(foldUnary(Opcode::MINUS, half)->text == "-0.5");
+        CHECK(foldUnary(Opcode::NOT, seven)->text == "0");
+        CHECK(isTrueConstant(half) == true);
+    }
+
+    SECTION("Propagate assigned constants") {
+        auto program = getIrOutput(lexer, parser, "int n = 2 * 5; int main() { int a = 1 + 2 * 3; float f = a / 2 + 0.5; str s = \"ab\" + \"cd\"; if (s == \"abcd\") { a = a + n; } return a + f; }");
+        const auto expected = IrInterpreter(program).run();
+        foldConstants(program);
+        CHECK(IrPrinter(program).toString() ==
+            "( =, 10, , t1 )\n"
+            "( =, 10, , n )\n"
+            "( FUNCTION, main, 0,  )\n"
+            "( =, 6, , t3 )\n"
+            "( =, 7, , t1 )\n"
+            "( =, 7, , a )\n"
+            "( =, 3, , t2 )\n"
+            "( =, 3.5, , t1 )\n"
+            "( =, 3.5, , f )\n"
+            "( =, \"abcd\", , t1 )\n"
+            "( =, \"abcd\", , s )\n"
+            "( =, 1, , t1 )\n"
+            "( if, 1, , L0 )\n"
+            "( goto, , , L1 )\n"
+            "L0:\n"
+            // a is assigned twice, so only its value in this block is known
+            "( +, a, 10, t1 )\n"
+            "( =, t1, , a )\n"
+            "L1:\n"
+            "( +, a, 3.5, t1 )\n"
+            "( RETURN, t1, ,  )\n"
+            "( ENDFUNC, main, ,  )\n");
+        CHECK(IrInterpreter(program).run() == expected);
+    }
+
+    SECTION("Keep globals a call may change") {
+        auto program = getIrOutput(lexer, parser, "int g = 1; int f() { g = 2; return 0; } int h = f(); int k = g + 1; int main() { return g; }");
+        foldConstants(program);
+        const auto& instructions = program.getInstructions();
+        const auto add = std::find_if(instructions.begin(), instructions.end(), [](const auto& instruction) { return instruction.opcode == Opcode::ADD; });
+        REQUIRE(add != instructions.end());
+        CHECK(add->arg1 == program.internName("g"));
+        CHECK(instructions[instructions.size() - 2].arg1 == program.internName("g"));
+        CHECK(IrInterpreter(program).run() == "main=2 g=2 h=0 k=3");
+    }
+
+    SECTION("Keep the reads of a local that hides a constant global") {
+        auto program = getIrOutput(lexer, parser, "int g = 5; int f() { int g; return g; } int main() { return g + f(); }");
+        foldConstants(program);
+        const auto& instructions = program.getInstructions();
+        const auto localReturn = std::find_if(instructions.begin(), instructions.end(), [](const auto& instruction) { return instruction.opcode == Opcode::RETURN; });
+        REQUIRE(localReturn != instructions.end());
+        CHECK(localReturn->arg1 == program.internName("g"));
+        const auto add = std::find_if(instructions.begin(), instructions.end(), [](const auto& instruction) { return instruction.opcode == Opcode::ADD; });
+        REQUIRE(add != instructions.end());
+        REQUIRE(add->arg1.getKind() == OperandKind::CONSTANT);
+        CHECK(program.getConstant(add->arg1).text == "5");
+    }
+
+    SECTION("Propagate along the dominator tree in SSA form") {
+        auto program = getIrOutput(lexer, parser, "int main() { int a = 1; int b = 0; if (b < 2) { a = a * 10; } else { b = 3; } return a + b; }");
+        const auto expected = IrInterpreter(program).run();
+        convertToSsa(program);
+        foldConstants(program);
+        size_t operations = 0;
+        for (const auto& instruction : program.getInstructions()) {
+            operations += isBinaryOpcode(instruction.opcode) && instruction.arg1.getKind() == OperandKind::CONSTANT;
+            if (instruction.opcode == Opcode::PHI) {
+                const auto arguments = program.getPhiArguments(instruction);
+                CHECK(std::all_of(arguments.begin(), arguments.end(), [](Operand argument) { return argument.getKind() == OperandKind::CONSTANT; }));
+            }
+        }
+        CHECK(operations == 0);
+        convertFromSsa(program);
+        CHECK(IrInterpreter(program).run() == expected);
+    }
+}
+
+TEST_CASE("Propagate constants along executable paths") {
+    Lexer lexer;
+    Parser parser;
+
+    const auto optimize = [&](const std::string& code) {
+        auto program = getIrOutput(lexer, parser, code);
+        const auto expected = IrInterpreter(program).run();
+        convertToSsa(program);
+        propagateConditionalConstants(program);
+        auto optimized = program;
+        convertFromSsa(program);
+        CHECK(IrInterpreter(program).run() == expected);
+        return optimized;
+    };
+    const auto countOpcodes = [](const IrProgram& program, Opcode opcode) {
+        const auto& instructions = program.getInstructions();
+        return std::count_if(instructions.begin(), instructions.end(), [&](const auto& instruction) { return instruction.opcode == opcode; });
+    };
+
+    SECTION("Ignore assignments on paths that cannot run") {
+        // a is only reassigned when it is not 2, so it stays 2 although a phi joins it at the loop header
+        const auto program = optimize("int main() { int a = 2; int i = 0; while (i < 10) { if (a != 2) { a = 3; } i = i + 1; } return a; }");
+        CHECK(countOpcodes(program, Opcode::IF) == 1);
+        CHECK(countOpcodes(program, Opcode::PHI) == 1);
+        const auto& instructions = program.getInstructions();
+        REQUIRE(instructions[instructions.size() - 2].arg1.getKind() == OperandKind::CONSTANT);
+        CHECK(program.getConstant(instructions[instructions.size() - 2].arg1).text == "2");
+    }
+
+    SECTION("Remove branches on constant globals") {
+        const auto program = optimize(samplePrograms[6]);
+        CHECK(countOpcodes(program, Opcode::IF) == 1);
+        CHECK(countOpcodes(program, Opcode::MUL) == 0);
+    }
+
+    SECTION("Keep branches on unknown values") {
+        const auto program = optimize("int main() { int x; if (x < 1) { x = 2; } return x; }");
+        CHECK(countOpcodes(program, Opcode::IF) == 1);
+        CHECK(countOpcodes(program, Opcode::PHI) == 1);
+    }
+
+    SECTION("Keep the program's behavior") {
+        for (const auto& code : samplePrograms) {
+            optimize(code);
+        }
+    }
+}
+
+TEST_CASE("Eliminate dead code") {
+    Lexer lexer;
+    Parser parser;
+
+    const auto countOpcodes = [](const IrProgram& program, Opcode opcode) {
+        const auto& instructions = program.getInstructions();
+        return std::count_if(instructions.begin(), instructions.end(), [&](const auto& instruction) { return instruction.opcode == opcode; });
+    };
+
+    SECTION("Remove the assignments folding leaves") {
+        auto program = getIrOutput(lexer, parser, "int main() { int a = 1 + 2; int b = a * 4; a = b - 2; return a; }");
+        foldConstants(program);
+        eliminateDeadCode(program);
+        CHECK(IrPrinter(program).toString() ==
+            "( FUNCTION, main, 0,  )\n"
+            "( RETURN, 10, ,  )\n"
+            "( ENDFUNC, main, ,  )\n");
+    }
+
+    SECTION("Remove code after a return") {
+        auto program = getIrOutput(lexer, parser, "int main() { int x = 2; return x; x = x + 1; return x; }");
+        eliminateDeadCode(program);
+        CHECK(countOpcodes(program, Opcode::RETURN) == 1);
+        CHECK(countOpcodes(program, Opcode::ADD) == 0);
+        CHECK(IrInterpreter(program).run() == "main=2");
+    }
+
+    SECTION("Remove stores to globals overwritten in the same block") {
+        auto program = getIrOutput(lexer, parser, "int g; int h() { return g; } int f() { g = 1; g = 2; h(); g = 3; g = 4; return 0; } int main() { return f() + g; }");
+        const auto expected = IrInterpreter(program).run();
+        eliminateDeadCode(program);
+        std::vector<std::string> stored;
+        for (const auto& instruction : program.getInstructions()) {
+            if (instruction.opcode == Opcode::ASSIGN && instruction.result == program.internName("g")) {
+                stored.push_back(program.getConstant(instruction.arg1).text);
+            }
+        }
+        // The call may read g, so the store before it stays
+        CHECK(stored == std::vector<std::string>({ "2", "4" }));
+        CHECK(IrInterpreter(program).run() == expected);
+    }
+
+    SECTION("Keep element stores nothing reads afterwards") {
+        auto program = getIrOutput(lexer, parser, "int a[10]; int f(int i, int v) { int b[4]; b[i] = v; a[i] = v; return 0; } int main() { f(2, 7); return a[2]; }");
+        eliminateDeadCode(program);
+        CHECK(countOpcodes(program, Opcode::INDEX_STORE) == 2);
+        CHECK(IrInterpreter(program).run() == "main=7");
+    }
+
+    SECTION("Remove what propagation leaves in SSA form") {
+        // Once every read of a is replaced by 2, nothing reads its values
+        auto program = getIrOutput(lexer, parser, "int main() { int a = 2; int i = 0; while (i < 10) { if (a != 2) { a = 3; } i = i + 1; } return a; }");
+        convertToSsa(program);
+        propagateConditionalConstants(program);
+        eliminateDeadCode(program);
+        for (const auto& instruction : program.getInstructions()) {
+            const auto definition = getDefinition(instruction);
+            if (definition && definition->getKind() == OperandKind::VALUE) {
+                CHECK(program.getValue(*definition).variable != program.internName("a"));
+            }
+        }
+        CHECK(countOpcodes(program, Opcode::PHI) == 1);
+    }
+
+    SECTION("Keep the program's behavior") {
+        for (const auto& code : samplePrograms) {
+            auto program = getIrOutput(lexer, parser, code);
+            const auto expected = IrInterpreter(program).run();
+            auto folded = program;
+            foldConstants(folded);
+            eliminateDeadCode(folded);
+            CHECK(IrInterpreter(folded).run() == expected);
+            convertToSsa(program);
+            propagateConditionalConstants(program);
+            eliminateDeadCode(program);
+            convertFromSsa(program);
+            CHECK(IrInterpreter(program).run() == expected);
+        }
+    }
+}
+
+TEST_CASE("Number values") {
+    Lexer lexer;
+    Parser parser;
+
+    const auto countOpcodes = [](const IrProgram& program, Opcode opcode) {
+        const auto& instructions = program.getInstructions();
+        return std::count_if(instructions.begin(), instructions.end(), [&](const auto& instruction) { return instruction.opcode == opcode; });
+    };
+
+    SECTION("Reuse expressions within a block") {
+        auto program = getIrOutput(lexer, parser, "int a[10]; int main() { int i = 3; int x = 2; int y = 5; return a[i] + a[i] + x * y + y * x; }");
+        numberValuesLocally(program);
+        eliminateDeadCode(program);
+        CHECK(IrPrinter(program).toString() ==
+            "( FUNCTION, main, 0,  )\n"
+            "( [], a, 3, t4 )\n"
+            "( +, t4, t4, t3 )\n"
+            "( *, 2, 5, t4 )\n"
+            "( +, t3, t4, t2 )\n"
+            "( +, t2, t4, t1 )\n"
+            "( RETURN, t1, ,  )\n"
+            "( ENDFUNC, main, ,  )\n");
+    }
+
+    SECTION("Read again after a call") {
+        auto program = getIrOutput(lexer, parser, "int a[10]; int g = 1; int f() { g = g + 1; return 0; } int main() { int s = a[1] + g; f(); s = s + a[1] + g; return s; }");
+        const auto expected = IrInterpreter(program).run();
+        numberValuesLocally(program);
+        eliminateDeadCode(program);
+        CHECK(countOpcodes(program, Opcode::INDEX) == 2);
+        CHECK(IrInterpreter(program).run() == expected);
+    }
+
+    SECTION("Read again after a store") {
+        const std::string code = "int a[10]; int main() { int i = 1; int x = a[i]; a[i] = 5; x = x + a[i]; return x; }";
+        auto local = getIrOutput(lexer, parser, code);
+        const auto expected = IrInterpreter(local).run();
+        CHECK(expected == "main=5");
+        numberValuesLocally(local);
+        eliminateDeadCode(local);
+        CHECK(countOpcodes(local, Opcode::INDEX) == 2);
+        CHECK(IrInterpreter(local).run() == expected);
+        auto global = getIrOutput(lexer, parser, code);
+        convertToSsa(global);
+        numberValuesGlobally(global);
+        eliminateDeadCode(global);
+        CHECK(countOpcodes(global, Opcode::INDEX) == 2);
+        convertFromSsa(global);
+        CHECK(IrInterpreter(global).run() == expected);
+    }
+
+    SECTION("Reuse expressions of dominating blocks in SSA form") {
+        const std::string code = "int f(int x, int y) { int z = x * y; if (z > 10) { z = z + y * x; } return z; } int main() { return f(3, 4) + f(1, 2); }";
+        auto local = getIrOutput(lexer, parser, code);
+        numberValuesLocally(local);
+        CHECK(countOpcodes(local, Opcode::MUL) == 2);
+        auto program = getIrOutput(lexer, parser, code);
+        const auto expected = IrInterpreter(program).run();
+        convertToSsa(program);
+        numberValuesGlobally(program);
+        eliminateDeadCode(program);
+        CHECK(countOpcodes(program, Opcode::MUL) == 1);
+        convertFromSsa(program);
+        CHECK(IrInterpreter(program).run() == expected);
+    }
+
+    SECTION("Keep the program's behavior") {
+        for (const auto& code : samplePrograms) {
+            auto program = getIrOutput(lexer, parser, code);
+            const auto expected = IrInterpreter(program).run();
+            auto local = program;
+            numberValuesLocally(local);
+            eliminateDeadCode(local);
+            CHECK(IrInterpreter(local).run() == expected);
+            convertToSsa(program);
+            numberValuesGlobally(program);
+            eliminateDeadCode(program);
+            convertFromSsa(program);
+            CHECK(IrInterpreter(program).run() == expected);
+        }
+    }
+}
+
+TEST_CASE("Hoist loop invariants") {
+    Lexer lexer;
+    Parser parser;
+
+    // The loop depth of the block of each instruction with the opcode, in instruction order
+    const auto getLoopDepths = [](const IrProgram& program, Opcode opcode) {
+        const auto& instructions = program.getInstructions();
+        std::vector<uint32_t> depths;
+        for (const auto& function : findFunctions(instructions)) {
+            const ControlFlowGraph cfg(std::span<const IrInstruction>(instructions).subspan(function.begin, function.end - function.begin));
+            for (auto i = function.begin; i < function.end; i++) {
+                if (instructions[i].opcode == opcode) {
+                    depths.push_back(cfg.getLoopDepth(cfg.getBlockOf(i - function.begin)));
+                }
+            }
+        }
+        return depths;
+    };
+    const auto hoist = [&](const std::string& code) {
+        auto program = getIrOutput(lexer, parser, code);
+        const auto expected = IrInterpreter(program).run();
+        convertToSsa(program);
+        hoistLoopInvariants(program);
+        auto hoisted = program;
+        convertFromSsa(program);
+        CHECK(IrInterpreter(program).run() == expected);
+        return hoisted;
+    };
+
+    SECTION("Move invariant operators to the preheader") {
+        const auto program = hoist("int f(int n, int k) { int s = 0; int i; for (i = 0; i < n; i = i + 1) { int j = 0; while (j < n) { s = s + n * k + j; j = j + 1; } } return s; } int main() { return f(3, 4); }");
+        CHECK(getLoopDepths(program, Opcode::MUL) == std::vector<uint32_t>{ 0 });
+        CHECK(getLoopDepths(program, Opcode::ADD) == std::vector<uint32_t>({ 2, 2, 2, 1 }));
+    }
+
+    SECTION("Move invariant element reads") {
+        const auto program = hoist("int a[10]; int f(int k) { int s = 0; int i = 0; while (i < k) { s = s + a[k] + a[i]; i = i + 1; } return s; } int main() { return f(5); }");
+        CHECK(getLoopDepths(program, Opcode::INDEX) == std::vector<uint32_t>({ 0, 1 }));
+    }
+
+    SECTION("Keep reads a call may change") {
+        const auto program = hoist("int a[10]; int g; int h() { g = g + 1; return 0; } int main() { int s = 0; int i = 0; while (i < 3) { s = s + a[2] + g * 2; h(); i = i + 1; } return s; }");
+        CHECK(getLoopDepths(program, Opcode::INDEX) == std::vector<uint32_t>{ 1 });
+        CHECK(getLoopDepths(program, Opcode::MUL) == std::vector<uint32_t>{ 1 });
+    }
+
+    SECTION("Keep reads of elements the loop stores to") {
+        const auto program = hoist("int a[10]; int f(int n, int k) { int s = 0; int i = 0; while (i < n) { a[k] = i; s = s + a[k]; i = i + 1; } return s; } int main() { return f(4, 2); }");
+        CHECK(getLoopDepths(program, Opcode::INDEX) == std::vector<uint32_t>{ 1 });
+        CHECK(getLoopDepths(program, Opcode::INDEX_STORE) == std::vector<uint32_t>{ 1 });
+    }
+
+    SECTION("Keep divisions the loop might not run") {
+        const auto program = hoist("int f(int d) { int s = 0; int i = 0; while (i < d) { s = s + 10 / d + d / 2; i = i + 1; } return s; } int main() { return f(0) + f(4); }");
+        // d / 2 moves before the loop, 10 / d stays
+        CHECK(getLoopDepths(program, Opcode::DIV) == std::vector<uint32_t>({ 0, 1 }));
+    }
+
+    SECTION("Add a preheader on a branch to the loop") {
+        IrProgram program;
+        const auto main = program.internName("main");
+        const auto i = program.internName("i");
+        const auto k = program.internName("k");
+        const auto condition = program.newTemp();
+        const auto square = program.newTemp();
+        const auto header = program.newLabel();
+        const auto body = program.newLabel();
+        const auto constant = [&](const char* text) { return program.internConstant(ConstantKind::INT, text); };
+        auto& instructions = program.getInstructions();
+        instructions.push_back({ Opcode::FUNCTION, main, Operand::count(0), {} });
+        instructions.push_back({ Opcode::ASSIGN, constant("0"), {}, i });
+        instructions.push_back({ Opcode::ASSIGN, constant("4"), {}, k });
+        instructions.push_back({ Opcode::IF, k, {}, header });
+        instructions.push_back({ Opcode::RETURN, constant("0"), {}, {} });
+        instructions.push_back({ Opcode::LABEL, header, {}, {} });
+        instructions.push_back({ Opcode::LESS, i, constant("20"), condition });
+        instructions.push_back({ Opcode::IF, condition, {}, body });
+        instructions.push_back({ Opcode::RETURN, i, {}, {} });
+        instructions.push_back({ Opcode::LABEL, body, {}, {} });
+        instructions.push_back({ Opcode::MUL, k, k, square });
+        instructions.push_back({ Opcode::ADD, i, square, i });
+        instructions.push_back({ Opcode::GOTO, {}, {}, header });
+        instructions.push_back({ Opcode::ENDFUNC, main, {}, {} });
+
+        convertToSsa(program);
+        hoistLoopInvariants(program);
+        CHECK(getLoopDepths(program, Opcode::MUL) == std::vector<uint32_t>{ 0 });
+        CHECK(program.getInstructions()[3].result != header);
+        convertFromSsa(program);
+        CHECK(IrInterpreter(program).run() == "main=32");
+    }
+
+    SECTION("Keep the program's behavior") {
+        for (const auto& code : samplePrograms) {
+            hoist(code);
+        }
+    }
+}
@@ -5,9 +5,13 @@
 
 #include <catch2/catch_all.hpp>
 #include <string>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
 
 import token;
 import lexer;
+import outputwriter;
 
 using Catch::Matchers::ContainsSubstring;
 
@@ -157,3 +161,49 @@ TEST_CASE("Parse a code snippet") {
         auto error = getLexerError(lexer, code);
     }
 }
+
+TEST_CASE("Write tokens through an output writer") {
+    Lexer lexer;
+    const auto path = (std::filesystem::temp_directory_path() / "test-lexer-output.txt").string();
+    const auto readFile = [&]() {
+        std::ifstream file(path);
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+
+    auto result = lexer.acceptCode("int main() { str s = \"a b\"; return 0; }");
+    REQUIRE(std::holds_alternative<std::vector<Token>>(result));
+    const auto tokens = std::get<std::vector<Token>>(result);
+
+    SECTION("Write the print string") {
+        {
+            OutputWriter out(path);
+            lexer.writePrintString(tokens, out);
+        }
+        CHECK(readFile() == lexer.getPrintString(tokens));
+    }
+
+    SECTION("Write the token file") {
+        {
+            OutputWriter out(path);
+            lexer.writeTokenFile(tokens, out);
+        }
+        std::ostringstream expected;
+        for (const auto& token : tokens) {
+            expected << token;
+        }
+        CHECK(readFile() == expected.str());
+    }
+
+    SECTION("Write pieces larger than the buffer") {
+        const std::string large(100, 'x');
+        {
+            OutputWriter out(path, 8);
+            out.write("ab");
+            out.write(large);
+            out.put('c');
+            out.writeNumber(-1234567890123);
+            out.write(large);
+        }
+        CHECK(readFile() == "ab" + large + "c-1234567890123" + large);
+    }
+}
@@ -6,11 +6,21 @@
 #include <catch2/catch_all.hpp>
 #include <string>
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <chrono>
 
 import token;
 import lexer;
+import flatast;
+import ir;
 import ast;
 import parser;
+import parsertrace;
+import threadpool;
+
+using Catch::Matchers::ContainsSubstring;
 
 inline std::vector<Token> getLexerOutput(const Lexer& lexer, const std::string_view code) {
     auto result = lexer.acceptCode(code);
@@ -31,6 +41,13 @@ inline ParserError getParserError(const Lexer& lexer, const Parser& parser, cons
     return std::get<ParserError>(result);
 }
 
+inline ParserRecoveryResult getRecoveredOutput(const Lexer& lexer, const Parser& parser, const std::string_view code) {
+    auto result = parser.parseWithRecovery(getLexerOutput(lexer, code));
+    REQUIRE(result.ast != nullptr);
+    result.ast->toQuadrupleString(); // check that quadruples can be generated
+    return result;
+}
+
 std::string wrapWithMain(const std::string& code) {
     return "int main() { " + code + " }";
 }
@@ -209,3 +226,491 @@ TEST_CASE("Parse errors") {
         auto error = getParserError(lexer, parser, code);
     }
 }
+
+TEST_CASE("Recover from parse errors") {
+    Lexer lexer;
+    Parser parser;
+
+    SECTION("Recover from no errors") {
+        std::string code = "int a = 1; int main() { a = a + 1; }";
+        const auto result = getRecoveredOutput(lexer, parser, code);
+        CHECK(result.errors.empty());
+        CHECK(result.ast->toQuadrupleString() == getParserOutput(lexer, parser, code)->toQuadrupleString());
+    }
+
+    SECTION("Recover from errors in statements") {
+        std::string code = wrapWithMain("a +; b = 1; c = (2; d = 3;");
+        const auto result = getRecoveredOutput(lexer, parser, code);
+        REQUIRE(result.errors.size() == 2);
+        CHECK_THAT(result.errors[0], ContainsSubstring("1:17"));
+        CHECK_THAT(result.errors[1], ContainsSubstring("1:32"));
+    }
+
+    SECTION("Recover from errors in nested blocks") {
+        std::string code = wrapWithMain("if (a) { a = ; } while (b) { b = b +; } c = 1;");
+        const auto result = getRecoveredOutput(lexer, parser, code);
+        CHECK(result.errors.size() == 2);
+    }
+
+    SECTION("Recover from errors in declarations") {
+        std::string code = "int a = ; float f(int x) { x = 1; } str s = 1 1; int main() { return; }";
+        const auto result = getRecoveredOutput(lexer, parser, code);
+        CHECK(result.errors.size() == 2);
+    }
+
+    SECTION("Recover from errors in function headers") {
+        std::string code = "int f(int [) { a; } int g(int a, float) { b +; } int main() { }";
+        const auto result = getRecoveredOutput(lexer, parser, code);
+        CHECK(result.errors.size() == 3);
+    }
+
+    SECTION("Recover at a declaration boundary") {
+        std::string code = "int a = 1 int main() { a; }";
+        const auto result = getRecoveredOutput(lexer, parser, code);
+        REQUIRE(result.errors.size() == 1);
+        CHECK_THAT(result.ast->toQuadrupleString(), ContainsSubstring("FUNCTION, main"));
+    }
+
+    SECTION("Report a syntax error during type checking") {
+        std::string code = wrapWithMain("a +;");
+        const auto result = getRecoveredOutput(lexer, parser, code);
+        const auto typeCheckResult = result.ast->startTypeCheck();
+        REQUIRE(std::holds_alternative<TypeCheckError>(typeCheckResult));
+        CHECK_THAT(std::get<TypeCheckError>(typeCheckResult).message, ContainsSubstring("Syntax error"));
+    }
+}
+
+TEST_CASE("Parse with shared parser tables") {
+    Lexer lexer;
+
+    SECTION("Parse with multiple parser instances") {
+        std::string code = wrapWithMain("a = b + 1;");
+        for (int i = 0; i < 3; ++i) {
+            Parser parser;
+            const auto ast = getParserOutput(lexer, parser, code);
+        }
+    }
+
+    SECTION("Parse from multiple threads") {
+        std::string code = wrapWithMain("if (a < b) { a = a + 1; } else { b = foo(a, 2); }");
+        const auto tokens = getLexerOutput(lexer, code);
+        const auto expected = getParserOutput(lexer, Parser(), code)->toQuadrupleString();
+        std::vector<std::string> outputs(4);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            threads.emplace_back([&tokens, &outputs, i]() {
+                Parser parser;
+                auto result = parser.parse(tokens);
+                if (std::holds_alternative<std::unique_ptr<AstNode>>(result)) {
+                    outputs[i] = std::get<std::unique_ptr<AstNode>>(result)->toQuadrupleString();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (const auto& output : outputs) {
+            CHECK(output == expected);
+        }
+    }
+}
+
+TEST_CASE("Parse incrementally") {
+    Lexer lexer;
+    Parser parser;
+    ParseCache cache;
+
+    const std::string code = "int a;\nint foo(int b) { a = b; }\nint main() { a = 1; foo(a); }";
+    const auto getIncrementalOutput = [&](const std::string_view code) {
+        auto result = parser.parseIncremental(getLexerOutput(lexer, code), cache);
+        REQUIRE(std::holds_alternative<std::unique_ptr<AstNode>>(result));
+        return std::move(std::get<std::unique_ptr<AstNode>>(result));
+    };
+
+    SECTION("Parse every declaration on the first run") {
+        const auto ast = getIncrementalOutput(code);
+        CHECK(cache.getReusedCount() == 0);
+        CHECK(cache.getReparsedCount() == 3);
+        CHECK(ast->toQuadrupleString() == getParserOutput(lexer, parser, code)->toQuadrupleString());
+    }
+
+    SECTION("Reparse only the changed declaration") {
+        getIncrementalOutput(code);
+        const std::string changedCode = "int a;\nint foo(int b) { a = b * 2; }\nint main() { a = 1; foo(a); }";
+        const auto ast = getIncrementalOutput(changedCode);
+        CHECK(cache.getReusedCount() == 2);
+        CHECK(cache.getReparsedCount() == 1);
+        CHECK(ast->toQuadrupleString() == getParserOutput(lexer, parser, changedCode)->toQuadrupleString());
+    }
+
+    SECTION("Reuse declarations that moved") {
+        getIncrementalOutput(code);
+        const std::string movedCode = "\n\n" + code;
+        const auto ast = getIncrementalOutput(movedCode);
+        CHECK(cache.getReusedCount() == 3);
+        CHECK(cache.getReparsedCount() == 0);
+        CHECK(ast->getWhere() == getParserOutput(lexer, parser, movedCode)->getWhere());
+    }
+
+    SECTION("Give reused declarations the positions of their new tokens") {
+        const std::string typeErrorCode = "int a;\nint main() { a = 1; str s; s = a; }";
+        getIncrementalOutput(typeErrorCode);
+        const std::string movedCode = "int b;\n" + typeErrorCode;
+        const auto result = getIncrementalOutput(movedCode)->startTypeCheck();
+        CHECK(cache.getReusedCount() == 2);
+        const auto expected = getParserOutput(lexer, parser, movedCode)->startTypeCheck();
+        REQUIRE(std::holds_alternative<TypeCheckError>(result));
+        REQUIRE(std::holds_alternative<TypeCheckError>(expected));
+        CHECK(std::get<TypeCheckError>(result).where == std::get<TypeCheckError>(expected).where);
+    }
+
+    SECTION("Report a syntax error like a full parse") {
+        getIncrementalOutput(code);
+        const std::string brokenCode = "int a;\nint foo(int b) { a = b +; }\nint main() { a = 1; foo(a); }";
+        auto result = parser.parseIncremental(getLexerOutput(lexer, brokenCode), cache);
+        REQUIRE(std::holds_alternative<ParserError>(result));
+        CHECK(std::get<ParserError>(result) == getParserError(lexer, parser, brokenCode));
+        CHECK(getIncrementalOutput(code)->toQuadrupleString() == getParserOutput(lexer, parser, code)->toQuadrupleString());
+    }
+}
+
+TEST_CASE("Parse in parallel") {
+    Lexer lexer;
+    Parser parser;
+
+    std::string code = "int a;\n";
+    for (int i = 0; i < 50; ++i) {
+        code += "int foo" + std::to_string(i) + "(int b) { if (b > " + std::to_string(i) + ") { a = b; } return a; }\n";
+    }
+    code += "int main() { a = foo1(1); }";
+
+    SECTION("Produce the same output as a serial parse") {
+        for (unsigned int threadCount : { 1u, 4u }) {
+            auto result = parser.parseParallel(getLexerOutput(lexer, code), threadCount);
+            REQUIRE(std::holds_alternative<std::unique_ptr<AstNode>>(result));
+            const auto& ast = std::get<std::unique_ptr<AstNode>>(result);
+            const auto expected = getParserOutput(lexer, parser, code);
+            CHECK(ast->toQuadrupleString() == expected->toQuadrupleString());
+            CHECK(ast->getWhere() == expected->getWhere());
+        }
+    }
+
+    SECTION("Report a syntax error like a serial parse") {
+        const std::string brokenCode = code + "\nint bar() { a = ; }\nint baz() { a = ; }";
+        auto result = parser.parseParallel(getLexerOutput(lexer, brokenCode), 4);
+        REQUIRE(std::holds_alternative<ParserError>(result));
+        CHECK(std::get<ParserError>(result) == getParserError(lexer, parser, brokenCode));
+    }
+
+    SECTION("Share the thread pool between calls from several threads") {
+        const auto tokens = getLexerOutput(lexer, code);
+        const auto expected = getParserOutput(lexer, parser, code)->toQuadrupleString();
+        std::vector<std::string> outputs(4);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            threads.emplace_back([&, i]() {
+                for (int run = 0; run < 10; ++run) {
+                    auto result = parser.parseParallel(tokens, 4);
+                    outputs[i] = std::holds_alternative<std::unique_ptr<AstNode>>(result)
+                        ? std::get<std::unique_ptr<AstNode>>(result)->toQuadrupleString()
+                        : std::get<ParserError>(result);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (const auto& output : outputs) {
+            CHECK(output == expected);
+        }
+    }
+}
+
+TEST_CASE("Run workers on the shared thread pool") {
+    SECTION("Rethrow what a worker throws once every worker has finished") {
+        for (const size_t throwingWorker : { 0, 3 }) {
+            std::atomic<size_t> finished = 0;
+            CHECK_THROWS_AS(ThreadPool::getShared().run(4, [&](size_t index) {
+                if (index == throwingWorker) {
+                    throw std::runtime_error("Worker failed");
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                finished++;
+            }), std::runtime_error);
+            CHECK(finished == 3);
+        }
+    }
+}
+
+TEST_CASE("Parse deeply nested input") {
+    Lexer lexer;
+
+    const auto repeat = [](const std::string& text, int count) {
+        std::string repeated;
+        for (int i = 0; i < count; ++i) {
+            repeated += text;
+        }
+        return repeated;
+    };
+    const auto nest = [](int depth) {
+        return wrapWithMain("int a; a = " + std::string(depth, '(') + "1" + std::string(depth, ')') + ";");
+    };
+
+    SECTION("Reject input nested beyond the default limit") {
+        Parser parser;
+        // The body of main is one level deep
+        getParserOutput(lexer, parser, nest(DEFAULT_MAX_DEPTH - 1));
+        CHECK_THAT(getParserError(lexer, parser, nest(DEFAULT_MAX_DEPTH)), ContainsSubstring("nesting depth limit of 1000"));
+        const auto result = parser.parseWithRecovery(getLexerOutput(lexer, nest(DEFAULT_MAX_DEPTH)));
+        CHECK(result.ast == nullptr);
+        REQUIRE(result.errors.size() == 1);
+        CHECK_THAT(result.errors[0], ContainsSubstring("nesting depth limit"));
+    }
+
+    SECTION("Parse, check and generate input nested within a raised limit") {
+        Parser parser(10000000);
+        const auto expected = getParserOutput(lexer, parser, nest(1))->toQuadrupleString();
+        const auto tokens = getLexerOutput(lexer, nest(5000));
+        auto result = parser.parse(tokens);
+        REQUIRE(std::holds_alternative<std::unique_ptr<AstNode>>(result));
+        const auto& ast = std::get<std::unique_ptr<AstNode>>(result);
+        CHECK(ast->toQuadrupleString() == expected);
+        CHECK(std::holds_alternative<TypeCheckSuccess>(ast->startTypeCheck()));
+
+        const auto recovered = parser.parseWithRecovery(tokens);
+        REQUIRE(recovered.ast != nullptr);
+        CHECK(recovered.errors.empty());
+        CHECK(recovered.ast->toQuadrupleString() == expected);
+
+        const auto nestedIfs = wrapWithMain("int a; " + repeat("if (a) { ", 5000) + "a = 1;" + repeat(" }", 5000));
+        const auto ifs = getParserOutput(lexer, parser, nestedIfs);
+        CHECK(std::holds_alternative<TypeCheckSuccess>(ifs->startTypeCheck()));
+        CHECK(parser.parseWithRecovery(getLexerOutput(lexer, nestedIfs)).errors.empty());
+    }
+
+    SECTION("Parse operators chained without brackets") {
+        Parser parser;
+        const auto negated = getParserOutput(lexer, parser, wrapWithMain("int a; a = " + repeat("- ", 20000) + "1;"));
+        CHECK(std::holds_alternative<TypeCheckSuccess>(negated->startTypeCheck()));
+        const auto assigned = getParserOutput(lexer, parser, wrapWithMain("int a; " + repeat("a = ", 20000) + "1;"));
+        CHECK(std::holds_alternative<TypeCheckSuccess>(assigned->startTypeCheck()));
+    }
+
+    SECTION("Parse what the static parser cannot recurse into like the recursive descent parser") {
+        Parser parser(20000);
+        const auto tokens = getLexerOutput(lexer, nest(200));
+        auto result = parser.parse(tokens);
+        auto tableResult = parser.parseWithTable(tokens);
+        REQUIRE(std::holds_alternative<std::unique_ptr<AstNode>>(result));
+        REQUIRE(std::holds_alternative<std::unique_ptr<AstNode>>(tableResult));
+        CHECK(std::get<std::unique_ptr<AstNode>>(result)->toQuadrupleString() == std::get<std::unique_ptr<AstNode>>(tableResult)->toQuadrupleString());
+
+        const auto brokenTokens = getLexerOutput(lexer, wrapWithMain("a = " + std::string(200, '(') + "1;"));
+        auto error = parser.parse(brokenTokens);
+        auto tableError = parser.parseWithTable(brokenTokens);
+        REQUIRE(std::holds_alternative<ParserError>(error));
+        REQUIRE(std::holds_alternative<ParserError>(tableError));
+        CHECK(std::get<ParserError>(error) == std::get<ParserError>(tableError));
+    }
+
+    SECTION("Reject input nested beyond a lowered limit") {
+        Parser parser(30);
+        getParserOutput(lexer, parser, nest(29));
+        CHECK_THAT(getParserError(lexer, parser, nest(30)), ContainsSubstring("nesting depth limit of 30"));
+        CHECK_THAT(getParserError(lexer, parser, wrapWithMain("a = b[" + repeat("(", 29) + "1" + repeat(")", 29) + "];")), ContainsSubstring("nesting depth limit of 30"));
+    }
+}
+
+TEST_CASE("Trace parsing") {
+    Lexer lexer;
+    Parser parser;
+
+    const std::string code = "int foo(int a, float b) { if (a < b) { a = b; } return a; }";
+    const auto tokens = getLexerOutput(lexer, code);
+    ParserTrace trace;
+    auto result = parser.parse(tokens, &trace);
+    REQUIRE(std::holds_alternative<std::unique_ptr<AstNode>>(result));
+    const auto& entries = trace.getEntries();
+
+    SECTION("Produce the same output as an untraced parse") {
+        CHECK(std::get<std::unique_ptr<AstNode>>(result)->toQuadrupleString() == getParserOutput(lexer, parser, code)->toQuadrupleString());
+    }
+
+    SECTION("Count attempts and consumed tokens per non-terminal") {
+        REQUIRE(entries.contains("Start"));
+        CHECK(entries.at("Start").attempts == 1);
+        CHECK(entries.at("Start").tokensConsumed == static_cast<long>(tokens.size()));
+        REQUIRE(entries.contains("IfStmt"));
+        CHECK(entries.at("Start").failedAlternatives == 0);
+        CHECK(entries.at("IfStmt").failedAlternatives > 0);
+    }
+
+    SECTION("Count subparser calls") {
+        REQUIRE(entries.contains("LL1Parser(S)"));
+        CHECK(entries.at("LL1Parser(S)").attempts > 0);
+        CHECK(entries.contains("LL1 VarConst"));
+        bool hasSlr1Parser = false;
+        for (const auto& [name, entry] : entries) {
+            hasSlr1Parser = hasSlr1Parser || name.starts_with("SLR1Parser(");
+        }
+        CHECK(hasSlr1Parser);
+    }
+
+    SECTION("Count the same work as the table-driven parser") {
+        ParserTrace tableTrace;
+        parser.parseWithTable(tokens, &tableTrace);
+        CHECK(trace.getTokenVisits() > static_cast<long>(tokens.size()));
+        CHECK(trace.getTokenVisits() == tableTrace.getTokenVisits());
+        for (const auto& [name, entry] : tableTrace.getEntries()) {
+            REQUIRE(entries.contains(name));
+            CHECK(entries.at(name).attempts == entry.attempts);
+            CHECK(entries.at(name).failedAlternatives == entry.failedAlternatives);
+            CHECK(entries.at(name).tokensConsumed == entry.tokensConsumed);
+        }
+    }
+
+    SECTION("Report as a table or JSON") {
+        CHECK_THAT(trace.toTable(), ContainsSubstring("attempts"));
+        CHECK_THAT(trace.toJson(), ContainsSubstring("{\"symbol\": \"Start\", \"attempts\": 1,"));
+    }
+}
+
+TEST_CASE("Parse with the static grammar") {
+    Lexer lexer;
+    Parser parser;
+
+    const auto compare = [&](const std::string& code) {
+        const auto tokens = getLexerOutput(lexer, code);
+        auto staticResult = parser.parse(tokens);
+        auto tableResult = parser.parseWithTable(tokens);
+        REQUIRE(staticResult.index() == tableResult.index());
+        if (std::holds_alternative<ParserError>(staticResult)) {
+            CHECK(std::get<ParserError>(staticResult) == std::get<ParserError>(tableResult));
+        } else {
+            const auto& staticAst = std::get<std::unique_ptr<AstNode>>(staticResult);
+            const auto& tableAst = std::get<std::unique_ptr<AstNode>>(tableResult);
+            CHECK(staticAst->toQuadrupleString() == tableAst->toQuadrupleString());
+            CHECK(staticAst->getWhere() == tableAst->getWhere());
+        }
+    };
+
+    SECTION("Produce the same tree as the recursive descent parser") {
+        compare("int a, b[3], c = 1;\nfloat foo(int x, str y[]) { if (x > 1 && !a) { return x * -2; } else { b[1] = foo(x - 1, y); } }");
+        compare(wrapWithMain("for (i = 0, j = 1; i < 10; i = i + 1) { while (j != i || j <= 2) { j = (j + 1) % 3; } }"));
+        compare(wrapWithMain("str s = \"text\"; float f = 1.5; a = b = c[d[1]];"));
+    }
+
+    SECTION("Report the same errors as the recursive descent parser") {
+        compare(wrapWithMain("a = b + ;"));
+        compare("int foo( { }");
+        compare("int a");
+        compare(wrapWithMain("a = " + std::string(3000, '(') + "1" + std::string(3000, ')') + ";"));
+    }
+}
+
+TEST_CASE("Flatten the AST") {
+    Lexer lexer;
+    Parser parser;
+
+    SECTION("Store nodes after their children") {
+        const auto ast = getParserOutput(lexer, parser, "int a = 1; int main() { if (a) { return a; } }");
+        const auto flatAst = ast->toFlatAst();
+        const auto root = flatAst.getRoot();
+        CHECK(flatAst.getKind(root) == AstKind::START);
+        CHECK(flatAst.getChildren(root).size() == 2);
+        for (AstIndex node = 0; node < flatAst.size(); node++) {
+            for (const auto child : flatAst.getChildren(node)) {
+                CHECK((child == NO_AST_INDEX || child < node));
+            }
+        }
+        CHECK(flatAst.getWhere(root) == ast->getWhere());
+    }
+
+    SECTION("Mark absent optional children") {
+        const auto ast = getParserOutput(lexer, parser, wrapWithMain("if (1) { return; }"));
+        const auto flatAst = ast->toFlatAst();
+        AstIndex ifStmt = NO_AST_INDEX;
+        for (AstIndex node = 0; node < flatAst.size(); node++) {
+            if (flatAst.getKind(node) == AstKind::IF_STMT) {
+                ifStmt = node;
+            }
+        }
+        REQUIRE(ifStmt != NO_AST_INDEX);
+        CHECK(flatAst.getChild(ifStmt, 2) == NO_AST_INDEX);
+    }
+}
+
+struct CountFrame {
+    AstIndex node;
+    uint32_t step = 0;
+    size_t nextChild = 0;
+    int count = 0;
+};
+
+// Counts the binary expressions; every other kind only visits its children
+class BinaryExprCounter : public FlatAstVisitor<BinaryExprCounter, CountFrame, int> {
+    private:
+        friend class FlatAstVisitor<BinaryExprCounter, CountFrame, int>;
+
+        Step visitChildren(CountFrame& frame, int childResult) {
+            frame.count += childResult;
+            const auto children = ast.getChildren(frame.node);
+            while (frame.nextChild < children.size() && children[frame.nextChild] == NO_AST_INDEX) {
+                frame.nextChild++;
+            }
+            if (frame.nextChild < children.size()) {
+                return CountFrame{ children[frame.nextChild++] };
+            }
+            return frame.count;
+        }
+
+        Step visitBinaryExpr(CountFrame& frame, int childResult) { return visitChildren(frame, frame.step == 0 ? 1 : childResult); }
+        Step visitUnaryExpr(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitStart(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitFuncDef(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitParam(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitVarDecl(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitVarAssignable(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitVar(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitType(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitConstant(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitBlockStmt(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitIfStmt(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitWhileStmt(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitForStmt(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitVarAssign(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitForVarDecl(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitReturnStmt(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitAssignExpr(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitFuncCall(CountFrame& frame, int childResult) { return visitChildren(frame, childResult); }
+        Step visitSyntaxError(CountFrame& frame, int childResult) { return 0; }
+
+    public:
+        BinaryExprCounter(const FlatAst& ast) : FlatAstVisitor(ast) {}
+};
+
+TEST_CASE("Visit the flat AST") {
+    Lexer lexer;
+    Parser parser;
+
+    const auto ast = getParserOutput(lexer, parser, wrapWithMain("a = -(1 + 2) * 3; if (a < 4 || !b) { return f(a % 2); }"));
+    const auto flatAst = ast->toFlatAst();
+    BinaryExprCounter counter(flatAst);
+    CHECK(counter.visit(CountFrame{ flatAst.getRoot() }) == 5);
+}
+
+TEST_CASE("Generate quadruples into a builder") {
+    Lexer lexer;
+    Parser parser;
+
+    const auto ast = getParserOutput(lexer, parser, wrapWithMain("a[i] = 3; while (a < 4) { a = a + 1; }"));
+    const auto flatAst = ast->toFlatAst();
+
+    SECTION("Append every node to one builder") {
+        IRBuilder builder;
+        FlatAstQuadrupleGenerator(flatAst).generate(builder);
+        CHECK(IrPrinter(builder.getProgram()).toString() == ast->toQuadrupleString());
+        CHECK(builder.take().getInstructions().size() == 12);
+        CHECK(builder.getProgram().getInstructions().empty());
+    }
+}
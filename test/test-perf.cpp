@@ -0,0 +1,115 @@
+// For my reference:
+// https://github.com/catchorg/Catch2/blob/devel/docs/tutorial.md#top
+// REQUIRE: Stops at first failure
+// CHECK: Execution continues in the same test case even if assertion fails
+
+#include <catch2/catch_all.hpp>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <variant>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+
+import token;
+import lexer;
+import ast;
+import parser;
+import perfcost;
+
+inline std::string readFile(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    REQUIRE(file.is_open());
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+inline void checkWithinBudget(const PerfMeter& meter, const std::string_view code) {
+    const PerfBudget budget;
+    const auto cost = meter.measure(code);
+    REQUIRE(cost.has_value());
+    CHECK(cost->parseVisits > 0);
+    CHECK(cost->getParseVisitsPerToken() <= budget.parseVisitsPerToken);
+    CHECK(cost->getTypeCheckVisitsPerToken() <= budget.typeCheckVisitsPerToken);
+}
+
+TEST_CASE("Parse and type check nested input within budget") {
+    const PerfMeter meter;
+
+    SECTION("Nested if statements without else") {
+        std::string code = "int main() { ";
+        for (int i = 0; i < 30; i++) {
+            code += "if (1) { ";
+        }
+        for (int i = 0; i < 30; i++) {
+            code += "} ";
+        }
+        code += "return 0; }";
+        checkWithinBudget(meter, code);
+    }
+
+    SECTION("Nested function calls") {
+        std::string code = "int f(int x) { return x; } int main() { return ";
+        for (int i = 0; i < 30; i++) {
+            code += "f(";
+        }
+        code += "1";
+        for (int i = 0; i < 30; i++) {
+            code += ")";
+        }
+        code += "; }";
+        checkWithinBudget(meter, code);
+    }
+}
+
+// Inputs saved by perffuzz because they were over budget when found
+TEST_CASE("Parse and type check saved fuzzer inputs within budget") {
+    const PerfMeter meter;
+    for (const auto& entry : std::filesystem::directory_iterator(PERF_CORPUS_DIR)) {
+        DYNAMIC_SECTION(entry.path().filename().string()) {
+            checkWithinBudget(meter, readFile(entry.path()));
+        }
+    }
+}
+
+TEST_CASE("Reparse a large file with one edited function in a fraction of a full parse") {
+    Lexer lexer;
+    Parser parser;
+    ParseCache cache;
+
+    constexpr int functionCount = 300;
+    // The function at index edited compares against a different constant in each version
+    const auto getTokens = [&](int edited, int version) {
+        std::string code = "int a;\n";
+        for (int i = 0; i < functionCount; i++) {
+            const auto bound = std::to_string(i == edited ? functionCount + version : i);
+            code += "int foo" + std::to_string(i) + "(int b) {\n    if (b > " + bound + ") {\n        a = b * 2;\n    }\n    return a;\n}\n";
+        }
+        code += "int main() { a = foo1(1); }";
+        const auto result = lexer.acceptCode(code);
+        REQUIRE(std::holds_alternative<std::vector<Token>>(result));
+        return std::get<std::vector<Token>>(result);
+    };
+
+    std::vector<std::vector<Token>> versions;
+    for (int version = 0; version < 4; version++) {
+        versions.push_back(getTokens(version == 0 ? -1 : functionCount / 2, version));
+    }
+    REQUIRE(std::holds_alternative<std::unique_ptr<AstNode>>(parser.parseIncremental(versions[0], cache)));
+    // The fastest of a few runs, so that a busy machine does not fail the check
+    auto fastestFull = std::chrono::steady_clock::duration::max();
+    auto fastestIncremental = std::chrono::steady_clock::duration::max();
+    for (size_t version = 1; version < versions.size(); version++) {
+        auto startTime = std::chrono::steady_clock::now();
+        const auto fullResult = parser.parse(versions[version]);
+        fastestFull = std::min(fastestFull, std::chrono::steady_clock::now() - startTime);
+        startTime = std::chrono::steady_clock::now();
+        const auto result = parser.parseIncremental(versions[version], cache);
+        fastestIncremental = std::min(fastestIncremental, std::chrono::steady_clock::now() - startTime);
+        REQUIRE(std::holds_alternative<std::unique_ptr<AstNode>>(result));
+        CHECK(cache.getReparsedCount() == 1);
+        CHECK(std::get<std::unique_ptr<AstNode>>(result)->getWhere() == std::get<std::unique_ptr<AstNode>>(fullResult)->getWhere());
+    }
+    CHECK(fastestIncremental * 10 < fastestFull);
+}
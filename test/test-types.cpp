@@ -8,8 +8,10 @@
 
 import token;
 import lexer;
+import flatast;
 import ast;
 import parser;
+import symboltable;
 
 using Catch::Matchers::ContainsSubstring;
 
@@ -373,3 +375,214 @@ TEST_CASE("For statements") {
         const auto type2 = getTypeOutput(lexer, parser, code2);
     }
 }
+
+TEST_CASE("Scoped symbol table") {
+    ScopedSymbolTable<int> table;
+
+    SECTION("Shadow and restore declarations") {
+        table.declare(0, 1);
+        table.enterScope();
+        CHECK(*table.lookup(0) == 1);
+        table.declare(0, 2);
+        table.declare(1, 3);
+        CHECK(*table.lookup(0) == 2);
+        table.leaveScope();
+        CHECK(*table.lookup(0) == 1);
+        CHECK(table.lookup(1) == nullptr);
+    }
+
+    SECTION("Keep or replace a declaration in the same scope") {
+        table.declare(0, 1);
+        table.declare(0, 2);
+        CHECK(*table.lookup(0) == 1);
+        table.redeclare(0, 3);
+        CHECK(*table.lookup(0) == 3);
+    }
+
+    SECTION("Grow past the expected number of names") {
+        for (uint32_t nameId = 0; nameId < 1000; nameId++) {
+            table.enterScope();
+            table.declare(nameId, nameId);
+        }
+        CHECK(*table.lookup(500) == 500);
+        for (uint32_t nameId = 0; nameId < 1000; nameId++) {
+            table.leaveScope();
+        }
+        CHECK(table.lookup(500) == nullptr);
+    }
+
+    SECTION("Type check deeply nested scopes") {
+        Lexer lexer;
+        Parser parser;
+        std::string code = "int a; int main() { ";
+        for (int i = 0; i < 200; i++) {
+            code += "while (a) { int b" + std::to_string(i) + " = a; ";
+        }
+        code += "a = b0 + b199;";
+        for (int i = 0; i < 200; i++) {
+            code += " }";
+        }
+        code += " }";
+        const auto type = getTypeOutput(lexer, parser, code);
+    }
+}
+
+TEST_CASE("Data type sets") {
+    STATIC_REQUIRE(NUMERIC_TYPES.contains(DataType::INT_T));
+    STATIC_REQUIRE(NUMERIC_TYPES.contains(DataType::FLOAT_T));
+    STATIC_REQUIRE(!NUMERIC_TYPES.contains(DataType::STR_T));
+    STATIC_REQUIRE(BOOLEAN_TYPES.contains(DataType::INT_T));
+    STATIC_REQUIRE(!BOOLEAN_TYPES.contains(DataType::ANY_T));
+    STATIC_REQUIRE(ALL_TYPES.contains(DataType::NONE_T));
+}
+
+TEST_CASE("Annotate the flat AST with types and bindings") {
+    Lexer lexer;
+    Parser parser;
+    const auto ast = getParserOutput(lexer, parser, "int a; float f(int x) { a = x + 1; f(a); return 1.5 * x; }");
+    const auto flatAst = ast->toFlatAst();
+    FlatAstTypeChecker typeChecker(flatAst);
+    REQUIRE(std::holds_alternative<TypeCheckSuccess>(typeChecker.startTypeCheck()));
+    const auto& annotations = typeChecker.getAnnotations();
+
+    for (AstIndex node = 0; node < flatAst.size(); node++) {
+        const auto kind = flatAst.getKind(node);
+        if (kind == AstKind::ADD_EXPR) {
+            CHECK(annotations.getType(node) == DataType::INT_T);
+        }
+        else if (kind == AstKind::MUL_EXPR) {
+            CHECK(annotations.getType(node) == DataType::FLOAT_T);
+        }
+        else if (kind == AstKind::VAR && flatAst.getToken(node).getValue() == "x") {
+            CHECK(flatAst.getKind(annotations.getBinding(node)) == AstKind::PARAM);
+        }
+        else if (kind == AstKind::VAR && flatAst.getToken(node).getValue() == "a") {
+            const auto declaration = annotations.getBinding(node);
+            REQUIRE(declaration != NO_AST_INDEX);
+            CHECK(flatAst.getKind(declaration) == AstKind::VAR);
+            CHECK(annotations.getBinding(declaration) == declaration);
+        }
+        else if (kind == AstKind::FUNC_CALL) {
+            CHECK(flatAst.getKind(annotations.getBinding(node)) == AstKind::FUNC_DEF);
+            CHECK(annotations.getType(node) == DataType::ANY_T);
+        }
+    }
+}
+
+TEST_CASE("Type check in parallel") {
+    Lexer lexer;
+    Parser parser;
+
+    const auto compare = [&](const std::string& code) {
+        const auto ast = getParserOutput(lexer, parser, code);
+        const auto flatAst = ast->toFlatAst();
+        FlatAstTypeChecker serialChecker(flatAst);
+        const auto expected = serialChecker.startTypeCheck();
+        for (unsigned int threadCount : { 1u, 4u }) {
+            FlatAstTypeChecker parallelChecker(flatAst);
+            const auto result = parallelChecker.startTypeCheckParallel(threadCount);
+            REQUIRE(result.index() == expected.index());
+            if (std::holds_alternative<TypeCheckError>(result)) {
+                CHECK(std::get<TypeCheckError>(result).message == std::get<TypeCheckError>(expected).message);
+                CHECK(std::get<TypeCheckError>(result).where == std::get<TypeCheckError>(expected).where);
+            } else {
+                CHECK(parallelChecker.getVisits() == serialChecker.getVisits());
+                for (AstIndex node = 0; node < flatAst.size(); node++) {
+                    CHECK(parallelChecker.getAnnotations().getType(node) == serialChecker.getAnnotations().getType(node));
+                    CHECK(parallelChecker.getAnnotations().getBinding(node) == serialChecker.getAnnotations().getBinding(node));
+                }
+            }
+        }
+    };
+
+    std::string code = "int a;\n";
+    for (int i = 0; i < 50; ++i) {
+        code += "int foo" + std::to_string(i) + "(int b) { if (b > " + std::to_string(i) + ") { a = b; } return a + foo" + std::to_string(i) + "(b); }\n";
+    }
+
+    SECTION("Produce the same result as a serial type check") {
+        compare(code + "int main() { a = foo1(1); }");
+    }
+
+    SECTION("Only see the globals declared before a function") {
+        compare("int f() { return b; } int b;");
+        compare("int a; int f() { return a; } str a; int g() { return a + 1; }");
+        compare("int f() { return g(); } int g() { return 1; }");
+    }
+
+    SECTION("Report the first error in source order") {
+        compare(code + "int bar() { a = \"s\"; }\nint baz() { a = c; }");
+        compare("int bar() { a = 1; } int a = \"s\";");
+        compare("int a = \"s\"; int bar() { b = 1; }");
+    }
+}
+
+TEST_CASE("Type check incrementally") {
+    Lexer lexer;
+    Parser parser;
+    TypeCheckCache cache;
+
+    const std::string code = "int a; int f(int b) { return a + b; } int g() { a = f(1); }";
+    // Checks the code with the cache and compares the result and annotations with a full check
+    const auto check = [&](const std::string& code) {
+        const auto flatAst = getParserOutput(lexer, parser, code)->toFlatAst();
+        FlatAstTypeChecker fullChecker(flatAst);
+        const auto expected = fullChecker.startTypeCheck();
+        FlatAstTypeChecker incrementalChecker(flatAst);
+        const auto result = incrementalChecker.startTypeCheckIncremental(cache);
+        REQUIRE(result.index() == expected.index());
+        if (std::holds_alternative<TypeCheckError>(result)) {
+            CHECK(std::get<TypeCheckError>(result).message == std::get<TypeCheckError>(expected).message);
+            CHECK(std::get<TypeCheckError>(result).where == std::get<TypeCheckError>(expected).where);
+        } else {
+            for (AstIndex node = 0; node < flatAst.size(); node++) {
+                CHECK(incrementalChecker.getAnnotations().getType(node) == fullChecker.getAnnotations().getType(node));
+                CHECK(incrementalChecker.getAnnotations().getBinding(node) == fullChecker.getAnnotations().getBinding(node));
+            }
+        }
+    };
+
+    SECTION("Check every declaration on the first run") {
+        cache.clear();
+        check(code);
+        CHECK(cache.getReusedCount() == 0);
+        CHECK(cache.getRecheckedCount() == 3);
+    }
+
+    SECTION("Recheck only the changed body") {
+        check(code);
+        check("int a; int f(int b) { return a * b; } int g() { a = f(1); }");
+        CHECK(cache.getReusedCount() == 2);
+        CHECK(cache.getRecheckedCount() == 1);
+    }
+
+    SECTION("Reuse declarations that moved") {
+        check(code);
+        check("int a; int h() { return 0; } int f(int b) { return a + b; } int g() { a = f(1); }");
+        CHECK(cache.getReusedCount() == 3);
+        CHECK(cache.getRecheckedCount() == 1);
+    }
+
+    SECTION("Recheck the dependents of a changed signature") {
+        check(code);
+        check("float a; int f(int b) { return a + b; } int g() { a = f(1); }");
+        CHECK(cache.getReusedCount() == 0);
+        CHECK(cache.getRecheckedCount() == 3);
+        check("str a; int f(int b) { return a + b; } int g() { a = f(1); }");
+        CHECK(cache.getRecheckedCount() == 2);
+    }
+
+    SECTION("Reuse the dependents of an unchanged signature") {
+        check(code);
+        check("int a = 1; int f(int b) { return a + b; } int g() { a = f(1); }");
+        CHECK(cache.getReusedCount() == 2);
+        CHECK(cache.getRecheckedCount() == 1);
+    }
+
+    SECTION("Recheck a function that an earlier global now hides") {
+        check(code);
+        check("int f; int a; int f(int b) { return a + b; } int g() { a = f(1); }");
+        CHECK(cache.getReusedCount() == 1);
+        CHECK(cache.getRecheckedCount() == 3);
+    }
+}